@@ -0,0 +1,103 @@
+#!/usr/bin/env python3
+# Copyright (c) 2021 The Gridcoin developers
+# Distributed under the MIT/X11 software license, see the accompanying
+# file COPYING or https://opensource.org/licenses/mit-license.php.
+"""Measure block connect time against the number of script check threads.
+
+Reindexes the blocks of a data directory once for each --threads value, with
+-par set to that value, and reads the time that ConnectBlock() took for each
+block from the bench log category. Compares the blocks that every run reached
+and that spend at least --min-inputs inputs.
+"""
+
+import argparse
+import os
+import re
+import signal
+import statistics
+import subprocess
+import sys
+import tempfile
+import time
+
+CONNECT_LINE = re.compile(
+    r"ConnectBlock: connected block (\d+) with (\d+) inputs in ([0-9.]+)ms \((parallel|serial)\)")
+
+
+def run(args, threads, log_path):
+    command = [
+        args.daemon,
+        "-datadir=%s" % args.datadir,
+        "-debuglogfile=%s" % log_path,
+        "-reindex",
+        "-par=%d" % threads,
+        "-debug=bench",
+        "-listen=0",
+        "-dnsseed=0",
+        "-maxconnections=0",
+        "-staking=0",
+        "-server=0",
+    ]
+    if args.testnet:
+        command.append("-testnet")
+
+    node = subprocess.Popen(command, stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+    try:
+        node.wait(timeout=args.duration)
+    except subprocess.TimeoutExpired:
+        node.send_signal(signal.SIGTERM)
+        node.wait()
+
+    blocks = {}
+    with open(log_path, errors="replace") as log:
+        for line in log:
+            match = CONNECT_LINE.search(line)
+            if match:
+                blocks[int(match.group(1))] = (int(match.group(2)), float(match.group(3)))
+
+    return blocks
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument("--daemon", default="gridcoinresearchd", help="path of the node executable")
+    parser.add_argument("--datadir", required=True, help="data directory with the block files to reindex")
+    parser.add_argument("--testnet", action="store_true", help="reindex the testnet blocks of the data directory")
+    parser.add_argument("--threads", default="1,2,4,8", help="comma-separated -par values to compare")
+    parser.add_argument("--duration", type=float, default=600.0, help="seconds to reindex for in each run")
+    parser.add_argument("--min-inputs", type=int, default=100, help="inputs that a block needs to count")
+    args = parser.parse_args()
+
+    thread_counts = [int(value) for value in args.threads.split(",")]
+    runs = {}
+
+    with tempfile.TemporaryDirectory() as log_dir:
+        for threads in thread_counts:
+            start = time.monotonic()
+            runs[threads] = run(args, threads, os.path.join(log_dir, "par%d.log" % threads))
+            print("-par=%d: connected %d blocks in %.0f s"
+                  % (threads, len(runs[threads]), time.monotonic() - start))
+
+    heights = set.intersection(*(set(blocks) for blocks in runs.values()))
+    heights = sorted(h for h in heights if runs[thread_counts[0]][h][0] >= args.min_inputs)
+
+    if not heights:
+        print("no block with %d or more inputs connected in every run" % args.min_inputs)
+        return 1
+
+    inputs = sum(runs[thread_counts[0]][h][0] for h in heights)
+    print("%d blocks with %d or more inputs, %d inputs in total"
+          % (len(heights), args.min_inputs, inputs))
+
+    baseline = sum(runs[thread_counts[0]][h][1] for h in heights)
+    for threads in thread_counts:
+        times = [runs[threads][h][1] for h in heights]
+        total = sum(times)
+        print("-par=%d: %.0f ms in total, median %.2f ms per block, %.1f inputs/ms, %.2fx"
+              % (threads, total, statistics.median(times), inputs / total, baseline / total))
+
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
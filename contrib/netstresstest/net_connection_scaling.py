@@ -0,0 +1,211 @@
+#!/usr/bin/env python3
+# Copyright (c) 2021 The Gridcoin developers
+# Distributed under the MIT/X11 software license, see the accompanying
+# file COPYING or https://opensource.org/licenses/mit-license.php.
+"""Measure how a Gridcoin node copes with many connected peers.
+
+Opens --peers connections to a node, completes the version handshake on each,
+and then has every peer send a ping at a fixed interval. Reports the ping round
+trip times and, with --pid, the CPU time that the node used over the
+measurement window.
+"""
+
+import argparse
+import hashlib
+import os
+import random
+import selectors
+import socket
+import struct
+import sys
+import time
+
+MAGIC = {
+    "main": bytes.fromhex("70352205"),
+    "testnet": bytes.fromhex("cdf2c0ef"),
+}
+
+PROTOCOL_VERSION = 180327
+NODE_NETWORK = 1
+HEADER_SIZE = 24
+
+
+def sha256d(data):
+    return hashlib.sha256(hashlib.sha256(data).digest()).digest()
+
+
+def message(magic, command, payload=b""):
+    return (magic
+            + command.encode().ljust(12, b"\0")
+            + struct.pack("<I", len(payload))
+            + sha256d(payload)[:4]
+            + payload)
+
+
+def address():
+    # Addresses in the version message carry the time field:
+    return (struct.pack("<IQ", int(time.time()), NODE_NETWORK)
+            + bytes(10) + b"\xff\xff" + socket.inet_aton("127.0.0.1")
+            + struct.pack(">H", 0))
+
+
+def version_payload():
+    subver = b"/netscaling:1.0/"
+    return (struct.pack("<iQq", PROTOCOL_VERSION, NODE_NETWORK, int(time.time()))
+            + address()
+            + address()
+            + struct.pack("<Q", random.getrandbits(64))
+            + bytes([len(subver)]) + subver
+            + struct.pack("<i", 0))
+
+
+class Peer:
+    def __init__(self, sock):
+        self.sock = sock
+        self.recv_buf = b""
+        self.send_buf = b""
+        self.ready = False
+        self.pings = {}
+        self.next_ping = 0.0
+
+
+def percentile(values, fraction):
+    if not values:
+        return float("nan")
+    values = sorted(values)
+    return values[min(len(values) - 1, int(fraction * len(values)))]
+
+
+def cpu_seconds(pid):
+    with open("/proc/%d/stat" % pid) as stat:
+        # Skip past the command name, which may contain spaces:
+        fields = stat.read().rsplit(")", 1)[1].split()
+    # utime and stime are fields 14 and 15 of the file:
+    return (int(fields[11]) + int(fields[12])) / float(os.sysconf("SC_CLK_TCK"))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument("--host", default="127.0.0.1")
+    parser.add_argument("--port", type=int, default=32748)
+    parser.add_argument("--network", choices=sorted(MAGIC), default="testnet")
+    parser.add_argument("--peers", type=int, default=100, help="number of connections to open")
+    parser.add_argument("--interval", type=float, default=1.0, help="seconds between the pings of a peer")
+    parser.add_argument("--duration", type=float, default=30.0, help="seconds to measure for")
+    parser.add_argument("--pid", type=int, help="process ID of the node, to measure its CPU time")
+    args = parser.parse_args()
+
+    magic = MAGIC[args.network]
+    selector = selectors.DefaultSelector()
+    peers = []
+
+    for _ in range(args.peers):
+        sock = socket.create_connection((args.host, args.port))
+        sock.setblocking(False)
+        peer = Peer(sock)
+        peer.send_buf = message(magic, "aries", version_payload())
+        selector.register(sock, selectors.EVENT_READ | selectors.EVENT_WRITE, peer)
+        peers.append(peer)
+
+    def close(peer):
+        if peer in peers:
+            selector.unregister(peer.sock)
+            peer.sock.close()
+            peers.remove(peer)
+
+    def flush(peer):
+        try:
+            sent = peer.sock.send(peer.send_buf)
+        except BlockingIOError:
+            sent = 0
+        except OSError:
+            close(peer)
+            return
+        peer.send_buf = peer.send_buf[sent:]
+        events = selectors.EVENT_READ | (selectors.EVENT_WRITE if peer.send_buf else 0)
+        selector.modify(peer.sock, events, peer)
+
+    def push(peer, command, payload=b""):
+        peer.send_buf += message(magic, command, payload)
+        flush(peer)
+
+    rtts = []
+    pings_sent = 0
+
+    def handle(peer, command, payload, now):
+        if command == "aries":
+            push(peer, "verack")
+        elif command == "verack":
+            peer.ready = True
+            peer.next_ping = now + random.uniform(0, args.interval)
+        elif command == "ping":
+            push(peer, "pong", payload)
+        elif command == "pong" and payload in peer.pings and measuring:
+            rtts.append(now - peer.pings.pop(payload))
+
+    def poll(timeout):
+        for key, events in selector.select(timeout):
+            peer = key.data
+            if events & selectors.EVENT_WRITE:
+                flush(peer)
+            if peer not in peers or not events & selectors.EVENT_READ:
+                continue
+            try:
+                data = peer.sock.recv(1 << 16)
+            except BlockingIOError:
+                continue
+            except OSError:
+                data = b""
+            if not data:
+                close(peer)
+                continue
+            now = time.monotonic()
+            peer.recv_buf += data
+            while len(peer.recv_buf) >= HEADER_SIZE:
+                command = peer.recv_buf[4:16].rstrip(b"\0").decode()
+                size = struct.unpack("<I", peer.recv_buf[16:20])[0]
+                if len(peer.recv_buf) < HEADER_SIZE + size:
+                    break
+                payload = peer.recv_buf[HEADER_SIZE:HEADER_SIZE + size]
+                peer.recv_buf = peer.recv_buf[HEADER_SIZE + size:]
+                handle(peer, command, payload, now)
+
+    # Handshake:
+    measuring = False
+    deadline = time.monotonic() + 60
+    while time.monotonic() < deadline and not all(peer.ready for peer in peers):
+        poll(0.1)
+
+    ready = sum(peer.ready for peer in peers)
+    print("peers: %d requested, %d connected, %d completed the handshake"
+          % (args.peers, len(peers), ready))
+    if ready == 0:
+        return 1
+
+    # Measurement:
+    measuring = True
+    cpu_start = cpu_seconds(args.pid) if args.pid else None
+    start = time.monotonic()
+    while time.monotonic() - start < args.duration:
+        now = time.monotonic()
+        for peer in list(peers):
+            if peer.ready and now >= peer.next_ping:
+                nonce = struct.pack("<Q", random.getrandbits(64))
+                peer.pings[nonce] = time.monotonic()
+                peer.next_ping = now + args.interval
+                pings_sent += 1
+                push(peer, "ping", nonce)
+        poll(0.005)
+    elapsed = time.monotonic() - start
+
+    print("pings: %d sent, %d answered in %.0f s" % (pings_sent, len(rtts), elapsed))
+    print("ping round trip: p50 %.2f ms, p90 %.2f ms, p99 %.2f ms"
+          % (1000 * percentile(rtts, 0.5), 1000 * percentile(rtts, 0.9), 1000 * percentile(rtts, 0.99)))
+    if cpu_start is not None:
+        print("node CPU: %.1f%% of one core" % (100 * (cpu_seconds(args.pid) - cpu_start) / elapsed))
+
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -72,5 +72,10 @@ inline int myclosesocket(SOCKET& hSocket)
 }
 #define closesocket(s)      myclosesocket(s)
 
+// The socket handler can wait on epoll instead of select() on Linux:
+#if defined(__linux__)
+#define USE_EPOLL
+#endif
+
 
 #endif // BITCOIN_COMPAT_H
@@ -33,11 +33,13 @@ void Transform(uint32_t* s, const unsigned char* chunk, size_t blocks);
 namespace sha256d64_sse41
 {
 void Transform_4way(unsigned char* out, const unsigned char* in);
+void Transform_4way_padded(unsigned char* out, const unsigned char* in);
 }
 
 namespace sha256d64_avx2
 {
 void Transform_8way(unsigned char* out, const unsigned char* in);
+void Transform_8way_padded(unsigned char* out, const unsigned char* in);
 }
 
 namespace sha256d64_x86_shani
@@ -477,11 +479,46 @@ void TransformD64Wrapper(unsigned char* out, const unsigned char* in)
     WriteBE32(out + 28, s[7]);
 }
 
+template<TransformType tr>
+void TransformDPaddedWrapper(unsigned char* out, const unsigned char* in)
+{
+    uint32_t s[8];
+    unsigned char buffer2[64] = {
+        0,    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0,    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0x80, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0,    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 0
+    };
+    sha256::Initialize(s);
+    tr(s, in, 1);
+    WriteBE32(buffer2 + 0, s[0]);
+    WriteBE32(buffer2 + 4, s[1]);
+    WriteBE32(buffer2 + 8, s[2]);
+    WriteBE32(buffer2 + 12, s[3]);
+    WriteBE32(buffer2 + 16, s[4]);
+    WriteBE32(buffer2 + 20, s[5]);
+    WriteBE32(buffer2 + 24, s[6]);
+    WriteBE32(buffer2 + 28, s[7]);
+    sha256::Initialize(s);
+    tr(s, buffer2, 1);
+    WriteBE32(out + 0, s[0]);
+    WriteBE32(out + 4, s[1]);
+    WriteBE32(out + 8, s[2]);
+    WriteBE32(out + 12, s[3]);
+    WriteBE32(out + 16, s[4]);
+    WriteBE32(out + 20, s[5]);
+    WriteBE32(out + 24, s[6]);
+    WriteBE32(out + 28, s[7]);
+}
+
 TransformType Transform = sha256::Transform;
 TransformD64Type TransformD64 = sha256::TransformD64;
 TransformD64Type TransformD64_2way = nullptr;
 TransformD64Type TransformD64_4way = nullptr;
 TransformD64Type TransformD64_8way = nullptr;
+TransformD64Type TransformDPadded = TransformDPaddedWrapper<sha256::Transform>;
+TransformD64Type TransformDPadded_4way = nullptr;
+TransformD64Type TransformDPadded_8way = nullptr;
 
 bool SelfTest() {
     // Input state (equal to the initial SHA256 state)
@@ -529,6 +566,25 @@ bool SelfTest() {
         0x6a, 0x46, 0x30, 0xa6, 0x89, 0x86, 0x23, 0xac, 0xf8, 0xa5, 0x15, 0xe9, 0x0a, 0xaa, 0x1e, 0x9a,
         0xd7, 0x93, 0x6b, 0x28, 0xe4, 0x3b, 0xfd, 0x59, 0xc6, 0xed, 0x7c, 0x5f, 0xa5, 0x41, 0xcb, 0x51
     };
+    // Expected output for the first 52 bytes of each of the 8 64-byte messages under double SHA256.
+    static const unsigned char result_d52[256] = {
+        0x7b, 0x32, 0x04, 0x78, 0xa9, 0xfd, 0xd9, 0x2c, 0x13, 0x3f, 0x93, 0x71, 0xa8, 0x8f, 0xfa, 0x4d,
+        0x14, 0x07, 0x3e, 0x6d, 0xf0, 0x34, 0x8c, 0x8c, 0xcf, 0x4d, 0xb5, 0x8b, 0xa5, 0x23, 0x82, 0x04,
+        0xa4, 0x4d, 0xfb, 0x1a, 0xcf, 0xf5, 0xfc, 0xd7, 0x86, 0x3a, 0xc3, 0x04, 0x2e, 0x13, 0x86, 0x1a,
+        0xd0, 0xb3, 0x15, 0xcd, 0x04, 0xc8, 0x21, 0x57, 0x7c, 0x5e, 0x5a, 0x0b, 0x02, 0xcb, 0xef, 0xfa,
+        0x4b, 0xef, 0x68, 0x77, 0x07, 0x97, 0x13, 0xe4, 0x4d, 0x0d, 0xdb, 0x1a, 0xde, 0xf2, 0xb6, 0x92,
+        0x19, 0x2d, 0xb1, 0xfd, 0x3f, 0xfc, 0x64, 0x1a, 0xf9, 0x1f, 0xcc, 0x36, 0xd2, 0xb0, 0x2e, 0x72,
+        0x98, 0xd2, 0xf4, 0xbe, 0xbd, 0xcb, 0xd9, 0xc7, 0xe1, 0x2b, 0x60, 0x79, 0xfa, 0x91, 0x99, 0x87,
+        0x68, 0x36, 0xc7, 0x49, 0xe2, 0xef, 0xe5, 0xd0, 0x65, 0x5f, 0x07, 0x50, 0x6f, 0xc0, 0x29, 0x47,
+        0xc6, 0xdc, 0x48, 0x0a, 0x73, 0x19, 0x02, 0xf2, 0x1c, 0xdb, 0xaf, 0x57, 0x89, 0x17, 0x7f, 0xea,
+        0xeb, 0xbf, 0xe4, 0xc7, 0x38, 0x26, 0xcc, 0xc2, 0x5f, 0xf5, 0xaf, 0x7e, 0xbd, 0x72, 0xf6, 0xb9,
+        0xbc, 0x8b, 0x2d, 0x7b, 0xfd, 0xbf, 0x74, 0xf3, 0x88, 0x48, 0xf6, 0x0f, 0xde, 0xb0, 0x1c, 0xa3,
+        0x59, 0xe6, 0x9a, 0x4c, 0x3f, 0x75, 0xb2, 0xef, 0x6b, 0xf4, 0xf9, 0xf3, 0x3d, 0x08, 0xa2, 0x23,
+        0x78, 0xcc, 0x05, 0xb0, 0xba, 0x65, 0x8d, 0x44, 0xcc, 0x43, 0xc7, 0x27, 0xee, 0x6a, 0x87, 0xf4,
+        0x80, 0x91, 0xf0, 0x8e, 0xc3, 0x45, 0xc5, 0x06, 0xdd, 0x0b, 0xc9, 0xb2, 0xe5, 0x5e, 0x40, 0x59,
+        0x88, 0xc1, 0x68, 0x09, 0xbf, 0x3b, 0x7a, 0x38, 0x57, 0x97, 0xfb, 0x66, 0xcc, 0xd8, 0x9e, 0xa8,
+        0x58, 0x09, 0x9d, 0x57, 0x1b, 0x0b, 0x57, 0x2f, 0x46, 0x4c, 0x5f, 0x23, 0xbc, 0x29, 0xfb, 0x55
+    };
 
 
     // Test Transform() for 0 through 8 transformations.
@@ -565,6 +621,30 @@ bool SelfTest() {
         if (!std::equal(out, out + 256, result_d64)) return false;
     }
 
+    // Test TransformDPadded and its multi-way variants on messages padded to one block.
+    unsigned char padded[512];
+    for (size_t i = 0; i < 8; ++i) {
+        std::copy(data + 1 + 64 * i, data + 1 + 64 * i + 52, padded + 64 * i);
+        SHA256PadBlock(padded + 64 * i, 52);
+    }
+
+    TransformDPadded(out, padded);
+    if (!std::equal(out, out + 32, result_d52)) return false;
+
+    // Test TransformDPadded_4way, if available.
+    if (TransformDPadded_4way) {
+        unsigned char out[128];
+        TransformDPadded_4way(out, padded);
+        if (!std::equal(out, out + 128, result_d52)) return false;
+    }
+
+    // Test TransformDPadded_8way, if available.
+    if (TransformDPadded_8way) {
+        unsigned char out[256];
+        TransformDPadded_8way(out, padded);
+        if (!std::equal(out, out + 256, result_d52)) return false;
+    }
+
     return true;
 }
 
@@ -617,6 +697,7 @@ std::string SHA256AutoDetect()
     if (have_x86_shani) {
         Transform = sha256_x86_shani::Transform;
         TransformD64 = TransformD64Wrapper<sha256_x86_shani::Transform>;
+        TransformDPadded = TransformDPaddedWrapper<sha256_x86_shani::Transform>;
         TransformD64_2way = sha256d64_x86_shani::Transform_2way;
         ret = "x86_shani(1way,2way)";
         have_sse4 = false; // Disable SSE4/AVX2;
@@ -628,10 +709,12 @@ std::string SHA256AutoDetect()
 #if defined(__x86_64__) || defined(__amd64__)
         Transform = sha256_sse4::Transform;
         TransformD64 = TransformD64Wrapper<sha256_sse4::Transform>;
+        TransformDPadded = TransformDPaddedWrapper<sha256_sse4::Transform>;
         ret = "sse4(1way)";
 #endif
 #if defined(ENABLE_SSE41) && !defined(BUILD_BITCOIN_INTERNAL)
         TransformD64_4way = sha256d64_sse41::Transform_4way;
+        TransformDPadded_4way = sha256d64_sse41::Transform_4way_padded;
         ret += ",sse41(4way)";
 #endif
     }
@@ -639,6 +722,7 @@ std::string SHA256AutoDetect()
 #if defined(ENABLE_AVX2) && !defined(BUILD_BITCOIN_INTERNAL)
     if (have_avx2 && have_avx && enabled_avx) {
         TransformD64_8way = sha256d64_avx2::Transform_8way;
+        TransformDPadded_8way = sha256d64_avx2::Transform_8way_padded;
         ret += ",avx2(8way)";
     }
 #endif
@@ -671,6 +755,7 @@ std::string SHA256AutoDetect()
     if (have_arm_shani) {
         Transform = sha256_arm_shani::Transform;
         TransformD64 = TransformD64Wrapper<sha256_arm_shani::Transform>;
+        TransformDPadded = TransformDPaddedWrapper<sha256_arm_shani::Transform>;
         TransformD64_2way = sha256d64_arm_shani::Transform_2way;
         ret = "arm_shani(1way,2way)";
     }
@@ -770,3 +855,37 @@ void SHA256D64(unsigned char* out, const unsigned char* in, size_t blocks)
         --blocks;
     }
 }
+
+void SHA256PadBlock(unsigned char* block, size_t len)
+{
+    assert(len <= 55);
+    memset(block + len, 0, 64 - len);
+    block[len] = 0x80;
+    WriteBE64(block + 56, len << 3);
+}
+
+void SHA256DPadded(unsigned char* out, const unsigned char* in, size_t blocks)
+{
+    if (TransformDPadded_8way) {
+        while (blocks >= 8) {
+            TransformDPadded_8way(out, in);
+            out += 256;
+            in += 512;
+            blocks -= 8;
+        }
+    }
+    if (TransformDPadded_4way) {
+        while (blocks >= 4) {
+            TransformDPadded_4way(out, in);
+            out += 128;
+            in += 256;
+            blocks -= 4;
+        }
+    }
+    while (blocks) {
+        TransformDPadded(out, in);
+        out += 32;
+        in += 64;
+        --blocks;
+    }
+}
@@ -39,4 +39,19 @@ std::string SHA256AutoDetect();
  */
 void SHA256D64(unsigned char* output, const unsigned char* input, size_t blocks);
 
+/** Write the SHA-256 padding of a message of at most 55 bytes into the rest
+ *  of its 64-byte block.
+ *  block:   pointer to a 64 byte buffer that begins with the message
+ *  len:     the length of the message.
+ */
+void SHA256PadBlock(unsigned char* block, size_t len);
+
+/** Compute multiple double-SHA256's of short messages that fit into a single
+ *  64-byte block with their padding (see SHA256PadBlock()).
+ *  output:  pointer to a blocks*32 byte output buffer
+ *  input:   pointer to a blocks*64 byte buffer of padded messages
+ *  blocks:  the number of hashes to compute.
+ */
+void SHA256DPadded(unsigned char* output, const unsigned char* input, size_t blocks);
+
 #endif // BITCOIN_CRYPTO_SHA256_H
@@ -3,7 +3,9 @@
 // Distributed under the MIT/X11 software license, see the accompanying
 // file license.txt or https://opensource.org/licenses/mit-license.php.
 
+#include <atomic>
 #include <map>
+#include <thread>
 
 #include <leveldb/env.h>
 #include <leveldb/cache.h>
@@ -12,11 +14,14 @@
 
 #include "chainparams.h"
 #include "clientversion.h"
+#include "crypto/siphash.h"
 #include "gridcoin/staking/kernel.h"
 #include "txdb.h"
 #include "main.h"
+#include "node/blockindexsnapshot.h"
 #include "node/blockstorage.h"
 #include "node/ui_interface.h"
+#include "random.h"
 #include "util.h"
 #include "validation.h"
 
@@ -27,6 +32,8 @@ extern bool fQtActive;
 
 leveldb::DB *txdb; // global pointer for LevelDB object instance
 
+CTxIndexCache g_txindex_cache;
+
 static leveldb::Options GetOptions() {
     leveldb::Options options;
 
@@ -43,6 +50,8 @@ void init_blockindex(leveldb::Options& options, bool fRemoveOld = false) {
 
     if (fRemoveOld) {
         fs::remove_all(directory); // remove directory
+        CloseBlockFile();
+        FlushBlockFileMappings();
         unsigned int nFile = 1;
 
         while (true)
@@ -59,6 +68,8 @@ void init_blockindex(leveldb::Options& options, bool fRemoveOld = false) {
         }
     }
 
+    g_txindex_cache.Clear();
+
     fs::create_directory(directory);
     LogPrintf("Opening LevelDB in %s", directory.string());
     leveldb::Status status = leveldb::DB::Open(options, directory.string(), &txdb);
@@ -86,6 +97,9 @@ CTxDB::CTxDB(const char* pszMode)
     options.create_if_missing = fCreate;
     options.filter_policy = leveldb::NewBloomFilterPolicy(10);
 
+    g_txindex_cache.SetMaxMemoryUsage(
+        std::clamp<int64_t>(gArgs.GetArg("-txindexreadcache", nDefaultTxIndexReadCache), nMinDbCache, nMaxDbCache) * 1048576);
+
     init_blockindex(options); // Init directory
     pdb = txdb;
 
@@ -134,6 +148,9 @@ void CTxDB::Close()
     options.block_cache = nullptr;
     delete activeBatch;
     activeBatch = nullptr;
+    m_batch_overlay.clear();
+    m_pending_txindex.clear();
+    g_txindex_cache.Clear();
 }
 
 bool CTxDB::TxnBegin()
@@ -146,84 +163,261 @@ bool CTxDB::TxnBegin()
 bool CTxDB::TxnCommit()
 {
     assert(activeBatch);
+
+    // Index entries in the batch may refer to block data that is not synced:
+    if (!CommitBlockFile()) {
+        LogPrintf("WARNING: %s: failed to sync block file", __func__);
+    }
+
     leveldb::Status status = pdb->Write(leveldb::WriteOptions(), activeBatch);
     delete activeBatch;
     activeBatch = nullptr;
+    m_batch_overlay.clear();
     if (!status.ok()) {
+        m_pending_txindex.clear();
         LogPrintf("LevelDB batch commit failure: %s", status.ToString());
         return false;
     }
+
+    // The batch reached the database, so the records that it changed are
+    // now the committed state that the shared cache mirrors:
+    g_txindex_cache.Apply(m_pending_txindex);
+    m_pending_txindex.clear();
+
     return true;
 }
 
-class CBatchScanner : public leveldb::WriteBatch::Handler {
-public:
-    std::string needle;
-    bool *deleted;
-    std::string *foundValue;
-    bool foundEntry;
+// When performing a read, if we have an active batch we need to check it first
+// before reading from the database, as the rest of the code assumes that once
+// a database transaction begins reads are consistent with it. The overlay
+// mirrors the batch so that this check costs one hash lookup instead of a
+// pass over every pending write.
+bool CTxDB::ScanBatch(const CDataStream &key, string *value, bool *deleted) const {
+    assert(activeBatch);
+    *deleted = false;
 
-    CBatchScanner() : foundEntry(false) {}
+    const auto iter = m_batch_overlay.find(key.str());
 
-    virtual void Put(const leveldb::Slice& key, const leveldb::Slice& value) {
-        if (key.ToString() == needle) {
-            foundEntry = true;
-            *deleted = false;
-            *foundValue = value.ToString();
-        }
+    if (iter == m_batch_overlay.end()) {
+        return false;
     }
 
-    virtual void Delete(const leveldb::Slice& key) {
-        if (key.ToString() == needle) {
-            foundEntry = true;
-            *deleted = true;
+    if (iter->second) {
+        *value = *iter->second;
+    } else {
+        *deleted = true;
+    }
+
+    return true;
+}
+
+CTxIndexCache::SaltedTxidHasher::SaltedTxidHasher()
+    : k0(GetRand(std::numeric_limits<uint64_t>::max()))
+    , k1(GetRand(std::numeric_limits<uint64_t>::max()))
+{
+}
+
+size_t CTxIndexCache::SaltedTxidHasher::operator()(const uint256& hash) const
+{
+    return SipHashUint256(k0, k1, hash);
+}
+
+CTxIndexCache::CTxIndexCache()
+    : m_memory_usage(0)
+    , m_max_memory_usage(nDefaultTxIndexReadCache * 1048576)
+    , m_generation(0)
+{
+}
+
+size_t CTxIndexCache::EntryMemoryUsage(const CTxIndex& txindex)
+{
+    // Node payload, the node's next pointer and cached hash, the bucket slot,
+    // and the heap block of the vSpent vector:
+    return sizeof(TxIndexMap::value_type)
+        + 3 * sizeof(void*)
+        + txindex.vSpent.capacity() * sizeof(CDiskTxPos);
+}
+
+bool CTxIndexCache::Lookup(const uint256& hash, CTxIndex& txindex) const
+{
+    LOCK(cs_cache);
+
+    const auto iter = m_entries.find(hash);
+
+    if (iter == m_entries.end()) {
+        return false;
+    }
+
+    txindex = iter->second;
+
+    return true;
+}
+
+uint64_t CTxIndexCache::Generation() const
+{
+    LOCK(cs_cache);
+
+    return m_generation;
+}
+
+void CTxIndexCache::Insert(const uint256& hash, const CTxIndex& txindex, uint64_t generation)
+{
+    LOCK(cs_cache);
+
+    if (generation == m_generation) {
+        InsertLocked(hash, txindex);
+    }
+}
+
+void CTxIndexCache::InsertLocked(const uint256& hash, const CTxIndex& txindex)
+{
+    const size_t entry_usage = EntryMemoryUsage(txindex);
+    auto iter = m_entries.find(hash);
+
+    if (iter != m_entries.end()) {
+        m_memory_usage -= EntryMemoryUsage(iter->second);
+        m_entries.erase(iter);
+    }
+
+    if (m_memory_usage + entry_usage > m_max_memory_usage) {
+        LogPrint(BCLog::LogFlags::COINDB, "INFO: %s: flushing %u records (%u bytes)",
+                 __func__, m_entries.size(), m_memory_usage);
+
+        m_entries.clear();
+        m_memory_usage = 0;
+    }
+
+    m_entries.emplace(hash, txindex);
+    m_memory_usage += entry_usage;
+}
+
+void CTxIndexCache::Apply(const std::unordered_map<uint256, std::optional<CTxIndex>, BlockHasher>& changes)
+{
+    LOCK(cs_cache);
+
+    ++m_generation;
+
+    for (const auto& [hash, txindex] : changes) {
+        if (txindex) {
+            InsertLocked(hash, *txindex);
+            continue;
+        }
+
+        auto iter = m_entries.find(hash);
+
+        if (iter != m_entries.end()) {
+            m_memory_usage -= EntryMemoryUsage(iter->second);
+            m_entries.erase(iter);
         }
     }
-};
+}
 
-// When performing a read, if we have an active batch we need to check it first
-// before reading from the database, as the rest of the code assumes that once
-// a database transaction begins reads are consistent with it. It would be good
-// to change that assumption in future and avoid the performance hit, though in
-// practice it does not appear to be large.
-bool CTxDB::ScanBatch(const CDataStream &key, string *value, bool *deleted) const {
-    assert(activeBatch);
-    *deleted = false;
-    CBatchScanner scanner;
-    scanner.needle = key.str();
-    scanner.deleted = deleted;
-    scanner.foundValue = value;
-    leveldb::Status status = activeBatch->Iterate(&scanner);
-    if (!status.ok()) {
-        throw runtime_error(status.ToString());
+void CTxIndexCache::Clear()
+{
+    LOCK(cs_cache);
+
+    ++m_generation;
+    m_entries.clear();
+    m_memory_usage = 0;
+}
+
+void CTxIndexCache::SetMaxMemoryUsage(size_t max_bytes)
+{
+    LOCK(cs_cache);
+
+    m_max_memory_usage = max_bytes;
+
+    if (m_memory_usage > m_max_memory_usage) {
+        m_entries.clear();
+        m_memory_usage = 0;
     }
-    return scanner.foundEntry;
+}
+
+size_t CTxIndexCache::MemoryUsage() const
+{
+    LOCK(cs_cache);
+
+    return m_memory_usage;
+}
+
+size_t CTxIndexCache::Size() const
+{
+    LOCK(cs_cache);
+
+    return m_entries.size();
 }
 
 bool CTxDB::ReadTxIndex(uint256 hash, CTxIndex& txindex)
 {
     txindex.SetNull();
-    return Read(make_pair(string("tx"), hash), txindex);
+
+    // Records changed by the open transaction take precedence over both the
+    // shared cache and the database:
+    if (activeBatch) {
+        const auto iter = m_pending_txindex.find(hash);
+
+        if (iter != m_pending_txindex.end()) {
+            if (!iter->second) {
+                return false;
+            }
+
+            txindex = *iter->second;
+
+            return true;
+        }
+    }
+
+    if (g_txindex_cache.Lookup(hash, txindex)) {
+        return true;
+    }
+
+    const uint64_t generation = g_txindex_cache.Generation();
+
+    if (!Read(make_pair(string("tx"), hash), txindex)) {
+        return false;
+    }
+
+    g_txindex_cache.Insert(hash, txindex, generation);
+
+    return true;
 }
 
 bool CTxDB::UpdateTxIndex(uint256 hash, const CTxIndex& txindex)
 {
-    return Write(make_pair(string("tx"), hash), txindex);
+    if (!Write(make_pair(string("tx"), hash), txindex)) {
+        return false;
+    }
+
+    if (activeBatch) {
+        m_pending_txindex[hash] = txindex;
+    } else {
+        g_txindex_cache.Apply({{ hash, txindex }});
+    }
+
+    return true;
 }
 
 bool CTxDB::AddTxIndex(const CTransaction& tx, const CDiskTxPos& pos, int nHeight)
 {
     // Add to tx index
-    uint256 hash = tx.GetHash();
-    CTxIndex txindex(pos, tx.vout.size());
-    return Write(make_pair(string("tx"), hash), txindex);
+    return UpdateTxIndex(tx.GetHash(), CTxIndex(pos, tx.vout.size()));
 }
 
 bool CTxDB::EraseTxIndex(const CTransaction& tx)
 {
     uint256 hash = tx.GetHash();
 
-    return Erase(make_pair(string("tx"), hash));
+    if (!Erase(make_pair(string("tx"), hash))) {
+        return false;
+    }
+
+    if (activeBatch) {
+        m_pending_txindex[hash] = std::nullopt;
+    } else {
+        g_txindex_cache.Apply({{ hash, std::nullopt }});
+    }
+
+    return true;
 }
 
 bool CTxDB::ContainsTx(uint256 hash)
@@ -321,6 +515,194 @@ bool ReadBlockHeight(CTxDB& txdb, const uint256 hash, int& height)
 
     return true;
 }
+
+//!
+//! \brief Outcome of checking a block of the best chain at startup.
+//!
+struct StartupCheckResult
+{
+    bool fChecked = false;              //!< Whether a worker visited the block.
+    bool fRead = false;                 //!< Whether the block was read from disk.
+    std::vector<std::string> vProblems; //!< Descriptions of the problems found.
+};
+
+//! Heights of the blocks in the verification window by their disk position.
+typedef std::map<std::pair<unsigned int, unsigned int>, int> BlockHeightsByPos;
+
+//! Upper bound on the number of threads that verify blocks at startup.
+constexpr size_t MAX_STARTUP_CHECK_THREADS = 16;
+
+//!
+//! \brief Run the -checklevel checks for one block of the best chain.
+//!
+//! This only reads shared state, so several threads can check blocks at once.
+//!
+void VerifyBlockAtStartup(
+    const CBlockIndex* pindex,
+    const int nCheckLevel,
+    const BlockHeightsByPos& mapBlockPos,
+    StartupCheckResult& result)
+{
+    result.fChecked = true;
+
+    CBlock block;
+    if (!ReadBlockFromDisk(block, pindex, Params().GetConsensus()))
+        return;
+    result.fRead = true;
+
+    // check level 1: verify block validity
+    // check level 7: verify block signature too
+    if (nCheckLevel>0 && !CheckBlock(block, pindex->nHeight, true, true, (nCheckLevel>6), true))
+    {
+        result.vProblems.push_back(strprintf("found bad block at %d, hash=%s", pindex->nHeight, pindex->GetBlockHash().ToString()));
+    }
+
+    // check level 2: verify transaction index validity
+    if (nCheckLevel<=1)
+        return;
+
+    CTxDB txdb("r");
+    for (auto const& tx : block.vtx)
+    {
+        uint256 hashTx = tx.GetHash();
+        CTxIndex txindex;
+        if (txdb.ReadTxIndex(hashTx, txindex))
+        {
+            // check level 3: checker transaction hashes
+            if (nCheckLevel>2 || pindex->nFile != txindex.pos.nFile || pindex->nBlockPos != txindex.pos.nBlockPos)
+            {
+                // either an error or a duplicate transaction
+                CTransaction txFound;
+                if (!ReadTxFromDisk(txFound, txindex.pos))
+                    result.vProblems.push_back(strprintf("cannot read mislocated transaction %s", hashTx.ToString()));
+                else if (txFound.GetHash() != hashTx) // not a duplicate tx
+                    result.vProblems.push_back(strprintf("invalid tx position for %s", hashTx.ToString()));
+            }
+            // check level 4: check whether spent txouts were spent within the main chain
+            unsigned int nOutput = 0;
+            if (nCheckLevel>3)
+            {
+                for (auto const& txpos : txindex.vSpent)
+                {
+                    if (!txpos.IsNull())
+                    {
+                        // The spend must come from this block or one above it
+                        // in the verification window:
+                        auto posFind = mapBlockPos.find(make_pair(txpos.nFile, txpos.nBlockPos));
+                        if (posFind == mapBlockPos.end() || posFind->second < pindex->nHeight)
+                        {
+                            result.vProblems.push_back(strprintf("found bad spend at %d, hashBlock=%s, hashTx=%s", pindex->nHeight, pindex->GetBlockHash().ToString(), hashTx.ToString()));
+                        }
+                        // check level 6: check whether spent txouts were spent by a valid transaction that consume them
+                        if (nCheckLevel>5)
+                        {
+                            CTransaction txSpend;
+                            if (!ReadTxFromDisk(txSpend, txpos))
+                            {
+                                result.vProblems.push_back(strprintf("cannot read spending transaction of %s:%i from disk", hashTx.ToString(), nOutput));
+                            }
+                            else if (!CheckTransaction(txSpend))
+                            {
+                                result.vProblems.push_back(strprintf("spending transaction of %s:%i is invalid", hashTx.ToString(), nOutput));
+                            }
+                            else
+                            {
+                                bool fFound = false;
+                                for (auto const& txin : txSpend.vin)
+                                    if (txin.prevout.hash == hashTx && txin.prevout.n == nOutput)
+                                        fFound = true;
+                                if (!fFound)
+                                {
+                                    result.vProblems.push_back(strprintf("spending transaction of %s:%i does not spend it", hashTx.ToString(), nOutput));
+                                }
+                            }
+                        }
+                    }
+                    nOutput++;
+                }
+            }
+        }
+        // check level 5: check whether all prevouts are marked spent
+        if (nCheckLevel>4)
+        {
+            for (auto const& txin : tx.vin)
+            {
+                CTxIndex txindex;
+                if (txdb.ReadTxIndex(txin.prevout.hash, txindex))
+                    if (txindex.vSpent.size()-1 < txin.prevout.n || txindex.vSpent[txin.prevout.n].IsNull())
+                    {
+                        result.vProblems.push_back(strprintf("found unspent prevout %s:%i in %s", txin.prevout.hash.ToString(), txin.prevout.n, hashTx.ToString()));
+                    }
+            }
+        }
+    }
+}
+
+//!
+//! \brief Check the blocks of the best chain at startup on a pool of threads.
+//!
+//! The threads claim blocks in order from the tip down, so the disk reads of
+//! the blocks checked next overlap the CPU-bound checks of the others. The
+//! calling thread joins the pool and reports the progress.
+//!
+//! \param vToVerify   Blocks to check ordered from the tip down.
+//! \param nCheckLevel Value of -checklevel.
+//!
+//! \return The outcome of the check of each block in the same order. When a
+//! shutdown interrupts the checks, the blocks that no thread visited form a
+//! tail of unchecked results.
+//!
+std::vector<StartupCheckResult> VerifyBlocksAtStartup(
+    const std::vector<const CBlockIndex*>& vToVerify,
+    const int nCheckLevel)
+{
+    BlockHeightsByPos mapBlockPos;
+    if (nCheckLevel>3)
+        for (const CBlockIndex* pindex : vToVerify)
+            mapBlockPos[make_pair(pindex->nFile, pindex->nBlockPos)] = pindex->nHeight;
+
+    std::vector<StartupCheckResult> vResults(vToVerify.size());
+    std::atomic<size_t> nNext{0};
+    std::atomic<size_t> nDone{0};
+    size_t nLastReport = 0; // Only touched by the thread that reports progress.
+
+    const auto worker = [&](const bool fReportProgress) {
+        for (size_t i = nNext++; i < vToVerify.size() && !fRequestShutdown; i = nNext++)
+        {
+            try {
+                VerifyBlockAtStartup(vToVerify[i], nCheckLevel, mapBlockPos, vResults[i]);
+            } catch (const std::exception& e) {
+                // Abort the load like the exception would on a single thread:
+                vResults[i].fRead = false;
+                vResults[i].vProblems.push_back(strprintf("exception while checking block at %d: %s", vToVerify[i]->nHeight, e.what()));
+            }
+
+            const size_t nCount = ++nDone;
+            if (fReportProgress && fQtActive && nCount / 1000 != nLastReport)
+            {
+                nLastReport = nCount / 1000;
+                uiInterface.InitMessage(strprintf("%" PRIszu "/%" PRIszu " %s", nCount, vToVerify.size(), _("Blocks Verified")));
+            }
+        }
+    };
+
+    const size_t nThreads = std::min<size_t>(
+        std::clamp<size_t>(std::thread::hardware_concurrency(), 1, MAX_STARTUP_CHECK_THREADS),
+        std::max<size_t>(vToVerify.size(), 1));
+
+    std::vector<std::thread> vThreads;
+    for (size_t i = 1; i < nThreads; ++i)
+        vThreads.emplace_back(worker, false);
+
+    worker(true);
+
+    for (auto& thread : vThreads)
+        thread.join();
+
+    LogPrint(BCLog::LogFlags::BENCH, "Verified %" PRIszu " blocks on %" PRIszu " threads", nDone.load(), nThreads);
+
+    return vResults;
+}
 } // anonymous namespace
 
 bool CTxDB::LoadBlockIndex()
@@ -351,84 +733,122 @@ bool CTxDB::LoadBlockIndex()
     // Avoid division by zero for the progress percentage without a condition:
     nHighest = std::max(nHighest, 1);
 
-    // The block index is an in-memory structure that maps hashes to on-disk
-    // locations where the contents of the block can be found. Here, we scan it
-    // out of the DB and into mapBlockIndex.
-    leveldb::Iterator *iterator = pdb->NewIterator(leveldb::ReadOptions());
-    // Seek to start key.
-    CDataStream ssStartKey(SER_DISK, CLIENT_VERSION);
-    ssStartKey << make_pair(string("blockindex"), uint256());
-    iterator->Seek(ssStartKey.str());
-
     int nLoaded = 0;
 
-    // Now read each entry.
-    LogPrintf("Loading DiskIndex %d",nHighest);
-    while (iterator->Valid())
-    {
-        // Unpack keys and values.
-        CDataStream ssKey(SER_DISK, CLIENT_VERSION);
-        ssKey.write(MakeByteSpan(iterator->key()));
-        CDataStream ssValue(SER_DISK, CLIENT_VERSION);
-        ssValue.write(MakeByteSpan(iterator->value()));
-        string strType;
-        ssKey >> strType;
-        // Did we reach the end of the data to read?
-        if (fRequestShutdown || strType != "blockindex")
-            break;
-        CDiskBlockIndex diskindex;
-        ssValue >> diskindex;
-
-        uint256 blockHash = diskindex.GetBlockHash();
-
-        // Construct block index object
-        CBlockIndex* pindexNew    = InsertBlockIndex(blockHash);
-        pindexNew->pprev          = InsertBlockIndex(diskindex.hashPrev);
-        pindexNew->pnext          = InsertBlockIndex(diskindex.hashNext);
-        pindexNew->nFile          = diskindex.nFile;
-        pindexNew->nBlockPos      = diskindex.nBlockPos;
-        pindexNew->nHeight        = diskindex.nHeight;
-        pindexNew->nMoneySupply   = diskindex.nMoneySupply;
-        pindexNew->nFlags         = diskindex.nFlags;
-        pindexNew->nStakeModifier = diskindex.nStakeModifier;
-        pindexNew->hashProof      = diskindex.hashProof;
-        pindexNew->nVersion       = diskindex.nVersion;
-        pindexNew->hashMerkleRoot = diskindex.hashMerkleRoot;
-        pindexNew->nTime          = diskindex.nTime;
-        pindexNew->nBits          = diskindex.nBits;
-        pindexNew->nNonce         = diskindex.nNonce;
-        pindexNew->m_researcher   = diskindex.m_researcher;
-        pindexNew->m_mrc_researchers = diskindex.m_mrc_researchers;
-
-        nBlockCount++;
-        // Watch for genesis block
-        if (pindexGenesisBlock == nullptr && blockHash == (!fTestNet ? hashGenesisBlock : hashGenesisBlockTestNet))
-            pindexGenesisBlock = pindexNew;
-
-        if(fQtActive)
+    // A snapshot written at the last clean shutdown saves the scan of the
+    // block index records in the database:
+    const bool fLoadedSnapshot = gArgs.GetBoolArg("-blockindexsnapshot", DEFAULT_BLOCK_INDEX_SNAPSHOT)
+        && LoadBlockIndexSnapshot(GetBlockIndexSnapshotPath(), hashBestChain, nBlockCount);
+
+    // The block index changes as soon as the node runs, so a snapshot is only
+    // valid for one startup:
+    try {
+        fs::remove(GetBlockIndexSnapshotPath());
+    } catch (const fs::filesystem_error& e) {
+        LogPrintf("WARNING: %s: failed to remove block index snapshot: %s", __func__, e.what());
+    }
+
+    if (!fLoadedSnapshot) {
+        // The block index is an in-memory structure that maps hashes to on-disk
+        // locations where the contents of the block can be found. Here, we scan it
+        // out of the DB and into mapBlockIndex.
+        leveldb::Iterator *iterator = pdb->NewIterator(leveldb::ReadOptions());
+        // Seek to start key.
+        CDataStream ssStartKey(SER_DISK, CLIENT_VERSION);
+        ssStartKey << make_pair(string("blockindex"), uint256());
+        iterator->Seek(ssStartKey.str());
+
+        // Now read each entry.
+        LogPrintf("Loading DiskIndex %d",nHighest);
+        while (iterator->Valid())
         {
-            if ((pindexNew->nHeight % 10000) == 0)
+            // Unpack keys and values.
+            CDataStream ssKey(SER_DISK, CLIENT_VERSION);
+            ssKey.write(MakeByteSpan(iterator->key()));
+            CDataStream ssValue(SER_DISK, CLIENT_VERSION);
+            ssValue.write(MakeByteSpan(iterator->value()));
+            string strType;
+            ssKey >> strType;
+            // Did we reach the end of the data to read?
+            if (fRequestShutdown || strType != "blockindex")
+                break;
+            CDiskBlockIndex diskindex;
+            ssValue >> diskindex;
+
+            uint256 blockHash = diskindex.GetBlockHash();
+
+            // Construct block index object
+            CBlockIndex* pindexNew    = InsertBlockIndex(blockHash);
+            pindexNew->pprev          = InsertBlockIndex(diskindex.hashPrev);
+            pindexNew->pnext          = InsertBlockIndex(diskindex.hashNext);
+            pindexNew->nFile          = diskindex.nFile;
+            pindexNew->nBlockPos      = diskindex.nBlockPos;
+            pindexNew->nHeight        = diskindex.nHeight;
+            pindexNew->nMoneySupply   = diskindex.nMoneySupply;
+            pindexNew->nFlags         = diskindex.nFlags;
+            pindexNew->nStakeModifier = diskindex.nStakeModifier;
+            pindexNew->nVersion       = diskindex.nVersion;
+            pindexNew->nTime          = diskindex.nTime;
+            pindexNew->nBits          = diskindex.nBits;
+            pindexNew->m_researcher   = diskindex.m_researcher;
+            pindexNew->m_mrc_researchers = diskindex.m_mrc_researchers;
+            pindexNew->m_mrc_researchers_count = diskindex.m_mrc_researchers_count;
+            pindexNew->SetProofHash(diskindex.hashProof);
+            pindexNew->SetMerkleRoot(diskindex.hashMerkleRoot);
+            pindexNew->SetNonce(diskindex.nNonce);
+
+            nBlockCount++;
+            // Watch for genesis block
+            if (pindexGenesisBlock == nullptr && blockHash == (!fTestNet ? hashGenesisBlock : hashGenesisBlockTestNet))
+                pindexGenesisBlock = pindexNew;
+
+            if(fQtActive)
             {
-                nLoaded +=10000;
-                if (nLoaded > nHighest) nHighest=nLoaded;
+                if ((pindexNew->nHeight % 10000) == 0)
+                {
+                    nLoaded +=10000;
+                    if (nLoaded > nHighest) nHighest=nLoaded;
 
-                uiInterface.InitMessage(strprintf(
-                    "%" PRId64 "/%" PRId64 " %s (%d%%)",
-                    nLoaded,
-                    nHighest,
-                    _("Blocks Loaded"),
-                    (100 * nLoaded / nHighest)));
+                    uiInterface.InitMessage(strprintf(
+                        "%" PRId64 "/%" PRId64 " %s (%d%%)",
+                        nLoaded,
+                        nHighest,
+                        _("Blocks Loaded"),
+                        (100 * nLoaded / nHighest)));
 
-                tfm::format(std::cout,"%d ",nLoaded); fflush(stdout);
+                    tfm::format(std::cout,"%d ",nLoaded); fflush(stdout);
+                }
             }
+
+            iterator->Next();
         }
+        delete iterator;
 
-        iterator->Next();
+        LogPrintf("Time to memorize diskindex containing %i blocks : %15" PRId64 "ms", nBlockCount, GetTimeMillis() - nStart);
     }
-    delete iterator;
 
+    nStart = GetTimeMillis();
+
+    // Build the skip list pointers. Each entry links to an ancestor by way of
+    // its predecessors, so we must visit the entries in order of height:
+    {
+        std::vector<CBlockIndex*> vSortedByHeight;
+        vSortedByHeight.reserve(mapBlockIndex.size());
+
+        for (const auto& item : mapBlockIndex) {
+            vSortedByHeight.push_back(item.second);
+        }
+
+        std::sort(vSortedByHeight.begin(), vSortedByHeight.end(), [](const CBlockIndex* a, const CBlockIndex* b) {
+            return a->nHeight < b->nHeight;
+        });
+
+        for (CBlockIndex* pindex : vSortedByHeight) {
+            pindex->BuildSkip();
+        }
+    }
 
-    LogPrintf("Time to memorize diskindex containing %i blocks : %15" PRId64 "ms", nBlockCount, GetTimeMillis() - nStart);
+    LogPrint(BCLog::LogFlags::BENCH, "Time to build block index skip list : %15" PRId64 "ms", GetTimeMillis() - nStart);
     nStart = GetTimeMillis();
 
 
@@ -442,6 +862,7 @@ bool CTxDB::LoadBlockIndex()
     if (!mapBlockIndex.count(hashBestChain))
         return error("CTxDB::LoadBlockIndex() : hashBestChain not found in the block index");
     pindexBest = mapBlockIndex[hashBestChain];
+    g_active_chain.SetTip(pindexBest);
     nBestHeight = pindexBest->nHeight;
 
     LogPrintf("LoadBlockIndex(): hashBestChain=%s  height=%d  date=%s",
@@ -449,133 +870,36 @@ bool CTxDB::LoadBlockIndex()
       nBestHeight,
       DateTimeStrFormat("%x %H:%M:%S", pindexBest->GetBlockTime()));
 
-    nLoaded = 0;
     // Verify blocks in the best chain
     int nCheckLevel = gArgs.GetArg("-checklevel", 1);
     int nCheckDepth = gArgs.GetArg( "-checkblocks", 1000);
 
     LogPrintf("Verifying last %i blocks at level %i", nCheckDepth, nCheckLevel);
     CBlockIndex* pindexFork = nullptr;
-    map<pair<unsigned int, unsigned int>, CBlockIndex*> mapBlockPos;
+
+    std::vector<const CBlockIndex*> vToVerify;
     for (CBlockIndex* pindex = pindexBest; pindex && pindex->pprev; pindex = pindex->pprev)
     {
-        if (fRequestShutdown || pindex->nHeight < nBestHeight-nCheckDepth)
+        if (pindex->nHeight < nBestHeight-nCheckDepth)
             break;
-        CBlock block;
-        if (!ReadBlockFromDisk(block, pindex, Params().GetConsensus()))
-            return error("LoadBlockIndex() : block.ReadFromDisk failed");
-        // check level 1: verify block validity
-        // check level 7: verify block signature too
-
-        if(fQtActive)
-        {
-            if ((pindex->nHeight % 1000) == 0)
-            {
-                nLoaded +=1000;
-                if (nLoaded > nHighest) nHighest=nLoaded;
-                if (nHighest < nGrandfather) nHighest=nGrandfather;
-                uiInterface.InitMessage(strprintf("%" PRId64 "/%" PRId64 " %s", nLoaded, nHighest, _("Blocks Verified")));
-            }
-        }
-
-        if (nCheckLevel>0 && !CheckBlock(block, pindex->nHeight, true, true, (nCheckLevel>6), true))
-        {
-            LogPrintf("LoadBlockIndex() : *** found bad block at %d, hash=%s", pindex->nHeight, pindex->GetBlockHash().ToString());
-            pindexFork = pindex->pprev;
-        }
-        // check level 2: verify transaction index validity
-        if (nCheckLevel>1)
-        {
-            pair<unsigned int, unsigned int> pos = make_pair(pindex->nFile, pindex->nBlockPos);
-            mapBlockPos[pos] = pindex;
-            for (auto const& tx : block.vtx)
-            {
-                uint256 hashTx = tx.GetHash();
-                CTxIndex txindex;
-                if (ReadTxIndex(hashTx, txindex))
-                {
-                    // check level 3: checker transaction hashes
-                    if (nCheckLevel>2 || pindex->nFile != txindex.pos.nFile || pindex->nBlockPos != txindex.pos.nBlockPos)
-                    {
-                        // either an error or a duplicate transaction
-                        CTransaction txFound;
-                        if (!ReadTxFromDisk(txFound, txindex.pos))
-                        {
-                            LogPrintf("LoadBlockIndex() : *** cannot read mislocated transaction %s", hashTx.ToString());
-                            pindexFork = pindex->pprev;
-                        }
-                        else
-                            if (txFound.GetHash() != hashTx) // not a duplicate tx
-                            {
-                                LogPrintf("LoadBlockIndex(): *** invalid tx position for %s", hashTx.ToString());
-                                pindexFork = pindex->pprev;
-                            }
-                    }
-                    // check level 4: check whether spent txouts were spent within the main chain
-                    unsigned int nOutput = 0;
-                    if (nCheckLevel>3)
-                    {
-                        for (auto const& txpos : txindex.vSpent)
-                        {
-                            if (!txpos.IsNull())
-                            {
-                                pair<unsigned int, unsigned int> posFind = make_pair(txpos.nFile, txpos.nBlockPos);
-                                if (!mapBlockPos.count(posFind))
-                                {
-                                    LogPrintf("LoadBlockIndex(): *** found bad spend at %d, hashBlock=%s, hashTx=%s", pindex->nHeight, pindex->GetBlockHash().ToString(), hashTx.ToString());
-                                    pindexFork = pindex->pprev;
-                                }
-                                // check level 6: check whether spent txouts were spent by a valid transaction that consume them
-                                if (nCheckLevel>5)
-                                {
-                                    CTransaction txSpend;
-                                    if (!ReadTxFromDisk(txSpend, txpos))
-                                    {
-                                        LogPrintf("LoadBlockIndex(): *** cannot read spending transaction of %s:%i from disk", hashTx.ToString(), nOutput);
-                                        pindexFork = pindex->pprev;
-                                    }
-                                    else if (!CheckTransaction(txSpend))
-                                    {
-                                        LogPrintf("LoadBlockIndex(): *** spending transaction of %s:%i is invalid", hashTx.ToString(), nOutput);
-                                        pindexFork = pindex->pprev;
-                                    }
-                                    else
-                                    {
-                                        bool fFound = false;
-                                        for (auto const& txin : txSpend.vin)
-                                            if (txin.prevout.hash == hashTx && txin.prevout.n == nOutput)
-                                                fFound = true;
-                                        if (!fFound)
-                                        {
-                                            LogPrintf("LoadBlockIndex(): *** spending transaction of %s:%i does not spend it", hashTx.ToString(), nOutput);
-                                            pindexFork = pindex->pprev;
-                                        }
-                                    }
-                                }
-                            }
-                            nOutput++;
-                        }
-                    }
-                }
-                // check level 5: check whether all prevouts are marked spent
-                if (nCheckLevel>4)
-                {
-                    for (auto const& txin : tx.vin)
-                    {
-                        CTxIndex txindex;
-                        if (ReadTxIndex(txin.prevout.hash, txindex))
-                            if (txindex.vSpent.size()-1 < txin.prevout.n || txindex.vSpent[txin.prevout.n].IsNull())
-                            {
-                                LogPrintf("LoadBlockIndex(): *** found unspent prevout %s:%i in %s", txin.prevout.hash.ToString(), txin.prevout.n, hashTx.ToString());
-                                pindexFork = pindex->pprev;
-                            }
-                    }
-                }
-            }
-        }
+        vToVerify.push_back(pindex);
     }
 
+    std::vector<StartupCheckResult> vResults = VerifyBlocksAtStartup(vToVerify, nCheckLevel);
 
+    // Report the problems in order from the tip down. The last block with a
+    // problem is the earliest one, so we move the best chain to its parent:
+    for (size_t i = 0; i < vResults.size(); ++i)
+    {
+        if (!vResults[i].fChecked)
+            break;
+        for (const auto& problem : vResults[i].vProblems)
+            LogPrintf("LoadBlockIndex() : *** %s", problem);
+        if (!vResults[i].fRead)
+            return error("LoadBlockIndex() : block.ReadFromDisk failed");
+        if (!vResults[i].vProblems.empty())
+            pindexFork = vToVerify[i]->pprev;
+    }
 
     LogPrintf("Time to Verify Blocks %15" PRId64 "ms", GetTimeMillis() - nStart);
 
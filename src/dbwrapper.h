@@ -9,8 +9,11 @@
 #include "clientversion.h"
 #include "main.h"
 #include "streams.h"
+#include "sync.h"
 
+#include <optional>
 #include <string>
+#include <unordered_map>
 #include <leveldb/db.h>
 #include <leveldb/write_batch.h>
 
@@ -25,6 +28,128 @@ static const int64_t nMaxDbCache = 1024;
 static const int64_t nMinDbCache = 4;
 //! Max memory allocated to block tree DB (leveldb) cache. There is little performance gain over 1024 MB.
 static const int64_t nMaxTxIndexCache = 1024;
+//! -txindexreadcache default (MiB). Separate from -dbcache, which the wallet database uses in full.
+static const int64_t nDefaultTxIndexReadCache = 32;
+
+//!
+//! \brief Read cache of decoded transaction index records layered over the
+//! LevelDB transaction index.
+//!
+//! Block connection resolves every input by looking up the transaction index
+//! record of the output that it spends, and it rewrites that record to flag
+//! the output as spent. Without a cache, each of these lookups deserializes a
+//! record from LevelDB, often for transactions that the same block or one of
+//! the previous blocks just touched. This cache keeps decoded records in an
+//! unordered map sized by -txindexreadcache so that the read side of
+//! connecting and disconnecting blocks does not hit the database for recently
+//! used outputs.
+//!
+//! It does not change the writes: spending an output still rewrites the full
+//! record, vSpent included, in the batch of the block that spends it.
+//!
+//! The cache only holds records that match the committed state of the
+//! database. CTxDB buffers the records modified in an open transaction in its
+//! own overlay and applies them to this cache after the LevelDB batch commits,
+//! so an aborted transaction never leaves stale entries behind. When the cache
+//! exceeds its memory budget, it drops every entry at once like the Bitcoin
+//! coins cache does on flush.
+//!
+class CTxIndexCache
+{
+public:
+    //!
+    //! \brief Initialize an empty cache with the default -txindexreadcache budget.
+    //!
+    CTxIndexCache();
+
+    //!
+    //! \brief Copy the cached record for the specified transaction.
+    //!
+    //! \return \c true if the cache contains a record for the transaction.
+    //!
+    bool Lookup(const uint256& hash, CTxIndex& txindex) const;
+
+    //!
+    //! \brief Get the counter that advances whenever a committed change
+    //! reaches the cache.
+    //!
+    //! Readers capture the generation before they load a record from the
+    //! database and pass it to \c Insert() so that a record read before a
+    //! concurrent commit cannot overwrite the newer entry.
+    //!
+    uint64_t Generation() const;
+
+    //!
+    //! \brief Store a record loaded from the database.
+    //!
+    //! \param generation Value of \c Generation() captured before reading
+    //! the record. The cache ignores the record if a commit happened since.
+    //!
+    void Insert(const uint256& hash, const CTxIndex& txindex, uint64_t generation);
+
+    //!
+    //! \brief Apply the records changed by a committed database transaction.
+    //!
+    //! \param changes Maps transaction hashes to the updated records. Empty
+    //! optional values represent erased records.
+    //!
+    void Apply(const std::unordered_map<uint256, std::optional<CTxIndex>, BlockHasher>& changes);
+
+    //!
+    //! \brief Drop every cached record.
+    //!
+    void Clear();
+
+    //!
+    //! \brief Set the memory budget for the cache.
+    //!
+    void SetMaxMemoryUsage(size_t max_bytes);
+
+    //!
+    //! \brief Get the approximate memory used by the cached records in bytes.
+    //!
+    size_t MemoryUsage() const;
+
+    //!
+    //! \brief Get the number of cached records.
+    //!
+    size_t Size() const;
+
+private:
+    //!
+    //! \brief Hashes transaction IDs with a random key so that peers cannot
+    //! craft transactions that collide in the same bucket.
+    //!
+    struct SaltedTxidHasher
+    {
+        SaltedTxidHasher();
+        size_t operator()(const uint256& hash) const;
+
+    private:
+        const uint64_t k0;
+        const uint64_t k1;
+    };
+
+    typedef std::unordered_map<uint256, CTxIndex, SaltedTxidHasher> TxIndexMap;
+
+    mutable Mutex cs_cache;
+    TxIndexMap m_entries GUARDED_BY(cs_cache);
+    size_t m_memory_usage GUARDED_BY(cs_cache);
+    size_t m_max_memory_usage GUARDED_BY(cs_cache);
+    uint64_t m_generation GUARDED_BY(cs_cache);
+
+    //!
+    //! \brief Estimate the heap memory consumed by one entry in the map.
+    //!
+    static size_t EntryMemoryUsage(const CTxIndex& txindex);
+
+    void InsertLocked(const uint256& hash, const CTxIndex& txindex) EXCLUSIVE_LOCKS_REQUIRED(cs_cache);
+};
+
+//!
+//! \brief Global cache of committed transaction index records.
+//!
+extern CTxIndexCache g_txindex_cache;
 
 // Class that provides access to a LevelDB. Note that this class is frequently
 // instantiated on the stack and then destroyed again, so instantiation has to
@@ -44,7 +169,8 @@ public:
     CTxDB(const char* pszMode="r+");
     ~CTxDB() {
         // Note that this is not the same as Close() because it deletes only
-        // data scoped to this TxDB object.
+        // data scoped to this TxDB object. Uncommitted transaction index
+        // changes are discarded with the batch.
         delete activeBatch;
     }
 
@@ -61,6 +187,15 @@ private:
     bool fReadOnly;
     int nVersion;
 
+    // Transaction index records written while activeBatch is open. Empty
+    // values mark erased records. Applied to g_txindex_cache on commit.
+    std::unordered_map<uint256, std::optional<CTxIndex>, BlockHasher> m_pending_txindex;
+
+    // Latest value of each key written to activeBatch, indexed by the key
+    // bytes so that reads inside a transaction do not iterate the batch.
+    // Empty values mark deletes.
+    std::unordered_map<std::string, std::optional<std::string>> m_batch_overlay;
+
 protected:
     // Returns true and sets (value,false) if activeBatch contains the given key
     // or leaves value alone and sets deleted = true if activeBatch contains a
@@ -121,7 +256,10 @@ protected:
         ssValue << value;
 
         if (activeBatch) {
-            activeBatch->Put(ssKey.str(), ssValue.str());
+            std::string strKey = ssKey.str();
+            std::string strValue = ssValue.str();
+            activeBatch->Put(strKey, strValue);
+            m_batch_overlay[std::move(strKey)] = std::move(strValue);
             return true;
         }
         leveldb::Status status = pdb->Put(leveldb::WriteOptions(), ssKey.str(), ssValue.str());
@@ -144,7 +282,9 @@ protected:
         ssKey.reserve(1000);
         ssKey << key;
         if (activeBatch) {
-            activeBatch->Delete(ssKey.str());
+            std::string strKey = ssKey.str();
+            activeBatch->Delete(strKey);
+            m_batch_overlay[std::move(strKey)] = std::nullopt;
             return true;
         }
         leveldb::Status status = pdb->Delete(leveldb::WriteOptions(), ssKey.str());
@@ -179,6 +319,8 @@ public:
     {
         delete activeBatch;
         activeBatch = nullptr;
+        m_batch_overlay.clear();
+        m_pending_txindex.clear();
         return true;
     }
 
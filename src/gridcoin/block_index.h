@@ -6,9 +6,16 @@
 #define GRIDCOIN_BLOCK_INDEX_H
 
 #include "gridcoin/cpid.h"
+#include "uint256.h"
 
 #include <array>
+#include <cassert>
+#include <cstdint>
 #include <forward_list>
+#include <iterator>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
 class CBlockIndex;
 
@@ -41,6 +48,21 @@ public:
     }
 };
 
+//!
+//! \brief Block index fields that chain traversals rarely read.
+//!
+//! Moving these out of \c CBlockIndex shrinks each entry to keep the fields
+//! visited by a walk through the chain close together. Pooled entries share
+//! cache lines with neighboring heights, so full-chain walks benefit as well.
+//!
+class BlockIndexColdData
+{
+public:
+    uint256 m_merkle_root;
+    uint256 m_proof_hash;
+    uint32_t m_nonce = 0;
+};
+
 //!
 //! \brief Bulk-allocates block index objects to improve heap efficiency.
 //!
@@ -54,11 +76,6 @@ public:
 //! The pool does not provide a way to return discarded objects because the
 //! application never removes or destroys block index entries.
 //!
-//! TODO: Consider a specialized hash table implementation for the block index
-//! map with more efficient memory management than \c std::unordered_map. This
-//! pool serves as a crutch until we can address the scalability problems with
-//! the block index on a deeper level.
-//!
 class BlockIndexPool
 {
 public:
@@ -78,6 +95,37 @@ public:
         return m_researcher_context_pool.GetNext();
     }
 
+    //!
+    //! \brief Get a contiguous run of researcher context instances from the
+    //! pool.
+    //!
+    //! \param count Number of instances in the run. Must not exceed the size
+    //! of a pool chunk.
+    //!
+    static ResearcherContext* GetNextResearcherContexts(const size_t count)
+    {
+        return m_researcher_context_pool.GetNext(count);
+    }
+
+    //!
+    //! \brief Get the next available cold data instance from the pool.
+    //!
+    static BlockIndexColdData* GetNextColdData()
+    {
+        return m_cold_data_pool.GetNext();
+    }
+
+    //!
+    //! \brief Get the next available block hash instance from the pool.
+    //!
+    //! The block index map stores its keys here so that the addresses held
+    //! by \c CBlockIndex::phashBlock remain stable when the table grows.
+    //!
+    static uint256* GetNextBlockHash()
+    {
+        return m_block_hash_pool.GetNext();
+    }
+
 private:
     //!
     //! \brief Allocates objects in chunks and provides access to unclaimed
@@ -89,7 +137,7 @@ private:
         //!
         //! \brief Number of objects to allocate per chunk.
         //!
-        //! For block index objects, this results in about a 5 MB allocation
+        //! For block index objects, this results in about a 3 MB allocation
         //! per chunk.
         //!
         static constexpr size_t CHUNK_SIZE = 32768;
@@ -107,12 +155,28 @@ private:
         //!
         T* GetNext()
         {
-            if (m_offset >= CHUNK_SIZE) {
+            return GetNext(1);
+        }
+
+        //!
+        //! \brief Get a run of consecutive instances from the pool.
+        //!
+        //! Any instances left at the end of the current chunk go unused when
+        //! the run does not fit.
+        //!
+        T* GetNext(const size_t count)
+        {
+            assert(count > 0 && count <= CHUNK_SIZE);
+
+            if (m_offset + count > CHUNK_SIZE) {
                 m_pool.emplace_front();
                 m_offset = 0;
             }
 
-            return &m_pool.front()[m_offset++];
+            T* run = &m_pool.front()[m_offset];
+            m_offset += count;
+
+            return run;
         }
 
     private:
@@ -144,7 +208,417 @@ private:
 
     static Pool<CBlockIndex> m_block_index_pool;
     static Pool<ResearcherContext> m_researcher_context_pool;
+    static Pool<BlockIndexColdData> m_cold_data_pool;
+    static Pool<uint256> m_block_hash_pool;
 }; // BlockIndexPool
+
+//!
+//! \brief An open-addressing hash table that maps block hashes to entries in
+//! the block index.
+//!
+//! Every node in a \c std::unordered_map costs a separate heap allocation and
+//! a bucket pointer in addition to the key and value. With millions of blocks
+//! in the chain, this overhead adds up. This table stores each entry inline in
+//! one flat array probed linearly: the low 64 bits of the hash, a pointer to
+//! the full key, and the mapped value. The keys themselves live in the arenas
+//! of \c BlockIndexPool so that \c CBlockIndex::phashBlock may keep pointing
+//! at them when the table resizes. Probes compare the inline bits first, so a
+//! lookup usually touches the full key of the matching entry only.
+//!
+//! The table uses less memory per entry than \c std::unordered_map only while
+//! more than 3/5 of its slots are full. Just after the table doubles, it uses
+//! more.
+//!
+//! The interface mirrors the subset of \c std::unordered_map that the block
+//! index code uses. Iterators dereference to a proxy object with \c first and
+//! \c second members that refer to the key and the mapped pointer. Inserting
+//! an entry invalidates any outstanding iterators, but not the key addresses.
+//!
+//! Like the pool, the table does not reclaim the storage for a key when code
+//! erases an entry. The application only erases entries in tests.
+//!
+class BlockIndexMap
+{
+    struct Slot
+    {
+        uint64_t m_fingerprint = 0; //!< Low bits of the key to skip mismatches.
+        const uint256* m_key = nullptr;
+        CBlockIndex* m_value = nullptr;
+    };
+
+public:
+    //!
+    //! \brief Refers to the key and value of an entry in the table.
+    //!
+    template <bool Const>
+    struct Reference
+    {
+        const uint256& first;
+        std::conditional_t<Const, CBlockIndex* const&, CBlockIndex*&> second;
+    };
+
+    //!
+    //! \brief Forward iterator over the occupied slots in the table.
+    //!
+    template <bool Const>
+    class Iterator
+    {
+        using SlotPtr = std::conditional_t<Const, const Slot*, Slot*>;
+
+        //!
+        //! \brief Holds the proxy reference for the arrow operator.
+        //!
+        struct Arrow
+        {
+            Reference<Const> m_ref;
+
+            const Reference<Const>* operator->() const
+            {
+                return &m_ref;
+            }
+        };
+
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = Reference<Const>;
+        using difference_type = std::ptrdiff_t;
+        using pointer = Arrow;
+        using reference = Reference<Const>;
+
+        Iterator() : m_slot(nullptr), m_end(nullptr)
+        {
+        }
+
+        Iterator(SlotPtr slot, SlotPtr end) : m_slot(slot), m_end(end)
+        {
+            SkipEmpty();
+        }
+
+        template <bool C = Const, typename = std::enable_if_t<!C>>
+        operator Iterator<true>() const
+        {
+            return Iterator<true>(m_slot, m_end);
+        }
+
+        Reference<Const> operator*() const
+        {
+            return { *m_slot->m_key, m_slot->m_value };
+        }
+
+        Arrow operator->() const
+        {
+            return { **this };
+        }
+
+        Iterator& operator++()
+        {
+            ++m_slot;
+            SkipEmpty();
+
+            return *this;
+        }
+
+        Iterator operator++(int)
+        {
+            Iterator copy = *this;
+            ++*this;
+
+            return copy;
+        }
+
+        bool operator==(const Iterator& other) const
+        {
+            return m_slot == other.m_slot;
+        }
+
+        bool operator!=(const Iterator& other) const
+        {
+            return m_slot != other.m_slot;
+        }
+
+    private:
+        SlotPtr m_slot; //!< Current position in the table.
+        SlotPtr m_end;  //!< One past the last slot in the table.
+
+        void SkipEmpty()
+        {
+            while (m_slot != m_end && m_slot->m_key == nullptr) {
+                ++m_slot;
+            }
+        }
+    };
+
+    using iterator = Iterator<false>;
+    using const_iterator = Iterator<true>;
+
+    BlockIndexMap() : m_size(0), m_shift(64)
+    {
+    }
+
+    iterator begin()
+    {
+        return iterator(m_slots.data(), m_slots.data() + m_slots.size());
+    }
+
+    const_iterator begin() const
+    {
+        return const_iterator(m_slots.data(), m_slots.data() + m_slots.size());
+    }
+
+    iterator end()
+    {
+        return iterator(m_slots.data() + m_slots.size(), m_slots.data() + m_slots.size());
+    }
+
+    const_iterator end() const
+    {
+        return const_iterator(m_slots.data() + m_slots.size(), m_slots.data() + m_slots.size());
+    }
+
+    size_t size() const
+    {
+        return m_size;
+    }
+
+    bool empty() const
+    {
+        return m_size == 0;
+    }
+
+    iterator find(const uint256& hash)
+    {
+        const size_t index = FindIndex(hash);
+
+        if (index == NOT_FOUND) {
+            return end();
+        }
+
+        return iterator(&m_slots[index], m_slots.data() + m_slots.size());
+    }
+
+    const_iterator find(const uint256& hash) const
+    {
+        const size_t index = FindIndex(hash);
+
+        if (index == NOT_FOUND) {
+            return end();
+        }
+
+        return const_iterator(&m_slots[index], m_slots.data() + m_slots.size());
+    }
+
+    size_t count(const uint256& hash) const
+    {
+        return FindIndex(hash) != NOT_FOUND;
+    }
+
+    //!
+    //! \brief Add an entry to the table unless an entry with the same key
+    //! exists.
+    //!
+    //! \return An iterator to the entry with the key and \c true if the call
+    //! inserted a new entry.
+    //!
+    std::pair<iterator, bool> insert(const std::pair<uint256, CBlockIndex*>& entry)
+    {
+        bool inserted = false;
+        Slot& slot = FindOrInsert(entry.first, inserted);
+
+        if (inserted) {
+            slot.m_value = entry.second;
+        }
+
+        return { iterator(&slot, m_slots.data() + m_slots.size()), inserted };
+    }
+
+    //!
+    //! \brief Get the block index entry for the specified hash, inserting a
+    //! null pointer for the key if the table contains no such entry.
+    //!
+    CBlockIndex*& operator[](const uint256& hash)
+    {
+        bool inserted = false;
+
+        return FindOrInsert(hash, inserted).m_value;
+    }
+
+    //!
+    //! \brief Remove the entry with the specified key from the table.
+    //!
+    //! \return The number of entries removed (zero or one).
+    //!
+    size_t erase(const uint256& hash)
+    {
+        size_t index = FindIndex(hash);
+
+        if (index == NOT_FOUND) {
+            return 0;
+        }
+
+        // Shift the entries that follow in the same probe sequence backward
+        // so that lookups never stop early at the emptied slot:
+        //
+        const size_t mask = m_slots.size() - 1;
+
+        for (size_t next = (index + 1) & mask; m_slots[next].m_key; next = (next + 1) & mask) {
+            const size_t ideal = Bucket(m_slots[next].m_fingerprint);
+
+            if (((next - ideal) & mask) >= ((next - index) & mask)) {
+                m_slots[index] = m_slots[next];
+                index = next;
+            }
+        }
+
+        m_slots[index] = Slot();
+        --m_size;
+
+        return 1;
+    }
+
+    //!
+    //! \brief Remove every entry from the table and release its storage.
+    //!
+    //! The pool keeps the memory of the keys and values.
+    //!
+    void clear()
+    {
+        std::vector<Slot>().swap(m_slots);
+        m_size = 0;
+        m_shift = 64;
+    }
+
+    //!
+    //! \brief Allocate enough slots to hold the specified number of entries
+    //! without growing the table.
+    //!
+    void reserve(const size_t count)
+    {
+        size_t capacity = MIN_CAPACITY;
+
+        while (count * MAX_LOAD_DENOMINATOR > capacity * MAX_LOAD_NUMERATOR) {
+            capacity *= 2;
+        }
+
+        if (capacity > m_slots.size()) {
+            Rehash(capacity);
+        }
+    }
+
+    //!
+    //! \brief Get the number of bytes consumed by the table and its keys.
+    //!
+    size_t MemoryUsage() const
+    {
+        return m_slots.capacity() * sizeof(Slot) + m_size * sizeof(uint256);
+    }
+
+private:
+    static constexpr size_t NOT_FOUND = static_cast<size_t>(-1);
+    static constexpr size_t MIN_CAPACITY = 16;
+
+    //!
+    //! \brief The table grows when more than 3/4 of its slots fill up.
+    //!
+    static constexpr size_t MAX_LOAD_NUMERATOR = 3;
+    static constexpr size_t MAX_LOAD_DENOMINATOR = 4;
+
+    std::vector<Slot> m_slots; //!< Table storage. Size is a power of two.
+    size_t m_size;             //!< Number of occupied slots.
+    unsigned int m_shift;      //!< 64 minus the log2 of the table size.
+
+    //!
+    //! \brief Get the preferred slot for a key.
+    //!
+    //! Block hashes are uniformly distributed, but mocked or crafted hashes
+    //! need not be. Fibonacci hashing spreads clustered keys across the table
+    //! for the cost of a single multiplication.
+    //!
+    size_t Bucket(const uint256& hash) const
+    {
+        return Bucket(hash.GetUint64(0));
+    }
+
+    size_t Bucket(const uint64_t fingerprint) const
+    {
+        return (fingerprint * 0x9E3779B97F4A7C15ull) >> m_shift;
+    }
+
+    size_t FindIndex(const uint256& hash) const
+    {
+        if (m_slots.empty()) {
+            return NOT_FOUND;
+        }
+
+        const size_t mask = m_slots.size() - 1;
+
+        const uint64_t fingerprint = hash.GetUint64(0);
+
+        for (size_t index = Bucket(hash); m_slots[index].m_key; index = (index + 1) & mask) {
+            if (m_slots[index].m_fingerprint == fingerprint && *m_slots[index].m_key == hash) {
+                return index;
+            }
+        }
+
+        return NOT_FOUND;
+    }
+
+    Slot& FindOrInsert(const uint256& hash, bool& inserted)
+    {
+        if ((m_size + 1) * MAX_LOAD_DENOMINATOR > m_slots.size() * MAX_LOAD_NUMERATOR) {
+            Rehash(m_slots.empty() ? MIN_CAPACITY : m_slots.size() * 2);
+        }
+
+        const size_t mask = m_slots.size() - 1;
+        const uint64_t fingerprint = hash.GetUint64(0);
+        size_t index = Bucket(hash);
+
+        for (; m_slots[index].m_key; index = (index + 1) & mask) {
+            if (m_slots[index].m_fingerprint == fingerprint && *m_slots[index].m_key == hash) {
+                return m_slots[index];
+            }
+        }
+
+        uint256* key = BlockIndexPool::GetNextBlockHash();
+        *key = hash;
+
+        m_slots[index].m_fingerprint = fingerprint;
+        m_slots[index].m_key = key;
+        ++m_size;
+        inserted = true;
+
+        return m_slots[index];
+    }
+
+    void Rehash(const size_t capacity)
+    {
+        assert((capacity & (capacity - 1)) == 0);
+
+        std::vector<Slot> old_slots(capacity);
+        old_slots.swap(m_slots);
+
+        m_shift = 64;
+
+        for (size_t i = capacity; i > 1; i >>= 1) {
+            --m_shift;
+        }
+
+        const size_t mask = capacity - 1;
+
+        for (const Slot& slot : old_slots) {
+            if (!slot.m_key) {
+                continue;
+            }
+
+            size_t index = Bucket(slot.m_fingerprint);
+
+            while (m_slots[index].m_key) {
+                index = (index + 1) & mask;
+            }
+
+            m_slots[index] = slot;
+        }
+    }
+}; // BlockIndexMap
 } // namespace GRC
 
 #endif // GRIDCOIN_BLOCK_INDEX_H
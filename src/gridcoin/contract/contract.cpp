@@ -477,19 +477,30 @@ void GRC::ReplayContracts(CBlockIndex* pindex_end, CBlockIndex* pindex_start)
                   __func__);
     }
 
+    const bool needs_is_contract_correction = beacons.NeedsIsContractCorrection();
+
+    // Read ahead only the blocks that the replay applies. The last block is
+    // always visited to finish the rescan.
+    SequentialBlockReader reader(pindex, pindex_end, [&](const CBlockIndex* candidate) {
+        return needs_is_contract_correction
+            || candidate->IsContract()
+            || (candidate->IsSuperblock() && candidate->nVersion >= 11)
+            || candidate == pindex_end;
+    });
+
     CBlock block;
+    bool fRead;
 
     // These are memorized consecutively in order from oldest to newest.
-    for (; pindex; pindex = pindex->pnext) {
+    while ((pindex = reader.Next(block, fRead))) {
+        if (!fRead) {
+            continue;
+        }
 
         // If the NeedsIsContractCorrection flag is set which means all blocks within the scan range
         // have to be checked, OR the block index entry is already marked to contain contract(s),
         // then apply the contracts found in the block.
-        if (beacons.NeedsIsContractCorrection() || pindex->IsContract()) {
-            if (!ReadBlockFromDisk(block, pindex, Params().GetConsensus())) {
-                continue;
-            }
-
+        if (needs_is_contract_correction || pindex->IsContract()) {
             bool found_contract;
             ApplyContracts(block, pindex, beacon_db_height, found_contract);
 
@@ -518,12 +529,6 @@ void GRC::ReplayContracts(CBlockIndex* pindex_end, CBlockIndex* pindex_start)
         }
 
         if (pindex->IsSuperblock() && pindex->nVersion >= 11) {
-            if (block.hashPrevBlock != pindex->pprev->GetBlockHash()
-                && !ReadBlockFromDisk(block, pindex, Params().GetConsensus()))
-            {
-                continue;
-            }
-
             // Only apply activations that have not already been stored/loaded into
             // the beacon DB. This is at the block level, so we have to be careful here.
             // If the pindex->nHeight is equal to the beacon_db_height, then the ActivatePending
@@ -134,8 +134,8 @@ CAmount MRC::ComputeMRCFee() const
             }
 
             // Historical MRC payment
-            for (const auto& mrc_context : last_payment_index->m_mrc_researchers) {
-                if (mrc_context->m_cpid == *cpid) {
+            for (const auto& mrc_context : last_payment_index->MRCResearchers()) {
+                if (mrc_context.m_cpid == *cpid) {
                     found_last_payment = true;
                     last_reward_time = last_payment_index->pprev->nTime;
                     break;
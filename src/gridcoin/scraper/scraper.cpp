@@ -3952,7 +3952,7 @@ ScraperStatsAndVerifiedBeacons GetScraperStatsByConvergedManifest(const Converge
     const auto& iter = StructConvergedManifest.ConvergedManifestPartPtrsMap.find("VerifiedBeacons");
     if (iter != StructConvergedManifest.ConvergedManifestPartPtrsMap.end())
     {
-        CDataStream part(iter->second->data, SER_NETWORK, 1);
+        SpanReader part(SER_NETWORK, 1, MakeUCharSpan(iter->second->data));
 
         try
         {
@@ -4027,7 +4027,7 @@ ScraperStatsAndVerifiedBeacons GetScraperStatsFromSingleManifest(CScraperManifes
     const auto& iter = StructDummyConvergedManifest.ConvergedManifestPartPtrsMap.find("VerifiedBeacons");
     if (iter != StructDummyConvergedManifest.ConvergedManifestPartPtrsMap.end())
     {
-        CDataStream part(iter->second->data, SER_NETWORK, 1);
+        SpanReader part(SER_NETWORK, 1, MakeUCharSpan(iter->second->data));
 
         try
         {
@@ -5600,7 +5600,7 @@ std::vector<uint160> GetVerifiedBeaconIDs(const ConvergedManifest& StructConverg
     const auto& iter = StructConvergedManifest.ConvergedManifestPartPtrsMap.find("VerifiedBeacons");
     if (iter != StructConvergedManifest.ConvergedManifestPartPtrsMap.end())
     {
-        CDataStream part(iter->second->data, SER_NETWORK, 1);
+        SpanReader part(SER_NETWORK, 1, MakeUCharSpan(iter->second->data));
 
         try
         {
@@ -5647,7 +5647,7 @@ ScraperStatsAndVerifiedBeacons GetScraperStatsAndVerifiedBeacons(const Converged
     const auto& iter = stats.Convergence.ConvergedManifestPartPtrsMap.find("VerifiedBeacons");
     if (iter != stats.Convergence.ConvergedManifestPartPtrsMap.end())
     {
-        CDataStream part(iter->second->data, SER_NETWORK, 1);
+        SpanReader part(SER_NETWORK, 1, MakeUCharSpan(iter->second->data));
 
         try
         {
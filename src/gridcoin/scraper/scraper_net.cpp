@@ -59,7 +59,11 @@ bool CSplitBlob::RecvPart(CNode* pfrom, CDataStream& vRecv)
         {
             LogPrint(BCLog::LogFlags::MANIFEST, "received part %s %u refs", hash.GetHex(), (unsigned) part.refs.size());
 
-            part.data = SerializeData(vRecv.begin(), vRecv.end());
+            // Take the received buffer instead of copying it. The part is the
+            // rest of the stream, so drop anything already read first:
+            vRecv.Compact();
+            vRecv.swap(part.data);
+
             for (const auto& ref : part.refs)
             {
                 CSplitBlob& split = *ref.first;
@@ -184,7 +188,7 @@ bool CSplitBlob::SendPartTo(CNode* pto, const uint256& hash) EXCLUSIVE_LOCKS_REQ
     {
         if (ipart->second.present())
         {
-            pto->PushMessage(NetMsgType::PART,ipart->second.getReader());
+            pto->PushMessage(NetMsgType::PART, MakeUCharSpan(ipart->second.data));
             return true;
         }
     }
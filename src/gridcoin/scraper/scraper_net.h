@@ -36,7 +36,6 @@ public:
         CPart(const uint256& ihash)
             :hash(ihash)
         {}
-        CDataStream getReader() const { return CDataStream(data, SER_NETWORK, PROTOCOL_VERSION); }
         bool present() const { return !this->data.empty(); }
     };
 
@@ -228,7 +228,7 @@ uint64_t GRC::GetStakeWeight(const CWallet& wallet)
 
     const int64_t now = GetAdjustedTime();
 
-    std::vector<std::pair<const CWalletTx*, unsigned int>> coins;
+    std::vector<StakeCandidate> coins;
     GRC::MinerStatus::ErrorFlags unused;
     int64_t balance = 0;
 
@@ -238,18 +238,12 @@ uint64_t GRC::GetStakeWeight(const CWallet& wallet)
         return 0;
     }
 
-    CTxDB txdb("r");
     uint64_t weight = 0;
 
-    for (const auto& pcoin : coins) {
-        CTxIndex txindex;
-
-        if (!txdb.ReadTxIndex(pcoin.first->GetHash(), txindex)) {
-            continue;
-        }
-
-        if (now - pcoin.first->nTime > nStakeMinAge) {
-            weight += (pcoin.first->vout[pcoin.second].nValue);
+    // The wallet only selects outputs of transactions in the main chain:
+    for (const auto& coin : coins) {
+        if (now - coin.m_tx_time > nStakeMinAge) {
+            weight += coin.m_value;
         }
     }
 
@@ -5,6 +5,8 @@
 
 #include "amount.h"
 #include "arith_uint256.h"
+#include "crypto/common.h"
+#include "crypto/sha256.h"
 #include "gridcoin/staking/kernel.h"
 #include "txdb.h"
 #include "main.h"
@@ -102,7 +104,7 @@ public:
     {
         if (!m_selection_hash) {
             CHashWriter hasher(SER_GETHASH, 0);
-            hasher << m_pindex->hashProof << previous_stake_modifier;
+            hasher << m_pindex->GetProofHash() << previous_stake_modifier;
 
             m_selection_hash = UintToArith256(hasher.GetHash());
 
@@ -512,18 +514,70 @@ uint256 GRC::CalculateStakeHashV8(
     unsigned CoinTxN,
     unsigned nTimeTx,
     uint64_t StakeModifier)
+{
+    return CalculateStakeHashV8(nBlockTime, CoinTx.GetHash(), CoinTxN, nTimeTx, StakeModifier);
+}
+
+uint256 GRC::CalculateStakeHashV8(
+    unsigned int nBlockTime,
+    const uint256& CoinTxHash,
+    unsigned CoinTxN,
+    unsigned nTimeTx,
+    uint64_t StakeModifier)
 {
     CHashWriter ss(SER_GETHASH, 0);
 
     ss << StakeModifier;
     ss << MaskStakeTime((uint32_t) nBlockTime);
-    ss << CoinTx.GetHash();
+    ss << CoinTxHash;
     ss << CoinTxN;
     ss << MaskStakeTime(nTimeTx);
 
     return ss.GetHash();
 }
 
+// -----------------------------------------------------------------------------
+// Class: StakeKernelBatch
+// -----------------------------------------------------------------------------
+
+GRC::StakeKernelBatch::StakeKernelBatch(unsigned nTimeTx, uint64_t StakeModifier)
+    : m_size(0)
+    , m_time_tx(MaskStakeTime(nTimeTx))
+    , m_stake_modifier(StakeModifier)
+{
+}
+
+void GRC::StakeKernelBatch::Add(unsigned int nBlockTime, const uint256& CoinTxHash, unsigned CoinTxN)
+{
+    assert(m_size < MAX_SIZE);
+
+    unsigned char* block = m_blocks + m_size * 64;
+
+    // Same layout as the CHashWriter serialization in CalculateStakeHashV8():
+    WriteLE64(block, m_stake_modifier);
+    WriteLE32(block + 8, MaskStakeTime((uint32_t) nBlockTime));
+    memcpy(block + 12, CoinTxHash.begin(), 32);
+    WriteLE32(block + 44, CoinTxN);
+    WriteLE32(block + 48, m_time_tx);
+
+    SHA256PadBlock(block, 52);
+
+    ++m_size;
+}
+
+void GRC::StakeKernelBatch::Hash(uint256* hashes) const
+{
+    static_assert(sizeof(uint256) == CSHA256::OUTPUT_SIZE, "uint256 must match a SHA256 digest");
+
+    unsigned char out[MAX_SIZE * CSHA256::OUTPUT_SIZE];
+
+    SHA256DPadded(out, m_blocks, m_size);
+
+    for (size_t i = 0; i < m_size; ++i) {
+        memcpy(hashes[i].begin(), out + i * CSHA256::OUTPUT_SIZE, CSHA256::OUTPUT_SIZE);
+    }
+}
+
 int64_t GRC::CalculateStakeWeightV8(const CTransaction &CoinTx, unsigned CoinTxN)
 {
     CAmount nValueIn = CoinTx.vout[CoinTxN].nValue;
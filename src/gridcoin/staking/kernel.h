@@ -119,6 +119,70 @@ uint256 CalculateStakeHashV8(
     unsigned nTimeTx,
     uint64_t StakeModifier);
 
+// overload
+// Kernel for V8, for callers that keep only the hash of the coin transaction
+uint256 CalculateStakeHashV8(
+    unsigned int nBlockTime,
+    const uint256& CoinTxHash,
+    unsigned CoinTxN,
+    unsigned nTimeTx,
+    uint64_t StakeModifier);
+
+//!
+//! \brief Calculates the V8 kernel hashes of several outputs at once.
+//!
+//! A V8 kernel is a double-SHA256 of a fixed 52-byte message, so the batch
+//! lays out each message in its own padded block and hashes them together on
+//! the multi-way SHA256 backends (4-way SSE4.1, 8-way AVX2) when the CPU has
+//! them. The results match CalculateStakeHashV8().
+//!
+class StakeKernelBatch
+{
+public:
+    //!
+    //! \brief Maximum number of outputs that one batch hashes.
+    //!
+    static constexpr size_t MAX_SIZE = 16;
+
+    //!
+    //! \brief Initialize an empty batch for the kernels of a coinstake.
+    //!
+    //! \param nTimeTx       Timestamp of the coinstake transaction.
+    //! \param StakeModifier Stake modifier for the block.
+    //!
+    StakeKernelBatch(unsigned nTimeTx, uint64_t StakeModifier);
+
+    //!
+    //! \brief Add the kernel of an output to the batch.
+    //!
+    //! \param nBlockTime Timestamp of the block that contains the coin.
+    //! \param CoinTxHash Hash of the coin transaction.
+    //! \param CoinTxN    Index of the coin in the transaction.
+    //!
+    void Add(unsigned int nBlockTime, const uint256& CoinTxHash, unsigned CoinTxN);
+
+    //!
+    //! \brief Calculate the kernel hashes of the outputs in the batch.
+    //!
+    //! \param hashes Receives one hash for each output in the order added.
+    //! Must have room for size() hashes.
+    //!
+    void Hash(uint256* hashes) const;
+
+    //!
+    //! \brief Remove the outputs from the batch.
+    //!
+    void Clear() { m_size = 0; }
+
+    size_t size() const { return m_size; }
+    bool full() const { return m_size == MAX_SIZE; }
+
+private:
+    unsigned char m_blocks[MAX_SIZE * 64]; //!< Padded kernel messages.
+    size_t m_size;                         //!< Number of outputs in the batch.
+    const uint32_t m_time_tx;              //!< Masked coinstake timestamp.
+    const uint64_t m_stake_modifier;       //!< Stake modifier for the block.
+};
 
 int64_t CalculateStakeWeightV8(const CTransaction &CoinTx, unsigned CoinTxN);
 int64_t CalculateStakeWeightV8(const CAmount& nValueIn);
@@ -141,7 +141,7 @@ public:
         }
 
         for (; pindex; pindex = pindex->pnext) {
-            Remember(pindex->hashProof);
+            Remember(pindex->GetProofHash());
         }
     }
 
@@ -9,62 +9,48 @@ using namespace GRC;
 
 CBlockIndex* BlockFinder::FindByHeight(int height)
 {
-    // If the height is at the bottom half of the chain, start searching from
-    // the start to the end, otherwise search backwards from the end.
-    CBlockIndex *index = height < nBestHeight / 2
-            ? pindexGenesisBlock
-            : pindexBest;
-
-    if(index != nullptr)
-    {
-        // Traverse towards the tail.
-        while (index && index->pprev && index->nHeight > height) {
-            index = index->pprev;
-        }
-
-        // Traverse towards the head.
-        while (index && index->pnext && index->nHeight < height) {
-            index = index->pnext;
-        }
+    if (g_active_chain.Height() < 0) {
+        return nullptr;
     }
 
-    return index;
+    // Clamp the height to the chain so that callers asking for a block past
+    // either end receive the closest block like the old traversal did.
+    height = std::clamp(height, 0, g_active_chain.Height());
+
+    return g_active_chain[height];
 }
 
 CBlockIndex* BlockFinder::FindByMinTime(int64_t time)
 {
-    // Select starting point depending on time proximity. While this is not as
-    // accurate as in the FindByHeight case it will still give us a reasonable
-    // estimate.
-    CBlockIndex *index = abs(time - pindexBest->nTime) < abs(time - pindexGenesisBlock->nTime)
-            ? pindexBest
-            : pindexGenesisBlock;
-
-    if (index != nullptr)
-    {
-        // Move back until the previous block is no longer younger than "time".
-        while (index && index->pprev && index->pprev->nTime > time) {
-            index = index->pprev;
-        }
-
-        // Move forward until the current block is younger than "time".
-        while (index && index->pnext && index->nTime < time) {
-            index = index->pnext;
-        }
+    if (CBlockIndex* index = g_active_chain.FindEarliestAtLeast(time)) {
+        return index;
     }
 
-    return index;
+    return g_active_chain.Tip();
 }
 
 // The arguments are passed by value on purpose.
 CBlockIndex* BlockFinder::FindByMinTimeFromGivenIndex(int64_t time, CBlockIndex* index)
 {
     // If no starting index is provided (i.e. second parameter is omitted or nullptr is passed in,
-    // then start at the Genesis Block. This is in general expensive and should be avoided.
+    // then start at the Genesis Block.
     if (!index) {
-        index = pindexGenesisBlock;
+        index = g_active_chain.Genesis();
+
+        if (!index) {
+            return nullptr;
+        }
+    }
+
+    if (g_active_chain.Contains(index)) {
+        if (CBlockIndex* found = g_active_chain.FindEarliestAtLeast(time, index->nHeight)) {
+            return found;
+        }
+
+        return g_active_chain.Tip();
     }
 
+    // A block on a side chain can only reach the active chain via its links:
     while (index && index->pnext && index->nTime < time) {
         index = index->pnext;
     }
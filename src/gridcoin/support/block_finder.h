@@ -11,7 +11,10 @@ class CBlockIndex;
 
 namespace GRC {
 //!
-//! \brief Chain traversing block finder.
+//! \brief Block finder for the active chain.
+//!
+//! Looks up blocks in the height-indexed \c g_active_chain container instead
+//! of traversing the pprev/pnext links. A lock on \c cs_main must be held.
 //!
 class BlockFinder
 {
@@ -19,8 +22,7 @@ public:
     //!
     //! \brief Find a block with a specific height.
     //!
-    //! Traverses the chain from head or tail, depending on what's closest to
-    //! find the block that matches \p height.
+    //! Looks up the block that matches \p height in constant time.
     //!
     //! \param nHeight Block height to find.
     //! \return The block with the height closest to \p nHeight if found, otherwise
@@ -31,9 +33,9 @@ public:
     //!
     //! \brief Find block by time.
     //!
-    //! Traverses the chain in the same way as FindByHeight() and stops at the
-    //! block which is not older than \p time, or the youngest block if it is
-    //! older than \p time.
+    //! Performs a binary search over the active chain for the first block
+    //! which is not older than \p time, or the youngest block if it is older
+    //! than \p time.
     //!
     //! \param time Block time to search for.
     //! \return The youngest block which is not older than \p time, or the
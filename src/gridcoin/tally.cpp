@@ -311,19 +311,19 @@ public:
     //!
     void RecordMRCRewardBlock(const CBlockIndex* const pindex)
     {
-        for (const auto& mrc_researcher : pindex->m_mrc_researchers) {
-            Cpid cpid = mrc_researcher->m_cpid;
+        for (const auto& mrc_researcher : pindex->MRCResearchers()) {
+            Cpid cpid = mrc_researcher.m_cpid;
 
             ResearchAccount& account = m_researchers[cpid];
 
-            account.m_total_research_subsidy += mrc_researcher->m_research_subsidy;
+            account.m_total_research_subsidy += mrc_researcher.m_research_subsidy;
 
             // MRC's are paid on the last block prior to the staked block (i.e. pprev), but recorded in the pindex
             // where the claim is. This is a little tricky.
             //
             // TODO: This probably doesn't work correctly given the implicit cast and should be removed. It isn't
             // used in accrual calculations, only reporting.
-            if (mrc_researcher->m_magnitude > 0) {
+            if (mrc_researcher.m_magnitude > 0) {
                 account.m_accuracy++;
                 account.m_total_magnitude += pindex->pprev->Magnitude();
             }
@@ -386,8 +386,8 @@ public:
             // accrual point.
             bool mrc_last_block_found = false;
 
-            for (const auto& mrc_researcher : pindex->m_mrc_researchers) {
-                if (mrc_researcher->m_cpid == cpid && mrc_researcher->m_research_subsidy > 0) {
+            for (const auto& mrc_researcher : pindex->MRCResearchers()) {
+                if (mrc_researcher.m_cpid == cpid && mrc_researcher.m_research_subsidy > 0) {
                     pindex = pindex->pprev;
 
                     mrc_last_block_found = true;
@@ -448,8 +448,8 @@ public:
     //!
     void ForgetMRCRewardBlock(const CBlockIndex* pindex)
     {
-        for (const auto& mrc_researcher : pindex->m_mrc_researchers) {
-            Cpid cpid = mrc_researcher->m_cpid;
+        for (const auto& mrc_researcher : pindex->MRCResearchers()) {
+            Cpid cpid = mrc_researcher.m_cpid;
 
             auto iter = m_researchers.find(cpid);
 
@@ -480,9 +480,9 @@ public:
                 return;
             }
 
-            account.m_total_research_subsidy -= mrc_researcher->m_research_subsidy;
+            account.m_total_research_subsidy -= mrc_researcher.m_research_subsidy;
 
-            if (mrc_researcher->m_magnitude > 0) {
+            if (mrc_researcher.m_magnitude > 0) {
                 account.m_accuracy--;
                 account.m_total_magnitude -= pindex->pprev->Magnitude();
             }
@@ -699,12 +699,7 @@ private:
         // starting height yet, so the tally will initialize without it.
         //
         if (m_start_pindex == nullptr && pindexGenesisBlock != nullptr) {
-            const int32_t threshold = Params().GetConsensus().ResearchAgeHeight;
-            const CBlockIndex* pindex = pindexGenesisBlock;
-
-            for (; pindex && pindex->nHeight < threshold; pindex = pindex->pnext);
-
-            m_start_pindex = pindex;
+            m_start_pindex = g_active_chain[Params().GetConsensus().ResearchAgeHeight];
         }
 
         // Tally initialization will repair block index entries with zero CPID
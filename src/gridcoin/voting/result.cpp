@@ -1071,10 +1071,8 @@ SuperblockPtr ResolveSuperblockForPoll(const Poll& poll)
         return superblock;
     }
 
-    const CBlockIndex* pindex = pindexBest;
-
     // Seek past the current superblock:
-    for (; pindex && pindex->nHeight >= superblock.m_height; pindex = pindex->pprev);
+    const CBlockIndex* pindex = pindexBest ? pindexBest->GetAncestor(superblock.m_height - 1) : nullptr;
 
     // Find the superblock active at the end of the poll:
     for (; pindex; pindex = pindex->pprev) {
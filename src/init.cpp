@@ -19,7 +19,9 @@
 #include "gridcoin/gridcoin.h"
 #include "gridcoin/upgrade.h"
 #include "miner.h"
+#include "node/blockindexsnapshot.h"
 #include "node/blockstorage.h"
+#include "validation.h"
 #include <util/syserror.h>
 
 #include <boost/algorithm/string/predicate.hpp>
@@ -58,6 +60,9 @@ std::unique_ptr<BanMan> g_banman;
 
 static std::unique_ptr<ECCVerifyHandle> globalVerifyHandle;
 
+//! Set when the block index loads completely. Only then may shutdown save it.
+static bool fBlockIndexLoaded = false;
+
 /**
  * The PID file facilities.
  */
@@ -144,10 +149,17 @@ void Shutdown(void* parg)
         // Interrupt all sleeping threads.
         LogPrintf("INFO: %s: Interrupting sleeping threads.", __func__);
         g_thread_interrupt();
+        WakeStakeMiner();
 
         LogPrintf("INFO: %s: Stopping net (node) threads.", __func__);
         StopNode();
 
+        LogPrintf("INFO: %s: Stopping script verification threads.", __func__);
+        StopScriptCheckWorkerThreads();
+
+        LogPrintf("INFO: %s: Closing block file.", __func__);
+        CloseBlockFile();
+
         LogPrintf("INFO: %s: Final flush of wallet database and closing wallet database file.", __func__);
         bitdb.Flush(true);
 
@@ -158,6 +170,11 @@ void Shutdown(void* parg)
         // step because of a write lock on accrual/registry.dat.
         GRC::CloseResearcherRegistryFile();
 
+        if (fBlockIndexLoaded && gArgs.GetBoolArg("-blockindexsnapshot", DEFAULT_BLOCK_INDEX_SNAPSHOT)) {
+            LogPrintf("INFO: %s: Writing block index snapshot.", __func__);
+            WriteBlockIndexSnapshot(GetBlockIndexSnapshotPath());
+        }
+
         fs::remove(GetPidFile(gArgs));
         UnregisterWallet(pwalletMain);
         delete pwalletMain;
@@ -325,6 +342,14 @@ void SetupServerArgs()
                                                     "(%d to %d, default: %d)",
                                                     nMinDbCache, nMaxTxIndexCache, nDefaultDbCache),
                    ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
+    argsman.AddArg("-txindexreadcache=<n>", strprintf("Set the size of the in-memory cache of decoded txindex records in"
+                                                      " megabytes (%d to %d, default: %d)",
+                                                      nMinDbCache, nMaxDbCache, nDefaultTxIndexReadCache),
+                   ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
+    argsman.AddArg("-par=<n>", strprintf("Set the number of script verification threads (%d to %d, 0 = auto, <0 = leave"
+                                         " that many cores free, default: %d)",
+                                         -GetNumCores(), MAX_SCRIPTCHECK_THREADS, DEFAULT_SCRIPTCHECK_THREADS),
+                   ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     argsman.AddArg("-dblogsize=<n>", "Set database disk log size in megabytes (default: 100)",
                    ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     argsman.AddArg("-synctime", "Sync time with other nodes. Disable if time on your system is precise e.g. syncing with"
@@ -380,6 +405,10 @@ void SetupServerArgs()
                    ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     argsman.AddArg("-reindex", "Rebuild chain state and block index from the blk*.dat files on disk",
                    ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
+    argsman.AddArg("-blockindexsnapshot", strprintf("Save the block index to a snapshot file at shutdown to load it"
+                                                    " faster at the next startup (default: %u)",
+                                                    DEFAULT_BLOCK_INDEX_SNAPSHOT),
+                   ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     argsman.AddArg("-settings=<file>", strprintf("Specify path to dynamic settings data file. Can be disabled with"
                                                  " -nosettings. File is written at runtime and not meant to be edited by"
                                                  " users (use %s instead for custom settings). Relative paths will be"
@@ -481,7 +510,11 @@ void SetupServerArgs()
                    ArgsManager::ALLOW_ANY, OptionsCategory::WALLET);
     argsman.AddArg("-enableaccounts", "DEPRECATED: Enable accounting functionality (default: 0)",
                    ArgsManager::ALLOW_ANY, OptionsCategory::WALLET);
-    argsman.AddArg("-maxsigcachesize=<n>", "Set maximum size for signature cache (default: 50000)",
+    argsman.AddArg("-maxsigcachemib=<n>", strprintf("Limit size of signature cache to <n> MiB (default: %u)",
+                                                    DEFAULT_MAX_SIG_CACHE_SIZE),
+                   ArgsManager::ALLOW_ANY, OptionsCategory::WALLET);
+    argsman.AddArg("-maxsigcachesize=<n>", "DEPRECATED: Set maximum number of entries in the signature cache. "
+                                           "Use -maxsigcachemib instead.",
                    ArgsManager::ALLOW_ANY, OptionsCategory::WALLET);
     argsman.AddArg("-contractchangetoinputaddress", "Change from a contract transaction is returned to an input address "
                                                     "rather than creating a new change address (default: 0)",
@@ -534,6 +567,9 @@ void SetupServerArgs()
                    ArgsManager::ALLOW_ANY, OptionsCategory::CONNECTION);
     argsman.AddArg("-maxsendbuffer=<n>", "Maximum per-connection send buffer, <n>*1000 bytes (default: 1000)",
                    ArgsManager::ALLOW_ANY, OptionsCategory::CONNECTION);
+    argsman.AddArg("-socketevents=<mode>", strprintf("Wait for network socket events with <mode>: %s (default: %s)",
+                                                     Join(GetSocketEventsModes(), ", "), DEFAULT_SOCKET_EVENTS),
+                   ArgsManager::ALLOW_ANY, OptionsCategory::CONNECTION);
 #ifdef USE_UPNP
 #if USE_UPNP
     argsman.AddArg("-upnp", "Use UPnP to map the listening port (default: 1 when listening and no -proxy)",
@@ -1021,6 +1057,31 @@ bool AppInit2(ThreadHandlerPtr threads)
         }
     }
 
+    if (gArgs.IsArgSet("-maxsigcachesize")) {
+        InitWarning(_("Warning: -maxsigcachesize is deprecated and counts signature cache entries. "
+                      "Use -maxsigcachemib to set the size of the cache in MiB."));
+    }
+
+    InitSignatureCache();
+
+    int script_threads = gArgs.GetArg("-par", DEFAULT_SCRIPTCHECK_THREADS);
+    if (script_threads <= 0) {
+        // -par=0 means autodetect (number of cores - 1 script threads)
+        // -par=-n means "leave n cores free" (number of cores - n - 1 script threads)
+        script_threads += GetNumCores();
+    }
+
+    // Subtract 1 because the main thread counts towards the par threads.
+    script_threads = std::max(script_threads - 1, 0);
+
+    // Number of script-checking threads <= MAX_SCRIPTCHECK_THREADS
+    script_threads = std::min(script_threads, MAX_SCRIPTCHECK_THREADS);
+
+    LogPrintf("Script verification uses %d additional threads", script_threads);
+    if (script_threads >= 1) {
+        StartScriptCheckWorkerThreads(script_threads);
+    }
+
     // ********************************************************* Step 5: verify database integrity
 
     uiInterface.InitMessage(_("Verifying database integrity..."));
@@ -1063,6 +1124,12 @@ bool AppInit2(ThreadHandlerPtr threads)
 
     // ********************************************************* Step 6: network initialization
 
+    const std::vector<std::string> socket_events_modes = GetSocketEventsModes();
+    const std::string socket_events = gArgs.GetArg("-socketevents", DEFAULT_SOCKET_EVENTS);
+    if (std::find(socket_events_modes.begin(), socket_events_modes.end(), socket_events) == socket_events_modes.end()) {
+        return InitError(strprintf(_("Unsupported -socketevents mode: '%s'"), socket_events));
+    }
+
     if (gArgs.GetArgs("-onlynet").size()) {
         std::set<enum Network> nets;
         for (auto const& snet : gArgs.GetArgs("-onlynet"))
@@ -1214,6 +1281,8 @@ bool AppInit2(ThreadHandlerPtr threads)
         return false;
     }
 
+    fBlockIndexLoaded = true;
+
     g_timer.GetTimes("Finished loading block chain", "init");
 
     if (gArgs.GetBoolArg("-printblockindex") || gArgs.GetBoolArg("-printblocktree"))
@@ -1446,6 +1515,7 @@ bool AppInit2(ThreadHandlerPtr threads)
     if (LogInstance().WillLogCategory(BCLog::LogFlags::VERBOSE))
     {
         LogPrintf("mapBlockIndex.size() = %" PRIszu,   mapBlockIndex.size());
+        LogPrintf("mapBlockIndex.MemoryUsage() = %" PRIszu, mapBlockIndex.MemoryUsage());
         LogPrintf("nBestHeight = %d",            nBestHeight);
 
         // So Clang doesn't complain, even though we are essentially single-threaded here.
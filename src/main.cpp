@@ -14,6 +14,7 @@
 #include "checkpoints.h"
 #include "txdb.h"
 #include "init.h"
+#include "miner.h"
 #include "node/ui_interface.h"
 #include "gridcoin/beacon.h"
 #include "gridcoin/claim.h"
@@ -33,6 +34,7 @@
 #include "gridcoin/support/xml.h"
 #include "gridcoin/tally.h"
 #include "gridcoin/tx_message.h"
+#include "node/blockdownload.h"
 #include "node/blockstorage.h"
 #include "policy/fees.h"
 #include "policy/policy.h"
@@ -71,6 +73,8 @@ extern int64_t GetCoinYearReward(int64_t nTime);
 namespace GRC {
 BlockIndexPool::Pool<CBlockIndex> BlockIndexPool::m_block_index_pool;
 BlockIndexPool::Pool<ResearcherContext> BlockIndexPool::m_researcher_context_pool;
+BlockIndexPool::Pool<BlockIndexColdData> BlockIndexPool::m_cold_data_pool;
+BlockIndexPool::Pool<uint256> BlockIndexPool::m_block_hash_pool;
 }
 
 BlockMap mapBlockIndex;
@@ -86,9 +90,11 @@ int nBestHeight = -1;
 
 uint256 hashBestChain;
 CBlockIndex* pindexBest = nullptr;
+CChain g_active_chain;
 std::atomic<int64_t> g_previous_block_time;
 std::atomic<int64_t> g_nTimeBestReceived;
 std::atomic<bool> g_reorg_in_progress = false;
+std::atomic<bool> g_importing_blocks = false;
 CMedianFilter<int> cPeerBlockCounts(5, 0); // Amount of blocks that other nodes claim to have
 
 
@@ -769,6 +775,10 @@ int GetNumBlocksOfPeers()
 
 bool IsInitialBlockDownload()
 {
+    // A bulk import defers syncs and wallet updates like a download does:
+    if (g_importing_blocks)
+        return true;
+
     LOCK(cs_main);
     if ((pindexBest == nullptr || nBestHeight < GetNumBlocksOfPeers()) && nBestHeight < 1185000)
         return true;
@@ -955,7 +965,7 @@ bool DisconnectBlocksBatch(CTxDB& txdb, list<CTransaction>& vResurrect, unsigned
                 vResurrect.push_front(tx);
 
         // TODO: Implement flag in CBlockIndex for mrcs?
-        if (pindexBest->IsUserCPID() || !pindexBest->m_mrc_researchers.empty()) {
+        if (pindexBest->IsUserCPID() || !pindexBest->MRCResearchers().empty()) {
             // The user has no longer staked this block.
             GRC::Tally::ForgetRewardBlock(pindexBest);
         }
@@ -1009,6 +1019,7 @@ bool DisconnectBlocksBatch(CTxDB& txdb, list<CTransaction>& vResurrect, unsigned
         // New best block
         cnt_dis++;
         pindexBest = pindexBest->pprev;
+        g_active_chain.SetTip(pindexBest);
         hashBestChain = pindexBest->GetBlockHash();
         nBestHeight = pindexBest->nHeight;
         g_chain_trust.SetBest(pindexBest);
@@ -1063,19 +1074,15 @@ EXCLUSIVE_LOCKS_REQUIRED(cs_main)
     CBlockIndex* pcommon = nullptr;
 
     if (pindexGenesisBlock) {
-        pcommon = pindexNew;
-        // The trivial reorg that most often happens here is where pcommon IS pindexBest, which
-        // means effectively we are simply adding a new block to the end of the current chain.
-        // Notice the logic of the while statement allows one traversal in that case... When
-        // pcommon = pindexNew then pcommon->pnext will be nullptr. It will also satisfy
-        // pcommon != pindexBest. Then the pointer moves back one block, which in the trivial
-        // case will be pindexBest and the while loop ends with pcommon = pindexBest.
-        while (pcommon->pnext == nullptr && pcommon != pindexBest) {
-            pcommon = pcommon->pprev;
+        // The trivial reorg that most often happens here is where pindexNew
+        // simply extends the current chain, and the fork point is pindexBest.
+        // Otherwise, the skip list pointers take us to the height of the tip
+        // in a logarithmic number of steps before we walk back to the fork:
+        //
+        pcommon = g_active_chain.FindFork(pindexNew);
 
-            if (!pcommon) {
-                return error("%s: unable to find fork root", __func__);
-            }
+        if (!pcommon) {
+            return error("%s: unable to find fork root", __func__);
         }
 
         // Blocks version 11+ do not use the legacy tally system triggered by
@@ -1243,6 +1250,7 @@ EXCLUSIVE_LOCKS_REQUIRED(cs_main)
         // update best block
         hashBestChain = hash;
         pindexBest = pindex;
+        g_active_chain.SetTip(pindexBest);
         nBestHeight = pindexBest->nHeight;
         g_chain_trust.SetBest(pindexBest);
         cnt_con++;
@@ -1335,9 +1343,157 @@ bool SetBestChain(CTxDB& txdb, CBlock &blockNew, CBlockIndex* pindexNew) EXCLUSI
         pindexNew->GetBlockTime(),
         blockNew.nBits);
 
+    // A stake miner waiting for a future time slot needs to search on the new tip:
+    WakeStakeMiner();
+
     return GridcoinServices();
 }
 
+void CChain::SetTip(CBlockIndex* pindex)
+{
+    if (pindex == nullptr) {
+        vChain.clear();
+        vTimeMax.clear();
+        return;
+    }
+
+    vChain.resize(pindex->nHeight + 1);
+    vTimeMax.resize(pindex->nHeight + 1);
+
+    int nFirstChanged = pindex->nHeight;
+
+    while (pindex && vChain[pindex->nHeight] != pindex) {
+        vChain[pindex->nHeight] = pindex;
+        nFirstChanged = pindex->nHeight;
+        pindex = pindex->pprev;
+    }
+
+    for (size_t nHeight = nFirstChanged; nHeight < vChain.size(); nHeight++) {
+        const unsigned int nTimePrev = nHeight > 0 ? vTimeMax[nHeight - 1] : 0;
+        vTimeMax[nHeight] = std::max(nTimePrev, vChain[nHeight]->nTime);
+    }
+}
+
+CBlockIndex* CChain::FindEarliestAtLeast(int64_t nTime, int nHeight) const
+{
+    if (nHeight < 0) {
+        nHeight = 0;
+    }
+
+    if (nHeight >= (int)vChain.size()) {
+        return nullptr;
+    }
+
+    // No block before the first one with a maximum time at or above nTime
+    // can match, and the first match is usually that block itself:
+    auto lower = std::lower_bound(
+        vTimeMax.begin() + nHeight,
+        vTimeMax.end(),
+        nTime,
+        [](unsigned int nTimeMax, int64_t nTime) { return (int64_t)nTimeMax < nTime; });
+
+    for (auto it = lower; it != vTimeMax.end(); ++it) {
+        CBlockIndex* pindex = vChain[it - vTimeMax.begin()];
+
+        if ((int64_t)pindex->nTime >= nTime) {
+            return pindex;
+        }
+    }
+
+    return nullptr;
+}
+
+CBlockIndex* CChain::FindFork(const CBlockIndex* pindex) const
+{
+    if (pindex == nullptr) {
+        return nullptr;
+    }
+
+    if (pindex->nHeight > Height()) {
+        pindex = pindex->GetAncestor(Height());
+    }
+
+    while (pindex && !Contains(pindex)) {
+        pindex = pindex->pprev;
+    }
+
+    return pindex ? vChain[pindex->nHeight] : nullptr;
+}
+
+const CBlockIndex* LastCommonAncestor(const CBlockIndex* pa, const CBlockIndex* pb)
+{
+    if (pa->nHeight > pb->nHeight) {
+        pa = pa->GetAncestor(pb->nHeight);
+    } else if (pb->nHeight > pa->nHeight) {
+        pb = pb->GetAncestor(pa->nHeight);
+    }
+
+    while (pa && pb && pa != pb) {
+        pa = pa->pprev;
+        pb = pb->pprev;
+    }
+
+    return pa == pb ? pa : nullptr;
+}
+
+/** Turn the lowest '1' bit in the binary representation of a number into a '0'. */
+static inline int InvertLowestOne(int n) { return n & (n - 1); }
+
+/** Compute what height to jump back to with the CBlockIndex::pskip pointer. */
+static inline int GetSkipHeight(int height)
+{
+    if (height < 2) {
+        return 0;
+    }
+
+    // Determine which height to jump back to. Any number strictly lower than height is acceptable,
+    // but the following expression seems to perform well in simulations (max 110 steps to go back
+    // up to 2**18 blocks).
+    return (height & 1) ? InvertLowestOne(InvertLowestOne(height - 1)) + 1 : InvertLowestOne(height);
+}
+
+const CBlockIndex* CBlockIndex::GetAncestor(int height) const
+{
+    if (height > nHeight || height < 0) {
+        return nullptr;
+    }
+
+    const CBlockIndex* pindexWalk = this;
+    int heightWalk = nHeight;
+
+    while (heightWalk > height) {
+        int heightSkip = GetSkipHeight(heightWalk);
+        int heightSkipPrev = GetSkipHeight(heightWalk - 1);
+
+        if (pindexWalk->pskip != nullptr
+            && (heightSkip == height
+                || (heightSkip > height && !(heightSkipPrev < heightSkip - 2 && heightSkipPrev >= height))))
+        {
+            // Only follow pskip if pprev->pskip isn't better than pskip->pprev.
+            pindexWalk = pindexWalk->pskip;
+            heightWalk = heightSkip;
+        } else {
+            assert(pindexWalk->pprev);
+            pindexWalk = pindexWalk->pprev;
+            heightWalk--;
+        }
+    }
+
+    return pindexWalk;
+}
+
+CBlockIndex* CBlockIndex::GetAncestor(int height)
+{
+    return const_cast<CBlockIndex*>(static_cast<const CBlockIndex*>(this)->GetAncestor(height));
+}
+
+void CBlockIndex::BuildSkip()
+{
+    if (pprev) {
+        pskip = pprev->GetAncestor(GetSkipHeight(nHeight));
+    }
+}
+
 arith_uint256 CBlockIndex::GetBlockTrust() const
 {
     arith_uint256 bnTarget;
@@ -1548,6 +1704,18 @@ bool ProcessBlock(CNode* pfrom, CBlock* pblock, bool generated_by_me) EXCLUSIVE_
             delete pblockOrphan;
         }
         mapOrphanBlocksByPrev.erase(hashPrev);
+
+        // Headers-first sync holds the blocks that arrive ahead of their
+        // parents outside of the orphan pool:
+        if (std::optional<CBlock> held = g_block_download.TakeHeldBlock(hashPrev))
+        {
+            const uint256 hash_held = held->GetHash(true);
+
+            if (AcceptBlock(*held, generated_by_me))
+                vWorkQueue.push_back(hash_held);
+            else if (!mapBlockIndex.count(hash_held))
+                g_block_download.BlockInvalid(hash_held);
+        }
     }
 
     return true;
@@ -1571,7 +1739,7 @@ bool CheckDiskSpace(uint64_t nAdditionalBytes)
     return true;
 }
 
-static fs::path BlockFilePath(unsigned int nFile)
+fs::path BlockFilePath(unsigned int nFile)
 {
     string strBlockFn = strprintf("blk%04u.dat", nFile);
     return GetDataDir() / strBlockFn;
@@ -1595,29 +1763,6 @@ FILE* OpenBlockFile(unsigned int nFile, unsigned int nBlockPos, const char* pszM
     return file;
 }
 
-static unsigned int nCurrentBlockFile = 1;
-
-FILE* AppendBlockFile(unsigned int& nFileRet)
-{
-    nFileRet = 0;
-    while (true)
-    {
-        FILE* file = OpenBlockFile(nCurrentBlockFile, 0, "ab");
-        if (!file)
-            return nullptr;
-        if (fseek(file, 0, SEEK_END) != 0)
-            return nullptr;
-        // FAT32 file size max 4GB, fseek and ftell max 2GB, so we must stay under 2GB
-        if (ftell(file) < (long)(0x7F000000 - MAX_SIZE))
-        {
-            nFileRet = nCurrentBlockFile;
-            return file;
-        }
-        fclose(file);
-        nCurrentBlockFile++;
-    }
-}
-
 bool LoadBlockIndex(bool fAllowNew)
 {
     LOCK(cs_main);
@@ -1832,6 +1977,10 @@ bool LoadExternalBlockFile(FILE* fileIn, size_t file_size, unsigned int percent_
     int64_t nStart = GetTimeMillis();
     int nLoaded = 0;
 
+    if (!fileIn) {
+        return error("%s: no file to load", __func__);
+    }
+
     bool display_progress = (file_size > 0 && (percent_end - percent_start) > 0) ? true : false;
     unsigned int cached_percent_progress = 0;
 
@@ -1839,79 +1988,54 @@ bool LoadExternalBlockFile(FILE* fileIn, size_t file_size, unsigned int percent_
         uiInterface.InitMessage(_("Block file load progress ") + ToString(percent_start) + "%");
     }
 
-    {
-        LOCK(cs_main);
-        try {
-            CAutoFile blkdat(fileIn, SER_DISK, CLIENT_VERSION);
-            unsigned int nPos = 0;
-            while (nPos != (unsigned int)-1 && !fRequestShutdown)
-            {
-                unsigned char pchData[65536];
-                do {
-                    fseek(blkdat.Get(), nPos, SEEK_SET);
-                    int nRead = fread(pchData, 1, sizeof(pchData), blkdat.Get());
-                    if (nRead <= 8)
-                    {
-                        nPos = (unsigned int)-1;
-                        break;
-                    }
-                    void* nFind = memchr(pchData, Params().MessageStart()[0], nRead + 1 - CMessageHeader::MESSAGE_START_SIZE);
-                    if (nFind)
-                    {
-                        if (memcmp(nFind, Params().MessageStart(), CMessageHeader::MESSAGE_START_SIZE) == 0)
-                        {
-                            nPos += ((unsigned char*)nFind - pchData) + CMessageHeader::MESSAGE_START_SIZE;
-                            break;
-                        }
-                        nPos += ((unsigned char*)nFind - pchData) + 1;
-                    }
-                    else
-                        nPos += sizeof(pchData) - CMessageHeader::MESSAGE_START_SIZE + 1;
-                } while(!fRequestShutdown);
+    g_importing_blocks = true;
 
-                if (nPos == (unsigned int)-1) {
-                    if (display_progress) {
-                        uiInterface.InitMessage(_("Block file load progress ") + ToString(percent_end) + "%");
-                    }
+    try {
+        // Worker threads scan, deserialize, and check the blocks ahead. We only
+        // hold cs_main to connect each one:
+        ExternalBlockFileReader reader(fileIn, WITH_LOCK(cs_main, return nBestHeight));
 
-                    break;
-                }
+        CBlock block;
+        uint64_t nPos = 0;
 
-                fseek(blkdat.Get(), nPos, SEEK_SET);
-                unsigned int nSize;
-                blkdat >> nSize;
-                if (nSize > 0 && nSize <= MAX_BLOCK_SIZE)
-                {
-                    CBlock block;
-                    blkdat >> block;
-                    if (ProcessBlock(nullptr, &block, false)) {
-                        ++nLoaded;
+        while (!fRequestShutdown && reader.Next(block, nPos))
+        {
+            LOCK(cs_main);
 
-                        if (display_progress) {
-                            unsigned int percent_progress = percent_start + (uint64_t) nPos
-                                    * (uint64_t) (percent_end - percent_start) / file_size;
+            if (ProcessBlock(nullptr, &block, false)) {
+                ++nLoaded;
 
-                            if (percent_progress != cached_percent_progress) {
-                                uiInterface.InitMessage(_("Block file load progress ") + ToString(percent_progress) + "%");
-                                LogPrintf("INFO: %s: blocks/s: %f, progress: %u%%", __func__,
-                                          nLoaded / ((GetTimeMillis() - nStart) / 1000.0), percent_progress);
+                if (display_progress) {
+                    unsigned int percent_progress = percent_start + nPos
+                            * (uint64_t) (percent_end - percent_start) / file_size;
 
-                                cached_percent_progress = percent_progress;
-                            }
-                        } else if (nLoaded % 10000 == 0) {
-                            LogPrintf("Blocks/s: %f", nLoaded / ((GetTimeMillis() - nStart) / 1000.0));
-                        }
+                    if (percent_progress != cached_percent_progress) {
+                        uiInterface.InitMessage(_("Block file load progress ") + ToString(percent_progress) + "%");
+                        LogPrintf("INFO: %s: blocks/s: %f, progress: %u%%", __func__,
+                                  nLoaded / ((GetTimeMillis() - nStart) / 1000.0), percent_progress);
 
-                        nPos += 4 + nSize;
+                        cached_percent_progress = percent_progress;
                     }
+                } else if (nLoaded % 10000 == 0) {
+                    LogPrintf("Blocks/s: %f", nLoaded / ((GetTimeMillis() - nStart) / 1000.0));
                 }
             }
         }
-        catch (std::exception &e) {
-            LogPrintf("%s() : Deserialize or I/O error caught during load",
-                   __PRETTY_FUNCTION__);
+
+        if (display_progress && !fRequestShutdown) {
+            uiInterface.InitMessage(_("Block file load progress ") + ToString(percent_end) + "%");
         }
     }
+    catch (std::exception &e) {
+        LogPrintf("%s() : Deserialize or I/O error caught during load",
+               __PRETTY_FUNCTION__);
+    }
+
+    g_importing_blocks = false;
+
+    // Sync the blocks imported since the last periodic sync:
+    CloseBlockFile();
+
     LogPrintf("Loaded %i blocks from external file in %" PRId64 "ms", nLoaded, GetTimeMillis() - nStart);
     return nLoaded > 0;
 }
@@ -2125,16 +2249,8 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
         }
 
 
-        // Ask the first connected node for block updates
-        static int nAskedForBlocks = 0;
-        if (!pfrom->fClient && !pfrom->fOneShot &&
-            (pfrom->nStartingHeight > (nBestHeight - 144)) &&
-             (nAskedForBlocks < 1 || (vNodes.size() <= 1 && nAskedForBlocks < 1)))
-        {
-            nAskedForBlocks++;
-            pfrom->PushGetBlocks(pindexBest, uint256());
-            LogPrint(BCLog::LogFlags::NET, "Asked For blocks.");
-        }
+        // SendMessages() asks a peer that is ahead of us for headers and then
+        // requests the blocks in parallel from all peers.
 
         // Relay alerts
         {
@@ -2502,7 +2618,7 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
         }
 
         vector<CBlockHeader> vHeaders;
-        int nLimit = 1000;
+        int nLimit = MAX_HEADERS_RESULTS;
         LogPrintf("getheaders %d to %s", (pindex ? pindex->nHeight : -1), hashStop.ToString().substr(0,20));
         for (; pindex; pindex = pindex->pnext)
         {
@@ -2512,6 +2628,45 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
         }
         pfrom->PushMessage(NetMsgType::HEADERS, vHeaders);
     }
+    else if (strCommand == NetMsgType::HEADERS)
+    {
+        vector<CBlockHeader> vHeaders;
+        vRecv >> vHeaders;
+
+        if (vHeaders.size() > MAX_HEADERS_RESULTS)
+        {
+            pfrom->Misbehaving(20);
+            return error("message headers size() = %" PRIszu "", vHeaders.size());
+        }
+
+        LOCK(cs_main);
+
+        const CBlockIndex* pindexPrev = nullptr;
+        if (!vHeaders.empty())
+        {
+            BlockMap::iterator mi = mapBlockIndex.find(vHeaders.front().hashPrevBlock);
+            if (mi != mapBlockIndex.end())
+                pindexPrev = mi->second;
+        }
+
+        CBlockLocator locator;
+
+        switch (g_block_download.ReceiveHeaders(pfrom->GetId(), vHeaders, pindexPrev, GetAdjustedTime(), locator))
+        {
+            case BlockDownloadManager::HeadersStatus::CONTINUE:
+                pfrom->PushMessage(NetMsgType::GETHEADERS, locator, uint256());
+                break;
+            case BlockDownloadManager::HeadersStatus::DONE:
+                LogPrint(BCLog::LogFlags::NET, "header sync with peer=%d done at height %d",
+                         pfrom->GetId(), g_block_download.GetHeaderHeight());
+                break;
+            case BlockDownloadManager::HeadersStatus::INVALID:
+                pfrom->Misbehaving(20);
+                return error("invalid headers from peer=%d", pfrom->GetId());
+            case BlockDownloadManager::HeadersStatus::IGNORED:
+                break;
+        }
+    }
     else if (strCommand == NetMsgType::TX)
     {
         vector<uint256> vWorkQueue;
@@ -2595,11 +2750,59 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
 
         LOCK(cs_main);
 
-        if (ProcessBlock(pfrom, &block, false))
+        // Headers-first sync downloads a window of blocks from several peers,
+        // so they can arrive before their parents. Hold those until the parent
+        // connects rather than treating them as orphans:
+        const BlockDownloadManager::BlockStatus status = g_block_download.BlockReceived(pfrom->GetId(), hashBlock, pindexBest);
+        const bool fRequested = status == BlockDownloadManager::BlockStatus::REQUESTED;
+        const bool fMissingParent = !mapBlockIndex.count(block.hashPrevBlock) && !mapBlockIndex.count(hashBlock);
+
+        if (fMissingParent && fRequested)
+        {
+            if (!CheckBlock(block, pindexBest->nHeight + 1))
+            {
+                g_block_download.BlockInvalid(hashBlock);
+            }
+            else if (block.IsProofOfStake() && g_seen_stakes.ContainsOrphan(block.vtx[1]))
+            {
+                // The same duplicate stake check that ProcessBlock() applies
+                // to orphans:
+                g_block_download.BlockInvalid(hashBlock);
+                return error("%s: ignored duplicate proof-of-stake for held block %s", __func__, hashBlock.ToString());
+            }
+            else
+            {
+                g_block_download.HoldBlock(std::move(block));
+                return true;
+            }
+        }
+        else if (fMissingParent && status == BlockDownloadManager::BlockStatus::UNREQUESTED)
+        {
+            // Only the blocks that we asked a peer for may wait for their
+            // parents, so that a peer cannot fill memory with blocks far ahead
+            // of the tip. Honest peers send these too: a block that arrives
+            // after its request timed out, or one fetched by getdata after an
+            // inv. Drop it without penalty. The download requests it again:
+            LogPrint(BCLog::LogFlags::NET, "ignoring unrequested block %s from peer=%d during header sync",
+                     hashBlock.ToString(), pfrom->GetId());
+            return true;
+        }
+        else if (fMissingParent && g_block_download.IsDownloading())
+        {
+            // The block download will get to it:
+            LogPrint(BCLog::LogFlags::NET, "ignoring unrequested block %s during header sync", hashBlock.ToString());
+            return true;
+        }
+        else if (ProcessBlock(pfrom, &block, false))
         {
             mapAlreadyAskedFor.erase(inv);
             pfrom->nTrust++;
         }
+        else if (fRequested && !mapBlockIndex.count(hashBlock))
+        {
+            g_block_download.BlockInvalid(hashBlock);
+        }
+
         if (block.nDoS)
         {
                 pfrom->Misbehaving(block.nDoS);
@@ -2772,7 +2975,8 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
     return true;
 }
 
-// requires LOCK(cs_vRecvMsg)
+// Processes the complete messages received from a node. They are taken off of
+// vRecvMsg first, so that the socket thread can receive more in the meantime.
 bool ProcessMessages(CNode* pfrom)
 {
     //
@@ -2785,8 +2989,20 @@ bool ProcessMessages(CNode* pfrom)
     //
     bool fOk = true;
 
-    std::deque<CNetMessage>::iterator it = pfrom->vRecvMsg.begin();
-    while (!pfrom->fDisconnect && it != pfrom->vRecvMsg.end()) {
+    std::deque<CNetMessage> vProcessMsg;
+    {
+        LOCK(pfrom->cs_vRecvMsg);
+        std::deque<CNetMessage>::iterator it = pfrom->vRecvMsg.begin();
+        while (it != pfrom->vRecvMsg.end() && it->complete())
+            it++;
+        vProcessMsg.insert(vProcessMsg.end(),
+                           std::make_move_iterator(pfrom->vRecvMsg.begin()),
+                           std::make_move_iterator(it));
+        pfrom->vRecvMsg.erase(pfrom->vRecvMsg.begin(), it);
+    }
+
+    std::deque<CNetMessage>::iterator it = vProcessMsg.begin();
+    while (!pfrom->fDisconnect && it != vProcessMsg.end()) {
         // Don't bother if send buffer is too full to respond anyway
         if (pfrom->nSendSize >= SendBufferSize())
             break;
@@ -2794,17 +3010,15 @@ bool ProcessMessages(CNode* pfrom)
         // get next message
         CNetMessage& msg = *it;
 
-        LogPrint(BCLog::LogFlags::NOISY, "ProcessMessages(message %u msgsz, %zu bytes, complete:%s)",
-                 msg.hdr.nMessageSize, msg.vRecv.size(),
-                 msg.complete() ? "Y" : "N");
-
-        // end, if an incomplete message is found
-        if (!msg.complete())
-            break;
+        LogPrint(BCLog::LogFlags::NOISY, "ProcessMessages(message %u msgsz, %zu bytes)",
+                 msg.hdr.nMessageSize, msg.vRecv.size());
 
         // at this point, any failure means we can delete the current message
         it++;
 
+        // A version message earlier in the batch may have changed it:
+        msg.SetVersion(pfrom->nRecvVersion);
+
         // Scan for message start
         if (memcmp(msg.hdr.pchMessageStart, Params().MessageStart(), CMessageHeader::MESSAGE_START_SIZE) != 0) {
             LogPrint(BCLog::LogFlags::NOISY, "PROCESSMESSAGE: INVALID MESSAGESTART");
@@ -2845,9 +3059,11 @@ bool ProcessMessages(CNode* pfrom)
 
         // Process message
         bool fRet = false;
+        const int64_t nProcessStart = GetTimeMicros();
         try
         {
             fRet = ProcessMessage(pfrom, strCommand, vRecv, msg.nTime);
+            g_message_latency.Record(strCommand, nProcessStart - msg.nTime, GetTimeMicros() - nProcessStart);
             if (fShutdown)
                 break;
         }
@@ -2880,9 +3096,15 @@ bool ProcessMessages(CNode* pfrom)
         }
     }
 
-    // In case the connection got shut down, its receive buffer was wiped
-    if (!pfrom->fDisconnect)
-        pfrom->vRecvMsg.erase(pfrom->vRecvMsg.begin(), it);
+    // Return the rest, ahead of any messages received meanwhile. In case the
+    // connection got shut down, its receive buffer was wiped:
+    if (it != vProcessMsg.end()) {
+        LOCK(pfrom->cs_vRecvMsg);
+        if (!pfrom->fDisconnect)
+            pfrom->vRecvMsg.insert(pfrom->vRecvMsg.begin(),
+                                   std::make_move_iterator(it),
+                                   std::make_move_iterator(vProcessMsg.end()));
+    }
 
     return fOk;
 }
@@ -3046,6 +3268,50 @@ bool SendMessages(CNode* pto, bool fSendTrickle)
     //
     vector<CInv> vGetData;
     int64_t nNow =  GetAdjustedTime() * 1000000;
+
+    // Headers-first sync: download the header chain from one peer that is
+    // ahead of us, and the blocks below it from every peer that has them:
+    if (!pto->fClient && !pto->fOneShot && !pto->fDisconnect)
+    {
+        CBlockLocator locator;
+
+        if (g_block_download.StartHeaderSync(pto->GetId(), pto->nStartingHeight, pindexBest, GetAdjustedTime(), locator))
+        {
+            LogPrint(BCLog::LogFlags::NET, "starting header sync with peer=%d at height %d",
+                     pto->GetId(), g_block_download.GetHeaderHeight());
+            pto->PushMessage(NetMsgType::GETHEADERS, locator, uint256());
+        }
+
+        bool fStalling = false;
+        bool fHeadersDropped = false;
+
+        for (const uint256& hash : g_block_download.RequestBlocks(
+                pto->GetId(), pto->nStartingHeight, pindexBest, GetAdjustedTime(), fStalling, fHeadersDropped))
+        {
+            LogPrint(BCLog::LogFlags::NOISY, "sending getdata: block %s", hash.ToString());
+            vGetData.push_back(CInv(MSG_BLOCK, hash));
+        }
+
+        if (fStalling)
+        {
+            LogPrintf("Peer=%d is stalling the block download, disconnecting", pto->GetId());
+            pto->fDisconnect = true;
+        }
+        else if (fHeadersDropped)
+        {
+            // No peer had the blocks of the header chain. Sync the usual way
+            // until the tip moves:
+            LogPrintf("Falling back to getblocks with peer=%d", pto->GetId());
+            pto->PushGetBlocks(pindexBest, uint256());
+        }
+
+        if (g_block_download.TakeBadHeaders(pto->GetId()))
+        {
+            LogPrintf("Peer=%d sent headers for blocks that no peer served", pto->GetId());
+            pto->Misbehaving(20);
+        }
+    }
+
     CTxDB txdb("r");
     while (!pto->mapAskFor.empty() && (*pto->mapAskFor.begin()).first <= nNow)
     {
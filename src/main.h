@@ -20,6 +20,7 @@
 #include "sync.h"
 #include "script.h"
 #include "scrypt.h"
+#include "span.h"
 #include "validation.h"
 
 #include <map>
@@ -71,7 +72,7 @@ struct BlockHasher
     size_t operator()(const uint256& hash) const { return hash.GetUint64(0); }
 };
 
-typedef std::unordered_map<uint256, CBlockIndex*, BlockHasher> BlockMap;
+typedef GRC::BlockIndexMap BlockMap;
 
 extern CScript COINBASE_FLAGS;
 extern CCriticalSection cs_main;
@@ -86,6 +87,7 @@ extern arith_uint256 nBestChainTrust;
 extern uint256 hashBestChain;
 extern CBlockIndex* pindexBest;
 extern std::atomic<bool> g_reorg_in_progress;
+extern std::atomic<bool> g_importing_blocks;
 extern const std::string strMessageMagic;
 extern CCriticalSection cs_setpwalletRegistered;
 extern std::set<CWallet*> setpwalletRegistered;
@@ -119,8 +121,8 @@ void SyncWithWallets(const CTransaction& tx, const CBlock* pblock = nullptr, boo
 void UpdatedTransaction(const uint256& hashTx);
 bool ProcessBlock(CNode* pfrom, CBlock* pblock, bool Generated_By_Me);
 bool CheckDiskSpace(uint64_t nAdditionalBytes=0);
+fs::path BlockFilePath(unsigned int nFile);
 FILE* OpenBlockFile(unsigned int nFile, unsigned int nBlockPos, const char* pszMode="rb");
-FILE* AppendBlockFile(unsigned int& nFileRet);
 bool LoadBlockIndex(bool fAllowNew=true);
 void PrintBlockTree();
 double CoinToDouble(double surrogate);
@@ -466,17 +468,22 @@ public:
 class CBlockIndex
 {
 public:
-    const uint256* phashBlock;
+    // Fields read while walking the chain. These fill the first 64 bytes of
+    // the object so that a walk touches as few cache lines as possible:
+    //
     CBlockIndex* pprev;
     CBlockIndex* pnext;
-    unsigned int nFile;
-    unsigned int nBlockPos;
-    int64_t nMoneySupply;
+    //! pointer to the index of some further predecessor of this block
+    CBlockIndex* pskip;
+    const uint256* phashBlock;
     GRC::ResearcherContext* m_researcher;
-    std::vector<GRC::ResearcherContext*> m_mrc_researchers;
+    //! contiguous run of MRC researcher contexts allocated from the pool
+    GRC::ResearcherContext* m_mrc_researchers;
     int nHeight;
-
     unsigned int nFlags;  // ppcoin: block index flags
+    unsigned int nTime;
+    uint32_t m_mrc_researchers_count;
+
     enum
     {
         BLOCK_PROOF_OF_STAKE = (1 << 0), // is proof-of-stake block
@@ -490,15 +497,17 @@ public:
         CONTRACT             = (1 << 6), // Block contains a contract
     };
 
+    int64_t nMoneySupply;
     uint64_t nStakeModifier; // hash modifier for proof-of-stake
-    uint256 hashProof;
+    unsigned int nFile;
+    unsigned int nBlockPos;
 
     // block header
     int nVersion;
-    unsigned int nTime;
     unsigned int nBits;
-    unsigned int nNonce;
-    uint256 hashMerkleRoot;
+
+    //! merkle root, proof hash, and nonce allocated from the pool on demand
+    GRC::BlockIndexColdData* m_cold;
 
     CBlockIndex()
     {
@@ -517,10 +526,10 @@ public:
         }
 
         nVersion       = block.nVersion;
-        hashMerkleRoot = block.hashMerkleRoot;
         nTime          = block.nTime;
         nBits          = block.nBits;
-        nNonce         = block.nNonce;
+        SetMerkleRoot(block.hashMerkleRoot);
+        SetNonce(block.nNonce);
     }
 
     void SetNull()
@@ -528,25 +537,25 @@ public:
         phashBlock = nullptr;
         pprev = nullptr;
         pnext = nullptr;
+        pskip = nullptr;
         nFile = 0;
         nBlockPos = 0;
         nHeight = 0;
         nMoneySupply = 0;
         nFlags = EMPTY_CPID;
         nStakeModifier = 0;
-        hashProof.SetNull();
 
         nVersion       = 0;
-        hashMerkleRoot.SetNull();
         nTime          = 0;
         nBits          = 0;
-        nNonce         = 0;
+        m_cold         = nullptr;
 
         // Note that the pointer entries are deleted, but not the memory allocations in the pool to which they
         // were allocated. I think this means that pool entries are leaked (orphaned) under reorgs.
         // TODO: Investigate this carefully as it could be a small memory leak source.
         m_researcher = nullptr;
-        m_mrc_researchers.clear();
+        m_mrc_researchers = nullptr;
+        m_mrc_researchers_count = 0;
     }
 
     CBlockHeader GetBlockHeader() const
@@ -555,13 +564,48 @@ public:
         block.nVersion       = nVersion;
         if (pprev)
             block.hashPrevBlock = pprev->GetBlockHash();
-        block.hashMerkleRoot = hashMerkleRoot;
+        block.hashMerkleRoot = GetMerkleRoot();
         block.nTime          = nTime;
         block.nBits          = nBits;
-        block.nNonce         = nNonce;
+        block.nNonce         = GetNonce();
         return block;
     }
 
+    uint256 GetMerkleRoot() const
+    {
+        return m_cold ? m_cold->m_merkle_root : uint256();
+    }
+
+    uint256 GetProofHash() const
+    {
+        return m_cold ? m_cold->m_proof_hash : uint256();
+    }
+
+    uint32_t GetNonce() const
+    {
+        return m_cold ? m_cold->m_nonce : 0;
+    }
+
+    void SetMerkleRoot(const uint256& merkle_root)
+    {
+        GetOrAllocateColdData().m_merkle_root = merkle_root;
+    }
+
+    void SetProofHash(const uint256& proof_hash)
+    {
+        GetOrAllocateColdData().m_proof_hash = proof_hash;
+    }
+
+    void SetNonce(const uint32_t nonce)
+    {
+        GetOrAllocateColdData().m_nonce = nonce;
+    }
+
+    Span<const GRC::ResearcherContext> MRCResearchers() const
+    {
+        return Span<const GRC::ResearcherContext>(m_mrc_researchers, m_mrc_researchers_count);
+    }
+
     uint256 GetBlockHash() const
     {
         return *phashBlock;
@@ -600,6 +644,13 @@ public:
         return pbegin[(pend - pbegin)/2];
     }
 
+    //! Build the skiplist pointer for this entry.
+    void BuildSkip();
+
+    //! Efficiently find an ancestor of this block.
+    CBlockIndex* GetAncestor(int height);
+    const CBlockIndex* GetAncestor(int height) const;
+
     bool IsProofOfWork() const
     {
         return !(nFlags & BLOCK_PROOF_OF_STAKE);
@@ -685,33 +736,48 @@ public:
     {
         if (const GRC::CpidOption cpid_option = mining_id.TryCpid()) {
             if (research_subsidy > 0) {
-                // Check for duplicate insert (the m_mrc_researchers is a vector not a map).
-                for (const auto& iter : m_mrc_researchers) {
-                    if (iter->m_cpid == *cpid_option) {
+                // Check for duplicate insert (the m_mrc_researchers is a span not a map).
+                for (const auto& iter : MRCResearchers()) {
+                    if (iter.m_cpid == *cpid_option) {
                         LogPrintf("WARNING: %s: Ignoring duplicate AddMRCResearcherContext for cpid %s, research_subsidy "
                                   "%s",
                                   __func__,
                                   cpid_option->ToString(),
-                                  FormatMoney(iter->m_research_subsidy)
+                                  FormatMoney(iter.m_research_subsidy)
                                   );
 
                         return;
                     }
                 }
 
-                GRC::ResearcherContext* mrc_researcher = GRC::BlockIndexPool::GetNextResearcherContext();
+                GRC::ResearcherContext mrc_researcher;
 
-                mrc_researcher->m_cpid = *cpid_option;
-                mrc_researcher->m_research_subsidy = research_subsidy;
-                mrc_researcher->m_magnitude = magnitude;
+                mrc_researcher.m_cpid = *cpid_option;
+                mrc_researcher.m_research_subsidy = research_subsidy;
+                mrc_researcher.m_magnitude = magnitude;
 
-                m_mrc_researchers.push_back(mrc_researcher);
+                AppendMRCResearcherContext(mrc_researcher);
 
                 return;
             }
         }
     }
 
+    void SetMRCResearcherContexts(const std::vector<GRC::ResearcherContext>& mrc_researchers)
+    {
+        if (mrc_researchers.empty()) {
+            m_mrc_researchers = nullptr;
+            m_mrc_researchers_count = 0;
+
+            return;
+        }
+
+        m_mrc_researchers = GRC::BlockIndexPool::GetNextResearcherContexts(mrc_researchers.size());
+        m_mrc_researchers_count = mrc_researchers.size();
+
+        std::copy(mrc_researchers.begin(), mrc_researchers.end(), m_mrc_researchers);
+    }
+
     GRC::MiningId GetMiningId() const
     {
         if (m_researcher)
@@ -736,8 +802,8 @@ public:
     {
         int64_t mrc_subsidy = 0;
 
-        for (const auto& mrc_researcher : m_mrc_researchers) {
-            mrc_subsidy += mrc_researcher->m_research_subsidy;
+        for (const auto& mrc_researcher : MRCResearchers()) {
+            mrc_subsidy += mrc_researcher.m_research_subsidy;
         }
 
         return mrc_subsidy;
@@ -779,8 +845,8 @@ public:
             FormatMoney(nMoneySupply),
             GeneratedStakeModifier() ? "MOD" : "-", GetStakeEntropyBit(), IsProofOfStake()? "PoS" : "PoW",
             nStakeModifier,
-            hashProof.ToString(),
-            hashMerkleRoot.ToString(),
+            GetProofHash().ToString(),
+            GetMerkleRoot().ToString(),
             GetBlockHash().ToString());
     }
 
@@ -788,6 +854,36 @@ public:
     {
         LogPrintf("%s", ToString());
     }
+
+protected:
+    GRC::BlockIndexColdData& GetOrAllocateColdData()
+    {
+        if (!m_cold) {
+            m_cold = GRC::BlockIndexPool::GetNextColdData();
+            *m_cold = GRC::BlockIndexColdData();
+        }
+
+        return *m_cold;
+    }
+
+    //!
+    //! \brief Copy the MRC researcher contexts to a new run in the pool with
+    //! room for one more context and append the supplied context.
+    //!
+    //! Blocks contain few MRC payments, so we favor compact storage over the
+    //! cost of copying. Like other discarded pool objects, the old run stays
+    //! allocated.
+    //!
+    void AppendMRCResearcherContext(const GRC::ResearcherContext& mrc_researcher)
+    {
+        GRC::ResearcherContext* run = GRC::BlockIndexPool::GetNextResearcherContexts(m_mrc_researchers_count + 1);
+
+        std::copy(m_mrc_researchers, m_mrc_researchers + m_mrc_researchers_count, run);
+        run[m_mrc_researchers_count] = mrc_researcher;
+
+        m_mrc_researchers = run;
+        ++m_mrc_researchers_count;
+    }
 };
 
 
@@ -802,28 +898,31 @@ public:
     uint256 hashPrev;
     uint256 hashNext;
 
+    // The in-memory block index stores these in the cold data pool:
+    uint256 hashProof;
+    uint256 hashMerkleRoot;
+    unsigned int nNonce;
+
     CDiskBlockIndex()
     {
         hashPrev.SetNull();
         hashNext.SetNull();
         blockHash.SetNull();
+        hashProof.SetNull();
+        hashMerkleRoot.SetNull();
+        nNonce = 0;
     }
 
     explicit CDiskBlockIndex(CBlockIndex* pindex) : CBlockIndex(*pindex)
     {
         hashPrev = (pprev ? pprev->GetBlockHash() : uint256());
         hashNext = (pnext ? pnext->GetBlockHash() : uint256());
-    }
+        hashProof = pindex->GetProofHash();
+        hashMerkleRoot = pindex->GetMerkleRoot();
+        nNonce = pindex->GetNonce();
 
-    void AddMRCResearcherContextFromDisk(const GRC::ResearcherContext& mrc_disk)
-    {
-        GRC::ResearcherContext* mrc_researcher = GRC::BlockIndexPool::GetNextResearcherContext();
-
-        mrc_researcher->m_cpid = mrc_disk.m_cpid;
-        mrc_researcher->m_research_subsidy = mrc_disk.m_research_subsidy;
-        mrc_researcher->m_magnitude = mrc_disk.m_magnitude;
-
-        m_mrc_researchers.push_back(mrc_researcher);
+        // Do not share the cold data with the block index entry:
+        m_cold = nullptr;
     }
 
     ADD_SERIALIZE_METHODS;
@@ -912,18 +1011,15 @@ public:
         }
 
         if (nVersion >= 12) {
-            std::vector<GRC::ResearcherContext> m_mrc_researchers_disk;
-
-            for (const auto& mrc : m_mrc_researchers) {
-                m_mrc_researchers_disk.push_back(*mrc);
-            }
+            const Span<const GRC::ResearcherContext> mrc_researchers = MRCResearchers();
+            std::vector<GRC::ResearcherContext> m_mrc_researchers_disk(
+                mrc_researchers.begin(),
+                mrc_researchers.end());
 
             READWRITE(m_mrc_researchers_disk);
 
             if (ser_action.ForRead()) {
-                for (const auto& mrc : m_mrc_researchers_disk) {
-                    NCONST_PTR(this)->AddMRCResearcherContextFromDisk(mrc);
-                }
+                NCONST_PTR(this)->SetMRCResearcherContexts(m_mrc_researchers_disk);
             }
         }
     }
@@ -967,6 +1063,81 @@ public:
 
 
 
+/** An in-memory indexed chain of blocks. The active chain is kept in one of
+ * these so that the block at a given height is a constant-time lookup and the
+ * first block at or after a given time is a binary search instead of a walk
+ * along the pprev/pnext links. Access requires cs_main.
+ */
+class CChain
+{
+private:
+    std::vector<CBlockIndex*> vChain;
+
+    //! Highest block time of any block up to and including each height. Block
+    //! times are not strictly increasing, so the time searches use this as a
+    //! monotonic key.
+    std::vector<unsigned int> vTimeMax;
+
+public:
+    /** Returns the index entry for the genesis block of this chain, or nullptr if none. */
+    CBlockIndex* Genesis() const
+    {
+        return vChain.size() > 0 ? vChain[0] : nullptr;
+    }
+
+    /** Returns the index entry for the tip of this chain, or nullptr if none. */
+    CBlockIndex* Tip() const
+    {
+        return vChain.size() > 0 ? vChain[vChain.size() - 1] : nullptr;
+    }
+
+    /** Returns the index entry at a particular height in this chain, or nullptr if no such height exists. */
+    CBlockIndex* operator[](int nHeight) const
+    {
+        if (nHeight < 0 || nHeight >= (int)vChain.size())
+            return nullptr;
+        return vChain[nHeight];
+    }
+
+    /** Efficiently check whether a block is present in this chain. */
+    bool Contains(const CBlockIndex* pindex) const
+    {
+        return (*this)[pindex->nHeight] == pindex;
+    }
+
+    /** Find the successor of a block in this chain, or nullptr if the given index is not found or is the tip. */
+    CBlockIndex* Next(const CBlockIndex* pindex) const
+    {
+        if (Contains(pindex))
+            return (*this)[pindex->nHeight + 1];
+        else
+            return nullptr;
+    }
+
+    /** Return the maximal height in the chain. Is equal to chain.Tip() ? chain.Tip()->nHeight : -1. */
+    int Height() const
+    {
+        return vChain.size() - 1;
+    }
+
+    /** Set/initialize a chain with a given tip. Only the heights that differ
+     *  from the current chain are rewritten, so extending the chain by one
+     *  block or disconnecting the tip costs constant time. */
+    void SetTip(CBlockIndex* pindex);
+
+    /** Find the last common block between this chain and a block index entry. */
+    CBlockIndex* FindFork(const CBlockIndex* pindex) const;
+
+    /** Find the earliest block at or above nHeight with a time not earlier than nTime, or nullptr if none. */
+    CBlockIndex* FindEarliestAtLeast(int64_t nTime, int nHeight = 0) const;
+};
+
+/** The currently-connected chain of blocks. Mirrors the pprev/pnext links from the genesis block to pindexBest. */
+extern CChain g_active_chain;
+
+/** Find the last common ancestor of two blocks, or nullptr if they share none. */
+const CBlockIndex* LastCommonAncestor(const CBlockIndex* pa, const CBlockIndex* pb);
+
 /** Describes a place in the block chain to another node such that if the
  * other node doesn't have the same branch, it can find a recent common trunk.
  * The further back it is, the further before the fork it may be.
@@ -30,6 +30,7 @@
 
 #include <memory>
 #include <algorithm>
+#include <condition_variable>
 #include <tuple>
 
 using namespace std;
@@ -40,6 +41,12 @@ using namespace std;
 
 unsigned int nMinerSleep;
 
+// The main thread wakes the stake miner when the chain tip changes, so that a
+// miner waiting for a future stake time slot can search on the new tip:
+static Mutex g_miner_wake_mutex;
+static std::condition_variable g_miner_wake_cond;
+static bool g_miner_wake GUARDED_BY(g_miner_wake_mutex) = false;
+
 namespace {
 class COrphan
 {
@@ -653,47 +660,45 @@ bool CreateRestOfTheBlock(CBlock &block, CBlockIndex* pindexPrev,
 }
 
 
-bool CreateCoinStake(CBlock &blocknew, CKey &key,
-    vector<const CWalletTx*> &StakeInputs,
-    CWallet &wallet, CBlockIndex* pindexPrev) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+namespace {
+//!
+//! \brief Capture the chain tip, stake modifier, and stakeable wallet outputs
+//! for a kernel search.
+//!
+//! This is the only part of the search that needs cs_main. It records the miner
+//! status for a cycle that finds no stakeable coins.
+//!
+//! \param snapshot Receives the search inputs.
+//! \param blocknew Bare block to stake. Supplies the timestamp, version, and bits.
+//! \param wallet   Supplies the outputs to stake.
+//!
+//! \return \c false if the wallet has nothing to stake.
+//!
+bool TakeStakeSnapshot(
+    StakeSnapshot& snapshot,
+    const CBlock& blocknew,
+    const CWallet& wallet) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
 {
-    std::string function = __func__;
-    function += ": ";
-
-    int64_t CoinWeight;
-    CBigNum StakeKernelHash;
-    CTxDB txdb("r");
-    int64_t StakeWeightSum = 0;
-    double StakeValueSum = 0;
-    int64_t StakeWeightMin = MAX_MONEY;
-    int64_t StakeWeightMax = 0;
-    CTransaction &txnew = blocknew.vtx[1]; // second tx is coinstake
+    AssertLockHeld(cs_main);
 
-    bool kernel_found = false;
+    const unsigned int nTime = GRC::MaskStakeTime(blocknew.nTime);
 
-    //initialize the transaction
-    txnew.nTime = GRC::MaskStakeTime(blocknew.nTime);
-    txnew.vin.clear();
-    txnew.vout.clear();
-
-    // Choose coins to use
-    vector<pair<const CWalletTx*,unsigned int>> CoinsToStake;
     GRC::MinerStatus::ErrorFlags error_flag;
 
-    // This will be used to calculate the staking efficiency.
-    int64_t balance = 0;
-
-    if (!wallet.SelectCoinsForStaking(txnew.nTime, CoinsToStake, error_flag, balance, true))
+    // The wallet copies the stakeable outputs out of its stake index, so the
+    // snapshot does not refer to the wallet transactions:
+    if (!wallet.SelectCoinsForStaking(nTime, snapshot.m_candidates, error_flag, snapshot.m_balance, true,
+                                      &snapshot.m_next_maturity_time))
     {
         g_miner_status.UpdateLastSearch(
-            kernel_found,
-            txnew.nTime,
+            false,
+            nTime,
             blocknew.nVersion,
-            StakeWeightSum,
-            StakeValueSum,
+            0,
+            0,
             0, // This should be set to zero for an unsuccessful iteration due to no stakeable coins.
-            StakeWeightMax,
-            GRC::CalculateStakeWeightV8(balance));
+            0,
+            GRC::CalculateStakeWeightV8(snapshot.m_balance));
 
         g_miner_status.UpdateCurrentErrors(error_flag);
 
@@ -702,130 +707,367 @@ bool CreateCoinStake(CBlock &blocknew, CKey &key,
         return false;
     }
 
-    g_timer.GetTimes(function + "SelectCoinsForStaking", "miner");
-
-    LogPrint(BCLog::LogFlags::MINER, "CreateCoinStake: Staking nTime/16 = %d Bits = %u",
-             txnew.nTime/16, blocknew.nBits);
-
-    uint64_t StakeModifier = 0;
     int nHeight_mod = 0;
 
-    if (!GRC::FindStakeModifierRev(StakeModifier, pindexPrev, nHeight_mod)) return false;
+    if (!GRC::FindStakeModifierRev(snapshot.m_stake_modifier, snapshot.m_pindex_prev, nHeight_mod)) return false;
 
     LogPrint(BCLog::LogFlags::MISC, "FindStakeModifierRev(): pindex->nHeight = %i, "
                                     "pindex->nStakeModifier = %" PRId64,
-                                    nHeight_mod, StakeModifier);
+                                    nHeight_mod, snapshot.m_stake_modifier);
+
+    return true;
+}
+
+//!
+//! \brief Search the captured wallet outputs for a stake kernel that meets the
+//! target of the new block.
+//!
+//! The search works on the snapshot alone and runs without cs_main, so it does
+//! not stall block and transaction processing on wallets with many outputs.
+//!
+//! \param snapshot Search inputs captured by TakeStakeSnapshot().
+//! \param blocknew Bare block to stake. Supplies the timestamp, version, and bits.
+//!
+//! \return The output that solves the kernel, or nothing.
+//!
+const StakeCandidate* FindStakeKernel(const StakeSnapshot& snapshot, const CBlock& blocknew)
+{
+    const unsigned int nTime = GRC::MaskStakeTime(blocknew.nTime);
+
+    CBigNum StakeKernelHash;
+    int64_t StakeWeightSum = 0;
+    double StakeValueSum = 0;
+    int64_t StakeWeightMin = MAX_MONEY;
+    int64_t StakeWeightMax = 0;
+    const StakeCandidate* kernel = nullptr;
+
+    LogPrint(BCLog::LogFlags::MINER, "CreateCoinStake: Staking nTime/16 = %d Bits = %u",
+             nTime/16, blocknew.nBits);
 
-    for (const auto& pcoin : CoinsToStake)
+    // Hash the kernels of up to StakeKernelBatch::MAX_SIZE outputs at a time
+    // on the multi-way SHA256 backends, then check each against the target:
+    GRC::StakeKernelBatch batch(nTime, snapshot.m_stake_modifier);
+    uint256 hashes[GRC::StakeKernelBatch::MAX_SIZE];
+
+    for (size_t offset = 0; offset < snapshot.m_candidates.size() && !kernel; offset += batch.size())
     {
-        const CWalletTx &CoinTx = *pcoin.first; //transaction that produced this coin
-        unsigned int CoinTxN = pcoin.second; //index of this coin inside it
-
-        unsigned int block_time;
-
-        block_time = mapBlockIndex[CoinTx.hashBlock]->nTime;
-
-        StakeValueSum += CoinTx.vout[CoinTxN].nValue / (double) COIN;
-
-        CoinWeight = GRC::CalculateStakeWeightV8(CoinTx, CoinTxN);
-
-        StakeKernelHash.setuint256(GRC::CalculateStakeHashV8(block_time, CoinTx, CoinTxN, txnew.nTime, StakeModifier));
-
-        CBigNum StakeTarget;
-        StakeTarget.SetCompact(blocknew.nBits);
-        StakeTarget *= CoinWeight;
-        StakeWeightSum += CoinWeight;
-        StakeWeightMin = std::min(StakeWeightMin, CoinWeight);
-        StakeWeightMax = std::max(StakeWeightMax, CoinWeight);
-        double StakeKernelDiff = GRC::GetBlockDifficulty(StakeKernelHash.GetCompact())*CoinWeight;
-
-        LogPrint(BCLog::LogFlags::MINER,
-                 "CreateCoinStake: V%d Time %d, Bits %u, Weight %" PRId64 "\n"
-                 " Stk %72s\n"
-                 " Trg %72s\n"
-                 " Diff %0.7f of %0.7f",
-                 blocknew.nVersion,
-                 txnew.nTime,
-                 blocknew.nBits,
-                 CoinWeight,
-                 StakeKernelHash.GetHex(),
-                 StakeTarget.GetHex(),
-                 StakeKernelDiff,
-                 GRC::GetBlockDifficulty(blocknew.nBits));
-
-        if (StakeKernelHash <= StakeTarget)
+        batch.Clear();
+
+        for (size_t i = offset; i < snapshot.m_candidates.size() && !batch.full(); ++i)
+        {
+            const StakeCandidate& candidate = snapshot.m_candidates[i];
+
+            batch.Add(candidate.m_block_time, candidate.m_txid, candidate.m_n);
+        }
+
+        batch.Hash(hashes);
+
+        for (size_t i = 0; i < batch.size(); ++i)
         {
-            // Found a kernel
-            LogPrintf("CreateCoinStake: Found Kernel");
-            vector<valtype> vSolutions;
-            txnouttype whichType;
-            CScript scriptPubKeyOut;
-            CScript scriptPubKeyKernel;
-            scriptPubKeyKernel = CoinTx.vout[CoinTxN].scriptPubKey;
-
-            if (!Solver(scriptPubKeyKernel, whichType, vSolutions))
+            const StakeCandidate& candidate = snapshot.m_candidates[offset + i];
+            const int64_t CoinWeight = candidate.m_weight;
+
+            StakeValueSum += candidate.m_value / (double) COIN;
+
+            StakeKernelHash.setuint256(hashes[i]);
+
+            CBigNum StakeTarget;
+            StakeTarget.SetCompact(blocknew.nBits);
+            StakeTarget *= CoinWeight;
+            StakeWeightSum += CoinWeight;
+            StakeWeightMin = std::min(StakeWeightMin, CoinWeight);
+            StakeWeightMax = std::max(StakeWeightMax, CoinWeight);
+            double StakeKernelDiff = GRC::GetBlockDifficulty(StakeKernelHash.GetCompact())*CoinWeight;
+
+            LogPrint(BCLog::LogFlags::MINER,
+                     "CreateCoinStake: V%d Time %d, Bits %u, Weight %" PRId64 "\n"
+                     " Stk %72s\n"
+                     " Trg %72s\n"
+                     " Diff %0.7f of %0.7f",
+                     blocknew.nVersion,
+                     nTime,
+                     blocknew.nBits,
+                     CoinWeight,
+                     StakeKernelHash.GetHex(),
+                     StakeTarget.GetHex(),
+                     StakeKernelDiff,
+                     GRC::GetBlockDifficulty(blocknew.nBits));
+
+            if (StakeKernelHash <= StakeTarget)
             {
-                LogPrintf("CreateCoinStake: failed to parse kernel");
+                LogPrintf("CreateCoinStake: Found Kernel");
+                kernel = &candidate;
                 break;
             }
+        }
+    }
+
+    g_miner_status.UpdateLastSearch(
+        kernel != nullptr,
+        nTime,
+        blocknew.nVersion,
+        StakeWeightSum,
+        StakeValueSum,
+        StakeWeightMin,
+        StakeWeightMax,
+        GRC::CalculateStakeWeightV8(snapshot.m_balance));
+
+    return kernel;
+}
+
+//!
+//! \brief Sleep until the specified time or until WakeStakeMiner() reports a
+//! change to the chain or wallet.
+//!
+//! \param wake_time Adjusted time to wake up at.
+//!
+//! \return \c false if interrupted for shutdown.
+//!
+bool WaitForStakeSlot(const int64_t wake_time)
+{
+    WAIT_LOCK(g_miner_wake_mutex, lock);
+
+    while (!g_miner_wake && !g_thread_interrupt) {
+        const int64_t remaining = wake_time - GetAdjustedTime();
+
+        if (remaining <= 0) {
+            break;
+        }
+
+        g_miner_wake_cond.wait_for(lock, std::chrono::seconds(remaining));
+    }
+
+    g_miner_wake = false;
+
+    return !g_thread_interrupt;
+}
+
+//!
+//! \brief Sleep for the interval between miner cycles that do not wait for a
+//! stake time slot, or until WakeStakeMiner() reports a change.
+//!
+//! \param timeout Milliseconds to sleep for.
+//!
+//! \return \c false if interrupted for shutdown.
+//!
+bool WaitForMinerCycle(const unsigned int timeout)
+{
+    WAIT_LOCK(g_miner_wake_mutex, lock);
+
+    g_miner_wake_cond.wait_for(lock, std::chrono::milliseconds(timeout), [] {
+        return g_miner_wake || g_thread_interrupt;
+    });
+
+    g_miner_wake = false;
+
+    return !g_thread_interrupt;
+}
+} // anonymous namespace
+
+//!
+//! \brief Find the first stake time slot after the current one in which one of
+//! the captured outputs solves the kernel.
+//!
+//! Kernel hashes depend only on the masked timestamp and the stake modifier of
+//! the tip, so the miner can check the next few time slots in advance and sleep
+//! until the first one that meets the target instead of waking up to search on
+//! an interval.
+//!
+//! \param snapshot Search inputs captured by TakeStakeSnapshot().
+//! \param blocknew Bare block to stake. Supplies the timestamp and bits.
+//!
+//! An output that reaches the minimum stake age during the look-ahead window
+//! is not in the snapshot yet, so the search stops at the first slot in which
+//! it can stake for the miner to capture the outputs again.
+//!
+//! \return Start time of the slot with a kernel, or of the first slot after the
+//! look-ahead window or the first slot that a maturing output can stake in if
+//! none of the checked slots has one.
+//!
+int64_t FindNextStakeSlot(const StakeSnapshot& snapshot, const CBlock& blocknew)
+{
+    constexpr int64_t slot_length = GRC::STAKE_TIMESTAMP_MASK + 1;
+    const int64_t nTime = GRC::MaskStakeTime(blocknew.nTime);
+
+    int64_t end_time = nTime + (STAKE_LOOKAHEAD_SLOTS + 1) * slot_length;
+
+    if (snapshot.m_next_maturity_time > 0) {
+        end_time = std::min(end_time, GRC::MaskStakeTime(snapshot.m_next_maturity_time + GRC::STAKE_TIMESTAMP_MASK));
+    }
+
+    CBigNum StakeTarget;
+    StakeTarget.SetCompact(blocknew.nBits);
+
+    uint256 hashes[GRC::StakeKernelBatch::MAX_SIZE];
+    CBigNum StakeKernelHash;
+
+    for (int64_t slot_time = nTime + slot_length; slot_time < end_time; slot_time += slot_length)
+    {
+        GRC::StakeKernelBatch batch(slot_time, snapshot.m_stake_modifier);
+
+        for (size_t offset = 0; offset < snapshot.m_candidates.size(); offset += batch.size())
+        {
+            batch.Clear();
 
-            if (whichType == TX_PUBKEYHASH) // pay to address type
+            for (size_t i = offset; i < snapshot.m_candidates.size() && !batch.full(); ++i)
             {
-                // convert to pay to public key type
-                if (!wallet.GetKey(uint160(vSolutions[0]), key))
-                {
-                    LogPrintf("CreateCoinStake: failed to get key for kernel type = %d", whichType);
-                    break;  // unable to find corresponding public key
-                }
-                scriptPubKeyOut << key.GetPubKey() << OP_CHECKSIG;
+                const StakeCandidate& candidate = snapshot.m_candidates[i];
+
+                batch.Add(candidate.m_block_time, candidate.m_txid, candidate.m_n);
             }
-            else if (whichType == TX_PUBKEY)  // pay to public key type
+
+            batch.Hash(hashes);
+
+            for (size_t i = 0; i < batch.size(); ++i)
             {
-                valtype& vchPubKey = vSolutions[0];
-                if (!wallet.GetKey(Hash160(vchPubKey), key)
-                    || key.GetPubKey() != CPubKey(vchPubKey))
+                CBigNum CoinTarget = StakeTarget;
+                CoinTarget *= snapshot.m_candidates[offset + i].m_weight;
+                StakeKernelHash.setuint256(hashes[i]);
+
+                if (StakeKernelHash <= CoinTarget)
                 {
-                    LogPrintf("CreateCoinStake: failed to get key for kernel type = %d", whichType);
-                    break;  // unable to find corresponding public key
-                }
+                    LogPrint(BCLog::LogFlags::MINER, "%s: kernel found for time slot %" PRId64,
+                             __func__, slot_time);
 
-                scriptPubKeyOut = scriptPubKeyKernel;
-            }
-            else
-            {
-                LogPrintf("CreateCoinStake: no support for kernel type = %d", whichType);
-                break;  // only support pay to public key and pay to address
+                    return slot_time;
+                }
             }
+        }
+    }
 
-            txnew.vin.push_back(CTxIn(CoinTx.GetHash(), CoinTxN));
-            StakeInputs.push_back(pcoin.first);
+    return end_time;
+}
+
+void WakeStakeMiner()
+{
+    {
+        LOCK(g_miner_wake_mutex);
+        g_miner_wake = true;
+    }
+
+    g_miner_wake_cond.notify_one();
+}
+
+//!
+//! \brief Check that a kernel found in a snapshot still proves a new block.
+//!
+//! The kernel search runs without locks, so another block may arrive or the
+//! wallet may spend the kernel output before the miner stakes it.
+//!
+//! \param snapshot Search inputs captured by TakeStakeSnapshot().
+//! \param kernel   Output that solves the kernel.
+//! \param wallet   Wallet that owns the output.
+//!
+//! \return \c false if the chain tip changed or the output is spent or no
+//! longer in the main chain.
+//!
+bool IsStakeKernelCurrent(
+    const StakeSnapshot& snapshot,
+    const StakeCandidate& kernel,
+    const CWallet& wallet) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+{
+    AssertLockHeld(cs_main);
+    LOCK(wallet.cs_wallet);
 
-            int64_t nCredit = CoinTx.vout[CoinTxN].nValue;
+    // The kernel proves a block on top of the captured tip only:
+    if (pindexBest != snapshot.m_pindex_prev) {
+        LogPrintf("INFO: %s: chain tip changed during the kernel search", __func__);
+        return false;
+    }
 
-            txnew.vout.push_back(CTxOut(0, CScript())); // First Must be empty
-            txnew.vout.push_back(CTxOut(nCredit, scriptPubKeyOut));
+    const auto iter = wallet.mapWallet.find(kernel.m_txid);
 
-            LogPrintf("CreateCoinStake: added kernel type = %d credit = %f", whichType, CoinToDouble(nCredit));
+    if (iter == wallet.mapWallet.end()
+        || kernel.m_n >= iter->second.vout.size()
+        || iter->second.IsSpent(kernel.m_n)
+        || iter->second.GetDepthInMainChain() < 1)
+    {
+        LogPrintf("INFO: %s: kernel output spent or reorganized during the search", __func__);
+        return false;
+    }
 
-            kernel_found = true;
+    return true;
+}
 
-            break;
-        } // if (StakeKernelHash <= StakeTarget)
-    } // for (const auto& pcoin : CoinsToStake)
+//!
+//! \brief Create the coinstake transaction of a new block from a kernel found
+//! by FindStakeKernel() and checked by IsStakeKernelCurrent().
+//!
+bool CreateCoinStake(CBlock &blocknew, CKey &key,
+    vector<const CWalletTx*> &StakeInputs,
+    CWallet &wallet, const StakeCandidate& kernel) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+{
+    AssertLockHeld(cs_main);
+    LOCK(wallet.cs_wallet);
 
-    g_miner_status.UpdateLastSearch(
-        kernel_found,
-        txnew.nTime,
-        blocknew.nVersion,
-        StakeWeightSum,
-        StakeValueSum,
-        StakeWeightMin,
-        StakeWeightMax,
-        GRC::CalculateStakeWeightV8(balance));
+    CTransaction &txnew = blocknew.vtx[1]; // second tx is coinstake
 
-    g_timer.GetTimes(function + "stake UTXO loop", "miner");
+    //initialize the transaction
+    txnew.nTime = GRC::MaskStakeTime(blocknew.nTime);
+    txnew.vin.clear();
+    txnew.vout.clear();
+
+    const auto iter = wallet.mapWallet.find(kernel.m_txid);
+
+    if (iter == wallet.mapWallet.end()) {
+        LogPrintf("CreateCoinStake: kernel output not in the wallet");
+        return false;
+    }
+
+    const CWalletTx &CoinTx = iter->second; //transaction that produced this coin
+    unsigned int CoinTxN = kernel.m_n; //index of this coin inside it
+
+    vector<valtype> vSolutions;
+    txnouttype whichType;
+    CScript scriptPubKeyOut;
+    CScript scriptPubKeyKernel;
+    scriptPubKeyKernel = CoinTx.vout[CoinTxN].scriptPubKey;
+
+    if (!Solver(scriptPubKeyKernel, whichType, vSolutions))
+    {
+        LogPrintf("CreateCoinStake: failed to parse kernel");
+        return false;
+    }
+
+    if (whichType == TX_PUBKEYHASH) // pay to address type
+    {
+        // convert to pay to public key type
+        if (!wallet.GetKey(uint160(vSolutions[0]), key))
+        {
+            LogPrintf("CreateCoinStake: failed to get key for kernel type = %d", whichType);
+            return false;  // unable to find corresponding public key
+        }
+        scriptPubKeyOut << key.GetPubKey() << OP_CHECKSIG;
+    }
+    else if (whichType == TX_PUBKEY)  // pay to public key type
+    {
+        valtype& vchPubKey = vSolutions[0];
+        if (!wallet.GetKey(Hash160(vchPubKey), key)
+            || key.GetPubKey() != CPubKey(vchPubKey))
+        {
+            LogPrintf("CreateCoinStake: failed to get key for kernel type = %d", whichType);
+            return false;  // unable to find corresponding public key
+        }
+
+        scriptPubKeyOut = scriptPubKeyKernel;
+    }
+    else
+    {
+        LogPrintf("CreateCoinStake: no support for kernel type = %d", whichType);
+        return false;  // only support pay to public key and pay to address
+    }
+
+    txnew.vin.push_back(CTxIn(CoinTx.GetHash(), CoinTxN));
+    StakeInputs.push_back(&CoinTx);
+
+    int64_t nCredit = CoinTx.vout[CoinTxN].nValue;
+
+    txnew.vout.push_back(CTxOut(0, CScript())); // First Must be empty
+    txnew.vout.push_back(CTxOut(nCredit, scriptPubKeyOut));
 
-    return kernel_found;
+    LogPrintf("CreateCoinStake: added kernel type = %d credit = %f", whichType, CoinToDouble(nCredit));
+
+    return true;
 }
 
 void SplitCoinStakeOutput(CBlock &blocknew, int64_t &nReward, bool &fEnableStakeSplit, bool &fEnableSideStaking,
@@ -1410,6 +1652,10 @@ void StakeMiner(CWallet *pwallet)
     std::string function = __func__;
     function += ": ";
 
+    // Start time of the next stake time slot worth a search, or zero to search
+    // again after nMinerSleep:
+    int64_t next_slot_time = 0;
+
     while (!fShutdown)
     {
         // nMinStakeSplitValue and dEfficiency are out parameters.
@@ -1423,7 +1669,12 @@ void StakeMiner(CWallet *pwallet)
         if (fEnableSideStaking) vSideStakeAlloc = GetSideStakingStatusAndAlloc();
 
         // wait for next round
-        if (!MilliSleep(nMinerSleep)) return;
+        if (next_slot_time > 0) {
+            if (!WaitForStakeSlot(next_slot_time)) return;
+            next_slot_time = 0;
+        } else if (!WaitForMinerCycle(nMinerSleep)) {
+            return;
+        }
 
         g_timer.InitTimer("miner", LogInstance().WillLogCategory(BCLog::LogFlags::MISC));
 
@@ -1441,23 +1692,54 @@ void StakeMiner(CWallet *pwallet)
         CBlock StakeBlock;
         std::map<GRC::Cpid, std::pair<uint256, GRC::MRC>> mrc_map;
         std::map<GRC::Cpid, uint256> mrc_tx_map;
+        StakeSnapshot snapshot;
 
-        LOCK(cs_main);
+        // * Create a bare block and capture the state that the kernel search
+        // depends on. The search itself runs without cs_main:
+        {
+            LOCK(cs_main);
 
-        g_timer.GetTimes(function + "lock cs_main", "miner");
+            g_timer.GetTimes(function + "lock cs_main", "miner");
+
+            snapshot.m_pindex_prev = pindexBest;
+
+            // This transition code is for mandatory change from V11 to v12 block format (accommodates MRC).
+            if (!IsV12Enabled(snapshot.m_pindex_prev->nHeight + 1)) {
+                StakeBlock.nVersion = 11;
+            }
+            StakeBlock.nTime = GetAdjustedTime();
+            StakeBlock.nNonce = 0;
+            StakeBlock.nBits = GRC::GetNextTargetRequired(snapshot.m_pindex_prev);
+            StakeBlock.vtx.resize(2);
+
+            if (!TakeStakeSnapshot(snapshot, StakeBlock, *pwallet)) continue;
+        }
+
+        g_timer.GetTimes(function + "SelectCoinsForStaking", "miner");
 
-        CBlockIndex* pindexPrev = pindexBest;
+        const StakeCandidate* kernel = FindStakeKernel(snapshot, StakeBlock);
 
-        // * Create a bare block
+        g_timer.GetTimes(function + "stake UTXO loop", "miner");
 
-        // This transition code is for mandatory change from V11 to v12 block format (accommodates MRC).
-        if (!IsV12Enabled(pindexPrev->nHeight + 1)) {
-            StakeBlock.nVersion = 11;
+        if (!kernel) {
+            // Sleep until the first time slot in which an output solves the
+            // kernel, or until the end of the look-ahead window:
+            next_slot_time = FindNextStakeSlot(snapshot, StakeBlock);
+
+            g_timer.GetTimes(function + "stake look-ahead", "miner");
+
+            continue;
         }
-        StakeBlock.nTime = GetAdjustedTime();
-        StakeBlock.nNonce = 0;
-        StakeBlock.nBits = GRC::GetNextTargetRequired(pindexPrev);
-        StakeBlock.vtx.resize(2);
+
+        LOCK(cs_main);
+
+        g_timer.GetTimes(function + "lock cs_main", "miner");
+
+        // Discard the kernel if another block arrived or the wallet spent the
+        // output during the search:
+        if (!IsStakeKernelCurrent(snapshot, *kernel, *pwallet)) continue;
+
+        CBlockIndex* pindexPrev = snapshot.m_pindex_prev;
         //tx 0 is coin_base
         CTransaction &StakeTX = StakeBlock.vtx[1]; //tx 1 is coin_stake
 
@@ -1465,7 +1747,7 @@ void StakeMiner(CWallet *pwallet)
         CKey BlockKey;
         vector<const CWalletTx*> StakeInputs;
 
-        bool createcoinstake_success = CreateCoinStake(StakeBlock, BlockKey, StakeInputs, *pwallet, pindexPrev);
+        bool createcoinstake_success = CreateCoinStake(StakeBlock, BlockKey, StakeInputs, *pwallet, *kernel);
 
         g_timer.GetTimes(function + "CreateCoinStake", "miner");
 
@@ -8,6 +8,7 @@
 #define BITCOIN_MINER_H
 
 #include "main.h"
+#include "wallet/stakeindex.h"
 
 class CWallet;
 class CWalletTx;
@@ -16,6 +17,10 @@ typedef std::vector< std::pair<std::string, double> > SideStakeAlloc;
 
 extern unsigned int nMinerSleep;
 
+//! Number of stake time slots after the current one that the miner checks for
+//! kernels in advance before it sleeps.
+static const unsigned int STAKE_LOOKAHEAD_SLOTS = 8;
+
 // Note the below constant controls the minimum value allowed for post
 // split UTXO size. It is int64_t but in GRC so that it matches the entry in the config file.
 // It will be converted to Halfords in GetNumberOfStakeOutputs by multiplying by COIN.
@@ -29,6 +34,32 @@ bool GetStakeSplitStatusAndParams(int64_t& nMinStakeSplitValue, double& dEfficie
 
 bool CreateMRCRewards(CBlock &blocknew, std::map<GRC::Cpid, std::pair<uint256, GRC::MRC>>& mrc_map, std::map<GRC::Cpid, uint256>& mrc_tx_map, GRC::Claim claim, CWallet* pwallet) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 bool CreateRestOfTheBlock(CBlock &block, CBlockIndex* pindexPrev, std::map<GRC::Cpid, std::pair<uint256, GRC::MRC>>& mrc_map);
+//!
+//! \brief The state of the chain and wallet that a kernel search depends on,
+//! captured at the beginning of a miner cycle.
+//!
+struct StakeSnapshot
+{
+    CBlockIndex* m_pindex_prev = nullptr;   //!< Chain tip that the new block builds on.
+    uint64_t m_stake_modifier = 0;          //!< Stake modifier for blocks after the tip.
+    int64_t m_balance = 0;                  //!< Wallet balance for the efficiency metrics.
+    int64_t m_next_maturity_time = 0;       //!< Earliest time that another output reaches the stake age, or zero.
+    std::vector<StakeCandidate> m_candidates;
+};
+
+//! Find the first stake time slot after the current one in which an output of
+//! the snapshot solves the kernel. See the definition for details.
+int64_t FindNextStakeSlot(const StakeSnapshot& snapshot, const CBlock& blocknew);
+
+//! Check that a kernel found in the snapshot still proves a new block on the
+//! current chain tip with an unspent wallet output.
+bool IsStakeKernelCurrent(const StakeSnapshot& snapshot, const StakeCandidate& kernel, const CWallet& wallet)
+    EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+
+//! Wake the stake miner from a wait for a future stake time slot, for example
+//! when the chain tip or the wallet changes.
+void WakeStakeMiner();
+
 bool CreateGridcoinReward(CBlock &blocknew, CBlockIndex* pindexPrev, int64_t &nReward, GRC::Claim& claim) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 
 #endif // BITCOIN_MINER_H
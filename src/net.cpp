@@ -11,13 +11,22 @@
 #include "banman.h"
 #include "net.h"
 #include "init.h"
+#include "node/blockdownload.h"
 #include "node/ui_interface.h"
 #include "random.h"
 #include "util.h"
 #include "util/threadnames.h"
 
+#include <algorithm>
 #include <boost/thread.hpp>
+#include <chrono>
+#include <condition_variable>
 #include <inttypes.h>
+#include <unordered_map>
+
+#ifdef USE_EPOLL
+#include <sys/epoll.h>
+#endif
 
 #if !defined(HAVE_MSG_NOSIGNAL)
 #define MSG_NOSIGNAL 0
@@ -25,6 +34,8 @@
 
 #ifdef WIN32
   #include <string.h>
+#else
+  #include <sys/uio.h>
 #endif
 
 #ifdef USE_UPNP
@@ -99,6 +110,15 @@ CCriticalSection CNode::cs_mapMisbehavior;
 
 static CSemaphore* semOutbound = nullptr;
 
+// The socket thread wakes the message handler when a message arrives or when
+// a full send buffer drains, so that the handler does not need to poll:
+static Mutex g_msgproc_mutex;
+static std::condition_variable g_msgproc_cond;
+static bool g_msgproc_wake GUARDED_BY(g_msgproc_mutex) = false;
+
+CMessageLatencyStats g_message_latency;
+CNetBufferPool g_net_buffer_pool;
+
 // This caches the block locators used to ask for a range of blocks. Due to a
 // sub-optimal workaround in our old net messaging code, a node will ask each
 // peer that advertises a block for the next range. The node generates a sub-
@@ -580,9 +600,12 @@ void CNode::copyStats(CNodeStats &stats)
     stats.nTrust = nTrust;
     stats.nMisbehavior = GetMisbehavior();
 
-    // No lock for these two... using atomics.
+    // No lock for these... using atomics.
     stats.nSendBytes = nSendBytes;
     stats.nRecvBytes = nRecvBytes;
+    stats.nSendMsgs = nSendMsgs;
+    stats.nSendCalls = nSendCalls;
+    stats.nRecvCalls = nRecvCalls;
 
     // It is common for nodes with good ping times to suddenly become lagged,
     // due to a new block arriving or other large transfer.
@@ -619,8 +642,9 @@ void CNode::CopyNodeStats(std::vector<CNodeStats>& vstats)
 
 
 // requires LOCK(cs_vRecvMsg)
-bool CNode::ReceiveMsgBytes(const char *pch, unsigned int nBytes)
+bool CNode::ReceiveMsgBytes(const char *pch, unsigned int nBytes, bool& complete)
 {
+    complete = false;
     nRecvBytes += nBytes;
 
     while (nBytes > 0) {
@@ -645,29 +669,72 @@ bool CNode::ReceiveMsgBytes(const char *pch, unsigned int nBytes)
         pch += handled;
         nBytes -= handled;
 
-        if (msg.complete())
+        if (msg.complete()) {
             msg.nTime = GetTimeMicros();
+            complete = true;
+        }
     }
 
     return true;
 }
 
+// requires LOCK(cs_vRecvMsg)
+Span<std::byte> CNode::GetRecvPayloadBuffer(unsigned int nMax)
+{
+    if (vRecvMsg.empty() || !vRecvMsg.back().in_data || vRecvMsg.back().complete())
+        return {};
+
+    CNetMessage& msg = vRecvMsg.back();
+
+    // When less than nMax remains, the bytes after the payload belong to the
+    // next message, so read them into the caller's buffer along with it:
+    if (msg.hdr.nMessageSize - msg.nDataPos < nMax)
+        return {};
+
+    return msg.GetDataBuffer(nMax);
+}
+
+// requires LOCK(cs_vRecvMsg)
+void CNode::ReceivedPayloadBytes(unsigned int nBytes, bool& complete)
+{
+    complete = false;
+    nRecvBytes += nBytes;
+
+    CNetMessage& msg = vRecvMsg.back();
+    msg.DataReceived(nBytes);
+
+    if (msg.complete()) {
+        msg.nTime = GetTimeMicros();
+        complete = true;
+    }
+}
+
+CNetMessage::~CNetMessage()
+{
+    g_net_buffer_pool.Put(std::move(vPayload));
+
+    // Unless the handler took the data, as for a scraper part:
+    SerializeData buffer;
+    vRecv.swap(buffer);
+    g_net_buffer_pool.Put(std::move(buffer));
+}
+
 int CNetMessage::readHeader(const char *pch, unsigned int nBytes)
 {
     // copy data to temporary parsing buffer
-    unsigned int nRemaining = 24 - nHdrPos;
+    unsigned int nRemaining = hdrbuf.size() - nHdrPos;
     unsigned int nCopy = std::min(nRemaining, nBytes);
 
     memcpy(&hdrbuf[nHdrPos], pch, nCopy);
     nHdrPos += nCopy;
 
     // if header incomplete, exit
-    if (nHdrPos < 24)
+    if (nHdrPos < hdrbuf.size())
         return nCopy;
 
     // deserialize to CMessageHeader
     try {
-        hdrbuf >> hdr;
+        SpanReader(vRecv.GetType(), vRecv.GetVersion(), MakeUCharSpan(hdrbuf)) >> hdr;
     }
     catch (std::exception &e) {
         return -1;
@@ -685,43 +752,196 @@ int CNetMessage::readHeader(const char *pch, unsigned int nBytes)
 
 int CNetMessage::readData(const char *pch, unsigned int nBytes)
 {
-    unsigned int nRemaining = hdr.nMessageSize - nDataPos;
-    unsigned int nCopy = std::min(nRemaining, nBytes);
+    Span<std::byte> buffer = GetDataBuffer(nBytes);
+
+    memcpy(buffer.data(), pch, buffer.size());
+    DataReceived(buffer.size());
+
+    return buffer.size();
+}
 
-    if (vRecv.size() < nDataPos + nCopy) {
-        // Allocate up to 256 KiB ahead, but never more than the total message size.
-        vRecv.resize(std::min(hdr.nMessageSize, nDataPos + nCopy + 256 * 1024));
+Span<std::byte> CNetMessage::GetDataBuffer(unsigned int nMax)
+{
+    const unsigned int nEnd = nDataPos + std::min(nMax, hdr.nMessageSize - nDataPos);
+
+    if (vPayload.size() < nEnd) {
+        // Allocate up to 256 KiB ahead, but never more than the total message
+        // size. Grow by doubling to limit the copies of the received part:
+        const unsigned int nSize = std::min<size_t>(
+            hdr.nMessageSize,
+            std::max<size_t>(nEnd + 256 * 1024, 2 * vPayload.size()));
+
+        if (nSize > vPayload.capacity()) {
+            SerializeData buffer = g_net_buffer_pool.Get(nSize);
+            std::copy(vPayload.begin(), vPayload.begin() + nDataPos, buffer.begin());
+            vPayload.swap(buffer);
+            g_net_buffer_pool.Put(std::move(buffer));
+        } else {
+            vPayload.resize(nSize);
+        }
     }
 
-    memcpy(&vRecv[nDataPos], pch, nCopy);
-    nDataPos += nCopy;
+    return Span<std::byte>(vPayload).subspan(nDataPos, nEnd - nDataPos);
+}
 
-    return nCopy;
+void CNetMessage::DataReceived(unsigned int nBytes)
+{
+    nDataPos += nBytes;
+
+    // Hand the payload to the stream that the handler reads from:
+    if (complete())
+        vRecv.swap(vPayload);
+}
+
+size_t CNetBufferPool::GetClassSize(size_t nSize)
+{
+    if (nSize <= MIN_POOLED_SIZE)
+        return MIN_POOLED_SIZE;
+
+    size_t nPower = MIN_POOLED_SIZE;
+    while (nPower * 2 < nSize)
+        nPower *= 2;
+
+    // Round up to a quarter step between nPower and 2 * nPower:
+    const size_t nStep = nPower / 4;
+    return nPower + (nSize - nPower + nStep - 1) / nStep * nStep;
+}
+
+SerializeData CNetBufferPool::Take(size_t nCapacity)
+{
+    SerializeData buffer;
+
+    if (nCapacity >= MIN_POOLED_SIZE) {
+        nCapacity = GetClassSize(nCapacity);
+
+        LOCK(m_mutex);
+        std::map<size_t, std::vector<SerializeData>>::iterator it = m_free.find(nCapacity);
+        if (it != m_free.end()) {
+            buffer = std::move(it->second.back());
+            it->second.pop_back();
+            m_pooled_bytes -= nCapacity;
+            if (it->second.empty())
+                m_free.erase(it);
+            return buffer;
+        }
+    }
+
+    buffer.reserve(nCapacity);
+    return buffer;
+}
+
+SerializeData CNetBufferPool::Get(size_t nSize)
+{
+    // Leave what a reused buffer holds, rather than wipe it, since receiving
+    // overwrites it anyway:
+    SerializeData buffer = Take(nSize);
+    buffer.resize(nSize);
+    return buffer;
+}
+
+SerializeData CNetBufferPool::GetEmpty(size_t nCapacity)
+{
+    SerializeData buffer = Take(nCapacity);
+    buffer.clear();
+    return buffer;
+}
+
+void CNetBufferPool::Put(SerializeData&& buffer)
+{
+    const size_t nCapacity = buffer.capacity();
+
+    // Buffers not from Get() do not fit a size class:
+    if (nCapacity < MIN_POOLED_SIZE || GetClassSize(nCapacity) != nCapacity)
+        return;
+
+    SerializeData drop;
+    {
+        LOCK(m_mutex);
+        if (m_pooled_bytes + nCapacity > MAX_POOLED_BYTES) {
+            // Wipe and free it outside of the lock:
+            drop.swap(buffer);
+        } else {
+            m_free[nCapacity].push_back(std::move(buffer));
+            m_pooled_bytes += nCapacity;
+        }
+    }
 }
 
+size_t CNetBufferPool::GetPooledBytes() const
+{
+    LOCK(m_mutex);
+    return m_pooled_bytes;
+}
 
 
+
+#ifndef WIN32
+// The most queued chunks that one sendmsg() call hands to the socket:
+static constexpr size_t MAX_SEND_IOV = 16;
+#endif
+
 // requires LOCK(cs_vSend)
 void SocketSendData(CNode *pnode)
 {
-    std::deque<SerializeData>::iterator it = pnode->vSendMsg.begin();
-
-    while (it != pnode->vSendMsg.end())
+    while (!pnode->vSendMsg.empty())
     {
-        const SerializeData &data = *it;
+        // Hand the socket as many queued chunks as one call takes:
+        size_t nAttempted = 0;
+#ifdef WIN32
+        const SerializeData& data = pnode->vSendMsg.front();
         assert(data.size() > pnode->nSendOffset);
-        int nBytes = send(pnode->hSocket, (const char*)&data[pnode->nSendOffset], data.size() - pnode->nSendOffset, MSG_NOSIGNAL | MSG_DONTWAIT);
+        nAttempted = data.size() - pnode->nSendOffset;
+        int nBytes = send(pnode->hSocket, (const char*)&data[pnode->nSendOffset], nAttempted, MSG_NOSIGNAL | MSG_DONTWAIT);
+#else
+        struct iovec iov[MAX_SEND_IOV];
+        size_t nIov = 0;
+        for (std::deque<SerializeData>::const_iterator it = pnode->vSendMsg.begin();
+             it != pnode->vSendMsg.end() && nIov < MAX_SEND_IOV;
+             ++it, ++nIov)
+        {
+            const size_t nOffset = nIov == 0 ? pnode->nSendOffset : 0;
+            assert(it->size() > nOffset);
+            iov[nIov].iov_base = (void*)(it->data() + nOffset);
+            iov[nIov].iov_len = it->size() - nOffset;
+            nAttempted += iov[nIov].iov_len;
+        }
+
+        struct msghdr msg = {};
+        msg.msg_iov = iov;
+        msg.msg_iovlen = nIov;
+        ssize_t nBytes = sendmsg(pnode->hSocket, &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
+#endif
+        pnode->nSendCalls++;
+
         if (nBytes > 0) {
             pnode->nLastSend = GetAdjustedTime();
             pnode->nSendBytes += nBytes;
-            pnode->nSendOffset += nBytes;
             pnode->RecordBytesSent(nBytes);
-            if (pnode->nSendOffset == data.size()) {
+
+            // Recycle the chunks that went out in full:
+            size_t nLeft = nBytes;
+            while (nLeft > 0) {
+                SerializeData& data = pnode->vSendMsg.front();
+                const size_t nRemaining = data.size() - pnode->nSendOffset;
+                if (nLeft < nRemaining) {
+                    pnode->nSendOffset += nLeft;
+                    break;
+                }
+                nLeft -= nRemaining;
                 pnode->nSendOffset = 0;
                 pnode->nSendSize -= data.size();
-                it++;
-            } else {
-                // could not send full message; stop sending more
+
+                // Most messages go out right away. Keep a chunk at hand for
+                // them, rather than take one from the pool for each:
+                if (pnode->vSendSpare.capacity() == 0 && data.capacity() == SEND_CHUNK_SIZE)
+                    pnode->vSendSpare.swap(data);
+                else
+                    g_net_buffer_pool.Put(std::move(data));
+                pnode->vSendMsg.pop_front();
+            }
+
+            if ((size_t)nBytes < nAttempted) {
+                // could not send everything; the socket buffer is full
                 break;
             }
         }
@@ -741,11 +961,10 @@ void SocketSendData(CNode *pnode)
         }
     }
 
-    if (it == pnode->vSendMsg.end()) {
+    if (pnode->vSendMsg.empty()) {
         assert(pnode->nSendOffset == 0);
         assert(pnode->nSendSize == 0);
     }
-    pnode->vSendMsg.erase(pnode->vSendMsg.begin(), it);
 }
 
 void ThreadSocketHandler(void* parg)
@@ -774,6 +993,272 @@ void ThreadSocketHandler(void* parg)
     LogPrintf("ThreadSocketHandler exited");
 }
 
+// How long the socket handler waits for socket events, in milliseconds. This
+// is also how often it checks for messages queued to nodes:
+static constexpr int SOCKET_WAIT_MILLIS = 50;
+
+std::vector<std::string> GetSocketEventsModes()
+{
+    std::vector<std::string> modes { "select" };
+#ifdef USE_EPOLL
+    modes.emplace_back("epoll");
+#endif
+
+    return modes;
+}
+
+//
+// Wait for socket events with select(). Returns false when interrupted.
+//
+static bool SocketEventsSelect(std::set<SOCKET>& recv_set, std::set<SOCKET>& send_set, std::set<SOCKET>& error_set)
+{
+    struct timeval timeout;
+    timeout.tv_sec  = 0;
+    timeout.tv_usec = SOCKET_WAIT_MILLIS * 1000;
+
+    fd_set fdsetRecv;
+    fd_set fdsetSend;
+    fd_set fdsetError;
+    FD_ZERO(&fdsetRecv);
+    FD_ZERO(&fdsetSend);
+    FD_ZERO(&fdsetError);
+    SOCKET hSocketMax = 0;
+    bool have_fds = false;
+
+    for (auto const& hListenSocket : vhListenSocket) {
+        FD_SET(hListenSocket, &fdsetRecv);
+        hSocketMax = max(hSocketMax, hListenSocket);
+        have_fds = true;
+    }
+    {
+        LOCK(cs_vNodes);
+        for (auto const& pnode : vNodes)
+        {
+            if (pnode->hSocket == INVALID_SOCKET)
+                continue;
+            {
+                TRY_LOCK(pnode->cs_vSend, lockSend);
+                if (lockSend) {
+                    // do not read, if draining write queue
+                    if (!pnode->vSendMsg.empty())
+                        FD_SET(pnode->hSocket, &fdsetSend);
+                    else
+                        FD_SET(pnode->hSocket, &fdsetRecv);
+                    FD_SET(pnode->hSocket, &fdsetError);
+                    hSocketMax = max(hSocketMax, pnode->hSocket);
+                    have_fds = true;
+                }
+            }
+        }
+    }
+
+    int nSelect = select(have_fds ? hSocketMax + 1 : 0,
+                         &fdsetRecv, &fdsetSend, &fdsetError, &timeout);
+    if (fShutdown)
+        return true;
+    if (nSelect == SOCKET_ERROR)
+    {
+        if (have_fds)
+        {
+            int nErr = WSAGetLastError();
+            LogPrint(BCLog::LogFlags::NET, "socket select error %d", nErr);
+            for (unsigned int i = 0; i <= hSocketMax; i++)
+                FD_SET(i, &fdsetRecv);
+        }
+        FD_ZERO(&fdsetSend);
+        FD_ZERO(&fdsetError);
+        if (!MilliSleep(timeout.tv_usec/1000)) return false;
+    }
+
+    if (!have_fds)
+        return true;
+
+    for (SOCKET hSocket = 0; hSocket <= hSocketMax; hSocket++)
+    {
+        if (FD_ISSET(hSocket, &fdsetRecv))
+            recv_set.insert(hSocket);
+        if (FD_ISSET(hSocket, &fdsetSend))
+            send_set.insert(hSocket);
+        if (FD_ISSET(hSocket, &fdsetError))
+            error_set.insert(hSocket);
+    }
+
+    return true;
+}
+
+#ifdef USE_EPOLL
+// Epoll instance of the socket handler, or -1 to use select():
+static int g_epoll_fd = -1;
+
+bool StartSocketEventsEpoll()
+{
+    if (g_epoll_fd != -1)
+        return true;
+
+    g_epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    int nErr = g_epoll_fd == -1 ? WSAGetLastError() : 0;
+
+    for (auto const& hListenSocket : vhListenSocket)
+    {
+        if (g_epoll_fd == -1)
+            break;
+
+        struct epoll_event event;
+        event.events = EPOLLIN;
+        event.data.fd = hListenSocket;
+
+        if (epoll_ctl(g_epoll_fd, EPOLL_CTL_ADD, hListenSocket, &event) == SOCKET_ERROR)
+        {
+            nErr = WSAGetLastError();
+            StopSocketEventsEpoll();
+        }
+    }
+
+    if (g_epoll_fd == -1)
+        LogPrintf("Failed to set up epoll (error %d). Falling back to select()", nErr);
+
+    return g_epoll_fd != -1;
+}
+
+void StopSocketEventsEpoll()
+{
+    if (g_epoll_fd != -1)
+        close(g_epoll_fd);
+
+    g_epoll_fd = -1;
+
+    // A new epoll instance does not know the sockets of the old one:
+    LOCK(cs_vNodes);
+    for (auto const& pnode : vNodes)
+    {
+        pnode->fSocketRegistered = false;
+        pnode->fSocketWantSend = false;
+    }
+}
+
+static bool EpollSetNode(CNode* pnode, int op, bool fWantSend)
+{
+    struct epoll_event event;
+    event.events = EPOLLIN | EPOLLRDHUP | EPOLLET | (fWantSend ? static_cast<uint32_t>(EPOLLOUT) : 0u);
+    event.data.fd = pnode->hSocket;
+
+    if (epoll_ctl(g_epoll_fd, op, pnode->hSocket, &event) == SOCKET_ERROR)
+    {
+        LogPrint(BCLog::LogFlags::NET, "socket epoll_ctl error %d", WSAGetLastError());
+        pnode->CloseSocketDisconnect();
+        return false;
+    }
+
+    return true;
+}
+
+//
+// Wait for socket events with epoll. Returns false when interrupted.
+//
+// Unlike select(), this does not hand every socket to the kernel on each pass.
+// A node's socket stays in the epoll set until it closes, and the set watches
+// it for writes only while the node has messages queued. Events are edge-
+// triggered: the socket thread keeps a node readable or writable until recv()
+// or send() reaches the end of the socket buffer, so this reports the nodes
+// with work left from the last pass without waiting.
+//
+bool SocketEventsEpoll(std::set<SOCKET>& recv_set, std::set<SOCKET>& send_set, std::set<SOCKET>& error_set)
+{
+    const auto add_ready = [&](const CNode* pnode) {
+        if (pnode->hSocket == INVALID_SOCKET)
+            return;
+
+        // do not read, if draining write queue
+        if (pnode->fSocketWantSend) {
+            if (pnode->fSocketWritable)
+                send_set.insert(pnode->hSocket);
+        } else if (pnode->fSocketReadable) {
+            recv_set.insert(pnode->hSocket);
+        }
+    };
+
+    // Events carry the socket rather than the node. A child process may hold
+    // a copy of a closed socket, which then stays in the epoll set:
+    std::unordered_map<SOCKET, CNode*> mapSocketNodes;
+
+    {
+        LOCK(cs_vNodes);
+        mapSocketNodes.reserve(vNodes.size());
+
+        for (auto const& pnode : vNodes)
+        {
+            if (pnode->hSocket == INVALID_SOCKET)
+                continue;
+
+            // Adding a socket reports any data that arrived before:
+            if (!pnode->fSocketRegistered)
+            {
+                if (!EpollSetNode(pnode, EPOLL_CTL_ADD, false))
+                    continue;
+                pnode->fSocketRegistered = true;
+            }
+
+            {
+                TRY_LOCK(pnode->cs_vSend, lockSend);
+                if (lockSend && pnode->vSendMsg.empty() == pnode->fSocketWantSend)
+                {
+                    // Changing the watched events reports a writable socket again:
+                    if (!EpollSetNode(pnode, EPOLL_CTL_MOD, !pnode->fSocketWantSend))
+                        continue;
+                    pnode->fSocketWantSend = !pnode->fSocketWantSend;
+                    pnode->fSocketWritable = false;
+                }
+            }
+
+            mapSocketNodes.emplace(pnode->hSocket, pnode);
+            add_ready(pnode);
+        }
+    }
+
+    const bool fWorkLeft = !recv_set.empty() || !send_set.empty();
+
+    std::array<struct epoll_event, 256> events;
+    int nEvents = epoll_wait(g_epoll_fd, events.data(), events.size(), fWorkLeft ? 0 : SOCKET_WAIT_MILLIS);
+    if (fShutdown)
+        return true;
+    if (nEvents == SOCKET_ERROR)
+    {
+        int nErr = WSAGetLastError();
+        if (nErr == WSAEINTR)
+            return true;
+
+        LogPrint(BCLog::LogFlags::NET, "socket epoll_wait error %d", nErr);
+        return MilliSleep(SOCKET_WAIT_MILLIS);
+    }
+
+    for (int i = 0; i < nEvents; i++)
+    {
+        const SOCKET hSocket = events[i].data.fd;
+        const auto it = mapSocketNodes.find(hSocket);
+
+        if (it == mapSocketNodes.end())
+        {
+            if (std::count(vhListenSocket.begin(), vhListenSocket.end(), hSocket))
+                recv_set.insert(hSocket);
+            continue;
+        }
+
+        CNode* pnode = it->second;
+
+        if (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))
+            pnode->fSocketReadable = true;
+        if (events[i].events & EPOLLOUT)
+            pnode->fSocketWritable = true;
+        if (events[i].events & (EPOLLHUP | EPOLLERR))
+            error_set.insert(hSocket);
+
+        add_ready(pnode);
+    }
+
+    return true;
+}
+#endif
+
 void ThreadSocketHandler2(void* parg)
 {
     LogPrint(BCLog::LogFlags::NET, "ThreadSocketHandler started");
@@ -797,6 +1282,9 @@ void ThreadSocketHandler2(void* parg)
                     // remove from vNodes
                     vNodes.erase(remove(vNodes.begin(), vNodes.end(), pnode), vNodes.end());
 
+                    // let other peers download the blocks that it owes us
+                    g_block_download.PeerDisconnected(pnode->GetId());
+
                     // release outbound grant (if any)
                     pnode->grantOutbound.Release();
 
@@ -856,70 +1344,31 @@ void ThreadSocketHandler2(void* parg)
         //
         // Find which sockets have data to receive
         //
-        struct timeval timeout;
-        timeout.tv_sec  = 0;
-        timeout.tv_usec = 50000; // frequency to poll pnode->vSend
-
-        fd_set fdsetRecv;
-        fd_set fdsetSend;
-        fd_set fdsetError;
-        FD_ZERO(&fdsetRecv);
-        FD_ZERO(&fdsetSend);
-        FD_ZERO(&fdsetError);
-        SOCKET hSocketMax = 0;
-        bool have_fds = false;
-
-        for (auto const& hListenSocket : vhListenSocket) {
-            FD_SET(hListenSocket, &fdsetRecv);
-            hSocketMax = max(hSocketMax, hListenSocket);
-            have_fds = true;
-        }
-        {
-            LOCK(cs_vNodes);
-            for (auto const& pnode : vNodes)
-            {
-                if (pnode->hSocket == INVALID_SOCKET)
-                    continue;
-                {
-                    TRY_LOCK(pnode->cs_vSend, lockSend);
-                    if (lockSend) {
-                        // do not read, if draining write queue
-                        if (!pnode->vSendMsg.empty())
-                            FD_SET(pnode->hSocket, &fdsetSend);
-                        else
-                            FD_SET(pnode->hSocket, &fdsetRecv);
-                        FD_SET(pnode->hSocket, &fdsetError);
-                        hSocketMax = max(hSocketMax, pnode->hSocket);
-                        have_fds = true;
-                    }
-                }
-            }
-        }
+        std::set<SOCKET> recv_set;
+        std::set<SOCKET> send_set;
+        std::set<SOCKET> error_set;
+        bool fContinue;
+
+#ifdef USE_EPOLL
+        if (g_epoll_fd != -1)
+            fContinue = SocketEventsEpoll(recv_set, send_set, error_set);
+        else
+#endif
+            fContinue = SocketEventsSelect(recv_set, send_set, error_set);
 
-        int nSelect = select(have_fds ? hSocketMax + 1 : 0,
-                             &fdsetRecv, &fdsetSend, &fdsetError, &timeout);
-        if (fShutdown)
+        if (!fContinue || fShutdown)
             return;
-        if (nSelect == SOCKET_ERROR)
-        {
-            if (have_fds)
-            {
-                int nErr = WSAGetLastError();
-                LogPrint(BCLog::LogFlags::NET, "socket select error %d", nErr);
-                for (unsigned int i = 0; i <= hSocketMax; i++)
-                    FD_SET(i, &fdsetRecv);
-            }
-            FD_ZERO(&fdsetSend);
-            FD_ZERO(&fdsetError);
-            if (!MilliSleep(timeout.tv_usec/1000)) return;
-        }
+
+        // Set when a ready socket could not be serviced. Back off at the end
+        // of the pass instead of spinning on it:
+        bool fBackOff = false;
 
 
         //
         // Accept new connections
         //
         for (auto const& hListenSocket : vhListenSocket)
-        if (hListenSocket != INVALID_SOCKET && FD_ISSET(hListenSocket, &fdsetRecv))
+        if (hListenSocket != INVALID_SOCKET && recv_set.count(hListenSocket))
         {
             struct sockaddr_storage sockaddr;
             socklen_t len = sizeof(sockaddr);
@@ -944,7 +1393,10 @@ void ThreadSocketHandler2(void* parg)
             {
                 int nErr = WSAGetLastError();
                 if (nErr != WSAEWOULDBLOCK)
+                {
                     LogPrintf("socket error accept INVALID_SOCKET: %d", nErr);
+                    fBackOff = true;
+                }
             }
             else if (nInbound >= max_connections - MAX_OUTBOUND_CONNECTIONS)
             {
@@ -995,7 +1447,7 @@ void ThreadSocketHandler2(void* parg)
             //
             if (pnode->hSocket == INVALID_SOCKET)
                 continue;
-            if (FD_ISSET(pnode->hSocket, &fdsetRecv) || FD_ISSET(pnode->hSocket, &fdsetError))
+            if (recv_set.count(pnode->hSocket) || error_set.count(pnode->hSocket))
             {
                 TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
                 if (lockRecv)
@@ -1008,13 +1460,36 @@ void ThreadSocketHandler2(void* parg)
                     else {
                         // typical socket buffer is 8K-64K
                         char pchBuf[0x10000];
-                        int nBytes = recv(pnode->hSocket, pchBuf, sizeof(pchBuf), MSG_DONTWAIT);
+
+                        // The rest of a large payload goes straight into the
+                        // buffer of its message:
+                        Span<std::byte> payload = pnode->GetRecvPayloadBuffer(sizeof(pchBuf));
+                        char* pchRecv = payload.empty() ? pchBuf : (char*)payload.data();
+                        const int nRecvSize = payload.empty() ? sizeof(pchBuf) : payload.size();
+
+                        int nBytes = recv(pnode->hSocket, pchRecv, nRecvSize, MSG_DONTWAIT);
+                        pnode->nRecvCalls++;
+
+                        // A short read or an error empties the socket buffer.
+                        // Epoll reports the next data that arrives:
+                        if (nBytes < nRecvSize)
+                            pnode->fSocketReadable = false;
+
                         if (nBytes > 0)
                         {
-                            if (!pnode->ReceiveMsgBytes(pchBuf, nBytes))
+                            bool fComplete = false;
+                            if (!payload.empty())
+                                pnode->ReceivedPayloadBytes(nBytes, fComplete);
+                            else if (!pnode->ReceiveMsgBytes(pchBuf, nBytes, fComplete))
                                 pnode->CloseSocketDisconnect();
                             pnode->nLastRecv = GetAdjustedTime();
                             pnode->RecordBytesRecv(nBytes);
+
+                            if (fComplete)
+                            {
+                                pnode->fHasCompleteMsg = true;
+                                WakeMessageHandler();
+                            }
                         }
                         else if (nBytes == 0)
                         {
@@ -1037,9 +1512,17 @@ void ThreadSocketHandler2(void* parg)
                                 }
                                 pnode->CloseSocketDisconnect();
                             }
+                            else
+                            {
+                                // select() may keep reporting the socket, for
+                                // example for out-of-band data:
+                                fBackOff = true;
+                            }
                         }
                     }
                 }
+                else
+                    fBackOff = true;
             }
 
             //
@@ -1047,11 +1530,27 @@ void ThreadSocketHandler2(void* parg)
             //
             if (pnode->hSocket == INVALID_SOCKET)
                 continue;
-            if (FD_ISSET(pnode->hSocket, &fdsetSend))
+            if (send_set.count(pnode->hSocket))
             {
                 TRY_LOCK(pnode->cs_vSend, lockSend);
                 if (lockSend)
+                {
+                    const bool fWasFull = pnode->nSendSize >= SendBufferSize();
+
                     SocketSendData(pnode);
+
+                    // A partial send filled the socket buffer. Epoll reports
+                    // when it drains:
+                    if (!pnode->vSendMsg.empty())
+                        pnode->fSocketWritable = false;
+
+                    // The handler stops processing a node's messages while its
+                    // send buffer is full:
+                    if (fWasFull && pnode->nSendSize < SendBufferSize() && pnode->fHasCompleteMsg)
+                        WakeMessageHandler();
+                }
+                else
+                    fBackOff = true;
             }
 
             //
@@ -1116,7 +1615,8 @@ void ThreadSocketHandler2(void* parg)
                 pnode->Release();
         }
 
-        UninterruptibleSleep(std::chrono::milliseconds{10});
+        if (fBackOff)
+            UninterruptibleSleep(std::chrono::milliseconds{10});
     }
 }
 
@@ -1758,11 +2258,61 @@ void ThreadMessageHandler(void* parg)
     LogPrintf("ThreadMessageHandler exited");
 }
 
+void WakeMessageHandler()
+{
+    {
+        LOCK(g_msgproc_mutex);
+        g_msgproc_wake = true;
+    }
+
+    g_msgproc_cond.notify_one();
+}
+
+void CMessageLatencyStats::Record(const std::string& strCommand, int64_t nWaitMicros, int64_t nProcessMicros)
+{
+    LOCK(m_mutex);
+
+    // The command list is a global of another translation unit, so look it up
+    // here rather than in the constructor of this global:
+    std::map<std::string, Entry>::iterator it = m_entries.find(strCommand);
+    if (it == m_entries.end())
+    {
+        const std::vector<std::string>& vKnown = getAllNetMessageTypes();
+        if (std::find(vKnown.begin(), vKnown.end(), strCommand) == vKnown.end())
+            return;
+
+        it = m_entries.emplace(strCommand, Entry()).first;
+    }
+
+    Entry& entry = it->second;
+    entry.nCount++;
+    entry.nTotalWaitMicros += nWaitMicros;
+    entry.nMaxWaitMicros = std::max(entry.nMaxWaitMicros, nWaitMicros);
+    entry.nTotalProcessMicros += nProcessMicros;
+}
+
+std::map<std::string, CMessageLatencyStats::Entry> CMessageLatencyStats::Get() const
+{
+    LOCK(m_mutex);
+    return m_entries;
+}
+
 void ThreadMessageHandler2(void* parg)
 {
     LogPrint(BCLog::LogFlags::NET, "ThreadMessageHandler started");
+
+    // SendMessages() runs for every node at this interval, for pings, trickled
+    // inventory, and request timeouts. In between, it runs only for the nodes
+    // that had messages to process:
+    const std::chrono::milliseconds tick_interval{100};
+    std::chrono::steady_clock::time_point next_tick = std::chrono::steady_clock::now();
+
     while (!fShutdown)
     {
+        const bool fTick = std::chrono::steady_clock::now() >= next_tick;
+        if (fTick)
+            next_tick = std::chrono::steady_clock::now() + tick_interval;
+
         vector<CNode*> vNodesCopy;
         {
             LOCK(cs_vNodes);
@@ -1771,28 +2321,58 @@ void ThreadMessageHandler2(void* parg)
                 pnode->AddRef();
         }
 
-        // Poll the connected nodes for messages
+        // Only trickle on the regular interval, whatever wakes us in between:
         CNode* pnodeTrickle = nullptr;
-        if (!vNodesCopy.empty())
+        if (fTick && !vNodesCopy.empty())
             pnodeTrickle = vNodesCopy[GetRand(vNodesCopy.size())];
+
+        bool fMoreWork = false;
+
         for (auto const& pnode : vNodesCopy)
         {
             if (pnode->fDisconnect)
                 continue;
 
-            //11-25-2015
-            // Receive messages
+            bool fProcessed = false;
+
+            // Receive messages. Only nodes that completed a message have work:
+            if (pnode->fHasCompleteMsg)
             {
-                TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
-                if (lockRecv)
-                    if (!ProcessMessages(pnode))
-                        pnode->CloseSocketDisconnect();
+                fProcessed = true;
+
+                // Clear the flag before ProcessMessages() takes the messages,
+                // so that one completed in between sets it again:
+                pnode->fHasCompleteMsg = false;
+
+                {
+                    LOCK(pnode->cs_vSend);
+                    pnode->CorkSend();
+                }
+
+                if (!ProcessMessages(pnode))
+                    pnode->CloseSocketDisconnect();
+
+                {
+                    LOCK(pnode->cs_vSend);
+                    pnode->UncorkSend();
+                }
+
+                // ProcessMessages() leaves the messages of a node with a full
+                // send buffer. The socket thread wakes us when it drains:
+                LOCK(pnode->cs_vRecvMsg);
+                if (!pnode->vRecvMsg.empty() && pnode->vRecvMsg.front().complete())
+                {
+                    pnode->fHasCompleteMsg = true;
+                    fMoreWork |= pnode->nSendSize < SendBufferSize();
+                }
             }
 
             if (fShutdown)
                 return;
 
-            // Send messages
+            // Send messages. Replies to the processed messages go out now, and
+            // the rest of the work waits for the interval:
+            if (fTick || fProcessed)
             {
                 // Having the outer cs_main TRY_LOCK here with reversed logic
                 // has the same effect as the original TRY_LOCK in Sendmessages,
@@ -1808,7 +2388,9 @@ void ThreadMessageHandler2(void* parg)
                     TRY_LOCK(pnode->cs_vSend, lockSend);
                     if (lockSend)
                     {
+                        pnode->CorkSend();
                         SendMessages(pnode, pnode == pnodeTrickle);
+                        pnode->UncorkSend();
                     }
                 }
             }
@@ -1823,13 +2405,18 @@ void ThreadMessageHandler2(void* parg)
                 pnode->Release();
         }
 
-        // Wait and allow messages to bunch up.
-        // we're sleeping, but we must always check fShutdown after doing this.
-        UninterruptibleSleep(std::chrono::milliseconds{100});
         if (fRequestShutdown)
             StartShutdown();
         if (fShutdown)
             return;
+
+        // Sleep until the socket thread wakes us or the next interval starts:
+        {
+            WAIT_LOCK(g_msgproc_mutex, lock);
+            if (!fMoreWork)
+                g_msgproc_cond.wait_until(lock, next_tick, []() EXCLUSIVE_LOCKS_REQUIRED(g_msgproc_mutex) { return g_msgproc_wake; });
+            g_msgproc_wake = false;
+        }
     }
 }
 
@@ -2016,6 +2603,13 @@ void StartNode(void* parg)
     LogPrintf("Using %i OutboundConnections with a MaxConnections of %" PRId64,
               nMaxOutbound, max_connections);
 
+#ifdef USE_EPOLL
+    if (gArgs.GetArg("-socketevents", DEFAULT_SOCKET_EVENTS) == "epoll")
+        StartSocketEventsEpoll();
+
+    LogPrintf("Using %s for socket events", g_epoll_fd != -1 ? "epoll" : "select");
+#endif
+
     if (pnodeLocalHost == nullptr)
         pnodeLocalHost = new CNode(INVALID_SOCKET, CAddress(LookupNumeric("127.0.0.1", 0), nLocalServices));
 
@@ -2070,6 +2664,7 @@ bool StopNode()
 {
     LogPrintf("StopNode()");
     fShutdown = true;
+    WakeMessageHandler();
     if (semOutbound)
         for (int i=0; i<MAX_OUTBOUND_CONNECTIONS; i++)
             semOutbound->post();
@@ -2098,6 +2693,12 @@ public:
                 if (closesocket(hListenSocket) == SOCKET_ERROR)
                     LogPrintf("closesocket(hListenSocket) died with error %d", WSAGetLastError());
 
+#ifdef USE_EPOLL
+        if (g_epoll_fd != -1)
+            close(g_epoll_fd);
+        g_epoll_fd = -1;
+#endif
+
 #ifdef WIN32
         // Shutdown Windows Sockets
         WSACleanup();
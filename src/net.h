@@ -9,12 +9,14 @@
 #include <array>
 #include <boost/thread.hpp>
 #include <atomic>
+#include <map>
 
 #include "netbase.h"
 #include "mruset.h"
 #include "protocol.h"
 #include "streams.h"
 #include "addrman.h"
+#include "sync.h"
 
 #ifndef WIN32
 #include <arpa/inet.h>
@@ -34,9 +36,19 @@ extern int PEER_TIMEOUT;
 
 typedef int64_t NodeId;
 
+/** Size of the buffers that small outgoing messages are serialized into together. */
+static const unsigned int SEND_CHUNK_SIZE = 16 * 1024;
+
 inline unsigned int ReceiveFloodSize() { return 1000*gArgs.GetArg("-maxreceivebuffer", 5*1000); }
 inline unsigned int SendBufferSize() { return 1000*gArgs.GetArg("-maxsendbuffer", 1*1000); }
 
+/** Default for -socketevents, the way that the socket handler waits for sockets to become ready. */
+#ifdef USE_EPOLL
+static const char* const DEFAULT_SOCKET_EVENTS = "epoll";
+#else
+static const char* const DEFAULT_SOCKET_EVENTS = "select";
+#endif
+
 void AddOneShot(std::string strDest);
 bool RecvLine(SOCKET hSocket, std::string& strLine);
 bool GetMyExternalIP(CNetAddr& ipRet);
@@ -50,6 +62,18 @@ bool BindListenPort(const CService &bindAddr, std::string& strError=REF(std::str
 void StartNode(void* parg);
 bool StopNode();
 void SocketSendData(CNode *pnode);
+/** Values of -socketevents that this build supports. */
+std::vector<std::string> GetSocketEventsModes();
+#ifdef USE_EPOLL
+/** Set up the epoll instance of the socket handler. Returns false when the socket handler must use select(). */
+bool StartSocketEventsEpoll();
+/** Close the epoll instance of the socket handler. */
+void StopSocketEventsEpoll();
+/** Wait for socket events with epoll and collect the sockets that the socket handler shall service. */
+bool SocketEventsEpoll(std::set<SOCKET>& recv_set, std::set<SOCKET>& send_set, std::set<SOCKET>& error_set);
+#endif
+/** Wake the message handler thread when a node has messages to process or room to respond. */
+void WakeMessageHandler();
 extern std::vector<CNode*> vNodes;
 extern CCriticalSection cs_vNodes;
 
@@ -122,6 +146,9 @@ public:
     int64_t nLastRecv;
     uint64_t nSendBytes;
     uint64_t nRecvBytes;
+    uint64_t nSendMsgs;
+    uint64_t nSendCalls;
+    uint64_t nRecvCalls;
     int64_t nTimeConnected;
     int64_t nTimeOffset;
     std::string addrName;
@@ -140,27 +167,72 @@ public:
 
 
 
+/**
+ * Recycles the buffers that received message payloads land in and that
+ * queued messages are serialized into. A large block or scraper part reuses
+ * the buffer of an earlier one instead of allocating, faulting in, and wiping
+ * a fresh one. Buffers come in four size classes per power of two, so one is
+ * at most a quarter larger than the data it holds.
+ */
+class CNetBufferPool
+{
+public:
+    //! Smaller payloads are cheap to allocate and are not pooled.
+    static constexpr size_t MIN_POOLED_SIZE = 4 * 1024;
+    //! The pool drops returned buffers beyond this many idle bytes.
+    static constexpr size_t MAX_POOLED_BYTES = 16 * 1024 * 1024;
+
+    //! Capacity of the size class that holds nSize bytes.
+    static size_t GetClassSize(size_t nSize);
+
+    //! Returns a buffer of nSize bytes.
+    SerializeData Get(size_t nSize);
+    //! Returns an empty buffer with room for nCapacity bytes.
+    SerializeData GetEmpty(size_t nCapacity);
+    //! Takes a buffer back for reuse once its contents are no longer needed.
+    void Put(SerializeData&& buffer);
+
+    size_t GetPooledBytes() const;
+
+private:
+    //! A pooled buffer of the size class for nCapacity, or a new one.
+    SerializeData Take(size_t nCapacity);
+
+    mutable Mutex m_mutex;
+    std::map<size_t, std::vector<SerializeData>> m_free GUARDED_BY(m_mutex); // by capacity
+    size_t m_pooled_bytes GUARDED_BY(m_mutex) = 0;
+};
+
+extern CNetBufferPool g_net_buffer_pool;
+
+
 class CNetMessage {
 public:
     bool in_data;                   // parsing header (false) or data (true)
 
-    CDataStream hdrbuf;             // partially received header
+    std::array<std::byte, CMessageHeader::HEADER_SIZE> hdrbuf; // partially received header
     CMessageHeader hdr;             // complete header
     unsigned int nHdrPos;
 
-    CDataStream vRecv;              // received message data
+    SerializeData vPayload;         // partially received message data, from g_net_buffer_pool
+    CDataStream vRecv;              // received message data, once complete
     unsigned int nDataPos;
 
     int64_t nTime;                  // time (in microseconds) of message receipt.
 
-    CNetMessage(int nTypeIn, int nVersionIn) : hdrbuf(nTypeIn, nVersionIn), vRecv(nTypeIn, nVersionIn) {
-        hdrbuf.resize(24);
+    CNetMessage(int nTypeIn, int nVersionIn) : vRecv(nTypeIn, nVersionIn) {
         in_data = false;
         nHdrPos = 0;
         nDataPos = 0;
         nTime = 0;
     }
 
+    CNetMessage(CNetMessage&&) = default;
+    CNetMessage& operator=(CNetMessage&&) = default;
+    CNetMessage(const CNetMessage&) = delete;
+    CNetMessage& operator=(const CNetMessage&) = delete;
+    ~CNetMessage();
+
     bool complete() const
     {
         if (!in_data)
@@ -170,18 +242,56 @@ public:
 
     void SetVersion(int nVersionIn)
     {
-        hdrbuf.SetVersion(nVersionIn);
         vRecv.SetVersion(nVersionIn);
     }
 
+    // Bytes held for the message data, including space allocated ahead
+    unsigned int GetDataSize() const
+    {
+        return vPayload.size() + vRecv.size();
+    }
+
     int readHeader(const char *pch, unsigned int nBytes);
     int readData(const char *pch, unsigned int nBytes);
+
+    // Space for up to nMax more bytes of message data, to receive into
+    Span<std::byte> GetDataBuffer(unsigned int nMax);
+    // Account for nBytes written to the space from GetDataBuffer()
+    void DataReceived(unsigned int nBytes);
 };
 
 
 
 
 
+/**
+ * Relay latency instrumentation: how long received messages wait for the
+ * message handler, and how long they take to process, by command.
+ */
+class CMessageLatencyStats
+{
+public:
+    struct Entry
+    {
+        uint64_t nCount = 0;
+        int64_t nTotalWaitMicros = 0;
+        int64_t nMaxWaitMicros = 0;
+        int64_t nTotalProcessMicros = 0;
+    };
+
+    //! Ignores commands that this version does not know.
+    void Record(const std::string& strCommand, int64_t nWaitMicros, int64_t nProcessMicros);
+
+    //! Returns the commands that were received at least once.
+    std::map<std::string, Entry> Get() const;
+
+private:
+    mutable Mutex m_mutex;
+    std::map<std::string, Entry> m_entries GUARDED_BY(m_mutex);
+};
+
+extern CMessageLatencyStats g_message_latency;
+
 /** Information about a peer */
 class CNode
 {
@@ -192,14 +302,27 @@ public:
     CDataStream ssSend;
     size_t nSendSize; // total size of all vSendMsg entries
     size_t nSendOffset; // offset inside the first vSendMsg already sent
+    size_t nSendMsgStart; // offset in ssSend of the message being built
     std::atomic<uint64_t> nSendBytes {0};
-    std::deque<SerializeData> vSendMsg;
+    std::atomic<uint64_t> nSendMsgs {0};
+    std::atomic<uint64_t> nSendCalls {0}; // send system calls
+    std::deque<SerializeData> vSendMsg; // chunks of queued messages, from g_net_buffer_pool
+    SerializeData vSendSpare; // a sent chunk kept for the next message
+    bool fSendCorked; // hold small writes back until the message handler is done with the node
     CCriticalSection cs_vSend;
 
     std::deque<CNetMessage> vRecvMsg;
     CCriticalSection cs_vRecvMsg;
     std::atomic<uint64_t> nRecvBytes {0};
+    std::atomic<uint64_t> nRecvCalls {0}; // recv system calls
     int nRecvVersion;
+    std::atomic_bool fHasCompleteMsg {false}; // vRecvMsg holds a message that the handler has not processed
+
+    // Edge-triggered epoll state of hSocket. Only the socket thread uses these:
+    bool fSocketRegistered = false; // hSocket is in the epoll set
+    bool fSocketWantSend = false;   // the epoll set watches hSocket for writes
+    bool fSocketReadable = false;   // data arrived since a recv() last drained the socket
+    bool fSocketWritable = false;   // space opened since a send() last filled the socket
 
     int64_t nLastSend;
     int64_t nLastRecv;
@@ -293,6 +416,8 @@ public:
         nRefCount = 0;
         nSendSize = 0;
         nSendOffset = 0;
+        nSendMsgStart = 0;
+        fSendCorked = false;
         hashContinue.SetNull();
         pindexLastGetBlocksBegin = 0;
         hashLastGetBlocksEnd.SetNull();
@@ -357,16 +482,25 @@ public:
     {
         unsigned int total = 0;
         for (auto const& msg : vRecvMsg)
-            total += msg.vRecv.size() + 24;
+            total += msg.GetDataSize() + CMessageHeader::HEADER_SIZE;
         return total;
     }
 
     // requires LOCK(cs_vRecvMsg)
-    bool ReceiveMsgBytes(const char *pch, unsigned int nBytes);
+    bool ReceiveMsgBytes(const char *pch, unsigned int nBytes, bool& complete);
 
+    // Space to receive the rest of a large message payload into directly, or
+    // empty when the next bytes should go through ReceiveMsgBytes().
     // requires LOCK(cs_vRecvMsg)
+    Span<std::byte> GetRecvPayloadBuffer(unsigned int nMax);
+
+    // Account for nBytes received into the space from GetRecvPayloadBuffer()
+    // requires LOCK(cs_vRecvMsg)
+    void ReceivedPayloadBytes(unsigned int nBytes, bool& complete);
+
     void SetRecvVersion(int nVersionIn)
     {
+        LOCK(cs_vRecvMsg);
         nRecvVersion = nVersionIn;
         for (auto &msg : vRecvMsg)
             msg.SetVersion(nVersionIn);
@@ -440,13 +574,40 @@ public:
     void BeginMessage(const char* pszCommand)
     {
         assert(ssSend.size() == 0);
+
+        // Serialize into the last queued chunk while it is small, so that
+        // small messages go out together in one send call:
+        SerializeData chunk;
+        if (!vSendMsg.empty() && vSendMsg.back().size() < SEND_CHUNK_SIZE) {
+            chunk.swap(vSendMsg.back());
+            vSendMsg.pop_back();
+        } else if (vSendSpare.capacity() > 0) {
+            chunk.swap(vSendSpare);
+            chunk.clear();
+        } else {
+            chunk = g_net_buffer_pool.GetEmpty(SEND_CHUNK_SIZE);
+        }
+
+        nSendMsgStart = chunk.size();
+        ssSend.swap(chunk);
         ssSend << CMessageHeader(pszCommand, 0);
     }
 
     // A lock on cs_vSend must be taken before calling this function
     void AbortMessage()
     {
-        ssSend.clear();
+        if (ssSend.size() == 0)
+            return;
+
+        // Keep the messages queued ahead of this one in the chunk:
+        SerializeData chunk;
+        ssSend.resize(nSendMsgStart);
+        ssSend.swap(chunk);
+
+        if (!chunk.empty())
+            vSendMsg.push_back(std::move(chunk));
+        else
+            g_net_buffer_pool.Put(std::move(chunk));
 
         LogPrint(BCLog::LogFlags::NOISY, "(aborted)");
     }
@@ -458,26 +619,53 @@ public:
             return;
 
         // Set the size
-        unsigned int nSize = ssSend.size() - CMessageHeader::HEADER_SIZE;
-        memcpy((char*)&ssSend[CMessageHeader::MESSAGE_SIZE_OFFSET], &nSize, sizeof(nSize));
+        unsigned int nSize = ssSend.size() - nSendMsgStart - CMessageHeader::HEADER_SIZE;
+        memcpy((char*)&ssSend[nSendMsgStart + CMessageHeader::MESSAGE_SIZE_OFFSET], &nSize, sizeof(nSize));
 
         // Set the checksum
-        uint256 hash = Hash(Span{ssSend}.subspan(CMessageHeader::HEADER_SIZE));
+        uint256 hash = Hash(Span{ssSend}.subspan(nSendMsgStart + CMessageHeader::HEADER_SIZE));
         unsigned int nChecksum = 0;
         memcpy(&nChecksum, &hash, sizeof(nChecksum));
-        assert(ssSend.size () >= CMessageHeader::CHECKSUM_OFFSET + sizeof(nChecksum));
-        memcpy((char*)&ssSend[CMessageHeader::CHECKSUM_OFFSET], &nChecksum, sizeof(nChecksum));
+        memcpy((char*)&ssSend[nSendMsgStart + CMessageHeader::CHECKSUM_OFFSET], &nChecksum, sizeof(nChecksum));
 
         LogPrint(BCLog::LogFlags::NOISY, "(%d bytes)", nSize);
 
-        std::deque<SerializeData>::iterator it = vSendMsg.insert(vSendMsg.end(), SerializeData());
-        it->insert(it->end(), ssSend.begin(), ssSend.end());
-        ssSend.clear();
-        nSendSize += it->size();
+        const bool fWasEmpty = nSendSize == 0;
+
+        SerializeData chunk;
+        ssSend.swap(chunk);
+        vSendMsg.push_back(std::move(chunk));
+        nSendSize += CMessageHeader::HEADER_SIZE + nSize;
+        nSendMsgs++;
+
+        // If write queue empty, attempt "optimistic write". While corked, wait
+        // for a chunk's worth of messages, and leave the rest to the socket
+        // thread if the socket fills up:
+        if (fSendCorked) {
+            if (nSendSize >= SEND_CHUNK_SIZE) {
+                SocketSendData(this);
+                fSendCorked = vSendMsg.empty();
+            }
+        } else if (fWasEmpty) {
+            SocketSendData(this);
+        }
+    }
+
+    // Hold back writes of messages pushed until UncorkSend(), so that replies
+    // to a batch of messages go out in few send calls. Does nothing while
+    // messages wait for the socket anyway.
+    // A lock on cs_vSend must be taken before calling this function
+    void CorkSend()
+    {
+        fSendCorked = vSendMsg.empty();
+    }
 
-        // If write queue empty, attempt "optimistic write"
-        if (it == vSendMsg.begin())
+    // A lock on cs_vSend must be taken before calling this function
+    void UncorkSend()
+    {
+        if (fSendCorked && !vSendMsg.empty())
             SocketSendData(this);
+        fSendCorked = false;
     }
 
     void PushVersion();
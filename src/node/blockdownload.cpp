@@ -0,0 +1,599 @@
+// Copyright (c) 2009-2021 The Bitcoin Core developers
+// Copyright (c) 2021 The Gridcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://opensource.org/licenses/mit-license.php.
+
+#include "checkpoints.h"
+#include "logging.h"
+#include "main.h"
+#include "node/blockdownload.h"
+
+#include <algorithm>
+
+BlockDownloadManager g_block_download;
+
+void BlockDownloadManager::Reset(const CBlockIndex* pindex_root)
+{
+    LOCK(m_mutex);
+    ResetLocked(pindex_root);
+}
+
+int BlockDownloadManager::GetHeaderHeight() const
+{
+    LOCK(m_mutex);
+    return TipHeight();
+}
+
+bool BlockDownloadManager::IsDownloading() const
+{
+    LOCK(m_mutex);
+    return !m_headers.empty();
+}
+
+bool BlockDownloadManager::StartHeaderSync(
+    NodeId node,
+    int peer_height,
+    const CBlockIndex* pindex_best,
+    int64_t now,
+    CBlockLocator& locator)
+{
+    LOCK(m_mutex);
+    UpdateRoot(pindex_best);
+
+    if (m_sync_peer && now - m_headers_requested > HEADERS_RESPONSE_TIMEOUT) {
+        LogPrint(BCLog::LogFlags::NET, "%s: headers request to peer=%d timed out", __func__, *m_sync_peer);
+        m_sync_peer.reset();
+    }
+
+    // After we dropped a header chain, getblocks drives the sync until the
+    // tip moves:
+    if (m_fallback_height) {
+        if (pindex_best && pindex_best->nHeight <= *m_fallback_height) {
+            return false;
+        }
+
+        m_fallback_height.reset();
+    }
+
+    PeerState& peer = m_peers[node];
+
+    if (m_sync_peer || peer.headers_tried || peer_height <= TipHeight()) {
+        return false;
+    }
+
+    peer.headers_tried = true;
+    m_sync_peer = node;
+    m_headers_requested = now;
+    locator = GetLocator();
+
+    return true;
+}
+
+BlockDownloadManager::HeadersStatus BlockDownloadManager::ReceiveHeaders(
+    NodeId node,
+    const std::vector<CBlockHeader>& headers,
+    const CBlockIndex* pindex_prev,
+    int64_t now,
+    CBlockLocator& locator)
+{
+    LOCK(m_mutex);
+
+    if (!m_sync_peer || *m_sync_peer != node) {
+        return HeadersStatus::IGNORED;
+    }
+
+    if (headers.empty()) {
+        m_sync_peer.reset();
+        return HeadersStatus::DONE;
+    }
+
+    int height;
+
+    if (const auto it = m_heights.find(headers.front().hashPrevBlock); it != m_heights.end()) {
+        height = it->second;
+    } else if (m_root && headers.front().hashPrevBlock == m_root->GetBlockHash()) {
+        height = m_root_height;
+    } else if (pindex_prev) {
+        // The peer's chain forks below the header chain, or the node moved on
+        // since the request. Start over from the block that the headers build
+        // on:
+        ResetLocked(pindex_prev);
+        height = m_root_height;
+    } else {
+        m_sync_peer.reset();
+        return HeadersStatus::IGNORED;
+    }
+
+    size_t i = 0;
+
+    // Skip the headers that we have already, so that a peer that repeats
+    // them does not cancel the downloads above them:
+    for (; i < headers.size() && height < TipHeight(); ++i, ++height) {
+        if (headers[i].GetHash() != HashAt(height + 1)) {
+            break;
+        }
+    }
+
+    Truncate(height);
+
+    for (; i < headers.size(); ++i) {
+        const CBlockHeader& header = headers[i];
+
+        if (header.hashPrevBlock != HashAt(TipHeight()) || !CheckHeader(header, TipHeight() + 1, now)) {
+            Truncate(height);
+            m_sync_peer.reset();
+            return HeadersStatus::INVALID;
+        }
+
+        const uint256 hash = header.GetHash();
+
+        m_headers.push_back({hash, header.GetBlockTime(), node});
+        m_heights.emplace(hash, TipHeight());
+    }
+
+    if (headers.size() < MAX_HEADERS_RESULTS) {
+        m_sync_peer.reset();
+        return HeadersStatus::DONE;
+    }
+
+    m_headers_requested = now;
+    locator = GetLocator();
+
+    return HeadersStatus::CONTINUE;
+}
+
+std::vector<uint256> BlockDownloadManager::RequestBlocks(
+    NodeId node,
+    int peer_height,
+    const CBlockIndex* pindex_best,
+    int64_t now,
+    bool& stalling,
+    bool& headers_dropped)
+{
+    LOCK(m_mutex);
+    UpdateRoot(pindex_best);
+
+    std::vector<uint256> hashes;
+    stalling = false;
+    headers_dropped = false;
+
+    if (m_headers.empty()) {
+        return hashes;
+    }
+
+    const int fork_height = FindForkHeight(pindex_best);
+
+    // Forget the blocks that connected since the last call:
+    for (auto it = m_in_flight.begin(); it != m_in_flight.end() && it->first <= fork_height;) {
+        it = ReleaseInFlight(it);
+    }
+
+    m_received.erase(m_received.begin(), m_received.upper_bound(fork_height));
+
+    // The window cannot move past the first block that did not arrive yet:
+    int next_height = fork_height + 1;
+
+    while (m_received.count(next_height)) {
+        ++next_height;
+    }
+
+    for (auto it = m_in_flight.begin(); it != m_in_flight.end();) {
+        if (it->second.node == node && now - it->second.time > BLOCK_DOWNLOAD_TIMEOUT) {
+            stalling |= it->first == next_height;
+            it = ReleaseInFlight(it);
+        } else {
+            ++it;
+        }
+    }
+
+    if (stalling) {
+        if (m_stalled_height != next_height) {
+            m_stalled_height = next_height;
+            m_stall_rounds = 0;
+        }
+
+        // Peers that time out one after another on the same block more likely
+        // never had it. Blame the header chain instead of the next peer:
+        if (++m_stall_rounds >= MAX_BLOCK_DOWNLOAD_ROUNDS) {
+            DropHeaders(fork_height, next_height, pindex_best);
+            stalling = false;
+            headers_dropped = true;
+        }
+
+        return hashes;
+    }
+
+    PeerState& peer = m_peers[node];
+    const int end_height = std::min({fork_height + BLOCK_DOWNLOAD_WINDOW, TipHeight(), peer_height});
+
+    for (int height = next_height; height <= end_height && peer.in_flight < MAX_BLOCKS_IN_TRANSIT_PER_PEER; ++height) {
+        if (m_received.count(height) || m_in_flight.count(height)) {
+            continue;
+        }
+
+        m_in_flight.emplace(height, InFlight{node, now});
+        ++peer.in_flight;
+        hashes.push_back(HashAt(height));
+    }
+
+    return hashes;
+}
+
+BlockDownloadManager::BlockStatus BlockDownloadManager::BlockReceived(
+    NodeId node,
+    const uint256& hash,
+    const CBlockIndex* pindex_best)
+{
+    LOCK(m_mutex);
+
+    const auto it = m_heights.find(hash);
+
+    if (it == m_heights.end()) {
+        return BlockStatus::UNKNOWN;
+    }
+
+    const int height = it->second;
+    const auto in_flight = m_in_flight.find(height);
+
+    if (in_flight == m_in_flight.end()
+        || in_flight->second.node != node
+        || height > FindForkHeight(pindex_best) + BLOCK_DOWNLOAD_WINDOW)
+    {
+        return BlockStatus::UNREQUESTED;
+    }
+
+    ReleaseInFlight(in_flight);
+    m_received.insert(height);
+
+    return BlockStatus::REQUESTED;
+}
+
+bool BlockDownloadManager::HoldBlock(CBlock block)
+{
+    LOCK(m_mutex);
+
+    const uint256 hash = block.GetHash(true);
+    const auto height_it = m_heights.find(hash);
+
+    if (height_it == m_heights.end()) {
+        return false;
+    }
+
+    const int height = height_it->second;
+
+    if (m_held.count(block.hashPrevBlock)) {
+        return true;
+    }
+
+    // The blocks of one chain cannot stake the same output twice. The later
+    // of the two blocks is invalid:
+    if (block.IsProofOfStake()) {
+        if (const auto stake = m_held_stakes.find(block.vtx[1].vin[0].prevout); stake != m_held_stakes.end()) {
+            LogPrintf("%s: block %s stakes the same output as the held block at height %d",
+                      __func__, hash.ToString(), stake->second);
+
+            const int invalid_height = std::max(height, stake->second);
+
+            InvalidateLocked(invalid_height);
+
+            if (invalid_height == height) {
+                return false;
+            }
+        }
+    }
+
+    const size_t size = GetSerializeSize(block, SER_NETWORK, PROTOCOL_VERSION);
+
+    // Make room by sending the blocks furthest from the tip back to the
+    // download queue. The block that the window waits for always fits:
+    while (m_held_size + size > MAX_HELD_BLOCKS_SIZE && !m_held.empty()) {
+        auto furthest = m_held.begin();
+
+        for (auto it = m_held.begin(); it != m_held.end(); ++it) {
+            if (it->second.height > furthest->second.height) {
+                furthest = it;
+            }
+        }
+
+        if (furthest->second.height < height) {
+            LogPrint(BCLog::LogFlags::NET, "%s: no room to hold block %s", __func__, hash.ToString());
+            m_received.erase(height);
+            return false;
+        }
+
+        m_received.erase(furthest->second.height);
+        ReleaseHeld(furthest);
+    }
+
+    if (block.IsProofOfStake()) {
+        m_held_stakes.emplace(block.vtx[1].vin[0].prevout, height);
+    }
+
+    m_held_size += size;
+
+    const uint256 hash_prev = block.hashPrevBlock;
+    m_held.emplace(hash_prev, HeldBlock{std::move(block), height, size});
+
+    return true;
+}
+
+std::optional<CBlock> BlockDownloadManager::TakeHeldBlock(const uint256& hash_prev)
+{
+    LOCK(m_mutex);
+
+    const auto it = m_held.find(hash_prev);
+
+    if (it == m_held.end()) {
+        return std::nullopt;
+    }
+
+    std::optional<CBlock> block = std::move(it->second.block);
+    ReleaseHeld(it);
+
+    return block;
+}
+
+void BlockDownloadManager::BlockInvalid(const uint256& hash)
+{
+    LOCK(m_mutex);
+
+    const auto it = m_heights.find(hash);
+
+    if (it == m_heights.end()) {
+        return;
+    }
+
+    InvalidateLocked(it->second);
+}
+
+bool BlockDownloadManager::TakeBadHeaders(NodeId node)
+{
+    LOCK(m_mutex);
+
+    const auto it = m_peers.find(node);
+
+    if (it == m_peers.end() || !it->second.bad_headers_new) {
+        return false;
+    }
+
+    it->second.bad_headers_new = false;
+
+    return true;
+}
+
+void BlockDownloadManager::PeerDisconnected(NodeId node)
+{
+    LOCK(m_mutex);
+
+    for (auto it = m_in_flight.begin(); it != m_in_flight.end();) {
+        if (it->second.node == node) {
+            it = ReleaseInFlight(it);
+        } else {
+            ++it;
+        }
+    }
+
+    if (m_sync_peer && *m_sync_peer == node) {
+        m_sync_peer.reset();
+    }
+
+    m_peers.erase(node);
+}
+
+void BlockDownloadManager::InvalidateLocked(int height)
+{
+    LogPrintf("%s: cutting the header chain back to height %d", __func__, height - 1);
+
+    Truncate(height - 1);
+
+    // Any peer may supply the replacement headers, including the ones that
+    // we asked before:
+    for (auto& peer : m_peers) {
+        peer.second.headers_tried = peer.second.bad_headers;
+    }
+}
+
+void BlockDownloadManager::DropHeaders(int fork_height, int stalled_height, const CBlockIndex* pindex_best)
+{
+    const NodeId source = m_headers[stalled_height - m_root_height - 1].source;
+
+    LogPrintf("%s: no peer served block %s at height %d. Dropping the header chain from peer=%d above height %d",
+              __func__, HashAt(stalled_height).ToString(), stalled_height, source, fork_height);
+
+    if (const auto peer = m_peers.find(source); peer != m_peers.end()) {
+        peer->second.headers_tried = true;
+        peer->second.bad_headers = true;
+        peer->second.bad_headers_new = true;
+    }
+
+    Truncate(fork_height);
+
+    m_sync_peer.reset();
+    m_stall_rounds = 0;
+    m_fallback_height = pindex_best ? pindex_best->nHeight : m_root_height;
+}
+
+void BlockDownloadManager::ResetLocked(const CBlockIndex* pindex_root)
+{
+    m_root = pindex_root;
+    m_root_height = pindex_root ? pindex_root->nHeight : 0;
+    m_headers.clear();
+    m_heights.clear();
+    m_in_flight.clear();
+    m_received.clear();
+    m_held.clear();
+    m_held_stakes.clear();
+    m_held_size = 0;
+    m_stall_rounds = 0;
+
+    for (auto& peer : m_peers) {
+        peer.second.in_flight = 0;
+    }
+}
+
+void BlockDownloadManager::UpdateRoot(const CBlockIndex* pindex_best)
+{
+    // Once the chain reaches the last header, the header chain has nothing
+    // more to offer. Start the next one from the new tip:
+    if (pindex_best && pindex_best != m_root && (!m_root || pindex_best->nHeight >= TipHeight())) {
+        ResetLocked(pindex_best);
+    }
+}
+
+void BlockDownloadManager::Truncate(int height)
+{
+    if (height >= TipHeight()) {
+        return;
+    }
+
+    for (int h = TipHeight(); h > height; --h) {
+        m_heights.erase(HashAt(h));
+    }
+
+    m_headers.resize(height - m_root_height);
+
+    for (auto it = m_in_flight.upper_bound(height); it != m_in_flight.end();) {
+        it = ReleaseInFlight(it);
+    }
+
+    m_received.erase(m_received.upper_bound(height), m_received.end());
+
+    // Drop the held blocks that are no longer in the header chain:
+    for (auto it = m_held.begin(); it != m_held.end();) {
+        if (it->second.height > height) {
+            it = ReleaseHeld(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+std::map<int, BlockDownloadManager::InFlight>::iterator
+BlockDownloadManager::ReleaseInFlight(std::map<int, InFlight>::iterator it)
+{
+    if (const auto peer = m_peers.find(it->second.node); peer != m_peers.end()) {
+        --peer->second.in_flight;
+    }
+
+    return m_in_flight.erase(it);
+}
+
+std::map<uint256, BlockDownloadManager::HeldBlock>::iterator
+BlockDownloadManager::ReleaseHeld(std::map<uint256, HeldBlock>::iterator it)
+{
+    const CBlock& block = it->second.block;
+
+    if (block.IsProofOfStake()) {
+        m_held_stakes.erase(block.vtx[1].vin[0].prevout);
+    }
+
+    m_held_size -= it->second.size;
+
+    return m_held.erase(it);
+}
+
+int BlockDownloadManager::TipHeight() const
+{
+    return m_root_height + m_headers.size();
+}
+
+uint256 BlockDownloadManager::HashAt(int height) const
+{
+    if (height == m_root_height) {
+        return m_root ? m_root->GetBlockHash() : uint256();
+    }
+
+    return m_headers[height - m_root_height - 1].hash;
+}
+
+int64_t BlockDownloadManager::MedianTimePast(int height) const
+{
+    std::vector<int64_t> times;
+
+    for (; height > m_root_height && times.size() < CBlockIndex::nMedianTimeSpan; --height) {
+        times.push_back(m_headers[height - m_root_height - 1].time);
+    }
+
+    for (const CBlockIndex* pindex = m_root;
+         pindex && times.size() < CBlockIndex::nMedianTimeSpan;
+         pindex = pindex->pprev)
+    {
+        times.push_back(pindex->GetBlockTime());
+    }
+
+    if (times.empty()) {
+        return 0;
+    }
+
+    std::sort(times.begin(), times.end());
+
+    return times[times.size() / 2];
+}
+
+int BlockDownloadManager::FindForkHeight(const CBlockIndex* pindex) const
+{
+    for (; pindex && pindex->nHeight > m_root_height; pindex = pindex->pprev) {
+        if (pindex->nHeight <= TipHeight() && HashAt(pindex->nHeight) == pindex->GetBlockHash()) {
+            return pindex->nHeight;
+        }
+    }
+
+    return m_root_height;
+}
+
+CBlockLocator BlockDownloadManager::GetLocator() const
+{
+    std::vector<uint256> have;
+    int step = 1;
+
+    // Exponentially larger steps back, like CBlockLocator::Set():
+    for (int height = TipHeight(); height > m_root_height; height -= step) {
+        have.push_back(HashAt(height));
+
+        if (have.size() > 10) {
+            step *= 2;
+        }
+    }
+
+    const CBlockLocator root_locator(m_root);
+    have.insert(have.end(), root_locator.vHave.begin(), root_locator.vHave.end());
+
+    return CBlockLocator(have);
+}
+
+bool BlockDownloadManager::CheckHeader(const CBlockHeader& header, int height, int64_t now) const
+{
+    const uint256 hash = header.GetHash();
+
+    if (!Checkpoints::CheckHardened(height, hash)) {
+        return error("%s: header %s at height %d does not match a checkpoint", __func__, hash.ToString(), height);
+    }
+
+    if (header.nVersion > CBlockHeader::CURRENT_VERSION) {
+        return error("%s: unknown block version %d", __func__, header.nVersion);
+    }
+
+    if (header.GetBlockTime() > FutureDrift(now, height)) {
+        return error("%s: header timestamp too far in the future", __func__);
+    }
+
+    // The same timestamp rules as AcceptBlock():
+    if (height > nGrandfather) {
+        const int64_t prev_time = height - 1 == m_root_height
+            ? m_root->GetBlockTime()
+            : m_headers[height - m_root_height - 2].time;
+
+        if (header.nVersion < 12
+            && (header.GetBlockTime() <= MedianTimePast(height - 1)
+                || FutureDrift(header.GetBlockTime(), height) < prev_time))
+        {
+            return error("%s: header timestamp too early", __func__);
+        }
+
+        if (header.nVersion >= 12 && prev_time - header.GetBlockTime() > 128) {
+            return error("%s: header timestamp too early", __func__);
+        }
+    }
+
+    return true;
+}
@@ -0,0 +1,225 @@
+// Copyright (c) 2009-2021 The Bitcoin Core developers
+// Copyright (c) 2021 The Gridcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_NODE_BLOCKDOWNLOAD_H
+#define BITCOIN_NODE_BLOCKDOWNLOAD_H
+
+#include "main.h"
+#include "net.h"
+#include "sync.h"
+
+#include <cstdint>
+#include <map>
+#include <optional>
+#include <set>
+#include <unordered_map>
+#include <vector>
+
+/** Number of headers sent in response to getheaders. A shorter response ends the header sync. */
+static constexpr unsigned int MAX_HEADERS_RESULTS = 1000;
+/** Size of the moving window above the tip that blocks are downloaded in. */
+static constexpr int BLOCK_DOWNLOAD_WINDOW = 1024;
+/** Number of blocks that we request from one peer at a time. */
+static constexpr int MAX_BLOCKS_IN_TRANSIT_PER_PEER = 16;
+/** Seconds to wait for a headers response before asking another peer. */
+static constexpr int64_t HEADERS_RESPONSE_TIMEOUT = 2 * 60;
+/** Seconds to wait for a requested block before asking another peer. */
+static constexpr int64_t BLOCK_DOWNLOAD_TIMEOUT = 60;
+/** Number of times the block that the window waits for may time out before we drop the header chain. */
+static constexpr int MAX_BLOCK_DOWNLOAD_ROUNDS = 3;
+/** Serialized size of the blocks that may wait for their parents at a time. */
+static constexpr size_t MAX_HELD_BLOCKS_SIZE = 64 * 1024 * 1024;
+
+/**
+ * Drives headers-first sync. Downloads and checks the header chain from one
+ * peer, then spreads the blocks of a window above the tip over all peers. A
+ * block that arrives before its parent waits here, so that blocks connect in
+ * order without the getblocks round trips that orphans cause.
+ *
+ * The header chain starts at a block that we have. Headers cannot prove the
+ * stake behind a block, so this only checks the links, timestamps, and
+ * checkpoints. Full validation happens as each block connects, and a block
+ * that fails it cuts the header chain back for another peer to replace.
+ *
+ * A single peer supplies the header chain, so it may describe blocks that
+ * nobody has. When the block that the window waits for times out on several
+ * peers in a row, we drop the header chain above the tip, blame the peer that
+ * sent the header, and leave the download to getblocks until the tip moves.
+ *
+ * This is a leaf lock: callers may hold cs_main or cs_vNodes, and the class
+ * does not call out while it holds its own mutex.
+ */
+class BlockDownloadManager
+{
+public:
+    enum class HeadersStatus
+    {
+        CONTINUE, //!< More headers are available. Send getheaders with the locator.
+        DONE,     //!< The peer has no more headers.
+        IGNORED,  //!< Unsolicited or unconnected headers.
+        INVALID,  //!< The headers break the chain rules.
+    };
+
+    enum class BlockStatus
+    {
+        REQUESTED,   //!< We asked the peer for the block, and it is in the window.
+        UNREQUESTED, //!< A block of the header chain that we did not ask the peer for.
+        UNKNOWN,     //!< Not a block of the header chain.
+    };
+
+    /** Start over with an empty header chain on top of the given block. */
+    void Reset(const CBlockIndex* pindex_root);
+
+    /** Height of the last header in the header chain. */
+    int GetHeaderHeight() const;
+
+    /** Whether the header chain has blocks that we still need to download. */
+    bool IsDownloading() const;
+
+    /**
+     * Choose the peer to download headers from. Returns true when the node
+     * shall send getheaders to the peer with the locator.
+     */
+    bool StartHeaderSync(
+        NodeId node,
+        int peer_height,
+        const CBlockIndex* pindex_best,
+        int64_t now,
+        CBlockLocator& locator);
+
+    /**
+     * Extend the header chain with a headers response.
+     *
+     * \param pindex_prev The block index entry of the parent of the first
+     * header, if we have one.
+     * \param now         Adjusted time, to reject headers from the future.
+     * \param locator     Set when the peer has more headers for us.
+     */
+    HeadersStatus ReceiveHeaders(
+        NodeId node,
+        const std::vector<CBlockHeader>& headers,
+        const CBlockIndex* pindex_prev,
+        int64_t now,
+        CBlockLocator& locator);
+
+    /**
+     * Choose the blocks to request from a peer.
+     *
+     * \param stalling        Set when the peer timed out on the block that the
+     * window waits for. The caller should disconnect it.
+     * \param headers_dropped Set when that block timed out too many times and
+     * we dropped the header chain. The caller should fall back to getblocks.
+     */
+    std::vector<uint256> RequestBlocks(
+        NodeId node,
+        int peer_height,
+        const CBlockIndex* pindex_best,
+        int64_t now,
+        bool& stalling,
+        bool& headers_dropped);
+
+    /**
+     * Record the arrival of a block. Only a block that we requested from the
+     * peer and that is still inside the download window counts as received.
+     */
+    BlockStatus BlockReceived(NodeId node, const uint256& hash, const CBlockIndex* pindex_best);
+
+    /**
+     * Keep a requested block of the header chain until its parent connects.
+     *
+     * The held blocks share a budget of MAX_HELD_BLOCKS_SIZE bytes. When the
+     * budget runs out, the blocks furthest from the tip make room and go back
+     * to the download queue.
+     *
+     * \return \c false when the block was not held: it is not in the header
+     * chain, it stakes the same output as a held block below it, or it is the
+     * furthest block from the tip and there is no room for it.
+     */
+    bool HoldBlock(CBlock block);
+
+    /** Remove and return a held block with the given parent, if any. */
+    std::optional<CBlock> TakeHeldBlock(const uint256& hash_prev);
+
+    /** Cut the header chain back to the parent of a block that failed validation. */
+    void BlockInvalid(const uint256& hash);
+
+    /**
+     * Whether the peer sent headers for blocks that no peer could serve since
+     * the last call. The caller should penalize it.
+     */
+    bool TakeBadHeaders(NodeId node);
+
+    /** Release the requests that a peer had in flight. */
+    void PeerDisconnected(NodeId node);
+
+private:
+    struct Header
+    {
+        uint256 hash;
+        int64_t time;
+        NodeId source; //!< Peer that sent the header.
+    };
+
+    struct InFlight
+    {
+        NodeId node;
+        int64_t time;
+    };
+
+    struct PeerState
+    {
+        int in_flight = 0;
+        bool headers_tried = false;
+        bool bad_headers = false;     //!< Sent headers for blocks that nobody served. Never sync headers from it again.
+        bool bad_headers_new = false; //!< Not yet reported by TakeBadHeaders().
+    };
+
+    struct HeldBlock
+    {
+        CBlock block;
+        int height;
+        size_t size;
+    };
+
+    mutable Mutex m_mutex;
+
+    const CBlockIndex* m_root GUARDED_BY(m_mutex) = nullptr;
+    int m_root_height GUARDED_BY(m_mutex) = 0;
+    std::vector<Header> m_headers GUARDED_BY(m_mutex);
+    std::unordered_map<uint256, int, BlockHasher> m_heights GUARDED_BY(m_mutex);
+
+    std::optional<NodeId> m_sync_peer GUARDED_BY(m_mutex);
+    int64_t m_headers_requested GUARDED_BY(m_mutex) = 0;
+
+    std::map<int, InFlight> m_in_flight GUARDED_BY(m_mutex);
+    std::set<int> m_received GUARDED_BY(m_mutex);
+    std::map<uint256, HeldBlock> m_held GUARDED_BY(m_mutex);
+    std::map<COutPoint, int> m_held_stakes GUARDED_BY(m_mutex); //!< Height of the block that staked each output.
+    size_t m_held_size GUARDED_BY(m_mutex) = 0;
+    std::map<NodeId, PeerState> m_peers GUARDED_BY(m_mutex);
+
+    int m_stalled_height GUARDED_BY(m_mutex) = 0; //!< Height of the block that the window waits for after a timeout.
+    int m_stall_rounds GUARDED_BY(m_mutex) = 0;   //!< Number of times that block timed out.
+    std::optional<int> m_fallback_height GUARDED_BY(m_mutex); //!< Tip height when we dropped a header chain.
+
+    void ResetLocked(const CBlockIndex* pindex_root) EXCLUSIVE_LOCKS_REQUIRED(m_mutex);
+    void InvalidateLocked(int height) EXCLUSIVE_LOCKS_REQUIRED(m_mutex);
+    void UpdateRoot(const CBlockIndex* pindex_best) EXCLUSIVE_LOCKS_REQUIRED(m_mutex);
+    void Truncate(int height) EXCLUSIVE_LOCKS_REQUIRED(m_mutex);
+    void DropHeaders(int fork_height, int stalled_height, const CBlockIndex* pindex_best) EXCLUSIVE_LOCKS_REQUIRED(m_mutex);
+    std::map<int, InFlight>::iterator ReleaseInFlight(std::map<int, InFlight>::iterator it) EXCLUSIVE_LOCKS_REQUIRED(m_mutex);
+    std::map<uint256, HeldBlock>::iterator ReleaseHeld(std::map<uint256, HeldBlock>::iterator it) EXCLUSIVE_LOCKS_REQUIRED(m_mutex);
+
+    int TipHeight() const EXCLUSIVE_LOCKS_REQUIRED(m_mutex);
+    uint256 HashAt(int height) const EXCLUSIVE_LOCKS_REQUIRED(m_mutex);
+    int64_t MedianTimePast(int height) const EXCLUSIVE_LOCKS_REQUIRED(m_mutex);
+    int FindForkHeight(const CBlockIndex* pindex) const EXCLUSIVE_LOCKS_REQUIRED(m_mutex);
+    CBlockLocator GetLocator() const EXCLUSIVE_LOCKS_REQUIRED(m_mutex);
+    bool CheckHeader(const CBlockHeader& header, int height, int64_t now) const EXCLUSIVE_LOCKS_REQUIRED(m_mutex);
+};
+
+extern BlockDownloadManager g_block_download;
+
+#endif // BITCOIN_NODE_BLOCKDOWNLOAD_H
@@ -0,0 +1,452 @@
+// Copyright (c) 2022 The Gridcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://opensource.org/licenses/mit-license.php.
+
+#include "node/blockindexsnapshot.h"
+
+#include "clientversion.h"
+#include "hash.h"
+#include "main.h"
+#include "serialize.h"
+#include "streams.h"
+#include "sync.h"
+#include "util.h"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <thread>
+#include <unordered_map>
+
+namespace {
+//! Identifies a block index snapshot file.
+constexpr unsigned char SNAPSHOT_MAGIC[8] = { 'g', 'r', 'c', 'b', 'i', 'd', 'x', 0 };
+
+//! Increment this when the layout of \c SnapshotEntry changes.
+constexpr uint32_t SNAPSHOT_VERSION = 1;
+
+//! Number of entries serialized and checksummed together. Chunks are the unit
+//! of work for the decoding threads.
+constexpr uint32_t ENTRIES_PER_CHUNK = 16384;
+
+//! Upper bound on the number of decoding threads.
+constexpr size_t MAX_DECODE_THREADS = 8;
+
+//! Marks an entry without a previous block in the snapshot.
+constexpr uint32_t NO_PREV = std::numeric_limits<uint32_t>::max();
+
+/** Flattened copy of a block index entry. */
+struct SnapshotEntry
+{
+    uint256 hash;
+    uint32_t prev = NO_PREV; //!< Position of the previous block in the snapshot.
+    unsigned int nFile = 0;
+    unsigned int nBlockPos = 0;
+    int nHeight = 0;
+    int64_t nMoneySupply = 0;
+    unsigned int nFlags = 0;
+    uint64_t nStakeModifier = 0;
+    uint256 hashProof;
+    int nVersion = 0;
+    uint256 hashMerkleRoot;
+    unsigned int nTime = 0;
+    unsigned int nBits = 0;
+    unsigned int nNonce = 0;
+    GRC::MiningId mining_id;
+    int64_t research_subsidy = 0;
+    double magnitude = 0;
+    std::vector<GRC::ResearcherContext> mrc_researchers;
+
+    SnapshotEntry() = default;
+
+    SnapshotEntry(const uint256& hash_in, const CBlockIndex& pindex, const uint32_t prev_in)
+        : hash(hash_in)
+        , prev(prev_in)
+        , nFile(pindex.nFile)
+        , nBlockPos(pindex.nBlockPos)
+        , nHeight(pindex.nHeight)
+        , nMoneySupply(pindex.nMoneySupply)
+        , nFlags(pindex.nFlags)
+        , nStakeModifier(pindex.nStakeModifier)
+        , hashProof(pindex.GetProofHash())
+        , nVersion(pindex.nVersion)
+        , hashMerkleRoot(pindex.GetMerkleRoot())
+        , nTime(pindex.nTime)
+        , nBits(pindex.nBits)
+        , nNonce(pindex.GetNonce())
+        , mining_id(pindex.GetMiningId())
+        // Round the subsidy the same way as the database records so that
+        // both ways of loading the index produce the same entries:
+        , research_subsidy(static_cast<int64_t>(pindex.ResearchSubsidy() / (double)COIN * COIN))
+        , magnitude(pindex.Magnitude())
+        , mrc_researchers(pindex.MRCResearchers().begin(), pindex.MRCResearchers().end())
+    {
+    }
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action)
+    {
+        READWRITE(hash);
+        READWRITE(prev);
+        READWRITE(nFile);
+        READWRITE(nBlockPos);
+        READWRITE(nHeight);
+        READWRITE(nMoneySupply);
+        READWRITE(nFlags);
+        READWRITE(nStakeModifier);
+        READWRITE(hashProof);
+        READWRITE(nVersion);
+        READWRITE(hashMerkleRoot);
+        READWRITE(nTime);
+        READWRITE(nBits);
+        READWRITE(nNonce);
+        READWRITE(mining_id);
+        READWRITE(research_subsidy);
+        READWRITE(magnitude);
+        READWRITE(mrc_researchers);
+    }
+};
+
+/** A serialized group of entries and the state of its decoding. */
+struct SnapshotChunk
+{
+    uint32_t entry_count = 0;
+    std::vector<unsigned char> payload;
+    uint256 checksum;
+    std::vector<SnapshotEntry> entries;
+    bool valid = false;
+
+    //! Verify the checksum and deserialize the payload. Runs on a worker thread.
+    void Decode()
+    {
+        if (Hash(payload) != checksum) {
+            return;
+        }
+
+        try {
+            SpanReader reader(SER_DISK, CLIENT_VERSION, payload);
+            reader >> entries;
+            valid = reader.empty() && entries.size() == entry_count;
+        } catch (const std::exception&) {
+            valid = false;
+        }
+
+        // Release the raw bytes before the entries wait to be linked:
+        std::vector<unsigned char>().swap(payload);
+    }
+};
+
+//! Read up to \p max_chunks chunks from the file. Throws on I/O errors.
+std::vector<SnapshotChunk> ReadChunks(CAutoFile& filein, const size_t max_chunks, uint32_t& remaining_chunks)
+{
+    std::vector<SnapshotChunk> chunks(std::min<size_t>(max_chunks, remaining_chunks));
+
+    for (auto& chunk : chunks) {
+        filein >> chunk.entry_count >> chunk.payload >> chunk.checksum;
+    }
+
+    remaining_chunks -= chunks.size();
+
+    return chunks;
+}
+
+//! Start a thread to decode each chunk in the batch.
+std::vector<std::thread> DecodeChunks(std::vector<SnapshotChunk>& chunks)
+{
+    std::vector<std::thread> threads;
+    threads.reserve(chunks.size());
+
+    for (auto& chunk : chunks) {
+        threads.emplace_back([&chunk] { chunk.Decode(); });
+    }
+
+    return threads;
+}
+
+void JoinAll(std::vector<std::thread>& threads)
+{
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    threads.clear();
+}
+
+/** Links decoded entries into mapBlockIndex in the order of the snapshot. */
+class SnapshotLinker
+{
+public:
+    explicit SnapshotLinker(const uint32_t entry_count)
+    {
+        m_entries.reserve(entry_count);
+    }
+
+    bool Link(std::vector<SnapshotChunk>& chunks) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+    {
+        const uint256& genesis_hash = !fTestNet ? hashGenesisBlock : hashGenesisBlockTestNet;
+
+        for (auto& chunk : chunks) {
+            if (!chunk.valid) {
+                return error("%s: checksum or format mismatch", __func__);
+            }
+
+            for (const auto& entry : chunk.entries) {
+                CBlockIndex* pindex = GRC::BlockIndexPool::GetNextBlockIndex();
+                const auto result = mapBlockIndex.insert(std::make_pair(entry.hash, pindex));
+
+                if (!result.second) {
+                    return error("%s: duplicate entry %s", __func__, entry.hash.ToString());
+                }
+
+                // Entries appear in order of height, so the previous block
+                // always precedes the block that links to it:
+                if (entry.prev != NO_PREV) {
+                    if (entry.prev >= m_entries.size()) {
+                        return error("%s: bad link for %s", __func__, entry.hash.ToString());
+                    }
+
+                    pindex->pprev = m_entries[entry.prev];
+                }
+
+                pindex->phashBlock = &result.first->first;
+                pindex->nFile = entry.nFile;
+                pindex->nBlockPos = entry.nBlockPos;
+                pindex->nHeight = entry.nHeight;
+                pindex->nMoneySupply = entry.nMoneySupply;
+                pindex->nFlags = entry.nFlags;
+                pindex->nStakeModifier = entry.nStakeModifier;
+                pindex->nVersion = entry.nVersion;
+                pindex->nTime = entry.nTime;
+                pindex->nBits = entry.nBits;
+                pindex->SetProofHash(entry.hashProof);
+                pindex->SetMerkleRoot(entry.hashMerkleRoot);
+                pindex->SetNonce(entry.nNonce);
+                pindex->SetResearcherContext(entry.mining_id, entry.research_subsidy, entry.magnitude);
+                pindex->SetMRCResearcherContexts(entry.mrc_researchers);
+
+                if (pindexGenesisBlock == nullptr && entry.hash == genesis_hash) {
+                    pindexGenesisBlock = pindex;
+                }
+
+                m_entries.push_back(pindex);
+            }
+
+            // Free the decoded entries of the chunk as we go:
+            std::vector<SnapshotEntry>().swap(chunk.entries);
+        }
+
+        return true;
+    }
+
+    size_t Count() const
+    {
+        return m_entries.size();
+    }
+
+private:
+    std::vector<CBlockIndex*> m_entries; //!< Linked entries by position.
+};
+
+void DiscardPartialBlockIndex() EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+{
+    // Like other discarded block index objects, the pooled entries stay
+    // allocated:
+    mapBlockIndex.clear();
+    pindexGenesisBlock = nullptr;
+}
+} // Anonymous namespace
+
+fs::path GetBlockIndexSnapshotPath()
+{
+    return GetDataDir() / "blkindex.snapshot";
+}
+
+bool WriteBlockIndexSnapshot(const fs::path& path)
+{
+    LOCK(cs_main);
+
+    const int64_t start_time = GetTimeMillis();
+
+    std::vector<std::pair<const uint256*, const CBlockIndex*>> sorted;
+    sorted.reserve(mapBlockIndex.size());
+
+    for (const auto& item : mapBlockIndex) {
+        sorted.emplace_back(&item.first, item.second);
+    }
+
+    std::sort(sorted.begin(), sorted.end(), [](const auto& a, const auto& b) {
+        return a.second->nHeight < b.second->nHeight;
+    });
+
+    std::unordered_map<const CBlockIndex*, uint32_t> positions;
+    positions.reserve(sorted.size());
+
+    for (size_t i = 0; i < sorted.size(); ++i) {
+        positions.emplace(sorted[i].second, static_cast<uint32_t>(i));
+    }
+
+    const fs::path path_tmp = path.string() + ".new";
+    CAutoFile fileout(fsbridge::fopen(path_tmp, "wb"), SER_DISK, CLIENT_VERSION);
+
+    if (fileout.IsNull()) {
+        return error("%s: failed to open file %s", __func__, path_tmp.string());
+    }
+
+    const uint32_t chunk_count = (sorted.size() + ENTRIES_PER_CHUNK - 1) / ENTRIES_PER_CHUNK;
+
+    try {
+        fileout << SNAPSHOT_MAGIC << SNAPSHOT_VERSION << hashBestChain << static_cast<uint32_t>(sorted.size()) << chunk_count;
+
+        for (size_t begin = 0; begin < sorted.size(); begin += ENTRIES_PER_CHUNK) {
+            const size_t end = std::min<size_t>(begin + ENTRIES_PER_CHUNK, sorted.size());
+            std::vector<SnapshotEntry> entries;
+            entries.reserve(end - begin);
+
+            for (size_t i = begin; i < end; ++i) {
+                const CBlockIndex* pindex = sorted[i].second;
+                uint32_t prev = NO_PREV;
+
+                if (pindex->pprev) {
+                    const auto iter = positions.find(pindex->pprev);
+
+                    if (iter == positions.end() || iter->second >= i) {
+                        fileout.fclose();
+                        fs::remove(path_tmp);
+                        return error("%s: unordered entry %s", __func__, sorted[i].first->ToString());
+                    }
+
+                    prev = iter->second;
+                }
+
+                entries.emplace_back(*sorted[i].first, *pindex, prev);
+            }
+
+            std::vector<unsigned char> payload;
+            CVectorWriter(SER_DISK, CLIENT_VERSION, payload, 0) << entries;
+
+            fileout << static_cast<uint32_t>(entries.size()) << payload << Hash(payload);
+        }
+    } catch (const std::exception& e) {
+        fileout.fclose();
+        fs::remove(path_tmp);
+        return error("%s: serialize or I/O error - %s", __func__, e.what());
+    }
+
+    if (!FileCommit(fileout.Get())) {
+        fileout.fclose();
+        fs::remove(path_tmp);
+        return error("%s: failed to flush file %s", __func__, path_tmp.string());
+    }
+
+    fileout.fclose();
+
+    if (!RenameOver(path_tmp, path)) {
+        fs::remove(path_tmp);
+        return error("%s: rename-into-place failed", __func__);
+    }
+
+    LogPrint(BCLog::LogFlags::BENCH, "Time to write block index snapshot containing %u blocks : %15" PRId64 "ms",
+             sorted.size(), GetTimeMillis() - start_time);
+
+    return true;
+}
+
+bool LoadBlockIndexSnapshot(const fs::path& path, const uint256& hash_best_chain, uint32_t& block_count)
+{
+    CAutoFile filein(fsbridge::fopen(path, "rb"), SER_DISK, CLIENT_VERSION);
+
+    if (filein.IsNull()) {
+        return false;
+    }
+
+    LOCK(cs_main);
+
+    const int64_t start_time = GetTimeMillis();
+
+    unsigned char magic[sizeof(SNAPSHOT_MAGIC)];
+    uint32_t version = 0;
+    uint256 snapshot_best_chain;
+    uint32_t entry_count = 0;
+    uint32_t remaining_chunks = 0;
+
+    try {
+        filein >> magic >> version >> snapshot_best_chain >> entry_count >> remaining_chunks;
+    } catch (const std::exception& e) {
+        return error("%s: failed to read header - %s", __func__, e.what());
+    }
+
+    if (memcmp(magic, SNAPSHOT_MAGIC, sizeof(magic)) != 0 || version != SNAPSHOT_VERSION) {
+        LogPrintf("INFO: %s: ignoring block index snapshot with unknown format", __func__);
+        return false;
+    }
+
+    if (snapshot_best_chain != hash_best_chain) {
+        LogPrintf("INFO: %s: ignoring stale block index snapshot", __func__);
+        return false;
+    }
+
+    // Decode the next batch of chunks on worker threads while this thread
+    // links the entries of the previous batch:
+    //
+    const size_t batch_size = std::clamp<size_t>(std::thread::hardware_concurrency(), 1, MAX_DECODE_THREADS);
+
+    SnapshotLinker linker(entry_count);
+    mapBlockIndex.reserve(entry_count);
+
+    std::vector<SnapshotChunk> decoding;
+    std::vector<std::thread> threads;
+    bool success = true;
+
+    try {
+        decoding = ReadChunks(filein, batch_size, remaining_chunks);
+        threads = DecodeChunks(decoding);
+
+        while (!decoding.empty()) {
+            JoinAll(threads);
+
+            std::vector<SnapshotChunk> decoded = std::move(decoding);
+            decoding = ReadChunks(filein, batch_size, remaining_chunks);
+            threads = DecodeChunks(decoding);
+
+            if (fRequestShutdown || !linker.Link(decoded)) {
+                success = false;
+                break;
+            }
+        }
+    } catch (const std::exception& e) {
+        success = error("%s: deserialize or I/O error - %s", __func__, e.what());
+    }
+
+    JoinAll(threads);
+
+    if (success && linker.Count() != entry_count) {
+        success = error("%s: expected %u entries but found %u", __func__, entry_count, linker.Count());
+    }
+
+    if (success) {
+        const auto iter = mapBlockIndex.find(hash_best_chain);
+
+        if (iter == mapBlockIndex.end()) {
+            success = error("%s: chain tip missing", __func__);
+        } else {
+            // The snapshot omits the forward links of the main chain:
+            for (CBlockIndex* pindex = iter->second; pindex->pprev; pindex = pindex->pprev) {
+                pindex->pprev->pnext = pindex;
+            }
+        }
+    }
+
+    if (!success) {
+        DiscardPartialBlockIndex();
+        return false;
+    }
+
+    block_count = entry_count;
+
+    LogPrintf("Time to load block index snapshot containing %u blocks : %15" PRId64 "ms",
+              block_count, GetTimeMillis() - start_time);
+
+    return true;
+}
@@ -0,0 +1,47 @@
+// Copyright (c) 2022 The Gridcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_NODE_BLOCKINDEXSNAPSHOT_H
+#define BITCOIN_NODE_BLOCKINDEXSNAPSHOT_H
+
+#include "fs.h"
+
+#include <cstdint>
+
+class uint256;
+
+/** Default for -blockindexsnapshot. */
+static constexpr bool DEFAULT_BLOCK_INDEX_SNAPSHOT = true;
+
+/** Get the location of the block index snapshot in the data directory. */
+fs::path GetBlockIndexSnapshotPath();
+
+/**
+ * Write the entire in-memory block index to a flat file that the next startup
+ * can load without scanning the block index records in LevelDB.
+ *
+ * Call this at shutdown after the threads that modify the block index stop.
+ *
+ * @param path Location of the snapshot file. Replaced atomically.
+ * @return false if the snapshot could not be written.
+ */
+bool WriteBlockIndexSnapshot(const fs::path& path);
+
+/**
+ * Load the block index from a snapshot file into mapBlockIndex.
+ *
+ * Worker threads verify and decode the chunks of the file while the calling
+ * thread links the entries that they decoded previously. The snapshot must
+ * belong to the chain tip stored in the database. On failure, this clears
+ * any partially loaded entries so that the caller can fall back to scanning
+ * the database.
+ *
+ * @param path            Location of the snapshot file.
+ * @param hash_best_chain Hash of the chain tip recorded in the database.
+ * @param block_count     Receives the number of entries loaded.
+ * @return false if the snapshot is missing, stale, or corrupt.
+ */
+bool LoadBlockIndexSnapshot(const fs::path& path, const uint256& hash_best_chain, uint32_t& block_count);
+
+#endif // BITCOIN_NODE_BLOCKINDEXSNAPSHOT_H
@@ -5,57 +5,422 @@
 
 #include "chainparams.h"
 #include "clientversion.h"
+#include "consensus/consensus.h"
+#include "crypto/common.h"
 #include "main.h"
+#include "node/blockstorage.h"
 #include "protocol.h"
 #include "serialize.h"
+#include "streams.h"
+#include "sync.h"
+#include "util/system.h"
+#include "util/threadnames.h"
 #include "validation.h"
 
+#include <algorithm>
+#include <cstring>
 #include <stdio.h>
+#include <vector>
+
+#ifdef WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+//! Block files grow to nearly 2 GB, so only map them where the address space
+//! can hold several at once.
+constexpr bool MAP_BLOCK_FILES = sizeof(void*) >= 8;
+
+struct CachedBlockFileMapping
+{
+    unsigned int nFile;
+    std::shared_ptr<const BlockFileMapping> mapping;
+    uint64_t last_used;
+};
+
+//!
+//! \brief Appends blocks to the current block file, which stays open between
+//! writes.
+//!
+struct BlockFileWriter
+{
+    FILE* file = nullptr;
+    unsigned int nFile = 1;
+    unsigned int nPos = 0;          //!< End of the block data in the file.
+    unsigned int nAllocated = 0;    //!< End of the space reserved for the file.
+    bool fCommitRequested = false;  //!< Sync at the next index commit.
+};
+
+Mutex cs_block_file_writer;
+BlockFileWriter g_block_file_writer GUARDED_BY(cs_block_file_writer);
+
+Mutex cs_block_file_mappings;
+std::vector<CachedBlockFileMapping> g_block_file_mappings GUARDED_BY(cs_block_file_mappings);
+uint64_t g_block_file_mapping_clock GUARDED_BY(cs_block_file_mappings) = 0;
+
+std::shared_ptr<const BlockFileMapping> MapWholeFile(const fs::path& path)
+{
+#ifdef WIN32
+    HANDLE file = CreateFileW(
+        path.wstring().c_str(),
+        GENERIC_READ,
+        FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+        nullptr,
+        OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL,
+        nullptr);
+
+    if (file == INVALID_HANDLE_VALUE) {
+        return nullptr;
+    }
+
+    LARGE_INTEGER size;
+
+    if (!GetFileSizeEx(file, &size) || size.QuadPart <= 0) {
+        CloseHandle(file);
+        return nullptr;
+    }
+
+    HANDLE file_mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    CloseHandle(file);
+
+    if (file_mapping == nullptr) {
+        return nullptr;
+    }
+
+    // The view keeps the mapping object alive after we close its handle:
+    void* data = MapViewOfFile(file_mapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(file_mapping);
+
+    if (data == nullptr) {
+        return nullptr;
+    }
+
+    return std::make_shared<const BlockFileMapping>(
+        static_cast<const unsigned char*>(data),
+        static_cast<size_t>(size.QuadPart));
+#else
+    int fd = open(path.c_str(), O_RDONLY);
+
+    if (fd == -1) {
+        return nullptr;
+    }
+
+    struct stat st;
+
+    if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+        close(fd);
+        return nullptr;
+    }
+
+    // The mapping stays valid after we close the descriptor:
+    void* data = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (data == MAP_FAILED) {
+        return nullptr;
+    }
+
+    return std::make_shared<const BlockFileMapping>(
+        static_cast<const unsigned char*>(data),
+        static_cast<size_t>(st.st_size));
+#endif
+}
+
+//!
+//! \brief Sync the open block file and close it after releasing the space
+//! reserved past the end of its block data.
+//!
+bool FinalizeBlockFile(BlockFileWriter& writer) EXCLUSIVE_LOCKS_REQUIRED(cs_block_file_writer)
+{
+    if (!writer.file) {
+        return true;
+    }
+
+    // Drop the cached mappings before the file shrinks under them. A reader
+    // that touches a mapped page past the new end of the file gets SIGBUS:
+    InvalidateBlockFileMapping(writer.nFile);
+
+    bool fOk = TruncateFile(writer.file, writer.nPos);
+    fOk &= FileCommit(writer.file);
+    fclose(writer.file);
+
+    writer.file = nullptr;
+    writer.fCommitRequested = false;
+
+    return fOk;
+}
+
+//!
+//! \brief Open the block file to append to, roll over to a new file when the
+//! current one is full, and reserve space for the next write.
+//!
+bool PrepareBlockFile(BlockFileWriter& writer, unsigned int nAddSize) EXCLUSIVE_LOCKS_REQUIRED(cs_block_file_writer)
+{
+    while (true) {
+        if (!writer.file) {
+            FILE* file = OpenBlockFile(writer.nFile, 0, "rb+");
+
+            if (!file) {
+                file = OpenBlockFile(writer.nFile, 0, "wb+");
+            }
+
+            if (!file) {
+                return false;
+            }
+
+            // A file left open by a crash keeps its reserved space. We append
+            // after it since nothing records where its block data ends:
+            long size = -1;
+
+            if (fseek(file, 0, SEEK_END) != 0 || (size = ftell(file)) < 0) {
+                fclose(file);
+                return false;
+            }
+
+            writer.file = file;
+            writer.nPos = size;
+            writer.nAllocated = size;
+        }
+
+        if (writer.nPos < MAX_BLOCKFILE_SIZE) {
+            break;
+        }
+
+        if (!FinalizeBlockFile(writer)) {
+            LogPrintf("WARNING: %s: failed to finalize block file %u", __func__, writer.nFile);
+        }
+
+        writer.nFile++;
+    }
+
+    if (writer.nPos + nAddSize > writer.nAllocated) {
+        const unsigned int nChunks = (writer.nPos + nAddSize + BLOCKFILE_CHUNK_SIZE - 1) / BLOCKFILE_CHUNK_SIZE;
+        const unsigned int nNewAllocated = nChunks * BLOCKFILE_CHUNK_SIZE;
+
+        AllocateFileRange(writer.file, writer.nAllocated, nNewAllocated - writer.nAllocated);
+        writer.nAllocated = nNewAllocated;
+
+        // The fallback allocation writes zeros through the stream:
+        if (fseek(writer.file, writer.nPos, SEEK_SET) != 0) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+//!
+//! \brief Deserialize a block through the shared cache of mapped block files.
+//!
+//! \return false if the block is not available through a mapping or does not
+//! deserialize from it. The caller then reads the block with stdio.
+//!
+bool ReadBlockFromMapping(CBlock& block, unsigned int nFile, unsigned int nBlockPos, const int ser_flags)
+{
+    // The block size precedes the block:
+    if (nBlockPos < sizeof(uint32_t)) {
+        return false;
+    }
+
+    std::shared_ptr<const BlockFileMapping> mapping = MapBlockFile(nFile, nBlockPos);
+
+    if (!mapping) {
+        return false;
+    }
+
+    const uint32_t nSize = ReadLE32(mapping->Data().data() + nBlockPos - sizeof(uint32_t));
+
+    if (nSize > MAX_SIZE) {
+        return false;
+    }
+
+    if (nBlockPos + nSize > mapping->Data().size()) {
+        mapping = MapBlockFile(nFile, nBlockPos + nSize);
+
+        if (!mapping) {
+            return false;
+        }
+    }
+
+    SpanReader reader(ser_flags, CLIENT_VERSION, mapping->Data().subspan(nBlockPos, nSize));
+
+    try {
+        reader >> block;
+    } catch (const std::exception&) {
+        block.SetNull();
+        return false;
+    }
+
+    return true;
+}
+} // Anonymous namespace
+
+BlockFileMapping::BlockFileMapping(const unsigned char* data, size_t size)
+    : m_data(data), m_size(size)
+{
+}
+
+BlockFileMapping::~BlockFileMapping()
+{
+#ifdef WIN32
+    UnmapViewOfFile(m_data);
+#else
+    munmap(const_cast<unsigned char*>(m_data), m_size);
+#endif
+}
+
+std::shared_ptr<const BlockFileMapping> MapBlockFile(unsigned int nFile, uint64_t min_size)
+{
+    if (!MAP_BLOCK_FILES || nFile < 1 || nFile == (unsigned int) -1) {
+        return nullptr;
+    }
+
+    LOCK(cs_block_file_mappings);
+
+    const uint64_t now = ++g_block_file_mapping_clock;
+    auto lru = g_block_file_mappings.end();
+
+    for (auto iter = g_block_file_mappings.begin(); iter != g_block_file_mappings.end(); ++iter) {
+        if (iter->nFile == nFile) {
+            if (iter->mapping->Data().size() < min_size) {
+                lru = iter;
+                break;
+            }
+
+            iter->last_used = now;
+
+            return iter->mapping;
+        }
+
+        if (lru == g_block_file_mappings.end() || iter->last_used < lru->last_used) {
+            lru = iter;
+        }
+    }
+
+    std::shared_ptr<const BlockFileMapping> mapping = MapWholeFile(BlockFilePath(nFile));
+
+    if (!mapping || mapping->Data().size() < min_size) {
+        return nullptr;
+    }
+
+    if (lru != g_block_file_mappings.end()
+        && (lru->nFile == nFile || g_block_file_mappings.size() >= MAX_MAPPED_BLOCK_FILES))
+    {
+        *lru = { nFile, mapping, now };
+    } else {
+        g_block_file_mappings.push_back({ nFile, mapping, now });
+    }
+
+    return mapping;
+}
+
+void InvalidateBlockFileMapping(unsigned int nFile)
+{
+    LOCK(cs_block_file_mappings);
+
+    g_block_file_mappings.erase(
+        std::remove_if(
+            g_block_file_mappings.begin(),
+            g_block_file_mappings.end(),
+            [&](const CachedBlockFileMapping& entry) { return entry.nFile == nFile; }),
+        g_block_file_mappings.end());
+}
+
+void FlushBlockFileMappings()
+{
+    LOCK(cs_block_file_mappings);
+
+    g_block_file_mappings.clear();
+}
 
 
 bool WriteBlockToDisk(const CBlock& block, unsigned int& nFileRet, unsigned int& nBlockPosRet,
                       const CMessageHeader::MessageStartChars& messageStart)
 {
-    // Open history file to append
-    CAutoFile fileout(AppendBlockFile(nFileRet), SER_DISK, CLIENT_VERSION);
-    if (fileout.IsNull())
-        return error("%s: AppendBlockFile failed", __func__);
+    // Serialize the index header and the block so that they reach the file
+    // in one write:
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    unsigned int nSize = GetSerializeSize(ss, block);
+    ss.reserve(sizeof(messageStart) + sizeof(nSize) + nSize);
+    ss << messageStart << nSize << block;
 
-    // Write index header
-    unsigned int nSize = GetSerializeSize(fileout, block);
-    fileout << messageStart << nSize;
+    // Defer the sync to the index commit that refers to the block:
+    const bool fCommit = !IsInitialBlockDownload() || (nBestHeight + 1) % 5000 == 0;
 
-    // Write block
-    long fileOutPos = ftell(fileout.Get());
-    if (fileOutPos < 0)
-        return error("%s: ftell failed", __func__);
-    nBlockPosRet = fileOutPos;
-    fileout << block;
+    LOCK(cs_block_file_writer);
+    BlockFileWriter& writer = g_block_file_writer;
 
-    // Flush stdio buffers and commit to disk before returning
-    fflush(fileout.Get());
-    if (!IsInitialBlockDownload() || (nBestHeight + 1) % 5000 == 0)
-        FileCommit(fileout.Get());
+    if (!PrepareBlockFile(writer, ss.size()))
+        return error("%s: cannot open block file %u to append", __func__, writer.nFile);
+
+    // Flush the stdio buffer so that readers with their own handles find
+    // the block:
+    if (fwrite(ss.data(), 1, ss.size(), writer.file) != ss.size() || fflush(writer.file) != 0) {
+        // Reopen the file on the next write rather than guess where a partial
+        // write left the stream:
+        fclose(writer.file);
+        writer.file = nullptr;
+        return error("%s: failed to write to block file %u", __func__, writer.nFile);
+    }
+
+    nFileRet = writer.nFile;
+    nBlockPosRet = writer.nPos + sizeof(messageStart) + sizeof(nSize);
+
+    writer.nPos += ss.size();
+    writer.fCommitRequested |= fCommit;
+
+    InvalidateBlockFileMapping(nFileRet);
 
     return true;
 }
 
+bool CommitBlockFile()
+{
+    LOCK(cs_block_file_writer);
+    BlockFileWriter& writer = g_block_file_writer;
+
+    if (!writer.file || !writer.fCommitRequested) {
+        return true;
+    }
+
+    writer.fCommitRequested = false;
+
+    return FileCommit(writer.file);
+}
+
+bool CloseBlockFile()
+{
+    LOCK(cs_block_file_writer);
+
+    return FinalizeBlockFile(g_block_file_writer);
+}
+
 
 bool ReadBlockFromDisk(CBlock& block, unsigned int nFile, unsigned int nBlockPos,
-                       const Consensus::Params& params, bool fReadTransactions=true)
+                       const Consensus::Params& params, bool fReadTransactions)
 {
     block.SetNull();
 
     const int ser_flags = SER_DISK | (fReadTransactions ? 0 : SER_BLOCKHEADERONLY);
 
-    // Open history file to read
-    CAutoFile filein(OpenBlockFile(nFile, nBlockPos, "rb"), ser_flags, CLIENT_VERSION);
-    if (filein.IsNull())
-        return error("%s: OpenBlockFile failed", __func__);
-
-    // Read block
     try {
-        filein >> block;
+        if (!ReadBlockFromMapping(block, nFile, nBlockPos, ser_flags)) {
+            // Open history file to read
+            CAutoFile filein(OpenBlockFile(nFile, nBlockPos, "rb"), ser_flags, CLIENT_VERSION);
+            if (filein.IsNull())
+                return error("%s: OpenBlockFile failed", __func__);
+
+            filein >> block;
+        }
     }
     catch (std::exception &e) {
         return error("%s: deserialize or I/O error", __func__);
@@ -70,7 +435,7 @@ bool ReadBlockFromDisk(CBlock& block, unsigned int nFile, unsigned int nBlockPos
 
 
 bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex, const Consensus::Params& params,
-                       bool fReadTransactions=true)
+                       bool fReadTransactions)
 {
     if (!fReadTransactions)
     {
@@ -88,3 +453,387 @@ bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex, const Consensus
     return true;
 }
 
+struct SequentialBlockReader::Slot
+{
+    CBlockIndex* pindex;
+    CBlock block;
+    bool fRead = false;
+    bool fDone = false;
+
+    explicit Slot(CBlockIndex* pindex_in) : pindex(pindex_in) { }
+};
+
+SequentialBlockReader::SequentialBlockReader(
+    CBlockIndex* pindex_start,
+    const CBlockIndex* pindex_end,
+    Filter filter,
+    size_t readahead,
+    int threads)
+    : m_cursor(pindex_start)
+    , m_end(pindex_end)
+    , m_filter(std::move(filter))
+    , m_readahead(std::max<size_t>(readahead, 1))
+{
+    Fill();
+
+    for (int n = 0; n < threads; ++n) {
+        m_threads.emplace_back([this, n]() {
+            util::ThreadRename(strprintf("blkread.%i", n));
+            WorkerLoop();
+        });
+    }
+}
+
+SequentialBlockReader::~SequentialBlockReader()
+{
+    WITH_LOCK(m_mutex, m_stop = true);
+    m_worker_cv.notify_all();
+
+    for (auto& thread : m_threads) {
+        thread.join();
+    }
+}
+
+void SequentialBlockReader::Fill()
+{
+    {
+        LOCK(m_mutex);
+
+        while (m_cursor && m_slots.size() < m_readahead) {
+            CBlockIndex* pindex = m_cursor;
+            m_cursor = pindex == m_end ? nullptr : pindex->pnext;
+
+            if (m_filter && !m_filter(pindex)) {
+                continue;
+            }
+
+            m_slots.emplace_back(std::make_unique<Slot>(pindex));
+            m_unread.push_back(m_slots.back().get());
+        }
+    }
+
+    m_worker_cv.notify_all();
+}
+
+void SequentialBlockReader::ReadSlot(Slot& slot)
+{
+    CBlock block;
+    const bool fRead = ReadBlockFromDisk(block, slot.pindex, Params().GetConsensus());
+
+    if (!fRead) {
+        block.SetNull();
+    }
+
+    {
+        LOCK(m_mutex);
+        slot.block = std::move(block);
+        slot.fRead = fRead;
+        slot.fDone = true;
+    }
+
+    m_done_cv.notify_all();
+}
+
+void SequentialBlockReader::WorkerLoop()
+{
+    while (true) {
+        Slot* slot;
+
+        {
+            WAIT_LOCK(m_mutex, lock);
+
+            while (!m_stop && m_unread.empty()) {
+                m_worker_cv.wait(lock);
+            }
+
+            if (m_stop) {
+                return;
+            }
+
+            slot = m_unread.front();
+            m_unread.pop_front();
+        }
+
+        ReadSlot(*slot);
+    }
+}
+
+CBlockIndex* SequentialBlockReader::Next(CBlock& block, bool& fRead)
+{
+    Slot* slot;
+    bool fClaimed = false;
+
+    {
+        LOCK(m_mutex);
+
+        if (m_slots.empty()) {
+            block.SetNull();
+            fRead = false;
+            return nullptr;
+        }
+
+        slot = m_slots.front().get();
+
+        // Rather than wait for a worker to start on the block that we need
+        // now, read it here:
+        if (!m_unread.empty() && m_unread.front() == slot) {
+            m_unread.pop_front();
+            fClaimed = true;
+        }
+    }
+
+    if (fClaimed) {
+        ReadSlot(*slot);
+    }
+
+    std::unique_ptr<Slot> done;
+
+    {
+        WAIT_LOCK(m_mutex, lock);
+
+        while (!slot->fDone) {
+            m_done_cv.wait(lock);
+        }
+
+        done = std::move(m_slots.front());
+        m_slots.pop_front();
+    }
+
+    Fill();
+
+    block = std::move(done->block);
+    fRead = done->fRead;
+
+    return done->pindex;
+}
+
+struct ExternalBlockFileReader::Slot
+{
+    std::vector<unsigned char> data;
+    uint64_t nPos = 0;
+    int nHeightHint = 0;
+    CBlock block;
+    bool fParsed = false;
+    bool fDone = false;
+};
+
+ExternalBlockFileReader::ExternalBlockFileReader(
+    FILE* file,
+    int start_height,
+    size_t queue_size,
+    int threads)
+    : m_file(std::make_unique<CBufferedFile>(file, 2 * MAX_BLOCK_SIZE, MAX_BLOCK_SIZE + 8, SER_DISK, CLIENT_VERSION))
+    , m_start_height(start_height)
+    , m_queue_size(std::max<size_t>(queue_size, 1))
+{
+    m_reader = std::thread([this]() {
+        util::ThreadRename("loadblk");
+        ReaderLoop();
+    });
+
+    for (int n = 0; n < threads; ++n) {
+        m_threads.emplace_back([this, n]() {
+            util::ThreadRename(strprintf("loadblk.%i", n));
+            WorkerLoop();
+        });
+    }
+}
+
+ExternalBlockFileReader::~ExternalBlockFileReader()
+{
+    WITH_LOCK(m_mutex, m_stop = true);
+    m_reader_cv.notify_all();
+    m_worker_cv.notify_all();
+
+    m_reader.join();
+
+    for (auto& thread : m_threads) {
+        thread.join();
+    }
+}
+
+void ExternalBlockFileReader::ReaderLoop()
+{
+    const CMessageHeader::MessageStartChars& message_start = Params().MessageStart();
+    CBufferedFile& blkdat = *m_file;
+    uint64_t nRewind = blkdat.GetPos();
+    int nHeightHint = m_start_height;
+
+    while (true) {
+        {
+            WAIT_LOCK(m_mutex, lock);
+
+            while (!m_stop && m_slots.size() >= m_queue_size) {
+                m_reader_cv.wait(lock);
+            }
+
+            if (m_stop) {
+                break;
+            }
+        }
+
+        blkdat.SetPos(nRewind);
+        nRewind++; // start one byte further next time, in case of failure
+        blkdat.SetLimit(); // remove former limit
+        unsigned int nSize = 0;
+
+        try {
+            // Locate a header:
+            unsigned char buf[CMessageHeader::MESSAGE_START_SIZE];
+            blkdat.FindByte(static_cast<char>(message_start[0]));
+            nRewind = blkdat.GetPos() + 1;
+            blkdat.read(MakeWritableByteSpan(buf));
+
+            if (memcmp(buf, message_start, CMessageHeader::MESSAGE_START_SIZE)) {
+                continue;
+            }
+
+            blkdat >> nSize;
+
+            if (nSize < 80 || nSize > MAX_BLOCK_SIZE) {
+                continue;
+            }
+        } catch (const std::exception&) {
+            // No valid block header found before the end of the file.
+            break;
+        }
+
+        auto slot = std::make_unique<Slot>();
+        slot->nPos = blkdat.GetPos();
+        slot->nHeightHint = ++nHeightHint;
+        slot->data.resize(nSize);
+
+        try {
+            blkdat.read(MakeWritableByteSpan(slot->data));
+        } catch (const std::exception&) {
+            LogPrintf("WARNING: %s: The file ends inside the block at offset %" PRIu64, __func__, slot->nPos);
+            break;
+        }
+
+        nRewind = blkdat.GetPos();
+
+        {
+            LOCK(m_mutex);
+            m_unparsed.push_back(slot.get());
+            m_slots.push_back(std::move(slot));
+        }
+
+        m_worker_cv.notify_one();
+        m_done_cv.notify_all();
+    }
+
+    WITH_LOCK(m_mutex, m_eof = true);
+    m_done_cv.notify_all();
+}
+
+void ExternalBlockFileReader::ParseSlot(Slot& slot)
+{
+    CBlock block;
+    bool fParsed = false;
+
+    try {
+        SpanReader reader(SER_DISK, CLIENT_VERSION, slot.data);
+        reader >> block;
+        fParsed = true;
+    } catch (const std::exception& e) {
+        LogPrintf("WARNING: %s: Deserialize error for the block at offset %" PRIu64 ": %s",
+                  __func__, slot.nPos, e.what());
+    }
+
+    // CheckBlock() only remembers a block that passed the checks for heights
+    // above the grandfather height, which are the strictest ones. Blocks that
+    // connect below it, or fail here, are checked again when they connect:
+    if (fParsed && slot.nHeightHint > nGrandfather) {
+        CheckBlock(block, slot.nHeightHint);
+    }
+
+    std::vector<unsigned char>().swap(slot.data);
+
+    {
+        LOCK(m_mutex);
+        slot.block = std::move(block);
+        slot.fParsed = fParsed;
+        slot.fDone = true;
+    }
+
+    m_done_cv.notify_all();
+}
+
+void ExternalBlockFileReader::WorkerLoop()
+{
+    while (true) {
+        Slot* slot;
+
+        {
+            WAIT_LOCK(m_mutex, lock);
+
+            while (!m_stop && m_unparsed.empty()) {
+                m_worker_cv.wait(lock);
+            }
+
+            if (m_stop) {
+                return;
+            }
+
+            slot = m_unparsed.front();
+            m_unparsed.pop_front();
+        }
+
+        ParseSlot(*slot);
+    }
+}
+
+bool ExternalBlockFileReader::Next(CBlock& block, uint64_t& nPos)
+{
+    while (true) {
+        Slot* slot;
+        bool fClaimed = false;
+
+        {
+            WAIT_LOCK(m_mutex, lock);
+
+            while (m_slots.empty() && !m_eof) {
+                m_done_cv.wait(lock);
+            }
+
+            if (m_slots.empty()) {
+                return false;
+            }
+
+            slot = m_slots.front().get();
+
+            // Rather than wait for a worker to start on the block that we need
+            // now, deserialize it here:
+            if (!m_unparsed.empty() && m_unparsed.front() == slot) {
+                m_unparsed.pop_front();
+                fClaimed = true;
+            }
+        }
+
+        if (fClaimed) {
+            ParseSlot(*slot);
+        }
+
+        std::unique_ptr<Slot> done;
+
+        {
+            WAIT_LOCK(m_mutex, lock);
+
+            while (!slot->fDone) {
+                m_done_cv.wait(lock);
+            }
+
+            done = std::move(m_slots.front());
+            m_slots.pop_front();
+        }
+
+        m_reader_cv.notify_one();
+
+        if (done->fParsed) {
+            block = std::move(done->block);
+            nPos = done->nPos;
+
+            return true;
+        }
+    }
+}
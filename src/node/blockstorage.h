@@ -7,19 +7,236 @@
 #define BITCOIN_NODE_BLOCKSTORAGE_H
 
 #include "protocol.h"
+#include "serialize.h"
+#include "span.h"
+#include "sync.h"
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
 
 class CBlock;
 class CBlockIndex;
+class CBufferedFile;
 
 namespace Consensus {
 struct Params;
 }
 
+/** Block files roll over once they reach this size. Stay under 2 GB for fseek() and ftell(). */
+static constexpr unsigned int MAX_BLOCKFILE_SIZE = 0x7F000000 - MAX_SIZE;
+/** The block file writer reserves space in chunks of this size. */
+static constexpr unsigned int BLOCKFILE_CHUNK_SIZE = 0x1000000; // 16 MiB
+
+/** Maximum number of block files that stay memory-mapped for reading. */
+static constexpr size_t MAX_MAPPED_BLOCK_FILES = 8;
+
+/**
+ * A read-only memory mapping of a block file. Readers share mappings, so a
+ * reader can keep using one after the cache drops it.
+ */
+class BlockFileMapping
+{
+public:
+    BlockFileMapping(const unsigned char* data, size_t size);
+    ~BlockFileMapping();
+
+    BlockFileMapping(const BlockFileMapping&) = delete;
+    BlockFileMapping& operator=(const BlockFileMapping&) = delete;
+
+    Span<const unsigned char> Data() const { return {m_data, m_size}; }
+
+private:
+    const unsigned char* const m_data;
+    const size_t m_size;
+};
+
+/**
+ * Get a mapping of block file nFile from the shared cache of mapped block
+ * files.
+ *
+ * A cached mapping that ends before min_size is replaced by a new mapping of
+ * the file as it exists now, because the file grew after we mapped it.
+ *
+ * @return nullptr if the file cannot be mapped or is smaller than min_size.
+ * Callers fall back to reading the file with stdio.
+ */
+std::shared_ptr<const BlockFileMapping> MapBlockFile(unsigned int nFile, uint64_t min_size);
+
+/** Drop the cached mapping of a block file after appending to it. */
+void InvalidateBlockFileMapping(unsigned int nFile);
+
+/** Drop all cached mappings, for example before removing the block files. */
+void FlushBlockFileMappings();
+
+/**
+ * Append a block to the open block file. The file stays open for the next
+ * block, and the data reaches the disk at the next CommitBlockFile() call.
+ */
 bool WriteBlockToDisk(const CBlock& block, unsigned int& nFileRet, unsigned int& nBlockPosRet, const CMessageHeader::MessageStartChars& messageStart);
 
+/**
+ * Sync the block data appended to the open block file if a write requested
+ * it. Block database transactions call this before they commit index entries
+ * that refer to the data.
+ */
+bool CommitBlockFile();
+
+/** Sync and close the open block file and release its unused reserved space. */
+bool CloseBlockFile();
+
 bool ReadBlockFromDisk(CBlock& block, unsigned int nFile, unsigned int nBlockPos, const Consensus::Params& params, bool fReadTransactions=true);
 bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex, const Consensus::Params& params, bool fReadTransactions=true);
 
+/** Default number of blocks that a SequentialBlockReader reads ahead. */
+static constexpr size_t DEFAULT_BLOCK_READAHEAD = 32;
+/** Default number of threads that read blocks ahead for a SequentialBlockReader. */
+static constexpr int DEFAULT_BLOCK_READAHEAD_THREADS = 2;
 
-#endif // BITCOIN_NODE_BLOCKSTORAGE_H
+/**
+ * Reads the blocks of the active chain in order for scans that visit many
+ * blocks. Worker threads read and deserialize the next blocks from disk while
+ * the caller processes the current one.
+ *
+ * The reader follows pnext from the calling thread only, so a caller that
+ * holds cs_main for the scan keeps the walk consistent. The worker threads
+ * only touch the block file positions of the index entries.
+ */
+class SequentialBlockReader
+{
+public:
+    /** Selects the blocks to read. The reader skips the others. */
+    using Filter = std::function<bool(const CBlockIndex*)>;
+
+    /**
+     * @param pindex_start First block to read.
+     * @param pindex_end   Last block to read, or nullptr to read to the tip.
+     * @param filter       Selects the blocks to read, or nullptr for all.
+     * @param readahead    Maximum number of blocks read ahead of the caller.
+     * @param threads      Number of read-ahead threads. With zero, the caller
+     *                     reads each block itself.
+     */
+    SequentialBlockReader(
+        CBlockIndex* pindex_start,
+        const CBlockIndex* pindex_end = nullptr,
+        Filter filter = nullptr,
+        size_t readahead = DEFAULT_BLOCK_READAHEAD,
+        int threads = DEFAULT_BLOCK_READAHEAD_THREADS);
+
+    ~SequentialBlockReader();
+
+    SequentialBlockReader(const SequentialBlockReader&) = delete;
+    SequentialBlockReader& operator=(const SequentialBlockReader&) = delete;
 
+    /**
+     * Get the next selected block.
+     *
+     * @param block   Receives the block. It is null when fRead is false.
+     * @param fRead   Set to false when the block failed to read from disk.
+     *
+     * @return Index entry of the block, or nullptr after the last block.
+     */
+    CBlockIndex* Next(CBlock& block, bool& fRead);
+
+private:
+    struct Slot;
+
+    //! Next index entry to queue. Only the calling thread follows pnext.
+    CBlockIndex* m_cursor;
+    const CBlockIndex* const m_end;
+    const Filter m_filter;
+    const size_t m_readahead;
+
+    Mutex m_mutex;
+    std::condition_variable m_worker_cv;
+    std::condition_variable m_done_cv;
+    //! Blocks queued for the caller, in chain order.
+    std::deque<std::unique_ptr<Slot>> m_slots GUARDED_BY(m_mutex);
+    //! Queued blocks that no thread started to read yet, in chain order.
+    std::deque<Slot*> m_unread GUARDED_BY(m_mutex);
+    bool m_stop GUARDED_BY(m_mutex) = false;
+    std::vector<std::thread> m_threads;
+
+    void Fill();
+    void ReadSlot(Slot& slot);
+    void WorkerLoop();
+};
+
+
+/** Default number of blocks that an import queues ahead of the connecting thread. */
+static constexpr size_t DEFAULT_IMPORT_QUEUE_SIZE = 256;
+/** Default number of threads that deserialize and check blocks for an import. */
+static constexpr int DEFAULT_IMPORT_THREADS = 2;
+
+/**
+ * Loads the blocks from an external block file, such as bootstrap.dat or the
+ * inputs of -loadblock and -reindex, for a bulk import.
+ *
+ * A reader thread scans the file for blocks. Worker threads deserialize them
+ * and run the context-free block checks, which CheckBlock() then remembers
+ * for the block. The caller takes the blocks in file order and only needs
+ * cs_main to connect them.
+ */
+class ExternalBlockFileReader
+{
+public:
+    /**
+     * @param file         File to read. The reader closes it.
+     * @param start_height Height of the chain tip before the import. The
+     *                     workers only check blocks that will connect above
+     *                     the signature grandfather height.
+     * @param queue_size   Maximum number of blocks read ahead of the caller.
+     * @param threads      Number of worker threads. With zero, the caller
+     *                     deserializes each block itself.
+     */
+    ExternalBlockFileReader(
+        FILE* file,
+        int start_height,
+        size_t queue_size = DEFAULT_IMPORT_QUEUE_SIZE,
+        int threads = DEFAULT_IMPORT_THREADS);
+
+    ~ExternalBlockFileReader();
+
+    ExternalBlockFileReader(const ExternalBlockFileReader&) = delete;
+    ExternalBlockFileReader& operator=(const ExternalBlockFileReader&) = delete;
+
+    /**
+     * Get the next block that deserializes, in file order.
+     *
+     * @param block Receives the block.
+     * @param nPos  Receives the offset of the block in the file.
+     *
+     * @return false after the last block.
+     */
+    bool Next(CBlock& block, uint64_t& nPos);
+
+private:
+    struct Slot;
+
+    const std::unique_ptr<CBufferedFile> m_file;
+    const int m_start_height;
+    const size_t m_queue_size;
+
+    Mutex m_mutex;
+    std::condition_variable m_reader_cv;
+    std::condition_variable m_worker_cv;
+    std::condition_variable m_done_cv;
+    //! Blocks queued for the caller, in file order.
+    std::deque<std::unique_ptr<Slot>> m_slots GUARDED_BY(m_mutex);
+    //! Queued blocks that no thread started to deserialize yet, in file order.
+    std::deque<Slot*> m_unparsed GUARDED_BY(m_mutex);
+    bool m_eof GUARDED_BY(m_mutex) = false;
+    bool m_stop GUARDED_BY(m_mutex) = false;
+    std::thread m_reader;
+    std::vector<std::thread> m_threads;
+
+    void ReaderLoop();
+    void ParseSlot(Slot& slot);
+    void WorkerLoop();
+};
+
+#endif // BITCOIN_NODE_BLOCKSTORAGE_H
@@ -11,6 +11,8 @@
 #include "script.h"
 #include "serialize.h"
 
+#include <cassert>
+
 /** An inpoint - a combination of a transaction and an index n into its vin */
 class CInPoint
 {
@@ -241,6 +243,12 @@ public:
         } else {
             READWRITE(hashBoinc);
         }
+
+        // Transactions received from peers or read from disk are not expected
+        // to change, so hash them once here instead of on every GetHash():
+        if (ser_action.ForRead()) {
+            m_cached_hash.m_hash = SerializeHash(*this);
+        }
     }
 
     void SetNull()
@@ -253,6 +261,7 @@ public:
         nDoS = 0;  // Denial-of-service prevention
         hashBoinc = "";
         vContracts.clear();
+        m_cached_hash.m_hash.SetNull();
     }
 
     bool IsNull() const
@@ -262,9 +271,30 @@ public:
 
     uint256 GetHash() const
     {
+        if (!m_cached_hash.m_hash.IsNull()) {
+#ifdef DEBUG
+            // Catch the code that modifies a transaction without calling
+            // ClearCachedHash():
+            assert(m_cached_hash.m_hash == SerializeHash(*this));
+#endif
+            return m_cached_hash.m_hash;
+        }
+
         return SerializeHash(*this);
     }
 
+    //!
+    //! \brief Discard the hash computed when the transaction was deserialized.
+    //!
+    //! Code that modifies a transaction after reading it from a stream, or a
+    //! copy of such a transaction, must call this so that GetHash() reflects
+    //! the changes. Builds with DEBUG defined check this on each GetHash().
+    //!
+    void ClearCachedHash()
+    {
+        m_cached_hash.m_hash.SetNull();
+    }
+
     bool IsCoinBase() const
     {
         return (vin.size() == 1 && vin[0].prevout.IsNull() && vout.size() >= 1);
@@ -334,10 +364,50 @@ public:
     std::vector<GRC::Contract> PullContracts()
     {
         GetContracts(); // Populate vContracts for legacy transactions.
+        ClearCachedHash();
 
         return std::move(vContracts);
     }
 
+private:
+    //!
+    //! \brief Holds the hash of a deserialized transaction.
+    //!
+    //! Copies keep the hash, so the mempool and wallet copies of a received
+    //! transaction do not hash it again. A move takes the hash and leaves the
+    //! moved-from transaction without one, because its fields are no longer
+    //! the ones that were hashed.
+    //!
+    class CachedHash
+    {
+    public:
+        CachedHash() = default;
+        CachedHash(const CachedHash&) = default;
+        CachedHash& operator=(const CachedHash&) = default;
+
+        CachedHash(CachedHash&& other) noexcept : m_hash(other.m_hash)
+        {
+            other.m_hash.SetNull();
+        }
+
+        CachedHash& operator=(CachedHash&& other) noexcept
+        {
+            if (this != &other) {
+                m_hash = other.m_hash;
+                other.m_hash.SetNull();
+            }
+
+            return *this;
+        }
+
+        uint256 m_hash;
+    };
+
+    //!
+    //! \brief Hash of a transaction that was deserialized. Null for a
+    //! transaction built in memory, which hashes itself on each GetHash().
+    //!
+    CachedHash m_cached_hash;
 };
 
 #endif // BITCOIN_PRIMITIVES_TRANSACTION_H
@@ -192,7 +192,7 @@ UniValue blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool fP
         blockindex->IsProofOfStake() ? "proof-of-stake" : "proof-of-work",
         blockindex->GeneratedStakeModifier()? " stake-modifier": "") + " " + PoRNarr);
 
-    result.pushKV("proofhash", blockindex->hashProof.GetHex());
+    result.pushKV("proofhash", blockindex->GetProofHash().GetHex());
     result.pushKV("entropybit", (int)blockindex->GetStakeEntropyBit());
     result.pushKV("modifier", strprintf("%016" PRIx64, blockindex->nStakeModifier));
 
@@ -545,19 +545,14 @@ UniValue getmrcinfo(const UniValue& params, bool fHelp)
         high_height = pindexBest->nHeight;
     }
 
-    CBlockIndex* blockindex = pindexBest;
-
-    // Rewind to low height.
-    for (; blockindex; blockindex = blockindex->pprev) {
-        if (blockindex->nHeight == low_height) break;
-    }
+    CBlockIndex* blockindex = g_active_chain[low_height];
 
     while (blockindex && blockindex->nHeight <= high_height) {
         CAmount mrc_research_rewards = 0;
 
-        for (const auto& mrc_context : blockindex->m_mrc_researchers) {
-            if (output_all_cpids || mrc_context->m_cpid == *cpid) {
-                mrc_research_rewards += mrc_context->m_research_subsidy;
+        for (const auto& mrc_context : blockindex->MRCResearchers()) {
+            if (output_all_cpids || mrc_context.m_cpid == *cpid) {
+                mrc_research_rewards += mrc_context.m_research_subsidy;
             }
         }
 
@@ -582,7 +577,7 @@ UniValue getmrcinfo(const UniValue& params, bool fHelp)
                     + mrc_fees.m_mrc_staker_fees
                     - mrc_fees.m_mrc_minimum_calc_fees;
 
-            mrcs_paid = claim.m_mrc_tx_map.size(); // This also matches the size of the blockindex->m_mrc_researchers
+            mrcs_paid = claim.m_mrc_tx_map.size(); // This also matches the size of the blockindex->MRCResearchers()
 
             if (output_mrc_details) {
                 UniValue mrc_requests_output_array(UniValue::VARR);
@@ -2802,8 +2797,11 @@ UniValue getburnreport(const UniValue& params, bool fHelp)
     // We can try additional heuristics in the future, but many of these will
     // be very difficult or expensive to recognize.
     //
-    for (const CBlockIndex* pindex = pindexGenesisBlock; pindex; pindex = pindex->pnext) {
-        if (!ReadBlockFromDisk(block, pindex, Params().GetConsensus())) {
+    SequentialBlockReader reader(pindexGenesisBlock);
+    bool fRead;
+
+    while (const CBlockIndex* pindex = reader.Next(block, fRead)) {
+        if (!fRead) {
             continue;
         }
 
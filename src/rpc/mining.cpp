@@ -474,19 +474,19 @@ UniValue auditsnapshotaccrual(const UniValue& params, bool fHelp)
 
                 accrual = 0;
                 pindex_low = pindex;
-            } else if (!pindex->m_mrc_researchers.empty()) {
-                // Because m_mrc_researchers is derived from a map that is keyed by CPID, the CPID must exist, and it
+            } else if (!pindex->MRCResearchers().empty()) {
+                // Because the MRC researchers are derived from a map that is keyed by CPID, the CPID must exist, and it
                 // must be unique (i.e. there will only be one match).
-                for (const auto& mrc : pindex->m_mrc_researchers) {
+                for (const auto& mrc : pindex->MRCResearchers()) {
                     // mrc payments are on the block previous to the staked block (the head of the chain when the mrc
                     // was submitted.
-                    if (mrc->m_cpid == *cpid) {
+                    if (mrc.m_cpid == *cpid) {
                         tally_accrual_period(
                                     "mrc payment",
                                     pindex->nHeight,
                                     pindex_low->nTime,
                                     pindex->pprev->nTime,
-                                    mrc->m_research_subsidy);
+                                    mrc.m_research_subsidy);
 
                         accrual = 0;
                         pindex_low = pindex->pprev;
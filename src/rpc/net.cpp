@@ -384,6 +384,9 @@ UniValue getpeerinfo(const UniValue& params, bool fHelp)
         obj.pushKV("lastrecv", stats.nLastRecv);
         obj.pushKV("bytessent", stats.nSendBytes);
         obj.pushKV("bytesrecv", stats.nRecvBytes);
+        obj.pushKV("msgssent", stats.nSendMsgs);
+        obj.pushKV("sendcalls", stats.nSendCalls);
+        obj.pushKV("recvcalls", stats.nRecvCalls);
         obj.pushKV("conntime", stats.nTimeConnected);
         obj.pushKV("timeoffset", stats.nTimeOffset);
         obj.pushKV("pingtime", stats.dPingTime);
@@ -411,12 +414,25 @@ UniValue getnettotals(const UniValue& params, bool fHelp)
                 "getnettotals\n"
                 "\n"
                 "Returns information about network traffic, including bytes in, bytes out,\n"
-                "and current time\n");
+                "and current time. \"messagelatency\" lists, by command, how long received\n"
+                "messages waited for the message handler and took to process, in microseconds.\n");
 
     UniValue obj(UniValue::VOBJ);
     obj.pushKV("totalbytesrecv", CNode::GetTotalBytesRecv());
     obj.pushKV("totalbytessent", CNode::GetTotalBytesSent());
     obj.pushKV("timemillis", GetTimeMillis());
+
+    UniValue latency(UniValue::VOBJ);
+    for (const auto& [command, entry] : g_message_latency.Get()) {
+        UniValue command_obj(UniValue::VOBJ);
+        command_obj.pushKV("count", entry.nCount);
+        command_obj.pushKV("avg_wait", entry.nTotalWaitMicros / (int64_t)entry.nCount);
+        command_obj.pushKV("max_wait", entry.nMaxWaitMicros);
+        command_obj.pushKV("avg_process", entry.nTotalProcessMicros / (int64_t)entry.nCount);
+        latency.pushKV(command, command_obj);
+    }
+    obj.pushKV("messagelatency", latency);
+
     return obj;
 }
 
@@ -1286,13 +1286,14 @@ UniValue scanforunspent(const UniValue& params, bool fHelp)
         if (!pblkindex)
             throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
 
-        while (pblkindex->nHeight < nBlockEnd)
-        {
-            pblkindex = pblkindex->pnext;
+        SequentialBlockReader reader(pblkindex->pnext, GRC::BlockFinder::FindByHeight(nBlockEnd));
 
-            CBlock block;
+        CBlock block;
+        bool fRead;
 
-            if (!ReadBlockFromDisk(block, pblkindex, Params().GetConsensus()))
+        while ((pblkindex = reader.Next(block, fRead)))
+        {
+            if (!fRead)
                 throw JSONRPCError(RPC_PARSE_ERROR, "Unable to read block from disk!");
 
             for (unsigned int i = 1; i < block.vtx.size(); i++)
@@ -1660,6 +1661,10 @@ UniValue signrawtransaction(const UniValue& params, bool fHelp)
     CTransaction mergedTx(txVariants[0]);
     bool fComplete = true;
 
+    // The copy keeps the hash of the decoded transaction, but the signatures
+    // change below:
+    mergedTx.ClearCachedHash();
+
     // Fetch previous transactions (inputs):
     map<COutPoint, CScript> mapPrevOut;
     for (unsigned int i = 0; i < mergedTx.vin.size(); i++)
@@ -7,6 +7,8 @@ using namespace std;
 
 #include "script.h"
 #include <crypto/sha1.h>
+#include <crypto/sha256.h>
+#include "cuckoocache.h"
 #include "keystore.h"
 #include "bignum.h"
 #include "key.h"
@@ -16,6 +18,9 @@ using namespace std;
 #include "sync.h"
 #include "util.h"
 
+#include <cstring>
+#include <shared_mutex>
+
 CScriptID::CScriptID(const CScript& in) : BaseHash(Hash160(in)) {}
 //CScriptID::CScriptID(const ScriptHash& in) : BaseHash(static_cast<uint160>(in)) {}
 
@@ -1216,67 +1221,127 @@ uint256 SignatureHash(CScript scriptCode, const CTransaction& txTo, unsigned int
 }
 
 
-// Valid signature cache, to avoid doing expensive ECDSA signature checking
-// twice for every transaction (once when accepted into memory pool, and
-// again when accepted into the block chain)
+namespace {
+/**
+ * We're hashing a nonce into the entries themselves, so we don't need extra
+ * blinding in the set hash computation.
+ *
+ * This may exhibit platform endian dependent behavior but because these are
+ * nonced hashes (random) and this state is only ever used locally it is safe.
+ * All that matters is local consistency.
+ */
+class SignatureCacheHasher
+{
+public:
+    template <uint8_t hash_select>
+    uint32_t operator()(const uint256& key) const
+    {
+        static_assert(hash_select < 8, "SignatureCacheHasher only has 8 hashes available.");
+        uint32_t u;
+        std::memcpy(&u, key.begin() + 4 * hash_select, 4);
+        return u;
+    }
+};
 
+/**
+ * Valid signature cache, to avoid doing expensive ECDSA signature checking
+ * twice for every transaction (once when accepted into memory pool, and
+ * again when accepted into the block chain).
+ *
+ * Entries are fixed-size salted digests of the (signature hash, public key,
+ * signature) triple stored in a cuckoo cache. Lookups only take a shared
+ * lock so that the script check threads and mempool acceptance can read the
+ * cache concurrently. The random salt foils would-be DoS attackers who might
+ * try to pre-generate colliding entries.
+ */
 class CSignatureCache
 {
 private:
-     // sigdata_type is (signature hash, signature, public key):
-    typedef std::tuple<uint256, std::vector<unsigned char>, std::vector<unsigned char> > sigdata_type;
-    std::set< sigdata_type> setValid;
-    CCriticalSection cs_sigcache;
+    //! Entries are SHA256(nonce || 32 zero bytes || signature hash || public key || signature):
+    CSHA256 m_salted_hasher;
+    typedef CuckooCache::cache<uint256, SignatureCacheHasher> map_type;
+    map_type setValid;
+    std::shared_mutex cs_sigcache;
 
 public:
-    bool
-    Get(uint256 hash, const std::vector<unsigned char>& vchSig, const std::vector<unsigned char>& pubKey)
+    CSignatureCache()
     {
-        LOCK(cs_sigcache);
-
-        sigdata_type k(hash, vchSig, pubKey);
-        std::set<sigdata_type>::iterator mi = setValid.find(k);
-        if (mi != setValid.end())
-            return true;
-        return false;
+        uint256 nonce = GetRandHash();
+        // We want the nonce to be 64 bytes long to force the hasher to process
+        // this chunk, which makes later hash computations more efficient. We
+        // just write our 32-byte entropy and pad with zero bytes.
+        static constexpr unsigned char PADDING[32] = {0};
+        m_salted_hasher.Write(nonce.begin(), 32);
+        m_salted_hasher.Write(PADDING, 32);
+
+        // The smallest possible cache keeps lookups safe until the node calls
+        // InitSignatureCache():
+        setValid.setup(0);
     }
 
-    void Set(uint256 hash, const std::vector<unsigned char>& vchSig, const std::vector<unsigned char>& pubKey)
+    void ComputeEntry(
+        uint256& entry,
+        const uint256& hash,
+        const std::vector<unsigned char>& vchSig,
+        const std::vector<unsigned char>& pubKey) const
     {
-        // DoS prevention: limit cache size to less than 10MB
-        // (~200 bytes per cache entry times 50,000 entries)
-        // Since there are a maximum of 20,000 signature operations per block
-        // 50,000 is a reasonable default.
-        int64_t nMaxCacheSize = gArgs.GetArg("-maxsigcachesize", 50000);
-        if (nMaxCacheSize <= 0) return;
+        CSHA256 hasher = m_salted_hasher;
+        hasher.Write(hash.begin(), 32)
+            .Write(pubKey.data(), pubKey.size())
+            .Write(vchSig.data(), vchSig.size())
+            .Finalize(entry.begin());
+    }
 
-        LOCK(cs_sigcache);
+    bool Get(const uint256& entry)
+    {
+        std::shared_lock<std::shared_mutex> lock(cs_sigcache);
+        return setValid.contains(entry, false);
+    }
 
-        while (static_cast<int64_t>(setValid.size()) > nMaxCacheSize)
-        {
-            // Evict a random entry. Random because that helps
-            // foil would-be DoS attackers who might try to pre-generate
-            // and re-use a set of valid signatures just-slightly-greater
-            // than our cache size.
-            uint256 randomHash = GetRandHash();
-            std::vector<unsigned char> unused;
-            std::set<sigdata_type>::iterator it =
-                setValid.lower_bound(sigdata_type(randomHash, unused, unused));
-            if (it == setValid.end())
-                it = setValid.begin();
-            setValid.erase(*it);
-        }
+    void Set(const uint256& entry)
+    {
+        std::unique_lock<std::shared_mutex> lock(cs_sigcache);
+        setValid.insert(entry);
+    }
 
-        sigdata_type k(hash, vchSig, pubKey);
-        setValid.insert(k);
+    uint32_t setup_bytes(size_t n)
+    {
+        std::unique_lock<std::shared_mutex> lock(cs_sigcache);
+        return setValid.setup_bytes(n);
     }
 };
 
+/* The cache is a namespace-scope object rather than a local static in
+ * CheckSig() to avoid the guard check on every call.
+ */
+CSignatureCache signatureCache;
+} // Anonymous namespace
+
+void InitSignatureCache()
+{
+    // nMaxCacheSize is unsigned. If the size is set to zero, setup_bytes
+    // creates the minimum possible cache (2 elements).
+    size_t nMaxCacheSize = std::min(
+        std::max((int64_t)0, gArgs.GetArg("-maxsigcachemib", DEFAULT_MAX_SIG_CACHE_SIZE)),
+        MAX_MAX_SIG_CACHE_SIZE) * ((size_t) 1 << 20);
+
+    // Older versions read -maxsigcachesize as a number of entries (default
+    // 50000). Honor that meaning unless -maxsigcachemib overrides it, so that
+    // an existing configuration file does not ask for gigabytes:
+    if (gArgs.IsArgSet("-maxsigcachesize") && !gArgs.IsArgSet("-maxsigcachemib")) {
+        nMaxCacheSize = std::min(
+            std::max((int64_t)0, gArgs.GetArg("-maxsigcachesize", 0)),
+            (MAX_MAX_SIG_CACHE_SIZE << 20) / (int64_t)sizeof(uint256)) * sizeof(uint256);
+    }
+    size_t nElems = signatureCache.setup_bytes(nMaxCacheSize);
+
+    LogPrintf("Using %zu MiB out of %zu requested for signature cache, able to store %zu elements",
+              (nElems * sizeof(uint256)) >> 20, nMaxCacheSize >> 20, nElems);
+}
+
 bool CheckSig(vector<unsigned char> vchSig, vector<unsigned char> vchPubKey, CScript scriptCode,
               const CTransaction& txTo, unsigned int nIn, int nHashType)
 {
-    static CSignatureCache signatureCache;
-
     // Hash type is one byte tacked on to the end of the signature
     if (vchSig.empty())
         return false;
@@ -1288,13 +1353,16 @@ bool CheckSig(vector<unsigned char> vchSig, vector<unsigned char> vchPubKey, CSc
 
     uint256 sighash = SignatureHash(scriptCode, txTo, nIn, nHashType);
 
-    if (signatureCache.Get(sighash, vchSig, vchPubKey))
+    uint256 entry;
+    signatureCache.ComputeEntry(entry, sighash, vchSig, vchPubKey);
+
+    if (signatureCache.Get(entry))
         return true;
 
     if (!CPubKey(vchPubKey).Verify(sighash, vchSig))
         return false;
 
-    signatureCache.Set(sighash, vchSig, vchPubKey);
+    signatureCache.Set(entry);
     return true;
 }
 
@@ -1763,6 +1831,7 @@ bool SignSignature(const CKeyStore &keystore, const CScript& fromPubKey, CTransa
 {
     assert(nIn < txTo.vin.size());
     CTxIn& txin = txTo.vin[nIn];
+    txTo.ClearCachedHash();
 
     // Leave out the signature from the hash, since a signature can't sign itself.
     // The checksig op will also drop the signatures from its hash.
@@ -39,6 +39,13 @@ static const unsigned int MAX_OP_RETURN_RELAY = 80;      // bytes
 // Maximum script length in bytes
 static const int MAX_SCRIPT_SIZE = 10000;
 
+// DoS prevention: limit the signature cache to 32 MiB (over 1000000 entries on
+// 64-bit systems). Due to how we count cache size, actual memory usage is
+// slightly more (~32.25 MiB).
+static const int64_t DEFAULT_MAX_SIG_CACHE_SIZE = 32;
+// Maximum signature cache size allowed, in MiB
+static const int64_t MAX_MAX_SIG_CACHE_SIZE = 16384;
+
 /** Signature hash types/flags */
 enum
 {
@@ -644,6 +651,9 @@ bool VerifyScript(const CScript& scriptSig, const CScript& scriptPubKey, const C
                   int nHashType);
 bool VerifySignature(const CTransaction& txFrom, const CTransaction& txTo, unsigned int nIn, int nHashType);
 
+// To be called once at startup to size the signature cache from -maxsigcachemib.
+void InitSignatureCache();
+
 // Given two sets of signatures for scriptPubKey, possibly with OP_0 placeholders,
 // combine them intelligently and return the result.
 CScript CombineSignatures(CScript scriptPubKey, const CTransaction& txTo, unsigned int nIn, const CScript& scriptSig1, const CScript& scriptSig2);
@@ -174,6 +174,14 @@ public:
         memcpy(dst.data(), m_data.data(), dst.size());
         m_data = m_data.subspan(dst.size());
     }
+
+    void ignore(size_t num_ignore)
+    {
+        if (num_ignore > m_data.size()) {
+            throw std::ios_base::failure("SpanReader::ignore(): end of data");
+        }
+        m_data = m_data.subspan(num_ignore);
+    }
 };
 
 /** Double ended buffer combining vector and stream-like interfaces.
@@ -249,6 +257,14 @@ public:
         m_read_pos = 0;
     }
 
+    /** Exchange the whole buffer with another one, such as to hand received
+     *  data on without copying it. Reading starts over at the beginning. */
+    void swap(vector_type& other)
+    {
+        vch.swap(other);
+        m_read_pos = 0;
+    }
+
     bool Rewind(std::optional<size_type> n = std::nullopt)
     {
         // Total rewind if no size is passed
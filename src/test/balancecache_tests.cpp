@@ -0,0 +1,193 @@
+// Copyright (c) 2022 The Gridcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://opensource.org/licenses/mit-license.php.
+
+#include "main.h"
+#include "test/test_gridcoin.h"
+#include "wallet/balancecache.h"
+
+#include <boost/test/unit_test.hpp>
+#include <set>
+
+namespace {
+//!
+//! \brief A block index tree with a fork:
+//!
+//!   0 <- 1 <- ... <- 12
+//!               ^--- 5' <- 6'
+//!
+struct BalanceCacheSetup
+{
+    CBlockIndex chain[13];
+    CBlockIndex fork[2];
+    WalletBalanceCache cache;
+
+    BalanceCacheSetup()
+    {
+        for (int height = 0; height < 13; ++height) {
+            Link(chain[height], height, height > 0 ? &chain[height - 1] : nullptr);
+        }
+
+        Link(fork[0], 5, &chain[4]);
+        Link(fork[1], 6, &fork[0]);
+    }
+
+    static void Link(CBlockIndex& pindex, const int height, CBlockIndex* pprev)
+    {
+        pindex.nHeight = height;
+        pindex.pprev = pprev;
+        pindex.BuildSkip();
+    }
+
+    static WalletBalanceCache::Entry MakeEntry(const int height, const CAmount available)
+    {
+        WalletBalanceCache::Entry entry;
+        entry.m_height = height;
+        entry.m_available = available;
+        entry.m_credit = available;
+
+        return entry;
+    }
+};
+} // Anonymous namespace
+
+BOOST_FIXTURE_TEST_SUITE(balancecache_tests, BalanceCacheSetup)
+
+BOOST_AUTO_TEST_CASE(it_classifies_received_transactions_by_depth)
+{
+    WalletBalanceCache::Entry entry = MakeEntry(10, 5 * COIN);
+
+    // Depth 3:
+    WalletBalances balances = WalletBalanceCache::Classify(entry, 12, 110);
+
+    BOOST_CHECK_EQUAL(balances.m_balance, 0);
+    BOOST_CHECK_EQUAL(balances.m_unconfirmed, 5 * COIN);
+
+    // Depth 10:
+    balances = WalletBalanceCache::Classify(entry, 19, 110);
+
+    BOOST_CHECK_EQUAL(balances.m_balance, 5 * COIN);
+    BOOST_CHECK_EQUAL(balances.m_unconfirmed, 0);
+
+    // Transactions created by the wallet are spendable once trusted:
+    entry.m_from_me = true;
+    balances = WalletBalanceCache::Classify(entry, 12, 110);
+
+    BOOST_CHECK_EQUAL(balances.m_balance, 5 * COIN);
+    BOOST_CHECK_EQUAL(balances.m_unconfirmed, 0);
+}
+
+BOOST_AUTO_TEST_CASE(it_classifies_generated_transactions_by_maturity)
+{
+    WalletBalanceCache::Entry entry = MakeEntry(10, 0);
+    entry.m_credit = 10 * COIN;
+    entry.m_coinstake = true;
+
+    WalletBalances balances = WalletBalanceCache::Classify(entry, 118, 110);
+
+    BOOST_CHECK_EQUAL(balances.m_stake, 10 * COIN);
+    BOOST_CHECK_EQUAL(balances.m_immature, 0);
+    BOOST_CHECK_EQUAL(balances.m_balance, 0);
+
+    entry.m_coinstake = false;
+    entry.m_coinbase = true;
+    balances = WalletBalanceCache::Classify(entry, 118, 110);
+
+    BOOST_CHECK_EQUAL(balances.m_immature, 10 * COIN);
+    BOOST_CHECK_EQUAL(balances.m_stake, 0);
+
+    // Matured, with one of the outputs spent since:
+    entry.m_available = 4 * COIN;
+    balances = WalletBalanceCache::Classify(entry, 119, 110);
+
+    BOOST_CHECK_EQUAL(balances.m_immature, 0);
+    BOOST_CHECK_EQUAL(balances.m_balance, 4 * COIN);
+}
+
+BOOST_AUTO_TEST_CASE(it_requests_a_rebuild_before_the_first_read)
+{
+    std::set<uint256> dirty;
+
+    BOOST_CHECK(cache.TakeChanges(&chain[12], dirty));
+    BOOST_CHECK(dirty.empty());
+    BOOST_CHECK(!cache.TakeChanges(&chain[12], dirty));
+}
+
+BOOST_AUTO_TEST_CASE(it_moves_entries_when_the_chain_reaches_their_next_depth)
+{
+    std::set<uint256> dirty;
+
+    cache.TakeChanges(&chain[5], dirty);
+    cache.Set(InsecureRand256(), MakeEntry(3, 2 * COIN));
+
+    BOOST_CHECK_EQUAL(cache.GetTotals().m_unconfirmed, 2 * COIN);
+    BOOST_CHECK_EQUAL(cache.GetTotals().m_balance, 0);
+
+    // Depth 9:
+    BOOST_REQUIRE(!cache.TakeChanges(&chain[11], dirty));
+    BOOST_CHECK(dirty.empty());
+    BOOST_CHECK_EQUAL(cache.GetTotals().m_unconfirmed, 2 * COIN);
+
+    // Depth 10:
+    BOOST_REQUIRE(!cache.TakeChanges(&chain[12], dirty));
+    BOOST_CHECK(dirty.empty());
+    BOOST_CHECK_EQUAL(cache.GetTotals().m_unconfirmed, 0);
+    BOOST_CHECK_EQUAL(cache.GetTotals().m_balance, 2 * COIN);
+}
+
+BOOST_AUTO_TEST_CASE(it_replaces_and_erases_entries)
+{
+    const uint256 txid = InsecureRand256();
+    std::set<uint256> dirty;
+
+    cache.TakeChanges(&chain[12], dirty);
+    cache.Set(txid, MakeEntry(1, 3 * COIN));
+    cache.Set(InsecureRand256(), MakeEntry(2, 1 * COIN));
+
+    BOOST_CHECK_EQUAL(cache.GetTotals().m_balance, 4 * COIN);
+
+    // An output was spent:
+    cache.Set(txid, MakeEntry(1, 2 * COIN));
+
+    BOOST_CHECK_EQUAL(cache.size(), 2U);
+    BOOST_CHECK_EQUAL(cache.GetTotals().m_balance, 3 * COIN);
+
+    cache.SetPending(txid);
+
+    BOOST_CHECK_EQUAL(cache.size(), 1U);
+    BOOST_CHECK_EQUAL(cache.GetPending().size(), 1U);
+    BOOST_CHECK_EQUAL(cache.GetTotals().m_balance, 1 * COIN);
+
+    cache.Erase(txid);
+
+    BOOST_CHECK(cache.GetPending().empty());
+}
+
+BOOST_AUTO_TEST_CASE(it_marks_entries_above_the_fork_dirty_after_a_reorganization)
+{
+    const uint256 txid_below = InsecureRand256();
+    const uint256 txid_above = InsecureRand256();
+    std::set<uint256> dirty;
+
+    cache.TakeChanges(&chain[5], dirty);
+    cache.Set(txid_below, MakeEntry(2, COIN));
+    cache.Set(txid_above, MakeEntry(5, COIN));
+
+    BOOST_REQUIRE(!cache.TakeChanges(&fork[1], dirty));
+    BOOST_CHECK_EQUAL(dirty.size(), 1U);
+    BOOST_CHECK(dirty.count(txid_above) == 1);
+}
+
+BOOST_AUTO_TEST_CASE(it_requests_a_rebuild_when_the_chain_gets_shorter)
+{
+    std::set<uint256> dirty;
+
+    cache.TakeChanges(&chain[12], dirty);
+    cache.Set(InsecureRand256(), MakeEntry(2, COIN));
+
+    BOOST_CHECK(cache.TakeChanges(&fork[1], dirty));
+    BOOST_CHECK_EQUAL(cache.size(), 0U);
+    BOOST_CHECK_EQUAL(cache.GetTotals().m_balance, 0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,465 @@
+// Copyright (c) 2022 The Gridcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://opensource.org/licenses/mit-license.php.
+
+#include "main.h"
+#include "node/blockdownload.h"
+#include "test/test_gridcoin.h"
+
+#include <algorithm>
+#include <boost/test/unit_test.hpp>
+#include <vector>
+
+namespace {
+constexpr int64_t START_TIME = 1600000000;
+
+//!
+//! \brief A header chain on top of a block index entry at the given height,
+//! and the entries of the same chain for a node that connected the blocks.
+//!
+struct DownloadSetup
+{
+    BlockDownloadManager manager;
+
+    uint256 root_hash = InsecureRand256();
+    CBlockIndex root;
+
+    std::vector<CBlockHeader> headers;
+    std::vector<uint256> hashes;
+    std::vector<CBlockIndex> index;
+
+    explicit DownloadSetup(const int root_height = 100, const size_t count = 2000)
+        : hashes(count), index(count)
+    {
+        root.phashBlock = &root_hash;
+        root.nHeight = root_height;
+        root.nTime = START_TIME;
+
+        headers = MakeHeaders(root_hash, START_TIME, count);
+
+        for (size_t i = 0; i < count; ++i) {
+            hashes[i] = headers[i].GetHash();
+            index[i].phashBlock = &hashes[i];
+            index[i].nHeight = root_height + 1 + i;
+            index[i].nTime = headers[i].nTime;
+            index[i].pprev = i > 0 ? &index[i - 1] : &root;
+        }
+
+        manager.Reset(&root);
+    }
+
+    static std::vector<CBlockHeader> MakeHeaders(uint256 hash_prev, int64_t time, const size_t count)
+    {
+        std::vector<CBlockHeader> result(count);
+
+        for (auto& header : result) {
+            header.nVersion = 12;
+            header.hashPrevBlock = hash_prev;
+            header.hashMerkleRoot = InsecureRand256();
+            header.nTime = time += 16;
+            header.nBits = 0x1d00ffff;
+            hash_prev = header.GetHash();
+        }
+
+        return result;
+    }
+
+    int64_t Now() const
+    {
+        return START_TIME + 16 * (headers.size() + 1);
+    }
+
+    BlockDownloadManager::HeadersStatus Receive(NodeId node, const size_t begin, const size_t end)
+    {
+        CBlockLocator locator;
+        const std::vector<CBlockHeader> batch(headers.begin() + begin, headers.begin() + end);
+
+        return manager.ReceiveHeaders(node, batch, nullptr, Now(), locator);
+    }
+
+    void SyncHeaders(NodeId node)
+    {
+        CBlockLocator locator;
+        BOOST_REQUIRE(manager.StartHeaderSync(node, root.nHeight + headers.size(), &root, Now(), locator));
+
+        size_t begin = 0;
+
+        for (; headers.size() - begin >= MAX_HEADERS_RESULTS; begin += MAX_HEADERS_RESULTS) {
+            BOOST_REQUIRE(Receive(node, begin, begin + MAX_HEADERS_RESULTS) == BlockDownloadManager::HeadersStatus::CONTINUE);
+        }
+
+        BOOST_REQUIRE(Receive(node, begin, headers.size()) == BlockDownloadManager::HeadersStatus::DONE);
+    }
+
+    std::vector<uint256> Request(NodeId node, const CBlockIndex* pindex_best, int64_t now)
+    {
+        bool stalling = false;
+        bool headers_dropped = false;
+        const std::vector<uint256> result = manager.RequestBlocks(
+            node, root.nHeight + headers.size(), pindex_best, now, stalling, headers_dropped);
+        BOOST_CHECK(!stalling);
+        BOOST_CHECK(!headers_dropped);
+
+        return result;
+    }
+
+    CBlock MakeBlock(const size_t i) const
+    {
+        CBlock block;
+        static_cast<CBlockHeader&>(block) = headers[i];
+
+        return block;
+    }
+
+    CBlock MakeStakeBlock(const size_t i, const COutPoint& stake) const
+    {
+        CBlock block = MakeBlock(i);
+        block.vtx.resize(2);
+
+        CTransaction& coinstake = block.vtx[1];
+        coinstake.vin.emplace_back(stake);
+        coinstake.vout.resize(2);
+        coinstake.vout[0].SetEmpty();
+        coinstake.vout[1].nValue = COIN;
+        coinstake.vout[1].scriptPubKey << OP_TRUE;
+
+        return block;
+    }
+};
+} // Anonymous namespace
+
+BOOST_AUTO_TEST_SUITE(blockdownload_tests)
+
+BOOST_AUTO_TEST_CASE(it_downloads_the_header_chain_from_one_peer)
+{
+    DownloadSetup setup;
+    CBlockLocator locator;
+
+    BOOST_CHECK(!setup.manager.StartHeaderSync(1, 100, &setup.root, setup.Now(), locator));
+    BOOST_REQUIRE(setup.manager.StartHeaderSync(1, 2100, &setup.root, setup.Now(), locator));
+    BOOST_CHECK(locator.vHave.front() == setup.root_hash);
+
+    // Another peer waits for the first one:
+    BOOST_CHECK(!setup.manager.StartHeaderSync(2, 2100, &setup.root, setup.Now(), locator));
+    BOOST_CHECK(setup.Receive(2, 0, 10) == BlockDownloadManager::HeadersStatus::IGNORED);
+
+    BOOST_CHECK(setup.manager.ReceiveHeaders(1, {setup.headers.begin(), setup.headers.begin() + MAX_HEADERS_RESULTS},
+        nullptr, setup.Now(), locator) == BlockDownloadManager::HeadersStatus::CONTINUE);
+    BOOST_CHECK(locator.vHave.front() == setup.hashes[MAX_HEADERS_RESULTS - 1]);
+    BOOST_CHECK(std::count(locator.vHave.begin(), locator.vHave.end(), setup.root_hash) == 1);
+    BOOST_CHECK_EQUAL(setup.manager.GetHeaderHeight(), 1100);
+
+    // Repeated headers do not change the chain:
+    BOOST_CHECK(setup.Receive(1, 500, 1500) == BlockDownloadManager::HeadersStatus::CONTINUE);
+    BOOST_CHECK_EQUAL(setup.manager.GetHeaderHeight(), 1600);
+
+    BOOST_CHECK(setup.Receive(1, 1500, 2000) == BlockDownloadManager::HeadersStatus::DONE);
+    BOOST_CHECK_EQUAL(setup.manager.GetHeaderHeight(), 2100);
+    BOOST_CHECK(setup.manager.IsDownloading());
+
+    // A peer is only asked once, and only when it is ahead of the headers:
+    BOOST_CHECK(!setup.manager.StartHeaderSync(1, 2200, &setup.root, setup.Now(), locator));
+    BOOST_CHECK(!setup.manager.StartHeaderSync(2, 2100, &setup.root, setup.Now(), locator));
+    BOOST_CHECK(setup.manager.StartHeaderSync(3, 2200, &setup.root, setup.Now(), locator));
+    BOOST_CHECK(locator.vHave.front() == setup.hashes.back());
+}
+
+BOOST_AUTO_TEST_CASE(it_asks_another_peer_when_the_headers_time_out)
+{
+    DownloadSetup setup;
+    CBlockLocator locator;
+
+    BOOST_REQUIRE(setup.manager.StartHeaderSync(1, 2100, &setup.root, setup.Now(), locator));
+    BOOST_CHECK(!setup.manager.StartHeaderSync(2, 2100, &setup.root, setup.Now() + HEADERS_RESPONSE_TIMEOUT, locator));
+    BOOST_CHECK(setup.manager.StartHeaderSync(2, 2100, &setup.root, setup.Now() + HEADERS_RESPONSE_TIMEOUT + 1, locator));
+
+    BOOST_CHECK(setup.Receive(1, 0, 10) == BlockDownloadManager::HeadersStatus::IGNORED);
+    BOOST_CHECK(setup.Receive(2, 0, 10) == BlockDownloadManager::HeadersStatus::DONE);
+}
+
+BOOST_AUTO_TEST_CASE(it_rejects_headers_that_break_the_chain_rules)
+{
+    DownloadSetup setup;
+    CBlockLocator locator;
+
+    // Broken link:
+    std::vector<CBlockHeader> headers(setup.headers.begin(), setup.headers.begin() + 10);
+    headers[5].hashPrevBlock = InsecureRand256();
+
+    BOOST_REQUIRE(setup.manager.StartHeaderSync(1, 2100, &setup.root, setup.Now(), locator));
+    BOOST_CHECK(setup.manager.ReceiveHeaders(1, headers, nullptr, setup.Now(), locator)
+        == BlockDownloadManager::HeadersStatus::INVALID);
+    BOOST_CHECK_EQUAL(setup.manager.GetHeaderHeight(), 100);
+
+    // From the future:
+    BOOST_REQUIRE(setup.manager.StartHeaderSync(2, 2100, &setup.root, setup.Now(), locator));
+    BOOST_CHECK(setup.manager.ReceiveHeaders(2, setup.headers, nullptr, START_TIME, locator)
+        == BlockDownloadManager::HeadersStatus::INVALID);
+    BOOST_CHECK_EQUAL(setup.manager.GetHeaderHeight(), 100);
+
+    // Unconnected:
+    BOOST_REQUIRE(setup.manager.StartHeaderSync(3, 2100, &setup.root, setup.Now(), locator));
+    BOOST_CHECK(setup.Receive(3, 10, 20) == BlockDownloadManager::HeadersStatus::IGNORED);
+
+    // The mainnet checkpoint at height 40:
+    DownloadSetup early(30, 20);
+
+    BOOST_REQUIRE(early.manager.StartHeaderSync(1, 50, &early.root, early.Now(), locator));
+    BOOST_CHECK(early.Receive(1, 0, 20) == BlockDownloadManager::HeadersStatus::INVALID);
+    BOOST_CHECK_EQUAL(early.manager.GetHeaderHeight(), 30);
+}
+
+BOOST_AUTO_TEST_CASE(it_spreads_block_requests_over_peers_in_a_window)
+{
+    DownloadSetup setup;
+    setup.SyncHeaders(1);
+
+    const std::vector<uint256> first = setup.Request(1, &setup.root, setup.Now());
+    const std::vector<uint256> second = setup.Request(2, &setup.root, setup.Now());
+
+    BOOST_REQUIRE_EQUAL(first.size(), MAX_BLOCKS_IN_TRANSIT_PER_PEER);
+    BOOST_REQUIRE_EQUAL(second.size(), MAX_BLOCKS_IN_TRANSIT_PER_PEER);
+    BOOST_CHECK(first.front() == setup.hashes[0]);
+    BOOST_CHECK(second.front() == setup.hashes[MAX_BLOCKS_IN_TRANSIT_PER_PEER]);
+
+    // A peer with all of its requests in flight gets no more:
+    BOOST_CHECK(setup.Request(1, &setup.root, setup.Now()).empty());
+
+    // A peer only gets the blocks that it has:
+    bool stalling = false;
+    bool headers_dropped = false;
+    BOOST_CHECK(setup.manager.RequestBlocks(3, 110, &setup.root, setup.Now(), stalling, headers_dropped).empty());
+
+    // The window limits the requests:
+    std::vector<uint256> requested(first);
+    requested.insert(requested.end(), second.begin(), second.end());
+
+    for (NodeId node = 4; node < 200; ++node) {
+        for (const auto& hash : setup.Request(node, &setup.root, setup.Now())) {
+            requested.push_back(hash);
+        }
+    }
+
+    BOOST_REQUIRE_EQUAL(requested.size(), BLOCK_DOWNLOAD_WINDOW);
+    BOOST_CHECK(requested.back() == setup.hashes[BLOCK_DOWNLOAD_WINDOW - 1]);
+
+    // Connected blocks move the window:
+    const CBlockIndex* pindex_best = &setup.index[MAX_BLOCKS_IN_TRANSIT_PER_PEER - 1];
+
+    BOOST_CHECK(setup.manager.BlockReceived(1, setup.hashes[0], &setup.root) == BlockDownloadManager::BlockStatus::REQUESTED);
+    BOOST_CHECK(setup.manager.BlockReceived(1, InsecureRand256(), &setup.root) == BlockDownloadManager::BlockStatus::UNKNOWN);
+
+    const std::vector<uint256> third = setup.Request(200, pindex_best, setup.Now());
+
+    BOOST_REQUIRE_EQUAL(third.size(), MAX_BLOCKS_IN_TRANSIT_PER_PEER);
+    BOOST_CHECK(third.front() == setup.hashes[BLOCK_DOWNLOAD_WINDOW]);
+}
+
+BOOST_AUTO_TEST_CASE(it_releases_the_requests_of_stalling_and_disconnected_peers)
+{
+    DownloadSetup setup;
+    setup.SyncHeaders(1);
+
+    const std::vector<uint256> first = setup.Request(1, &setup.root, setup.Now());
+    const std::vector<uint256> second = setup.Request(2, &setup.root, setup.Now());
+
+    // The first peer holds up the window:
+    bool stalling = false;
+    bool headers_dropped = false;
+    const int64_t later = setup.Now() + BLOCK_DOWNLOAD_TIMEOUT + 1;
+
+    BOOST_CHECK(setup.manager.RequestBlocks(1, 2100, &setup.root, later, stalling, headers_dropped).empty());
+    BOOST_CHECK(stalling);
+    BOOST_CHECK(!headers_dropped);
+
+    // The second one timed out too, but on blocks that the window does not
+    // wait for yet. It may try the first blocks again:
+    const std::vector<uint256> retry = setup.Request(2, &setup.root, later);
+
+    BOOST_REQUIRE(!retry.empty());
+    BOOST_CHECK(retry.front() == first.front());
+
+    setup.manager.PeerDisconnected(2);
+
+    const std::vector<uint256> third = setup.Request(3, &setup.root, later);
+
+    BOOST_REQUIRE(!third.empty());
+    BOOST_CHECK(third.front() == first.front());
+}
+
+BOOST_AUTO_TEST_CASE(it_drops_the_header_chain_when_no_peer_serves_the_blocks)
+{
+    DownloadSetup setup;
+    setup.SyncHeaders(1);
+
+    bool stalling = false;
+    bool headers_dropped = false;
+    int64_t now = setup.Now();
+
+    // Each peer in turn times out on the first block of the window:
+    for (int round = 1; round <= MAX_BLOCK_DOWNLOAD_ROUNDS; ++round) {
+        const NodeId node = 10 + round;
+        const std::vector<uint256> requested = setup.Request(node, &setup.root, now);
+
+        BOOST_REQUIRE(!requested.empty());
+        BOOST_CHECK(requested.front() == setup.hashes[0]);
+
+        now += BLOCK_DOWNLOAD_TIMEOUT + 1;
+
+        BOOST_CHECK(setup.manager.RequestBlocks(node, 2100, &setup.root, now, stalling, headers_dropped).empty());
+        BOOST_CHECK_EQUAL(stalling, round < MAX_BLOCK_DOWNLOAD_ROUNDS);
+        BOOST_CHECK_EQUAL(headers_dropped, round == MAX_BLOCK_DOWNLOAD_ROUNDS);
+
+        setup.manager.PeerDisconnected(node);
+    }
+
+    // The last peer is not to blame. The peer that sent the headers is:
+    BOOST_CHECK(!setup.manager.IsDownloading());
+    BOOST_CHECK(!setup.manager.TakeBadHeaders(10 + MAX_BLOCK_DOWNLOAD_ROUNDS));
+    BOOST_CHECK(setup.manager.TakeBadHeaders(1));
+    BOOST_CHECK(!setup.manager.TakeBadHeaders(1));
+
+    // Getblocks takes over until the tip moves:
+    CBlockLocator locator;
+    BOOST_CHECK(!setup.manager.StartHeaderSync(2, 2100, &setup.root, now, locator));
+
+    // Then another peer may send headers, but not the one that we blamed:
+    BOOST_CHECK(!setup.manager.StartHeaderSync(1, 2100, &setup.index[0], now, locator));
+    BOOST_CHECK(setup.manager.StartHeaderSync(2, 2100, &setup.index[0], now, locator));
+}
+
+BOOST_AUTO_TEST_CASE(it_only_accepts_blocks_requested_from_the_peer)
+{
+    DownloadSetup setup;
+    setup.SyncHeaders(1);
+
+    setup.Request(1, &setup.root, setup.Now());
+
+    // Another peer sends a block that we asked the first one for:
+    BOOST_CHECK(setup.manager.BlockReceived(2, setup.hashes[0], &setup.root)
+        == BlockDownloadManager::BlockStatus::UNREQUESTED);
+
+    BOOST_CHECK(setup.manager.BlockReceived(1, setup.hashes[0], &setup.root)
+        == BlockDownloadManager::BlockStatus::REQUESTED);
+
+    // The request is consumed:
+    BOOST_CHECK(setup.manager.BlockReceived(1, setup.hashes[0], &setup.root)
+        == BlockDownloadManager::BlockStatus::UNREQUESTED);
+
+    // A block of the header chain that we never asked for:
+    BOOST_CHECK(setup.manager.BlockReceived(1, setup.hashes[1500], &setup.root)
+        == BlockDownloadManager::BlockStatus::UNREQUESTED);
+}
+
+BOOST_AUTO_TEST_CASE(it_holds_blocks_until_their_parents_connect)
+{
+    DownloadSetup setup;
+    setup.SyncHeaders(1);
+
+    CBlock block;
+    static_cast<CBlockHeader&>(block) = setup.headers[1];
+
+    setup.manager.HoldBlock(block);
+
+    BOOST_CHECK(!setup.manager.TakeHeldBlock(setup.root_hash));
+
+    const std::optional<CBlock> held = setup.manager.TakeHeldBlock(setup.hashes[0]);
+
+    BOOST_REQUIRE(held);
+    BOOST_CHECK(held->GetHash() == setup.hashes[1]);
+    BOOST_CHECK(!setup.manager.TakeHeldBlock(setup.hashes[0]));
+}
+
+BOOST_AUTO_TEST_CASE(it_limits_the_size_of_the_held_blocks)
+{
+    DownloadSetup setup;
+    setup.SyncHeaders(1);
+
+    // Four of these exceed the budget:
+    const auto make_large_block = [&](const size_t i) {
+        CBlock block = setup.MakeBlock(i);
+        block.vtx.resize(1);
+        block.vtx[0].vout.resize(1);
+        block.vtx[0].vout[0].scriptPubKey.resize(MAX_HELD_BLOCKS_SIZE / 4);
+
+        return block;
+    };
+
+    BOOST_CHECK(setup.manager.HoldBlock(make_large_block(2)));
+    BOOST_CHECK(setup.manager.HoldBlock(make_large_block(3)));
+    BOOST_CHECK(setup.manager.HoldBlock(make_large_block(4)));
+
+    // No room for a block further from the tip than the held ones:
+    BOOST_CHECK(!setup.manager.HoldBlock(make_large_block(5)));
+
+    // A block closer to the tip takes the place of the furthest one:
+    BOOST_CHECK(setup.manager.HoldBlock(make_large_block(1)));
+    BOOST_CHECK(!setup.manager.TakeHeldBlock(setup.hashes[3]));
+    BOOST_CHECK(setup.manager.TakeHeldBlock(setup.hashes[0]));
+    BOOST_CHECK(setup.manager.TakeHeldBlock(setup.hashes[1]));
+    BOOST_CHECK(setup.manager.TakeHeldBlock(setup.hashes[2]));
+
+    // Blocks outside of the header chain are not held:
+    CBlock unknown;
+    unknown.hashPrevBlock = setup.hashes[10];
+    BOOST_CHECK(!setup.manager.HoldBlock(unknown));
+}
+
+BOOST_AUTO_TEST_CASE(it_invalidates_the_later_of_two_blocks_with_the_same_stake)
+{
+    const COutPoint stake(InsecureRand256(), 1);
+
+    DownloadSetup setup;
+    setup.SyncHeaders(1);
+
+    BOOST_CHECK(setup.manager.HoldBlock(setup.MakeStakeBlock(2, stake)));
+    BOOST_CHECK(!setup.manager.HoldBlock(setup.MakeStakeBlock(5, stake)));
+
+    BOOST_CHECK_EQUAL(setup.manager.GetHeaderHeight(), 105);
+    BOOST_CHECK(setup.manager.TakeHeldBlock(setup.hashes[1]));
+
+    // When the earlier block arrives second, the held one is cut off:
+    DownloadSetup reverse;
+    reverse.SyncHeaders(1);
+
+    BOOST_CHECK(reverse.manager.HoldBlock(reverse.MakeStakeBlock(5, stake)));
+    BOOST_CHECK(reverse.manager.HoldBlock(reverse.MakeStakeBlock(2, stake)));
+
+    BOOST_CHECK_EQUAL(reverse.manager.GetHeaderHeight(), 105);
+    BOOST_CHECK(!reverse.manager.TakeHeldBlock(reverse.hashes[4]));
+    BOOST_CHECK(reverse.manager.TakeHeldBlock(reverse.hashes[1]));
+}
+
+BOOST_AUTO_TEST_CASE(it_cuts_the_header_chain_back_at_an_invalid_block)
+{
+    DownloadSetup setup;
+    setup.SyncHeaders(1);
+
+    CBlock block;
+    static_cast<CBlockHeader&>(block) = setup.headers[10];
+    setup.manager.HoldBlock(block);
+
+    setup.manager.BlockInvalid(setup.hashes[9]);
+
+    BOOST_CHECK_EQUAL(setup.manager.GetHeaderHeight(), 109);
+    BOOST_CHECK(!setup.manager.TakeHeldBlock(setup.hashes[9]));
+    BOOST_CHECK(setup.manager.BlockReceived(1, setup.hashes[9], &setup.root) == BlockDownloadManager::BlockStatus::UNKNOWN);
+
+    // The same peer may send the replacement headers:
+    CBlockLocator locator;
+    BOOST_CHECK(setup.manager.StartHeaderSync(1, 2100, &setup.root, setup.Now(), locator));
+    BOOST_CHECK(locator.vHave.front() == setup.hashes[8]);
+}
+
+BOOST_AUTO_TEST_CASE(it_starts_over_when_the_chain_reaches_the_last_header)
+{
+    DownloadSetup setup(100, 20);
+    setup.SyncHeaders(1);
+
+    BOOST_CHECK(setup.manager.IsDownloading());
+    BOOST_CHECK(setup.Request(1, &setup.index.back(), setup.Now()).empty());
+    BOOST_CHECK(!setup.manager.IsDownloading());
+    BOOST_CHECK_EQUAL(setup.manager.GetHeaderHeight(), 120);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,212 @@
+// Copyright (c) 2022 The Gridcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://opensource.org/licenses/mit-license.php.
+
+#include "main.h"
+#include "node/blockindexsnapshot.h"
+#include "test/test_gridcoin.h"
+
+#include <boost/test/unit_test.hpp>
+#include <cstdio>
+#include <vector>
+
+namespace {
+//!
+//! \brief Swaps a small block index tree into the global block index for the
+//! duration of a test:
+//!
+//!   0 <- 1 <- 2 (tip)
+//!          ^--- 2' (fork)
+//!
+struct SnapshotSetup
+{
+    const fs::path path = GetDataDir() / "blkindex.snapshot.test";
+    const GRC::Cpid cpid = GRC::Cpid(InsecureRandBytes(16));
+
+    std::vector<std::pair<uint256, CBlockIndex*>> saved_entries;
+    CBlockIndex* saved_genesis = pindexGenesisBlock;
+    uint256 saved_best_chain = hashBestChain;
+
+    std::vector<CBlockIndex*> chain;
+    CBlockIndex* fork = nullptr;
+
+    SnapshotSetup()
+    {
+        for (const auto& item : mapBlockIndex) {
+            saved_entries.emplace_back(item.first, item.second);
+        }
+
+        mapBlockIndex.clear();
+        pindexGenesisBlock = nullptr;
+
+        for (int height = 0; height < 3; ++height) {
+            chain.push_back(AddEntry(height, chain.empty() ? nullptr : chain.back()));
+        }
+
+        chain[0]->pnext = chain[1];
+        chain[1]->pnext = chain[2];
+        chain[2]->SetResearcherContext(GRC::MiningId(cpid), 5 * COIN, 123.5);
+        chain[2]->SetProofHash(InsecureRand256());
+        chain[2]->SetMerkleRoot(InsecureRand256());
+        chain[2]->SetNonce(42);
+        chain[2]->AddMRCResearcherContext(GRC::MiningId(GRC::Cpid(InsecureRandBytes(16))), 2 * COIN, 7.0);
+        chain[2]->MarkAsSuperblock();
+
+        fork = AddEntry(2, chain[1]);
+        fork->SetResearcherContext(GRC::MiningId::ForInvestor(), 0, 0);
+
+        hashBestChain = chain[2]->GetBlockHash();
+    }
+
+    ~SnapshotSetup()
+    {
+        fs::remove(path);
+
+        mapBlockIndex.clear();
+
+        for (const auto& item : saved_entries) {
+            mapBlockIndex[item.first] = item.second;
+        }
+
+        pindexGenesisBlock = saved_genesis;
+        hashBestChain = saved_best_chain;
+    }
+
+    CBlockIndex* AddEntry(const int height, CBlockIndex* pprev)
+    {
+        CBlockIndex* pindex = GRC::BlockIndexPool::GetNextBlockIndex();
+        const auto result = mapBlockIndex.insert(std::make_pair(InsecureRand256(), pindex));
+
+        pindex->phashBlock = &result.first->first;
+        pindex->pprev = pprev;
+        pindex->nHeight = height;
+        pindex->nFile = 1;
+        pindex->nBlockPos = 100 * height;
+        pindex->nMoneySupply = height * COIN;
+        pindex->nStakeModifier = 1000 + height;
+        pindex->nVersion = 12;
+        pindex->nTime = 1600000000 + height;
+        pindex->nBits = 0x1d00ffff;
+
+        return pindex;
+    }
+
+    //! Copy the entries of the mock tree so that we can compare the ones loaded.
+    std::vector<std::pair<uint256, CBlockIndex>> Copy() const
+    {
+        std::vector<std::pair<uint256, CBlockIndex>> copies;
+
+        for (const CBlockIndex* pindex : { chain[0], chain[1], chain[2], fork }) {
+            copies.emplace_back(pindex->GetBlockHash(), *pindex);
+        }
+
+        return copies;
+    }
+};
+
+void CheckEntriesMatch(const CBlockIndex& expected, const CBlockIndex& loaded)
+{
+    BOOST_CHECK_EQUAL(loaded.nFile, expected.nFile);
+    BOOST_CHECK_EQUAL(loaded.nBlockPos, expected.nBlockPos);
+    BOOST_CHECK_EQUAL(loaded.nHeight, expected.nHeight);
+    BOOST_CHECK_EQUAL(loaded.nMoneySupply, expected.nMoneySupply);
+    BOOST_CHECK_EQUAL(loaded.nFlags, expected.nFlags);
+    BOOST_CHECK_EQUAL(loaded.nStakeModifier, expected.nStakeModifier);
+    BOOST_CHECK_EQUAL(loaded.nVersion, expected.nVersion);
+    BOOST_CHECK_EQUAL(loaded.nTime, expected.nTime);
+    BOOST_CHECK_EQUAL(loaded.nBits, expected.nBits);
+    BOOST_CHECK(loaded.GetProofHash() == expected.GetProofHash());
+    BOOST_CHECK(loaded.GetMerkleRoot() == expected.GetMerkleRoot());
+    BOOST_CHECK_EQUAL(loaded.GetNonce(), expected.GetNonce());
+    BOOST_CHECK(loaded.GetMiningId() == expected.GetMiningId());
+    BOOST_CHECK_EQUAL(loaded.ResearchSubsidy(), expected.ResearchSubsidy());
+    BOOST_CHECK_EQUAL(loaded.Magnitude(), expected.Magnitude());
+    BOOST_CHECK_EQUAL(loaded.MRCResearchers().size(), expected.MRCResearchers().size());
+
+    for (size_t i = 0; i < loaded.MRCResearchers().size(); ++i) {
+        BOOST_CHECK(loaded.MRCResearchers()[i].m_cpid == expected.MRCResearchers()[i].m_cpid);
+        BOOST_CHECK_EQUAL(loaded.MRCResearchers()[i].m_research_subsidy, expected.MRCResearchers()[i].m_research_subsidy);
+    }
+}
+} // Anonymous namespace
+
+BOOST_FIXTURE_TEST_SUITE(blockindexsnapshot_tests, SnapshotSetup)
+
+BOOST_AUTO_TEST_CASE(it_round_trips_the_block_index)
+{
+    const auto expected = Copy();
+
+    BOOST_REQUIRE(WriteBlockIndexSnapshot(path));
+
+    mapBlockIndex.clear();
+
+    uint32_t block_count = 0;
+    BOOST_REQUIRE(LoadBlockIndexSnapshot(path, hashBestChain, block_count));
+    BOOST_CHECK_EQUAL(block_count, 4U);
+    BOOST_CHECK_EQUAL(mapBlockIndex.size(), 4U);
+
+    for (const auto& item : expected) {
+        const auto iter = mapBlockIndex.find(item.first);
+        BOOST_REQUIRE(iter != mapBlockIndex.end());
+        BOOST_CHECK(iter->second->GetBlockHash() == item.first);
+
+        CheckEntriesMatch(item.second, *iter->second);
+    }
+
+    const CBlockIndex* tip = mapBlockIndex.find(expected[2].first)->second;
+    const CBlockIndex* fork_tip = mapBlockIndex.find(expected[3].first)->second;
+
+    BOOST_CHECK(tip->pprev->GetBlockHash() == expected[1].first);
+    BOOST_CHECK(tip->pprev->pprev->GetBlockHash() == expected[0].first);
+    BOOST_CHECK(tip->pprev->pprev->pprev == nullptr);
+    BOOST_CHECK(fork_tip->pprev == tip->pprev);
+
+    // Forward links only follow the main chain:
+    BOOST_CHECK(tip->pprev->pnext == tip);
+    BOOST_CHECK(tip->pprev->pprev->pnext == tip->pprev);
+    BOOST_CHECK(tip->pnext == nullptr);
+    BOOST_CHECK(fork_tip->pnext == nullptr);
+}
+
+BOOST_AUTO_TEST_CASE(it_ignores_a_snapshot_for_another_chain_tip)
+{
+    BOOST_REQUIRE(WriteBlockIndexSnapshot(path));
+
+    mapBlockIndex.clear();
+
+    uint32_t block_count = 0;
+    BOOST_CHECK(!LoadBlockIndexSnapshot(path, fork->GetBlockHash(), block_count));
+    BOOST_CHECK(mapBlockIndex.empty());
+}
+
+BOOST_AUTO_TEST_CASE(it_discards_the_entries_of_a_corrupt_snapshot)
+{
+    BOOST_REQUIRE(WriteBlockIndexSnapshot(path));
+
+    // Flip a bit in the last entry of the chunk:
+    {
+        FILE* file = fsbridge::fopen(path, "rb+");
+        BOOST_REQUIRE(file != nullptr);
+        BOOST_REQUIRE(fseek(file, -40, SEEK_END) == 0);
+
+        const int byte = fgetc(file);
+        BOOST_REQUIRE(fseek(file, -40, SEEK_END) == 0);
+        fputc(byte ^ 1, file);
+        fclose(file);
+    }
+
+    mapBlockIndex.clear();
+
+    uint32_t block_count = 0;
+    BOOST_CHECK(!LoadBlockIndexSnapshot(path, hashBestChain, block_count));
+    BOOST_CHECK(mapBlockIndex.empty());
+    BOOST_CHECK(pindexGenesisBlock == nullptr);
+}
+
+BOOST_AUTO_TEST_CASE(it_ignores_a_missing_snapshot)
+{
+    uint32_t block_count = 0;
+    BOOST_CHECK(!LoadBlockIndexSnapshot(path, hashBestChain, block_count));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
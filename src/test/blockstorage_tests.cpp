@@ -0,0 +1,351 @@
+// Copyright (c) 2022 The Gridcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://opensource.org/licenses/mit-license.php.
+
+#include "chainparams.h"
+#include "consensus/consensus.h"
+#include "main.h"
+#include "node/blockstorage.h"
+#include "streams.h"
+#include "test/test_gridcoin.h"
+#include "validation.h"
+
+#include <boost/test/unit_test.hpp>
+
+namespace {
+//!
+//! \brief Make a proof-of-stake block so that reading it back skips the
+//! proof-of-work check.
+//!
+CBlock MakeBlock(const size_t padding)
+{
+    CBlock block;
+    block.nVersion = 12;
+    block.nTime = 1600000000;
+
+    CTransaction coinbase;
+    coinbase.vin.resize(1);
+    coinbase.vout.resize(1);
+    coinbase.vout[0].SetEmpty();
+
+    CTransaction coinstake;
+    coinstake.vin.emplace_back(InsecureRand256(), 0);
+    coinstake.vout.resize(2);
+    coinstake.vout[0].SetEmpty();
+    coinstake.vout[1].nValue = COIN;
+    const std::vector<unsigned char> script(padding, OP_NOP);
+    coinstake.vout[1].scriptPubKey = CScript(script.begin(), script.end());
+
+    block.vtx.push_back(coinbase);
+    block.vtx.push_back(coinstake);
+
+    return block;
+}
+
+//!
+//! \brief Write blocks to disk and link index entries for them into a chain.
+//!
+struct BlockChainFixture
+{
+    std::vector<CBlock> blocks;
+    std::vector<uint256> hashes;
+    std::vector<CBlockIndex> index;
+
+    explicit BlockChainFixture(const size_t count) : hashes(count), index(count)
+    {
+        for (size_t i = 0; i < count; ++i) {
+            // Distinct times give each block a distinct header hash:
+            blocks.push_back(MakeBlock(100 + i));
+            blocks[i].nTime += i;
+            hashes[i] = blocks[i].GetHash(true);
+
+            BOOST_REQUIRE(WriteBlockToDisk(blocks[i], index[i].nFile, index[i].nBlockPos, Params().MessageStart()));
+
+            index[i].phashBlock = &hashes[i];
+            index[i].nHeight = i;
+            index[i].pprev = i > 0 ? &index[i - 1] : nullptr;
+            index[i].pnext = nullptr;
+
+            if (i > 0) {
+                index[i - 1].pnext = &index[i];
+            }
+        }
+    }
+};
+} // Anonymous namespace
+
+BOOST_AUTO_TEST_SUITE(blockstorage_tests)
+
+BOOST_AUTO_TEST_CASE(it_reads_blocks_appended_after_mapping_a_file)
+{
+    const auto& params = Params().GetConsensus();
+    const auto& message_start = Params().MessageStart();
+
+    const CBlock first = MakeBlock(100);
+    unsigned int first_file = 0;
+    unsigned int first_pos = 0;
+
+    BOOST_REQUIRE(WriteBlockToDisk(first, first_file, first_pos, message_start));
+
+    CBlock read;
+    BOOST_REQUIRE(ReadBlockFromDisk(read, first_file, first_pos, params));
+    BOOST_CHECK(read.GetHash(true) == first.GetHash(true));
+
+    // Release the space reserved past the block so that the mapping ends at
+    // the block:
+    BOOST_REQUIRE(CloseBlockFile());
+
+    const auto mapping = MapBlockFile(first_file, 0);
+    BOOST_REQUIRE(mapping != nullptr);
+
+    // The file grows past the end of the cached mapping:
+    const CBlock second = MakeBlock(5000);
+    unsigned int second_file = 0;
+    unsigned int second_pos = 0;
+
+    BOOST_REQUIRE(WriteBlockToDisk(second, second_file, second_pos, message_start));
+    BOOST_CHECK_EQUAL(second_file, first_file);
+    BOOST_CHECK(second_pos >= mapping->Data().size());
+
+    BOOST_REQUIRE(ReadBlockFromDisk(read, second_file, second_pos, params));
+    BOOST_CHECK(read.GetHash(true) == second.GetHash(true));
+    BOOST_CHECK_EQUAL(read.vtx[1].vout[1].scriptPubKey.size(), 5000U);
+
+    // Readers still holding the old mapping can use it:
+    BOOST_CHECK(mapping->Data().size() > first_pos);
+
+    BOOST_REQUIRE(ReadBlockFromDisk(read, first_file, first_pos, params));
+    BOOST_CHECK(read.GetHash(true) == first.GetHash(true));
+}
+
+BOOST_AUTO_TEST_CASE(it_reads_transactions_from_a_mapped_file)
+{
+    const CBlock block = MakeBlock(200);
+    unsigned int file = 0;
+    unsigned int pos = 0;
+
+    BOOST_REQUIRE(WriteBlockToDisk(block, file, pos, Params().MessageStart()));
+
+    const CDiskTxPos tx_pos(file, pos, pos + ::GetSerializeSize(block.GetBlockHeader(), SER_DISK, CLIENT_VERSION)
+        + GetSizeOfCompactSize(block.vtx.size()) + ::GetSerializeSize(block.vtx[0], SER_DISK, CLIENT_VERSION));
+
+    CTransaction tx;
+    BOOST_REQUIRE(ReadTxFromDisk(tx, tx_pos));
+    BOOST_CHECK(tx.GetHash() == block.vtx[1].GetHash());
+
+    FlushBlockFileMappings();
+
+    BOOST_REQUIRE(ReadTxFromDisk(tx, tx_pos));
+    BOOST_CHECK(tx.GetHash() == block.vtx[1].GetHash());
+}
+
+BOOST_AUTO_TEST_CASE(it_appends_blocks_to_reserved_space_in_an_open_file)
+{
+    const auto& message_start = Params().MessageStart();
+    const uint64_t header_size = sizeof(message_start) + sizeof(uint32_t);
+
+    const CBlock first = MakeBlock(300);
+    const CBlock second = MakeBlock(400);
+    unsigned int first_file = 0;
+    unsigned int first_pos = 0;
+    unsigned int second_file = 0;
+    unsigned int second_pos = 0;
+
+    BOOST_REQUIRE(WriteBlockToDisk(first, first_file, first_pos, message_start));
+    BOOST_REQUIRE(WriteBlockToDisk(second, second_file, second_pos, message_start));
+
+    const uint64_t end = second_pos + ::GetSerializeSize(second, SER_DISK, CLIENT_VERSION);
+
+    BOOST_CHECK_EQUAL(second_file, first_file);
+    BOOST_CHECK_EQUAL(second_pos, first_pos + ::GetSerializeSize(first, SER_DISK, CLIENT_VERSION) + header_size);
+    BOOST_CHECK_EQUAL(fs::file_size(BlockFilePath(first_file)) % BLOCKFILE_CHUNK_SIZE, 0U);
+    BOOST_CHECK(fs::file_size(BlockFilePath(first_file)) >= end);
+    BOOST_CHECK(CommitBlockFile());
+
+    CBlock read;
+    BOOST_REQUIRE(ReadBlockFromDisk(read, second_file, second_pos, Params().GetConsensus()));
+    BOOST_CHECK(read.GetHash(true) == second.GetHash(true));
+
+    // Closing the file releases the reserved space, and the next block goes
+    // right after the last one:
+    BOOST_REQUIRE(CloseBlockFile());
+    BOOST_CHECK_EQUAL(fs::file_size(BlockFilePath(first_file)), end);
+
+    unsigned int third_file = 0;
+    unsigned int third_pos = 0;
+
+    BOOST_REQUIRE(WriteBlockToDisk(first, third_file, third_pos, message_start));
+    BOOST_CHECK_EQUAL(third_file, first_file);
+    BOOST_CHECK_EQUAL(third_pos, end + header_size);
+
+    BOOST_REQUIRE(ReadBlockFromDisk(read, third_file, third_pos, Params().GetConsensus()));
+    BOOST_CHECK(read.GetHash(true) == first.GetHash(true));
+}
+
+BOOST_AUTO_TEST_CASE(it_imports_the_blocks_of_an_external_file_in_order)
+{
+    const auto& message_start = Params().MessageStart();
+
+    std::vector<CBlock> blocks;
+    for (size_t i = 0; i < 10; ++i) {
+        blocks.push_back(MakeBlock(100 * i));
+        blocks.back().nTime += i;
+    }
+
+    // Surround the blocks with junk, a block that fails to deserialize, and
+    // a header with an invalid size, and cut the file off inside a block:
+    CDataStream stream(SER_DISK, CLIENT_VERSION);
+    std::vector<uint64_t> positions;
+
+    stream << uint32_t{0} << uint8_t{message_start[0]};
+
+    for (const auto& block : blocks) {
+        stream << message_start << static_cast<unsigned int>(::GetSerializeSize(block, SER_DISK, CLIENT_VERSION));
+        positions.push_back(stream.size());
+        stream << block;
+
+        stream << message_start << 100U;
+        for (size_t i = 0; i < 100; ++i) stream << uint8_t{0xFF};
+
+        stream << message_start << MAX_BLOCK_SIZE + 1;
+    }
+
+    stream << message_start << 1000U << uint8_t{1};
+
+    for (const int threads : { 0, 2 }) {
+        const fs::path path = GetDataDir() / "import.dat";
+        FILE* file = fsbridge::fopen(path, "wb+");
+        BOOST_REQUIRE(file != nullptr);
+        BOOST_REQUIRE_EQUAL(fwrite(stream.data(), 1, stream.size(), file), stream.size());
+        BOOST_REQUIRE_EQUAL(fseek(file, 0, SEEK_SET), 0);
+
+        ExternalBlockFileReader reader(file, 0, 4, threads);
+
+        CBlock block;
+        uint64_t nPos;
+        size_t count = 0;
+
+        while (reader.Next(block, nPos)) {
+            BOOST_REQUIRE(count < blocks.size());
+            BOOST_CHECK_EQUAL(nPos, positions[count]);
+            BOOST_CHECK(block.GetHash(true) == blocks[count].GetHash(true));
+            BOOST_CHECK_EQUAL(block.vtx.size(), blocks[count].vtx.size());
+            ++count;
+        }
+
+        BOOST_CHECK_EQUAL(count, blocks.size());
+    }
+}
+
+BOOST_AUTO_TEST_CASE(it_stops_an_import_early)
+{
+    CDataStream stream(SER_DISK, CLIENT_VERSION);
+    const CBlock block = MakeBlock(100);
+
+    for (size_t i = 0; i < 50; ++i) {
+        stream << Params().MessageStart() << static_cast<unsigned int>(::GetSerializeSize(block, SER_DISK, CLIENT_VERSION));
+        stream << block;
+    }
+
+    FILE* file = fsbridge::fopen(GetDataDir() / "import.dat", "wb+");
+    BOOST_REQUIRE(file != nullptr);
+    BOOST_REQUIRE_EQUAL(fwrite(stream.data(), 1, stream.size(), file), stream.size());
+    BOOST_REQUIRE_EQUAL(fseek(file, 0, SEEK_SET), 0);
+
+    ExternalBlockFileReader reader(file, 0, 4, 2);
+
+    CBlock read;
+    uint64_t nPos;
+
+    BOOST_CHECK(reader.Next(read, nPos));
+    BOOST_CHECK(read.GetHash(true) == block.GetHash(true));
+}
+
+BOOST_AUTO_TEST_CASE(it_does_not_map_a_missing_block_file)
+{
+    BOOST_CHECK(MapBlockFile(9999, 0) == nullptr);
+    BOOST_CHECK(MapBlockFile(0, 0) == nullptr);
+}
+
+BOOST_AUTO_TEST_CASE(it_reads_a_chain_of_blocks_ahead_in_order)
+{
+    BlockChainFixture chain(20);
+
+    for (const int threads : { 0, 1, 3 }) {
+        SequentialBlockReader reader(&chain.index[0], nullptr, nullptr, 4, threads);
+
+        CBlock block;
+        bool fRead;
+        size_t count = 0;
+
+        while (const CBlockIndex* pindex = reader.Next(block, fRead)) {
+            BOOST_REQUIRE(count < chain.index.size());
+            BOOST_CHECK_EQUAL(pindex, &chain.index[count]);
+            BOOST_CHECK(fRead);
+            BOOST_CHECK(block.GetHash(true) == chain.hashes[count]);
+            ++count;
+        }
+
+        BOOST_CHECK_EQUAL(count, chain.index.size());
+        BOOST_CHECK(reader.Next(block, fRead) == nullptr);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(it_reads_only_selected_blocks_up_to_the_end)
+{
+    BlockChainFixture chain(20);
+
+    SequentialBlockReader reader(&chain.index[2], &chain.index[15], [](const CBlockIndex* pindex) {
+        return pindex->nHeight % 3 == 0;
+    });
+
+    CBlock block;
+    bool fRead;
+    std::vector<int> heights;
+
+    while (const CBlockIndex* pindex = reader.Next(block, fRead)) {
+        BOOST_CHECK(fRead);
+        BOOST_CHECK(block.GetHash(true) == pindex->GetBlockHash());
+        heights.push_back(pindex->nHeight);
+    }
+
+    const std::vector<int> expected { 3, 6, 9, 12, 15 };
+    BOOST_CHECK_EQUAL_COLLECTIONS(heights.begin(), heights.end(), expected.begin(), expected.end());
+}
+
+BOOST_AUTO_TEST_CASE(it_reports_blocks_that_fail_to_read)
+{
+    BlockChainFixture chain(3);
+
+    // The block at this position does not match the hash in the index:
+    chain.index[1].nBlockPos = chain.index[2].nBlockPos;
+
+    SequentialBlockReader reader(&chain.index[0]);
+
+    CBlock block;
+    bool fRead;
+
+    BOOST_CHECK_EQUAL(reader.Next(block, fRead), &chain.index[0]);
+    BOOST_CHECK(fRead);
+    BOOST_CHECK_EQUAL(reader.Next(block, fRead), &chain.index[1]);
+    BOOST_CHECK(!fRead);
+    BOOST_CHECK(block.vtx.empty());
+    BOOST_CHECK_EQUAL(reader.Next(block, fRead), &chain.index[2]);
+    BOOST_CHECK(fRead);
+    BOOST_CHECK(reader.Next(block, fRead) == nullptr);
+}
+
+BOOST_AUTO_TEST_CASE(it_stops_reading_ahead_when_destroyed_early)
+{
+    BlockChainFixture chain(50);
+
+    SequentialBlockReader reader(&chain.index[0], nullptr, nullptr, 8, 2);
+
+    CBlock block;
+    bool fRead;
+
+    BOOST_CHECK_EQUAL(reader.Next(block, fRead), &chain.index[0]);
+    BOOST_CHECK(fRead);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
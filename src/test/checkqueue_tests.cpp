@@ -0,0 +1,134 @@
+// Copyright (c) 2012-2020 The Bitcoin Core developers
+// Copyright (c) 2022 The Gridcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://opensource.org/licenses/mit-license.php.
+
+#include <checkqueue.h>
+
+#include <atomic>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+namespace {
+static const unsigned int QUEUE_BATCH_SIZE = 128;
+static const int SCRIPT_CHECK_THREADS = 3;
+
+struct FakeCheckCheckCompletion {
+    static std::atomic<size_t> n_calls;
+    bool operator()()
+    {
+        n_calls.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+    void swap(FakeCheckCheckCompletion& x){};
+};
+
+struct FailingCheck {
+    bool fails;
+    FailingCheck(bool _fails) : fails(_fails){};
+    FailingCheck() : fails(true){};
+    bool operator()()
+    {
+        return !fails;
+    }
+    void swap(FailingCheck& x)
+    {
+        std::swap(fails, x.fails);
+    };
+};
+
+std::atomic<size_t> FakeCheckCheckCompletion::n_calls{0};
+
+typedef CCheckQueue<FakeCheckCheckCompletion> Correct_Queue;
+typedef CCheckQueue<FailingCheck> Failing_Queue;
+} // Anonymous namespace
+
+BOOST_AUTO_TEST_SUITE(checkqueue_tests)
+
+BOOST_AUTO_TEST_CASE(test_CheckQueue_Correct)
+{
+    auto small_queue = std::make_unique<Correct_Queue>(QUEUE_BATCH_SIZE);
+    small_queue->StartWorkerThreads(SCRIPT_CHECK_THREADS);
+
+    for (const size_t total : { 0, 1, 10, 1000, 100000 }) {
+        FakeCheckCheckCompletion::n_calls = 0;
+        {
+            CCheckQueueControl<FakeCheckCheckCompletion> control(small_queue.get());
+
+            for (size_t added = 0; added < total; added += 100) {
+                std::vector<FakeCheckCheckCompletion> vChecks(std::min<size_t>(100, total - added));
+                control.Add(vChecks);
+            }
+
+            BOOST_CHECK(control.Wait());
+        }
+
+        BOOST_CHECK_EQUAL(FakeCheckCheckCompletion::n_calls, total);
+    }
+
+    small_queue->StopWorkerThreads();
+}
+
+BOOST_AUTO_TEST_CASE(test_CheckQueue_Catches_Failure)
+{
+    auto fail_queue = std::make_unique<Failing_Queue>(QUEUE_BATCH_SIZE);
+    fail_queue->StartWorkerThreads(SCRIPT_CHECK_THREADS);
+
+    for (size_t i = 0; i < 1001; ++i) {
+        CCheckQueueControl<FailingCheck> control(fail_queue.get());
+        size_t remaining = i;
+
+        while (remaining) {
+            size_t r = std::min<size_t>(remaining, 10);
+
+            std::vector<FailingCheck> vChecks;
+            vChecks.reserve(r);
+            for (size_t k = 0; k < r; k++)
+                vChecks.emplace_back(i > 0 && remaining == i && k == 0);
+            control.Add(vChecks);
+            remaining -= r;
+        }
+
+        // Only the first check of each non-empty round fails:
+        BOOST_CHECK_EQUAL(control.Wait(), i == 0);
+    }
+
+    fail_queue->StopWorkerThreads();
+}
+
+BOOST_AUTO_TEST_CASE(test_CheckQueue_Recovers_From_Failure)
+{
+    auto fail_queue = std::make_unique<Failing_Queue>(QUEUE_BATCH_SIZE);
+    fail_queue->StartWorkerThreads(SCRIPT_CHECK_THREADS);
+
+    for (auto times = 0; times < 10; ++times) {
+        for (const bool end_fails : {true, false}) {
+            CCheckQueueControl<FailingCheck> control(fail_queue.get());
+            {
+                std::vector<FailingCheck> vChecks;
+                vChecks.resize(100, false);
+                vChecks[99] = end_fails;
+                control.Add(vChecks);
+            }
+            bool r = control.Wait();
+            BOOST_CHECK(r != end_fails);
+        }
+    }
+
+    fail_queue->StopWorkerThreads();
+}
+
+BOOST_AUTO_TEST_CASE(test_CheckQueueControl_Without_Queue)
+{
+    CCheckQueueControl<FailingCheck> control(nullptr);
+
+    std::vector<FailingCheck> vChecks(1, true);
+    control.Add(vChecks);
+
+    // Without a queue, callers run their checks inline and the control has
+    // nothing to wait for:
+    BOOST_CHECK(control.Wait());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -590,6 +590,24 @@ BOOST_AUTO_TEST_CASE(sha256d64)
     }
 }
 
+BOOST_AUTO_TEST_CASE(sha256dpadded)
+{
+    for (int i = 0; i <= 32; ++i) {
+        unsigned char in[64 * 32];
+        unsigned char out1[32 * 32], out2[32 * 32];
+        for (int j = 0; j < i; ++j) {
+            const size_t len = InsecureRandRange(56);
+            for (size_t k = 0; k < len; ++k) {
+                in[64 * j + k] = InsecureRandBits(8);
+            }
+            CHash256().Write({in + 64 * j, len}).Finalize({out1 + 32 * j, 32});
+            SHA256PadBlock(in + 64 * j, len);
+        }
+        SHA256DPadded(out2, in, i);
+        BOOST_CHECK(memcmp(out1, out2, 32 * i) == 0);
+    }
+}
+
 static void TestSHA3_256(const std::string& input, const std::string& output)
 {
     const auto in_bytes = ParseHex(input);
@@ -0,0 +1,153 @@
+// Copyright (c) 2012-2020 The Bitcoin Core developers
+// Copyright (c) 2022 The Gridcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://opensource.org/licenses/mit-license.php.
+
+#include <cuckoocache.h>
+#include <test/test_gridcoin.h>
+
+#include <cstring>
+#include <shared_mutex>
+#include <thread>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+/** Test Suite for CuckooCache
+ *
+ * The hit rates are regression checks: a change that lowers them noticeably
+ * makes the signature cache less effective.
+ */
+namespace {
+/** Same layout as the signature cache hasher: slices of a random key. */
+struct RandomHasher
+{
+    template <uint8_t hash_select>
+    uint32_t operator()(const uint256& key) const
+    {
+        static_assert(hash_select < 8, "RandomHasher only has 8 hashes available.");
+        uint32_t u;
+        std::memcpy(&u, key.begin() + 4 * hash_select, 4);
+        return u;
+    }
+};
+
+typedef CuckooCache::cache<uint256, RandomHasher> test_cache;
+
+/** Fill the cache to the given load with random keys and return the fraction
+ * of them that it still contains.
+ */
+double HitRate(const double load, const size_t megabytes)
+{
+    test_cache set{};
+    const uint32_t n = set.setup_bytes(megabytes << 20);
+    const uint64_t n_insert = static_cast<uint64_t>(load * n);
+
+    std::vector<uint256> hashes;
+    hashes.reserve(n_insert);
+
+    for (uint64_t i = 0; i < n_insert; ++i) {
+        hashes.emplace_back(InsecureRand256());
+        set.insert(hashes.back());
+    }
+
+    double count = 0;
+    for (const auto& hash : hashes) {
+        count += set.contains(hash, false);
+    }
+
+    return count / n_insert;
+}
+} // Anonymous namespace
+
+BOOST_AUTO_TEST_SUITE(cuckoocache_tests)
+
+BOOST_AUTO_TEST_CASE(test_cuckoocache_no_fakes)
+{
+    test_cache cc{};
+    cc.setup_bytes(32 << 20);
+
+    for (int x = 0; x < 100000; ++x) {
+        cc.insert(InsecureRand256());
+    }
+    for (int x = 0; x < 100000; ++x) {
+        BOOST_CHECK(!cc.contains(InsecureRand256(), false));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(cuckoocache_hit_rate_ok)
+{
+    // At a load of 90%, the cache should keep nearly everything. Below that,
+    // nothing should be evicted at all.
+    BOOST_CHECK_GE(HitRate(0.90, 1), 0.98);
+    BOOST_CHECK_GE(HitRate(0.50, 1), 0.999);
+}
+
+BOOST_AUTO_TEST_CASE(cuckoocache_erased_entries_are_replaced_first)
+{
+    test_cache set{};
+    const uint32_t n = set.setup_bytes(1 << 20);
+
+    std::vector<uint256> hashes;
+    for (uint32_t i = 0; i < n * 9 / 10; ++i) {
+        hashes.emplace_back(InsecureRand256());
+        set.insert(hashes.back());
+    }
+
+    // Erase the first half:
+    for (size_t i = 0; i < hashes.size() / 2; ++i) {
+        set.contains(hashes[i], true);
+    }
+
+    // Refill the cache. The inserts should reuse the erased slots and evict
+    // almost none of the entries that we kept:
+    for (size_t i = 0; i < hashes.size() / 2; ++i) {
+        set.insert(InsecureRand256());
+    }
+
+    double count = 0;
+    for (size_t i = hashes.size() / 2; i < hashes.size(); ++i) {
+        count += set.contains(hashes[i], false);
+    }
+
+    BOOST_CHECK_GE(count / (hashes.size() - hashes.size() / 2), 0.98);
+}
+
+BOOST_AUTO_TEST_CASE(cuckoocache_concurrent_reads_see_all_entries)
+{
+    test_cache set{};
+    set.setup_bytes(1 << 20);
+
+    std::vector<uint256> hashes;
+    for (int i = 0; i < 10000; ++i) {
+        hashes.emplace_back(InsecureRand256());
+        set.insert(hashes.back());
+    }
+
+    // Mirror the signature cache: readers share the lock and may erase.
+    std::shared_mutex mtx;
+    std::vector<std::thread> threads;
+    std::vector<size_t> found(4, 0);
+
+    for (size_t t = 0; t < found.size(); ++t) {
+        threads.emplace_back([&, t] {
+            std::shared_lock<std::shared_mutex> lock(mtx);
+            for (size_t i = t; i < hashes.size(); i += found.size()) {
+                found[t] += set.contains(hashes[i], i % 2 == 0);
+            }
+        });
+    }
+
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    size_t total = 0;
+    for (const size_t count : found) {
+        total += count;
+    }
+
+    BOOST_CHECK_EQUAL(total, hashes.size());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
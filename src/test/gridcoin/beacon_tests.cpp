@@ -155,13 +155,13 @@ public:
             pindex->nMoneySupply   = element.m_disk_block_index.nMoneySupply;
             pindex->nFlags         = element.m_disk_block_index.nFlags;
             pindex->nStakeModifier = element.m_disk_block_index.nStakeModifier;
-            pindex->hashProof      = element.m_disk_block_index.hashProof;
             pindex->nVersion       = element.m_disk_block_index.nVersion;
-            pindex->hashMerkleRoot = element.m_disk_block_index.hashMerkleRoot;
             pindex->nTime          = element.m_disk_block_index.nTime;
             pindex->nBits          = element.m_disk_block_index.nBits;
-            pindex->nNonce         = element.m_disk_block_index.nNonce;
             pindex->m_researcher   = element.m_disk_block_index.m_researcher;
+            pindex->SetProofHash(element.m_disk_block_index.hashProof);
+            pindex->SetMerkleRoot(element.m_disk_block_index.hashMerkleRoot);
+            pindex->SetNonce(element.m_disk_block_index.nNonce);
 
             // Update hashBestChain to fixup global for BeaconRegistry::Initialize call.
             hashBestChain = block_hash;
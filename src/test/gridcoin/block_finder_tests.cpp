@@ -28,6 +28,7 @@ namespace
                     block->pprev = prev;
                     block->nHeight = prev->nHeight + 1;
                     block->nTime = prev->nTime + 10;
+                    block->BuildSkip();
                 }
                 if(block != &blocks.back())
                     block->pnext = next;
@@ -36,6 +37,11 @@ namespace
             pindexBest = &blocks.back();
             pindexGenesisBlock = &blocks.front();
             nBestHeight = blocks.back().nHeight;
+            g_active_chain.SetTip(pindexBest);
+        }
+        ~BlockChain()
+        {
+            g_active_chain.SetTip(nullptr);
         }
         std::array<CBlockIndex, Size> blocks;
     };
@@ -83,4 +89,87 @@ BOOST_AUTO_TEST_CASE(FindBlockByTimeShouldReturnLastBlockIfOlderThanTime)
     BOOST_CHECK_EQUAL(&chain.blocks.back(), GRC::BlockFinder::FindByMinTime(999999));
 }
 
+BOOST_AUTO_TEST_CASE(FindBlockByTimeShouldSkipBlocksWithOutOfOrderTimes)
+{
+    BlockChain<10> chain;
+
+    // Block #3 has a timestamp earlier than block #2:
+    chain.blocks[2].nTime = 35;
+
+    // Rebuild the time index. Connected blocks never change their times, so
+    // setting the same tip again would keep the stale maximums:
+    g_active_chain.SetTip(nullptr);
+    g_active_chain.SetTip(&chain.blocks.back());
+
+    BOOST_CHECK_EQUAL(&chain.blocks[2], GRC::BlockFinder::FindByMinTime(31));
+    BOOST_CHECK_EQUAL(&chain.blocks[3], GRC::BlockFinder::FindByMinTimeFromGivenIndex(30, &chain.blocks[3]));
+    BOOST_CHECK_EQUAL(&chain.blocks[4], GRC::BlockFinder::FindByMinTimeFromGivenIndex(31, &chain.blocks[3]));
+}
+
+BOOST_AUTO_TEST_CASE(ActiveChainShouldFollowReorganizations)
+{
+    BlockChain<10> chain;
+    BlockChain<3> fork;
+
+    // Attach the fork to block #6 of the main chain, then switch to it:
+    fork.blocks[0].pprev = &chain.blocks[6];
+    fork.blocks[0].nHeight = 7;
+    fork.blocks[1].nHeight = 8;
+    fork.blocks[2].nHeight = 9;
+    g_active_chain.SetTip(&fork.blocks.back());
+
+    BOOST_CHECK_EQUAL(g_active_chain.Height(), 9);
+    BOOST_CHECK_EQUAL(g_active_chain[6], &chain.blocks[6]);
+    BOOST_CHECK_EQUAL(g_active_chain[7], &fork.blocks[0]);
+    BOOST_CHECK(!g_active_chain.Contains(&chain.blocks[7]));
+    BOOST_CHECK_EQUAL(g_active_chain.Next(&chain.blocks[6]), &fork.blocks[0]);
+
+    // Disconnect back to the fork point:
+    g_active_chain.SetTip(&chain.blocks[6]);
+
+    BOOST_CHECK_EQUAL(g_active_chain.Tip(), &chain.blocks[6]);
+    BOOST_CHECK(g_active_chain[7] == nullptr);
+}
+
+BOOST_AUTO_TEST_CASE(GetAncestorShouldFindEveryPredecessor)
+{
+    BlockChain<1000> chain;
+
+    for (const auto& block : chain.blocks) {
+        if (block.nHeight > 0) {
+            BOOST_CHECK(block.pskip != nullptr);
+            BOOST_CHECK(block.pskip->nHeight < block.nHeight);
+        }
+
+        for (int height = 0; height <= block.nHeight; height += 37) {
+            BOOST_CHECK_EQUAL(block.GetAncestor(height), &chain.blocks[height]);
+        }
+
+        BOOST_CHECK_EQUAL(block.GetAncestor(block.nHeight), &block);
+    }
+
+    BOOST_CHECK(chain.blocks[500].GetAncestor(501) == nullptr);
+    BOOST_CHECK(chain.blocks[500].GetAncestor(-1) == nullptr);
+}
+
+BOOST_AUTO_TEST_CASE(FindForkShouldReturnLastCommonBlock)
+{
+    BlockChain<10> chain;
+    BlockChain<5> fork;
+
+    // Attach the fork to block #6 of the main chain so that it outgrows it:
+    fork.blocks[0].pprev = &chain.blocks[6];
+
+    for (size_t i = 0; i < fork.blocks.size(); ++i) {
+        fork.blocks[i].nHeight = 7 + i;
+        fork.blocks[i].BuildSkip();
+    }
+
+    g_active_chain.SetTip(&chain.blocks.back());
+
+    BOOST_CHECK_EQUAL(g_active_chain.FindFork(&fork.blocks.back()), &chain.blocks[6]);
+    BOOST_CHECK_EQUAL(g_active_chain.FindFork(&chain.blocks[4]), &chain.blocks[4]);
+    BOOST_CHECK(g_active_chain.FindFork(nullptr) == nullptr);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,256 @@
+// Copyright (c) 2014-2022 The Gridcoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or https://opensource.org/licenses/mit-license.php.
+
+#include "main.h"
+#include "gridcoin/block_index.h"
+#include "test/test_gridcoin.h"
+
+#include <boost/test/unit_test.hpp>
+#include <cstddef>
+#include <map>
+#include <set>
+
+// -----------------------------------------------------------------------------
+// BlockIndexMap
+// -----------------------------------------------------------------------------
+
+BOOST_AUTO_TEST_SUITE(BlockIndexMap)
+
+BOOST_AUTO_TEST_CASE(it_initializes_to_an_empty_table)
+{
+    const GRC::BlockIndexMap map;
+
+    BOOST_CHECK(map.empty());
+    BOOST_CHECK_EQUAL(map.size(), 0U);
+    BOOST_CHECK(map.begin() == map.end());
+    BOOST_CHECK(map.find(uint256()) == map.end());
+    BOOST_CHECK_EQUAL(map.count(uint256()), 0U);
+}
+
+BOOST_AUTO_TEST_CASE(it_inserts_and_finds_entries)
+{
+    GRC::BlockIndexMap map;
+    std::map<uint256, CBlockIndex> expected;
+
+    // Enough entries to force the table to grow a few times:
+    for (size_t i = 0; i < 1000; ++i) {
+        const uint256 hash = InsecureRand256();
+        CBlockIndex* pindex = &expected[hash];
+
+        const auto result = map.insert(std::make_pair(hash, pindex));
+
+        BOOST_CHECK(result.second);
+        BOOST_CHECK(result.first->first == hash);
+        BOOST_CHECK_EQUAL(result.first->second, pindex);
+    }
+
+    BOOST_CHECK_EQUAL(map.size(), expected.size());
+
+    for (auto& entry : expected) {
+        const auto iter = map.find(entry.first);
+
+        BOOST_REQUIRE(iter != map.end());
+        BOOST_CHECK(iter->first == entry.first);
+        BOOST_CHECK_EQUAL(iter->second, &entry.second);
+        BOOST_CHECK_EQUAL(map.count(entry.first), 1U);
+    }
+
+    BOOST_CHECK(map.find(InsecureRand256()) == map.end());
+}
+
+BOOST_AUTO_TEST_CASE(it_does_not_replace_existing_entries_on_insert)
+{
+    GRC::BlockIndexMap map;
+    CBlockIndex first;
+    CBlockIndex second;
+    const uint256 hash = InsecureRand256();
+
+    BOOST_CHECK(map.insert(std::make_pair(hash, &first)).second);
+
+    const auto result = map.insert(std::make_pair(hash, &second));
+
+    BOOST_CHECK(!result.second);
+    BOOST_CHECK_EQUAL(result.first->second, &first);
+    BOOST_CHECK_EQUAL(map.size(), 1U);
+}
+
+BOOST_AUTO_TEST_CASE(it_keeps_key_addresses_stable_when_growing)
+{
+    GRC::BlockIndexMap map;
+    std::vector<std::pair<uint256, const uint256*>> keys;
+
+    for (size_t i = 0; i < 1000; ++i) {
+        const uint256 hash = InsecureRand256();
+        keys.emplace_back(hash, &map.insert(std::make_pair(hash, nullptr)).first->first);
+    }
+
+    for (const auto& key : keys) {
+        BOOST_CHECK(*key.second == key.first);
+        BOOST_CHECK_EQUAL(&map.find(key.first)->first, key.second);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(it_inserts_null_entries_for_missing_keys_by_subscript)
+{
+    GRC::BlockIndexMap map;
+    CBlockIndex index;
+    const uint256 hash = InsecureRand256();
+
+    BOOST_CHECK(map[hash] == nullptr);
+    BOOST_CHECK_EQUAL(map.size(), 1U);
+
+    map[hash] = &index;
+
+    BOOST_CHECK_EQUAL(map.find(hash)->second, &index);
+    BOOST_CHECK_EQUAL(map.size(), 1U);
+}
+
+BOOST_AUTO_TEST_CASE(it_erases_entries)
+{
+    GRC::BlockIndexMap map;
+    std::vector<uint256> hashes;
+
+    // Keys that share the low 64 bits all probe from the same slot, so every
+    // removal exercises the backward shift of the entries that follow:
+    for (uint64_t i = 1; i <= 500; ++i) {
+        hashes.emplace_back(ArithToUint256(arith_uint256(i) << 64));
+        map[hashes.back()] = nullptr;
+    }
+
+    for (size_t i = 0; i < hashes.size(); i += 2) {
+        BOOST_CHECK_EQUAL(map.erase(hashes[i]), 1U);
+        BOOST_CHECK_EQUAL(map.erase(hashes[i]), 0U);
+    }
+
+    BOOST_CHECK_EQUAL(map.size(), hashes.size() / 2);
+
+    for (size_t i = 0; i < hashes.size(); ++i) {
+        BOOST_CHECK_EQUAL(map.count(hashes[i]), i % 2);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(it_iterates_over_every_entry)
+{
+    GRC::BlockIndexMap map;
+    std::set<uint256> expected;
+
+    for (size_t i = 0; i < 100; ++i) {
+        const uint256 hash = InsecureRand256();
+        expected.emplace(hash);
+        map[hash] = nullptr;
+    }
+
+    std::set<uint256> seen;
+
+    for (const auto& entry : map) {
+        seen.emplace(entry.first);
+    }
+
+    BOOST_CHECK(seen == expected);
+
+    const GRC::BlockIndexMap& const_map = map;
+    size_t count = 0;
+
+    for (GRC::BlockIndexMap::const_iterator iter = const_map.begin(); iter != const_map.end(); ++iter) {
+        ++count;
+    }
+
+    BOOST_CHECK_EQUAL(count, expected.size());
+}
+
+BOOST_AUTO_TEST_CASE(it_reports_memory_usage_below_a_node_based_map)
+{
+    // A node of std::unordered_map<uint256, CBlockIndex*> holds the key, the
+    // value, and a link pointer. Each node is a separate heap allocation that
+    // glibc pads with a header word to a multiple of 16 bytes, and the bucket
+    // array adds a pointer for each entry:
+    //
+    const size_t node_size = sizeof(uint256) + sizeof(CBlockIndex*) + sizeof(void*);
+    const size_t allocated_node_size = (node_size + sizeof(void*) + 15) / 16 * 16;
+    const size_t node_map_entry_size = allocated_node_size + sizeof(void*);
+
+    GRC::BlockIndexMap map;
+
+    // The table uses less memory than the node-based map once it fills more
+    // than 3/5 of its slots. It grows at 3/4, so check every size from 5/8 up
+    // to that for the tables with 2048 and 4096 slots:
+    //
+    for (size_t size = 1; size <= 3072; ++size) {
+        map[InsecureRand256()] = nullptr;
+
+        if ((size >= 1280 && size <= 1536) || size >= 2560) {
+            BOOST_CHECK_MESSAGE(
+                map.MemoryUsage() < map.size() * node_map_entry_size,
+                "size " << size << ": " << map.MemoryUsage() << " bytes");
+        }
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+// -----------------------------------------------------------------------------
+// CBlockIndex
+// -----------------------------------------------------------------------------
+
+BOOST_AUTO_TEST_SUITE(block_index_tests)
+
+BOOST_AUTO_TEST_CASE(it_defers_cold_data_allocation_until_written)
+{
+    CBlockIndex index;
+
+    BOOST_CHECK(index.m_cold == nullptr);
+    BOOST_CHECK(index.GetMerkleRoot().IsNull());
+    BOOST_CHECK(index.GetProofHash().IsNull());
+    BOOST_CHECK_EQUAL(index.GetNonce(), 0U);
+
+    const uint256 merkle_root = InsecureRand256();
+    const uint256 proof_hash = InsecureRand256();
+
+    index.SetMerkleRoot(merkle_root);
+    index.SetProofHash(proof_hash);
+    index.SetNonce(123);
+
+    BOOST_CHECK(index.m_cold != nullptr);
+    BOOST_CHECK(index.GetMerkleRoot() == merkle_root);
+    BOOST_CHECK(index.GetProofHash() == proof_hash);
+    BOOST_CHECK_EQUAL(index.GetNonce(), 123U);
+}
+
+BOOST_AUTO_TEST_CASE(it_keeps_traversal_fields_in_the_first_cache_line)
+{
+    BOOST_CHECK(offsetof(CBlockIndex, pprev) < 64);
+    BOOST_CHECK(offsetof(CBlockIndex, nHeight) < 64);
+    BOOST_CHECK(offsetof(CBlockIndex, nFlags) < 64);
+    BOOST_CHECK(offsetof(CBlockIndex, nTime) < 64);
+    BOOST_CHECK(offsetof(CBlockIndex, m_researcher) < 64);
+    BOOST_CHECK(offsetof(CBlockIndex, m_mrc_researchers_count) < 64);
+}
+
+BOOST_AUTO_TEST_CASE(it_stores_mrc_researcher_contexts_contiguously)
+{
+    CBlockIndex index;
+    const GRC::Cpid cpid_1 = GRC::Cpid::Parse("00010203040506070809101112131415");
+    const GRC::Cpid cpid_2 = GRC::Cpid::Parse("15141312111009080706050403020100");
+
+    BOOST_CHECK(index.MRCResearchers().empty());
+
+    index.AddMRCResearcherContext(cpid_1, 100, 1.0);
+    index.AddMRCResearcherContext(cpid_2, 200, 2.0);
+
+    // Duplicate CPIDs and zero rewards do not produce an entry:
+    index.AddMRCResearcherContext(cpid_1, 300, 3.0);
+    index.AddMRCResearcherContext(GRC::Cpid(), 0, 0.0);
+
+    const auto mrcs = index.MRCResearchers();
+
+    BOOST_REQUIRE_EQUAL(mrcs.size(), 2U);
+    BOOST_CHECK(mrcs[0].m_cpid == cpid_1);
+    BOOST_CHECK_EQUAL(mrcs[0].m_research_subsidy, 100);
+    BOOST_CHECK(mrcs[1].m_cpid == cpid_2);
+    BOOST_CHECK_EQUAL(mrcs[1].m_research_subsidy, 200);
+    BOOST_CHECK_EQUAL(&mrcs[1], &mrcs[0] + 1);
+    BOOST_CHECK_EQUAL(index.ResearchMRCSubsidy(), 300);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
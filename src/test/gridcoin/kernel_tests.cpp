@@ -0,0 +1,62 @@
+// Copyright (c) 2014-2022 The Gridcoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or https://opensource.org/licenses/mit-license.php.
+
+#include "gridcoin/staking/kernel.h"
+#include "test/test_gridcoin.h"
+
+#include <boost/test/unit_test.hpp>
+
+// -----------------------------------------------------------------------------
+// StakeKernelBatch
+// -----------------------------------------------------------------------------
+
+BOOST_AUTO_TEST_SUITE(StakeKernelBatch)
+
+BOOST_AUTO_TEST_CASE(it_matches_the_single_kernel_hash_for_each_batch_size)
+{
+    const unsigned nTimeTx = 1600000017;
+    const uint64_t modifier = 0x0123456789abcdef;
+
+    for (size_t size : { 1, 3, 4, 8, 15, 16 }) {
+        GRC::StakeKernelBatch batch(nTimeTx, modifier);
+        std::vector<uint256> txids;
+
+        for (size_t i = 0; i < size; ++i) {
+            txids.push_back(InsecureRand256());
+            batch.Add(1500000000 + i * 7, txids.back(), i);
+        }
+
+        BOOST_CHECK_EQUAL(batch.size(), size);
+        BOOST_CHECK_EQUAL(batch.full(), size == GRC::StakeKernelBatch::MAX_SIZE);
+
+        uint256 hashes[GRC::StakeKernelBatch::MAX_SIZE];
+        batch.Hash(hashes);
+
+        for (size_t i = 0; i < size; ++i) {
+            const uint256 expected = GRC::CalculateStakeHashV8(1500000000 + i * 7, txids[i], i, nTimeTx, modifier);
+
+            BOOST_CHECK_EQUAL(hashes[i].ToString(), expected.ToString());
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(it_reuses_the_batch_after_clearing)
+{
+    GRC::StakeKernelBatch batch(1600000000, 42);
+    const uint256 txid = InsecureRand256();
+
+    batch.Add(1500000000, InsecureRand256(), 0);
+    batch.Clear();
+
+    BOOST_CHECK_EQUAL(batch.size(), 0U);
+
+    batch.Add(1500000000, txid, 1);
+
+    uint256 hash;
+    batch.Hash(&hash);
+
+    BOOST_CHECK(hash == GRC::CalculateStakeHashV8(1500000000, txid, 1, 1600000000, 42));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
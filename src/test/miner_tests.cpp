@@ -0,0 +1,264 @@
+// Copyright (c) 2022 The Gridcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://opensource.org/licenses/mit-license.php.
+
+#include "gridcoin/staking/kernel.h"
+#include "miner.h"
+#include "test/test_gridcoin.h"
+#include "wallet/wallet.h"
+
+#include <boost/test/unit_test.hpp>
+
+namespace {
+constexpr int64_t SLOT_LENGTH = GRC::STAKE_TIMESTAMP_MASK + 1;
+constexpr int64_t STAKE_TIME = 1600000000;
+
+//! A target that no kernel hash meets.
+constexpr unsigned int UNREACHABLE_BITS = 0x03000001;
+
+//!
+//! \brief A snapshot of one stakeable output and a bare block that stakes in
+//! the slot that starts at STAKE_TIME.
+//!
+struct StakeSlotSetup
+{
+    StakeSnapshot snapshot;
+    CBlock block;
+
+    StakeSlotSetup()
+    {
+        StakeCandidate candidate;
+        candidate.m_txid = uint256S("0x94ab3f1d5b1c1a7fe45d3a3f0b60c95d8d4c1c5e2b3d9a8f7e6d5c4b3a291807");
+        candidate.m_n = 1;
+        candidate.m_value = COIN;
+        candidate.m_weight = 1;
+        candidate.m_tx_time = 1500000000;
+        candidate.m_block_time = 1500000000;
+        candidate.m_height = 1;
+        candidate.m_maturity_height = 1;
+
+        snapshot.m_stake_modifier = 0x0123456789abcdef;
+        snapshot.m_candidates.push_back(candidate);
+
+        // Inside the slot but not at its start, like the adjusted time:
+        block.nTime = STAKE_TIME + 7;
+        block.nBits = UNREACHABLE_BITS;
+    }
+
+    uint256 SlotHash(const int64_t slot_time) const
+    {
+        const StakeCandidate& candidate = snapshot.m_candidates.front();
+
+        return GRC::CalculateStakeHashV8(
+            candidate.m_block_time,
+            candidate.m_txid,
+            candidate.m_n,
+            slot_time,
+            snapshot.m_stake_modifier);
+    }
+};
+
+//!
+//! \brief A wallet with one output in a block at the tip of a two-block chain
+//! with a fork, and a snapshot of the output found as a kernel:
+//!
+//!   0 <- 1
+//!     ^--- 1'
+//!
+struct StakeKernelSetup
+{
+    CBlockIndex chain[2];
+    CBlockIndex fork;
+    std::vector<uint256> block_hashes;
+    CBlockIndex* saved_best = pindexBest;
+
+    CWallet wallet;
+    StakeSnapshot snapshot;
+    StakeCandidate kernel;
+
+    StakeKernelSetup()
+    {
+        AddBlock(chain[0], 0, nullptr);
+        AddBlock(chain[1], 1, &chain[0]);
+        AddBlock(fork, 1, &chain[0]);
+
+        chain[0].pnext = &chain[1];
+        pindexBest = &chain[1];
+
+        CTransaction tx;
+        tx.nTime = 1600000000;
+        tx.vout.resize(2);
+        tx.vout[1].nValue = COIN;
+
+        CWalletTx wtx(&wallet, tx);
+        wtx.hashBlock = chain[1].GetBlockHash();
+        wtx.nIndex = 1;
+
+        {
+            LOCK(wallet.cs_wallet);
+            wallet.mapWallet.emplace(wtx.GetHash(), wtx);
+        }
+
+        kernel.m_txid = wtx.GetHash();
+        kernel.m_n = 1;
+        snapshot.m_pindex_prev = &chain[1];
+    }
+
+    ~StakeKernelSetup()
+    {
+        for (const auto& hash : block_hashes) {
+            mapBlockIndex.erase(hash);
+        }
+
+        pindexBest = saved_best;
+    }
+
+    void AddBlock(CBlockIndex& pindex, const int height, CBlockIndex* pprev)
+    {
+        block_hashes.push_back(InsecureRand256());
+
+        const auto result = mapBlockIndex.insert(std::make_pair(block_hashes.back(), &pindex));
+
+        pindex.phashBlock = &result.first->first;
+        pindex.pprev = pprev;
+        pindex.nHeight = height;
+    }
+
+    CWalletTx& KernelTx()
+    {
+        LOCK(wallet.cs_wallet);
+
+        return wallet.mapWallet.at(kernel.m_txid);
+    }
+};
+} // Anonymous namespace
+
+BOOST_FIXTURE_TEST_SUITE(miner_tests, StakeSlotSetup)
+
+BOOST_AUTO_TEST_CASE(it_waits_until_the_end_of_the_look_ahead_window_without_a_kernel)
+{
+    BOOST_CHECK_EQUAL(
+        FindNextStakeSlot(snapshot, block),
+        STAKE_TIME + (STAKE_LOOKAHEAD_SLOTS + 1) * SLOT_LENGTH);
+
+    snapshot.m_candidates.clear();
+
+    BOOST_CHECK_EQUAL(
+        FindNextStakeSlot(snapshot, block),
+        STAKE_TIME + (STAKE_LOOKAHEAD_SLOTS + 1) * SLOT_LENGTH);
+}
+
+BOOST_AUTO_TEST_CASE(it_finds_the_first_slot_with_a_kernel_after_the_current_one)
+{
+    // Set the target to the smallest kernel hash in the window. The weight
+    // covers the precision lost in the compact representation:
+    CBigNum lowest(SlotHash(STAKE_TIME + SLOT_LENGTH));
+
+    for (unsigned int slot = 2; slot <= STAKE_LOOKAHEAD_SLOTS; ++slot) {
+        lowest = std::min(lowest, CBigNum(SlotHash(STAKE_TIME + slot * SLOT_LENGTH)));
+    }
+
+    block.nBits = lowest.GetCompact();
+    snapshot.m_candidates.front().m_weight = 2;
+
+    CBigNum target;
+    target.SetCompact(block.nBits);
+    target *= 2;
+
+    int64_t expected = 0;
+
+    for (unsigned int slot = 1; slot <= STAKE_LOOKAHEAD_SLOTS && expected == 0; ++slot) {
+        if (CBigNum(SlotHash(STAKE_TIME + slot * SLOT_LENGTH)) <= target) {
+            expected = STAKE_TIME + slot * SLOT_LENGTH;
+        }
+    }
+
+    BOOST_REQUIRE(expected > 0);
+    BOOST_CHECK_EQUAL(FindNextStakeSlot(snapshot, block), expected);
+
+    // A kernel in the current slot is the business of FindStakeKernel():
+    block.nBits = 0x2100ffff;
+
+    BOOST_CHECK_EQUAL(FindNextStakeSlot(snapshot, block), STAKE_TIME + SLOT_LENGTH);
+}
+
+BOOST_AUTO_TEST_CASE(it_stops_at_the_slot_in_which_another_output_matures)
+{
+    // An output reaches the stake age in the middle of the third slot, so it
+    // can stake from the fourth:
+    snapshot.m_next_maturity_time = STAKE_TIME + 3 * SLOT_LENGTH - 5;
+
+    BOOST_CHECK_EQUAL(FindNextStakeSlot(snapshot, block), STAKE_TIME + 3 * SLOT_LENGTH);
+
+    snapshot.m_next_maturity_time = STAKE_TIME + 2 * SLOT_LENGTH;
+
+    BOOST_CHECK_EQUAL(FindNextStakeSlot(snapshot, block), STAKE_TIME + 2 * SLOT_LENGTH);
+
+    snapshot.m_next_maturity_time = STAKE_TIME + 100 * SLOT_LENGTH;
+
+    BOOST_CHECK_EQUAL(
+        FindNextStakeSlot(snapshot, block),
+        STAKE_TIME + (STAKE_LOOKAHEAD_SLOTS + 1) * SLOT_LENGTH);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+BOOST_FIXTURE_TEST_SUITE(miner_kernel_tests, StakeKernelSetup)
+
+BOOST_AUTO_TEST_CASE(it_accepts_a_kernel_from_a_current_snapshot)
+{
+    LOCK(cs_main);
+
+    BOOST_CHECK(IsStakeKernelCurrent(snapshot, kernel, wallet));
+}
+
+BOOST_AUTO_TEST_CASE(it_rejects_a_kernel_when_the_chain_tip_changed)
+{
+    LOCK(cs_main);
+
+    pindexBest = &chain[0];
+
+    BOOST_CHECK(!IsStakeKernelCurrent(snapshot, kernel, wallet));
+}
+
+BOOST_AUTO_TEST_CASE(it_rejects_a_kernel_when_the_output_was_spent)
+{
+    LOCK(cs_main);
+
+    KernelTx().MarkSpent(kernel.m_n);
+
+    BOOST_CHECK(!IsStakeKernelCurrent(snapshot, kernel, wallet));
+}
+
+BOOST_AUTO_TEST_CASE(it_rejects_a_kernel_when_the_output_left_the_main_chain)
+{
+    LOCK(cs_main);
+
+    // A reorganization to a chain of the same height leaves the output in a
+    // block that is no longer in the main chain:
+    chain[0].pnext = &fork;
+    pindexBest = &fork;
+    snapshot.m_pindex_prev = &fork;
+
+    BOOST_CHECK(!IsStakeKernelCurrent(snapshot, kernel, wallet));
+
+    KernelTx().hashBlock = fork.GetBlockHash();
+
+    BOOST_CHECK(IsStakeKernelCurrent(snapshot, kernel, wallet));
+}
+
+BOOST_AUTO_TEST_CASE(it_rejects_a_kernel_that_the_wallet_does_not_have)
+{
+    LOCK(cs_main);
+
+    kernel.m_n = 2;
+
+    BOOST_CHECK(!IsStakeKernelCurrent(snapshot, kernel, wallet));
+
+    kernel.m_txid = InsecureRand256();
+    kernel.m_n = 1;
+
+    BOOST_CHECK(!IsStakeKernelCurrent(snapshot, kernel, wallet));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -151,4 +151,336 @@ BOOST_AUTO_TEST_CASE(caddrdb_read_corrupted)
     BOOST_CHECK(addrman2.size() == 0);
 }
 
+BOOST_AUTO_TEST_CASE(receive_msg_bytes_reports_complete_messages)
+{
+    CNode node(INVALID_SOCKET, CAddress(CService(), NODE_NONE), "", true);
+
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << CMessageHeader(NetMsgType::PING, sizeof(uint64_t)) << uint64_t{42};
+
+    const std::string bytes = ss.str();
+    bool complete = true;
+
+    // The socket thread only wakes the message handler for whole messages:
+    BOOST_CHECK(node.ReceiveMsgBytes(bytes.data(), bytes.size() - 4, complete));
+    BOOST_CHECK(!complete);
+    BOOST_CHECK(node.ReceiveMsgBytes(bytes.data() + bytes.size() - 4, 4, complete));
+    BOOST_CHECK(complete);
+    BOOST_CHECK_EQUAL(node.vRecvMsg.size(), 1U);
+    BOOST_CHECK(node.vRecvMsg.front().complete());
+    BOOST_CHECK(node.vRecvMsg.front().nTime > 0);
+}
+
+BOOST_AUTO_TEST_CASE(receive_large_message_into_payload_buffer)
+{
+    CNode node(INVALID_SOCKET, CAddress(CService(), NODE_NONE), "", true);
+
+    std::vector<unsigned char> payload(300000);
+    for (size_t i = 0; i < payload.size(); ++i)
+        payload[i] = i % 251;
+
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << CMessageHeader(NetMsgType::PART, payload.size()) << Span<const unsigned char>(payload);
+    ss << CMessageHeader(NetMsgType::PING, sizeof(uint64_t)) << uint64_t{42};
+
+    const std::string bytes = ss.str();
+    const size_t nPayloadEnd = CMessageHeader::HEADER_SIZE + payload.size();
+    size_t nPos = 0;
+    bool complete = true;
+
+    // Nothing to receive into before the header arrives:
+    BOOST_CHECK(node.GetRecvPayloadBuffer(0x10000).empty());
+    BOOST_CHECK(node.ReceiveMsgBytes(bytes.data(), 1000, complete));
+    nPos += 1000;
+    BOOST_CHECK(!complete);
+
+    // The socket thread reads most of the payload straight into its buffer:
+    Span<std::byte> buffer;
+    while (!(buffer = node.GetRecvPayloadBuffer(0x10000)).empty()) {
+        BOOST_CHECK_EQUAL(buffer.size(), 0x10000U);
+        memcpy(buffer.data(), bytes.data() + nPos, buffer.size());
+        nPos += buffer.size();
+        node.ReceivedPayloadBytes(buffer.size(), complete);
+        BOOST_CHECK(!complete);
+    }
+    BOOST_CHECK(nPayloadEnd - nPos < 0x10000);
+
+    // ...and the tail with the next message through its own buffer:
+    BOOST_CHECK(node.ReceiveMsgBytes(bytes.data() + nPos, bytes.size() - nPos, complete));
+    BOOST_CHECK(complete);
+    BOOST_CHECK_EQUAL(node.nRecvBytes.load(), bytes.size());
+    BOOST_REQUIRE_EQUAL(node.vRecvMsg.size(), 2U);
+
+    const CNetMessage& msg = node.vRecvMsg.front();
+    BOOST_CHECK(msg.complete());
+    BOOST_CHECK(msg.vPayload.empty());
+    BOOST_CHECK(std::equal(payload.begin(), payload.end(), UCharCast(msg.vRecv.data()), UCharCast(msg.vRecv.data()) + msg.vRecv.size()));
+    BOOST_CHECK(node.vRecvMsg.back().complete());
+}
+
+BOOST_AUTO_TEST_CASE(net_buffer_pool_reuses_size_classes)
+{
+    BOOST_CHECK_EQUAL(CNetBufferPool::GetClassSize(1), 4096U);
+    BOOST_CHECK_EQUAL(CNetBufferPool::GetClassSize(4096), 4096U);
+    BOOST_CHECK_EQUAL(CNetBufferPool::GetClassSize(4097), 5120U);
+    BOOST_CHECK_EQUAL(CNetBufferPool::GetClassSize(8192), 8192U);
+    BOOST_CHECK_EQUAL(CNetBufferPool::GetClassSize(8193), 10240U);
+    BOOST_CHECK_EQUAL(CNetBufferPool::GetClassSize(1000000), 1048576U);
+    BOOST_CHECK_EQUAL(CNetBufferPool::GetClassSize(MAX_SIZE), MAX_SIZE);
+
+    CNetBufferPool pool;
+
+    SerializeData buffer = pool.Get(5000);
+    BOOST_CHECK_EQUAL(buffer.size(), 5000U);
+    BOOST_CHECK_EQUAL(buffer.capacity(), 5120U);
+
+    const std::byte* data = buffer.data();
+    pool.Put(std::move(buffer));
+    BOOST_CHECK_EQUAL(pool.GetPooledBytes(), 5120U);
+
+    // A payload of the same size class gets the same buffer back:
+    buffer = pool.Get(4500);
+    BOOST_CHECK(buffer.data() == data);
+    BOOST_CHECK_EQUAL(buffer.size(), 4500U);
+    BOOST_CHECK_EQUAL(pool.GetPooledBytes(), 0U);
+
+    // Small buffers and those outside of a size class are not pooled:
+    pool.Put(pool.Get(100));
+    pool.Put(SerializeData(5000));
+    BOOST_CHECK_EQUAL(pool.GetPooledBytes(), 0U);
+
+    // Nor are buffers beyond the limit:
+    SerializeData large1 = pool.Get(CNetBufferPool::MAX_POOLED_BYTES);
+    SerializeData large2 = pool.Get(CNetBufferPool::MAX_POOLED_BYTES);
+    pool.Put(std::move(large1));
+    pool.Put(std::move(large2));
+    BOOST_CHECK_EQUAL(pool.GetPooledBytes(), CNetBufferPool::MAX_POOLED_BYTES);
+}
+
+#ifndef WIN32
+BOOST_AUTO_TEST_CASE(send_queue_coalesces_small_messages)
+{
+    int sockets[2];
+    BOOST_REQUIRE(socketpair(AF_UNIX, SOCK_STREAM, 0, sockets) == 0);
+    fcntl(sockets[1], F_SETFL, O_NONBLOCK);
+
+    CNode node(sockets[0], CAddress(CService(), NODE_NONE), "", true);
+
+    // An empty queue sends a message right away:
+    node.PushMessage(NetMsgType::PING, uint64_t{0});
+    BOOST_CHECK(node.vSendMsg.empty());
+    BOOST_CHECK_EQUAL(node.nSendCalls.load(), 1U);
+
+    // While corked, replies wait to go out together:
+    {
+        LOCK(node.cs_vSend);
+        node.CorkSend();
+    }
+    for (uint64_t nonce = 1; nonce <= 3; ++nonce)
+        node.PushMessage(NetMsgType::PONG, nonce);
+    BOOST_CHECK_EQUAL(node.vSendMsg.size(), 1U);
+    BOOST_CHECK_EQUAL(node.nSendCalls.load(), 1U);
+    {
+        LOCK(node.cs_vSend);
+        node.UncorkSend();
+    }
+    BOOST_CHECK(node.vSendMsg.empty());
+    BOOST_CHECK_EQUAL(node.nSendCalls.load(), 2U);
+
+    // A message larger than the socket buffer stays queued, and the small
+    // ones after it share a chunk:
+    const std::vector<unsigned char> payload(4 * 1024 * 1024, 0x5a);
+    node.PushMessage(NetMsgType::PART, Span<const unsigned char>(payload));
+    for (uint64_t nonce = 1; nonce <= 100; ++nonce)
+        node.PushMessage(NetMsgType::PING, nonce);
+
+    BOOST_CHECK_EQUAL(node.vSendMsg.size(), 2U);
+    BOOST_CHECK_EQUAL(node.nSendMsgs.load(), 105U);
+    BOOST_CHECK_EQUAL(node.nSendCalls.load(), 3U);
+
+    // Drain the other end until everything went out:
+    std::vector<unsigned char> received;
+    unsigned char buffer[0x10000];
+    while (true) {
+        {
+            LOCK(node.cs_vSend);
+            SocketSendData(&node);
+        }
+        const ssize_t nBytes = recv(sockets[1], buffer, sizeof(buffer), 0);
+        if (nBytes > 0)
+            received.insert(received.end(), buffer, buffer + nBytes);
+        else if (node.vSendMsg.empty())
+            break;
+    }
+
+    BOOST_CHECK_EQUAL(node.nSendSize, 0U);
+    BOOST_CHECK_EQUAL(received.size(), node.nSendBytes.load());
+    BOOST_CHECK(node.nSendCalls.load() < node.nSendMsgs.load());
+
+    // The messages arrive whole and in order:
+    CDataStream ss(received, SER_NETWORK, PROTOCOL_VERSION);
+    for (uint64_t nonce = 0; nonce <= 100; ++nonce) {
+        CMessageHeader hdr;
+        ss >> hdr;
+        if (nonce == 1) {
+            for (uint64_t pong = 1; pong <= 3; ++pong) {
+                uint64_t nonce_received;
+                ss >> nonce_received;
+                BOOST_CHECK_EQUAL(hdr.GetCommand(), NetMsgType::PONG);
+                BOOST_CHECK_EQUAL(nonce_received, pong);
+                ss >> hdr;
+            }
+
+            BOOST_CHECK_EQUAL(hdr.GetCommand(), NetMsgType::PART);
+            BOOST_REQUIRE_EQUAL(hdr.nMessageSize, payload.size());
+            ss.ignore(payload.size());
+            ss >> hdr;
+        }
+
+        uint64_t nonce_received;
+        ss >> nonce_received;
+        BOOST_CHECK_EQUAL(hdr.GetCommand(), NetMsgType::PING);
+        BOOST_CHECK_EQUAL(nonce_received, nonce);
+    }
+    BOOST_CHECK(ss.empty());
+
+    close(sockets[1]);
+}
+#endif
+
+BOOST_AUTO_TEST_CASE(message_latency_stats_accumulate_by_command)
+{
+    CMessageLatencyStats stats;
+
+    stats.Record(NetMsgType::BLOCK, 100, 5);
+    stats.Record(NetMsgType::BLOCK, 300, 7);
+    stats.Record("bogus", 1000, 1000);
+
+    const std::map<std::string, CMessageLatencyStats::Entry> entries = stats.Get();
+
+    BOOST_CHECK(entries.count("bogus") == 0);
+    BOOST_CHECK(entries.count(NetMsgType::TX) == 0);
+
+    const CMessageLatencyStats::Entry& block = entries.at(NetMsgType::BLOCK);
+    BOOST_CHECK_EQUAL(block.nCount, 2U);
+    BOOST_CHECK_EQUAL(block.nTotalWaitMicros, 400);
+    BOOST_CHECK_EQUAL(block.nMaxWaitMicros, 300);
+    BOOST_CHECK_EQUAL(block.nTotalProcessMicros, 12);
+}
+
+BOOST_AUTO_TEST_CASE(socket_events_modes_include_default)
+{
+    const std::vector<std::string> modes = GetSocketEventsModes();
+
+    // select() is always available as a fallback:
+    BOOST_CHECK(std::count(modes.begin(), modes.end(), "select") == 1);
+    BOOST_CHECK(std::count(modes.begin(), modes.end(), DEFAULT_SOCKET_EVENTS) == 1);
+#ifdef USE_EPOLL
+    BOOST_CHECK(std::count(modes.begin(), modes.end(), "epoll") == 1);
+#endif
+}
+
+#ifdef USE_EPOLL
+BOOST_AUTO_TEST_CASE(socket_events_epoll_reports_edges_until_the_socket_drains)
+{
+    BOOST_REQUIRE(StartSocketEventsEpoll());
+
+    int sockets[2];
+    BOOST_REQUIRE(socketpair(AF_UNIX, SOCK_STREAM, 0, sockets) == 0);
+    fcntl(sockets[0], F_SETFL, O_NONBLOCK);
+    fcntl(sockets[1], F_SETFL, O_NONBLOCK);
+
+    CNode node(sockets[0], CAddress(CService(), NODE_NONE), "", true);
+    {
+        LOCK(cs_vNodes);
+        vNodes.push_back(&node);
+    }
+
+    std::set<SOCKET> recv_set, send_set, error_set;
+    const auto wait = [&]() {
+        recv_set.clear();
+        send_set.clear();
+        error_set.clear();
+        BOOST_REQUIRE(SocketEventsEpoll(recv_set, send_set, error_set));
+    };
+
+    // Registering the socket reports nothing while no data arrived:
+    wait();
+    BOOST_CHECK(node.fSocketRegistered);
+    BOOST_CHECK(recv_set.empty());
+    BOOST_CHECK(send_set.empty());
+
+    const std::vector<char> data(3000, 'x');
+    BOOST_REQUIRE_EQUAL(send(sockets[1], data.data(), data.size(), 0), (ssize_t)data.size());
+
+    wait();
+    BOOST_CHECK(recv_set.count(sockets[0]));
+    BOOST_CHECK(node.fSocketReadable);
+
+    // Like the socket handler, read in full buffers. A full read may leave
+    // data behind, so the socket stays ready without a new edge:
+    char buffer[1000];
+    BOOST_REQUIRE_EQUAL(recv(sockets[0], buffer, sizeof(buffer), MSG_DONTWAIT), (ssize_t)sizeof(buffer));
+
+    wait();
+    BOOST_CHECK(recv_set.count(sockets[0]));
+
+    // Drain until a short read, which here is EAGAIN:
+    while (true) {
+        const ssize_t nBytes = recv(sockets[0], buffer, sizeof(buffer), MSG_DONTWAIT);
+
+        if (nBytes < (ssize_t)sizeof(buffer)) {
+            BOOST_CHECK_EQUAL(nBytes, -1);
+            BOOST_CHECK_EQUAL(errno, EAGAIN);
+            node.fSocketReadable = false;
+            break;
+        }
+    }
+
+    // The edge was consumed, so the drained socket is not reported again:
+    wait();
+    BOOST_CHECK(recv_set.empty());
+
+    // A message larger than the socket buffer fills it and stays queued:
+    const std::vector<unsigned char> payload(4 * 1024 * 1024, 0x5a);
+    node.PushMessage(NetMsgType::PART, Span<const unsigned char>(payload));
+    BOOST_REQUIRE(!node.vSendMsg.empty());
+
+    // The epoll set now watches for writes, but the full buffer is not
+    // writable:
+    wait();
+    BOOST_CHECK(node.fSocketWantSend);
+    BOOST_CHECK(send_set.empty());
+
+    // The peer drains its end, which opens space:
+    std::vector<char> sink(0x10000);
+    while (recv(sockets[1], sink.data(), sink.size(), MSG_DONTWAIT) > 0) { }
+
+    wait();
+    BOOST_CHECK(send_set.count(sockets[0]));
+    BOOST_CHECK(recv_set.empty());
+
+    // Send until the queue empties, then the set stops watching for writes:
+    while (!node.vSendMsg.empty()) {
+        {
+            LOCK(node.cs_vSend);
+            SocketSendData(&node);
+        }
+        while (recv(sockets[1], sink.data(), sink.size(), MSG_DONTWAIT) > 0) { }
+    }
+
+    wait();
+    BOOST_CHECK(!node.fSocketWantSend);
+    BOOST_CHECK(send_set.empty());
+
+    {
+        LOCK(cs_vNodes);
+        vNodes.erase(std::remove(vNodes.begin(), vNodes.end(), &node), vNodes.end());
+    }
+
+    StopSocketEventsEpoll();
+    close(sockets[1]);
+}
+#endif
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,157 @@
+// Copyright (c) 2022 The Gridcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://opensource.org/licenses/mit-license.php.
+
+#include "main.h"
+#include "test/test_gridcoin.h"
+#include "wallet/stakeindex.h"
+
+#include <boost/test/unit_test.hpp>
+#include <set>
+#include <vector>
+
+namespace {
+//!
+//! \brief A small block index tree with a fork:
+//!
+//!   0 <- 1 <- 2 <- 3
+//!          ^--- 2' <- 3'
+//!
+struct StakeIndexSetup
+{
+    CBlockIndex chain[4];
+    CBlockIndex fork[2];
+    StakeCandidateIndex index;
+
+    StakeIndexSetup()
+    {
+        for (int height = 0; height < 4; ++height) {
+            Link(chain[height], height, height > 0 ? &chain[height - 1] : nullptr);
+        }
+
+        Link(fork[0], 2, &chain[1]);
+        Link(fork[1], 3, &fork[0]);
+    }
+
+    static void Link(CBlockIndex& pindex, const int height, CBlockIndex* pprev)
+    {
+        pindex.nHeight = height;
+        pindex.pprev = pprev;
+        pindex.BuildSkip();
+    }
+
+    static StakeCandidate MakeCandidate(const uint256& txid, const unsigned int n, const int height)
+    {
+        StakeCandidate candidate;
+        candidate.m_txid = txid;
+        candidate.m_n = n;
+        candidate.m_value = COIN;
+        candidate.m_weight = 80;
+        candidate.m_tx_time = 1600000000;
+        candidate.m_block_time = 1600000000;
+        candidate.m_height = height;
+        candidate.m_maturity_height = height;
+
+        return candidate;
+    }
+
+    std::vector<StakeCandidate> Entries() const
+    {
+        std::vector<StakeCandidate> entries;
+        index.ForEach([&](const StakeCandidate& candidate) { entries.push_back(candidate); });
+
+        return entries;
+    }
+};
+} // Anonymous namespace
+
+BOOST_FIXTURE_TEST_SUITE(stakeindex_tests, StakeIndexSetup)
+
+BOOST_AUTO_TEST_CASE(it_requests_a_rebuild_before_the_first_read)
+{
+    std::set<uint256> dirty;
+
+    BOOST_CHECK(index.TakeChanges(&chain[3], dirty));
+    BOOST_CHECK(dirty.empty());
+
+    index.Reset({ MakeCandidate(InsecureRand256(), 0, 1) });
+
+    BOOST_CHECK(!index.TakeChanges(&chain[3], dirty));
+    BOOST_CHECK_EQUAL(index.size(), 1U);
+}
+
+BOOST_AUTO_TEST_CASE(it_replaces_the_entries_of_dirty_transactions)
+{
+    const uint256 txid_a = InsecureRand256();
+    const uint256 txid_b = InsecureRand256();
+    std::set<uint256> dirty;
+
+    index.TakeChanges(&chain[3], dirty);
+    index.Reset({ MakeCandidate(txid_a, 0, 1), MakeCandidate(txid_a, 1, 1), MakeCandidate(txid_b, 0, 2) });
+
+    index.MarkDirty(txid_a);
+
+    BOOST_REQUIRE(!index.TakeChanges(&chain[3], dirty));
+    BOOST_CHECK_EQUAL(dirty.size(), 1U);
+    BOOST_CHECK(dirty.count(txid_a) == 1);
+
+    // Output 0 of transaction A was spent:
+    index.Update(dirty, { MakeCandidate(txid_a, 1, 1) });
+
+    const std::vector<StakeCandidate> entries = Entries();
+
+    BOOST_REQUIRE_EQUAL(entries.size(), 2U);
+    BOOST_CHECK(entries[0].m_txid == txid_b);
+    BOOST_CHECK(entries[1].m_txid == txid_a);
+    BOOST_CHECK_EQUAL(entries[1].m_n, 1U);
+
+    // The changes were consumed:
+    BOOST_CHECK(!index.TakeChanges(&chain[3], dirty));
+    BOOST_CHECK(dirty.empty());
+}
+
+BOOST_AUTO_TEST_CASE(it_does_not_mark_entries_dirty_when_the_chain_extends)
+{
+    std::set<uint256> dirty;
+
+    index.TakeChanges(&chain[2], dirty);
+    index.Reset({ MakeCandidate(InsecureRand256(), 0, 2) });
+
+    BOOST_CHECK(!index.TakeChanges(&chain[3], dirty));
+    BOOST_CHECK(dirty.empty());
+}
+
+BOOST_AUTO_TEST_CASE(it_marks_entries_above_the_fork_dirty_after_a_reorganization)
+{
+    const uint256 txid_below = InsecureRand256();
+    const uint256 txid_above = InsecureRand256();
+    const uint256 txid_pending = InsecureRand256();
+    std::set<uint256> dirty;
+
+    index.TakeChanges(&chain[3], dirty);
+    index.Reset({
+        MakeCandidate(txid_below, 0, 1),
+        MakeCandidate(txid_above, 0, 2),
+        MakeCandidate(txid_pending, 0, -1),
+    });
+
+    BOOST_REQUIRE(!index.TakeChanges(&fork[1], dirty));
+    BOOST_CHECK_EQUAL(dirty.size(), 1U);
+    BOOST_CHECK(dirty.count(txid_above) == 1);
+}
+
+BOOST_AUTO_TEST_CASE(it_discards_dirty_transactions_when_marked_for_rebuild)
+{
+    std::set<uint256> dirty;
+
+    index.TakeChanges(&chain[3], dirty);
+    index.Reset({});
+
+    index.MarkDirty(InsecureRand256());
+    index.MarkAllDirty();
+
+    BOOST_CHECK(index.TakeChanges(&chain[3], dirty));
+    BOOST_CHECK(dirty.empty());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
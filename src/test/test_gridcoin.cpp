@@ -44,6 +44,7 @@ struct TestingSetup {
 
         InitLogging();
         ECC_Start();
+        InitSignatureCache();
 
         // TODO: Refactor CTxDB to something like bitcoin's current CDBWrapper and remove this workaround.
         leveldb::Options db_options;
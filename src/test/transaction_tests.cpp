@@ -7,7 +7,10 @@
 #include <boost/test/unit_test.hpp>
 
 #include <main.h>
+#include <gridcoin/contract/contract.h>
+#include <gridcoin/project.h>
 #include <streams.h>
+#include <test/test_gridcoin.h>
 #include <wallet/wallet.h>
 #include <policy/policy.h>
 
@@ -244,6 +247,103 @@ BOOST_AUTO_TEST_CASE(basic_transaction_tests)
     BOOST_CHECK_MESSAGE(!CheckTransaction(tx), "Transaction with duplicate txins should be invalid.");
 }
 
+BOOST_AUTO_TEST_CASE(it_caches_the_hash_of_a_deserialized_transaction)
+{
+    CTransaction tx;
+    tx.nTime = 1600000000;
+    tx.vin.emplace_back(COutPoint(InsecureRand256(), 0));
+    tx.vout.resize(1);
+    tx.vout[0].nValue = COIN;
+    tx.vout[0].scriptPubKey << OP_TRUE;
+
+    const uint256 expected = SerializeHash(tx);
+
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << tx;
+
+    CTransaction deserialized;
+    stream >> deserialized;
+
+    BOOST_CHECK(deserialized.GetHash() == expected);
+
+    // A modification needs ClearCachedHash() to show in the hash:
+    deserialized.vout[0].nValue = 2 * COIN;
+    deserialized.ClearCachedHash();
+
+    BOOST_CHECK(deserialized.GetHash() != expected);
+    BOOST_CHECK(deserialized.GetHash() == SerializeHash(deserialized));
+}
+
+BOOST_AUTO_TEST_CASE(it_keeps_the_cached_hash_in_copies_but_not_in_moved_from_transactions)
+{
+    CTransaction tx;
+    tx.nTime = 1600000000;
+    tx.vin.emplace_back(COutPoint(InsecureRand256(), 0));
+    tx.vout.resize(1);
+    tx.vout[0].nValue = COIN;
+    tx.vout[0].scriptPubKey << OP_TRUE;
+
+    const uint256 expected = SerializeHash(tx);
+
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << tx;
+
+    CTransaction deserialized;
+    stream >> deserialized;
+
+    CTransaction copy(deserialized);
+    CTransaction assigned;
+    assigned = deserialized;
+
+    BOOST_CHECK(copy.GetHash() == expected);
+    BOOST_CHECK(assigned.GetHash() == expected);
+
+    // A modified copy needs ClearCachedHash() like the original:
+    copy.vout.emplace_back(CENT, CScript() << OP_TRUE);
+    copy.ClearCachedHash();
+
+    BOOST_CHECK(copy.GetHash() == SerializeHash(copy));
+    BOOST_CHECK(copy.GetHash() != expected);
+    BOOST_CHECK(deserialized.GetHash() == expected);
+
+    // A move takes the hash. A transaction that is reused after a move must
+    // hash its new contents:
+    CTransaction moved(std::move(deserialized));
+
+    BOOST_CHECK(moved.GetHash() == expected);
+
+    deserialized.vin.clear();
+    deserialized.vout.assign(1, CTxOut(CENT, CScript() << OP_TRUE));
+
+    BOOST_CHECK(deserialized.GetHash() == SerializeHash(deserialized));
+
+    CTransaction move_assigned;
+    move_assigned = std::move(assigned);
+
+    BOOST_CHECK(move_assigned.GetHash() == expected);
+
+    assigned.vin.clear();
+    assigned.vout.assign(1, CTxOut(CENT, CScript() << OP_TRUE));
+
+    BOOST_CHECK(assigned.GetHash() == SerializeHash(assigned));
+
+    // Pulling the contracts out of a transaction changes its hash:
+    CTransaction with_contract;
+    with_contract.nTime = 1600000000;
+    with_contract.vContracts.emplace_back(GRC::MakeContract<GRC::Project>(
+        GRC::ContractAction::ADD, "Enigma", "http://enigma.test/@", 1600000000));
+
+    CDataStream contract_stream(SER_NETWORK, PROTOCOL_VERSION);
+    contract_stream << with_contract;
+    contract_stream >> with_contract;
+
+    const uint256 contract_hash = with_contract.GetHash();
+    BOOST_CHECK_EQUAL(with_contract.PullContracts().size(), 1U);
+
+    BOOST_CHECK(with_contract.GetHash() != contract_hash);
+    BOOST_CHECK(with_contract.GetHash() == SerializeHash(with_contract));
+}
+
 //
 // Helper: create two dummy transactions, each with
 // two outputs.  The first has 11 and 50 CENT outputs
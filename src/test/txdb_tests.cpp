@@ -0,0 +1,164 @@
+// Copyright (c) 2014-2022 The Gridcoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or https://opensource.org/licenses/mit-license.php.
+
+#include "dbwrapper.h"
+#include "main.h"
+
+#include <boost/test/unit_test.hpp>
+
+namespace {
+CTransaction MakeTransaction(const uint32_t lock_time, const size_t outputs)
+{
+    CTransaction tx;
+    tx.nLockTime = lock_time;
+    tx.vin.resize(1);
+    tx.vout.resize(outputs);
+
+    return tx;
+}
+} // Anonymous namespace
+
+BOOST_AUTO_TEST_SUITE(txdb_tests)
+
+BOOST_AUTO_TEST_CASE(it_reads_back_tx_index_records)
+{
+    g_txindex_cache.Clear();
+
+    CTxDB txdb;
+    const CTransaction tx = MakeTransaction(1, 3);
+
+    BOOST_CHECK(txdb.AddTxIndex(tx, CDiskTxPos(1, 2, 3), 0));
+
+    CTxIndex txindex;
+    BOOST_CHECK(txdb.ReadTxIndex(tx.GetHash(), txindex));
+    BOOST_CHECK(txindex.pos == CDiskTxPos(1, 2, 3));
+    BOOST_CHECK_EQUAL(txindex.vSpent.size(), 3U);
+
+    // Writes outside of a transaction go straight to the shared cache:
+    CTxIndex cached;
+    BOOST_CHECK(g_txindex_cache.Lookup(tx.GetHash(), cached));
+    BOOST_CHECK(cached == txindex);
+
+    BOOST_CHECK(txdb.EraseTxIndex(tx));
+    BOOST_CHECK(!txdb.ReadTxIndex(tx.GetHash(), txindex));
+    BOOST_CHECK(!g_txindex_cache.Lookup(tx.GetHash(), cached));
+}
+
+BOOST_AUTO_TEST_CASE(it_applies_transaction_records_to_the_cache_on_commit)
+{
+    g_txindex_cache.Clear();
+
+    CTxDB txdb;
+    const CTransaction tx = MakeTransaction(2, 2);
+    CTxIndex txindex(CDiskTxPos(1, 2, 3), 2);
+
+    BOOST_CHECK(txdb.TxnBegin());
+    BOOST_CHECK(txdb.UpdateTxIndex(tx.GetHash(), txindex));
+
+    txindex.vSpent[1] = CDiskTxPos(4, 5, 6);
+    BOOST_CHECK(txdb.UpdateTxIndex(tx.GetHash(), txindex));
+
+    // The open transaction sees its own changes before the cache does:
+    CTxIndex read;
+    BOOST_CHECK(txdb.ReadTxIndex(tx.GetHash(), read));
+    BOOST_CHECK(read == txindex);
+    BOOST_CHECK(!g_txindex_cache.Lookup(tx.GetHash(), read));
+
+    BOOST_CHECK(txdb.TxnCommit());
+
+    BOOST_CHECK(g_txindex_cache.Lookup(tx.GetHash(), read));
+    BOOST_CHECK(read == txindex);
+}
+
+BOOST_AUTO_TEST_CASE(it_discards_transaction_records_on_abort)
+{
+    g_txindex_cache.Clear();
+
+    CTxDB txdb;
+    const CTransaction tx = MakeTransaction(3, 1);
+
+    BOOST_CHECK(txdb.AddTxIndex(tx, CDiskTxPos(1, 2, 3), 0));
+
+    BOOST_CHECK(txdb.TxnBegin());
+    BOOST_CHECK(txdb.EraseTxIndex(tx));
+
+    CTxIndex read;
+    BOOST_CHECK(!txdb.ReadTxIndex(tx.GetHash(), read));
+
+    BOOST_CHECK(txdb.TxnAbort());
+
+    BOOST_CHECK(txdb.ReadTxIndex(tx.GetHash(), read));
+    BOOST_CHECK(read.pos == CDiskTxPos(1, 2, 3));
+}
+
+BOOST_AUTO_TEST_CASE(it_ignores_records_read_before_a_commit)
+{
+    g_txindex_cache.Clear();
+
+    const uint256 hash = MakeTransaction(4, 1).GetHash();
+    const uint64_t generation = g_txindex_cache.Generation();
+
+    g_txindex_cache.Apply({{ hash, CTxIndex(CDiskTxPos(7, 8, 9), 1) }});
+    g_txindex_cache.Insert(hash, CTxIndex(CDiskTxPos(1, 2, 3), 1), generation);
+
+    CTxIndex read;
+    BOOST_CHECK(g_txindex_cache.Lookup(hash, read));
+    BOOST_CHECK(read.pos == CDiskTxPos(7, 8, 9));
+}
+
+BOOST_AUTO_TEST_CASE(it_flushes_when_exceeding_the_memory_budget)
+{
+    g_txindex_cache.Clear();
+    g_txindex_cache.SetMaxMemoryUsage(1024);
+
+    for (uint32_t i = 0; i < 100; ++i) {
+        g_txindex_cache.Insert(
+            MakeTransaction(i, 1).GetHash(),
+            CTxIndex(CDiskTxPos(1, 2, i), 1),
+            g_txindex_cache.Generation());
+
+        BOOST_CHECK(g_txindex_cache.MemoryUsage() <= 1024);
+    }
+
+    BOOST_CHECK(g_txindex_cache.Size() < 100);
+
+    g_txindex_cache.SetMaxMemoryUsage(nDefaultTxIndexReadCache * 1048576);
+    g_txindex_cache.Clear();
+}
+
+BOOST_AUTO_TEST_CASE(it_reads_pending_writes_inside_a_transaction)
+{
+    CTxDB txdb;
+    std::string key = "txdb_tests_batch_erased";
+
+    BOOST_CHECK(txdb.WriteGenericData("txdb_tests_batch_kept", "committed"));
+    BOOST_CHECK(txdb.WriteGenericData(key, "committed"));
+
+    BOOST_CHECK(txdb.TxnBegin());
+
+    for (int i = 0; i < 1000; ++i) {
+        BOOST_CHECK(txdb.WriteGenericData("txdb_tests_batch_" + ToString(i), ToString(i)));
+    }
+
+    BOOST_CHECK(txdb.WriteGenericData("txdb_tests_batch_7", "overwritten"));
+    BOOST_CHECK(txdb.EraseGenericSerializable(key));
+
+    std::string value;
+    BOOST_CHECK(txdb.ReadGenericData("txdb_tests_batch_999", value));
+    BOOST_CHECK_EQUAL(value, "999");
+    BOOST_CHECK(txdb.ReadGenericData("txdb_tests_batch_7", value));
+    BOOST_CHECK_EQUAL(value, "overwritten");
+    BOOST_CHECK(txdb.ReadGenericData("txdb_tests_batch_kept", value));
+    BOOST_CHECK_EQUAL(value, "committed");
+    BOOST_CHECK(!txdb.ReadGenericData(key, value));
+
+    BOOST_CHECK(txdb.TxnAbort());
+
+    // Nothing from the aborted batch remains visible:
+    BOOST_CHECK(!txdb.ReadGenericData("txdb_tests_batch_999", value));
+    BOOST_CHECK(txdb.ReadGenericData(key, value));
+    BOOST_CHECK_EQUAL(value, "committed");
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -43,6 +43,8 @@ void SetupEnvironment();
  * feature analogous to fsync().
  */
 bool FileCommit(FILE *file);
+bool TruncateFile(FILE *file, unsigned int length);
+void AllocateFileRange(FILE *file, unsigned int offset, unsigned int length);
 
 #ifdef WIN32
 fs::path GetSpecialFolderPath(int nFolder, bool fCreate = true);
@@ -452,6 +454,12 @@ std::string HelpMessageGroup(const std::string& message);
  */
 std::string HelpMessageOpt(const std::string& option, const std::string& message);
 
+/**
+ * Return the number of cores available on the current system.
+ * @note This does count virtual cores, such as those provided by HyperThreading.
+ */
+int GetNumCores();
+
 namespace util {
 
 //! Simplification of std insertion
@@ -4,6 +4,7 @@
 // file COPYING or https://opensource.org/licenses/mit-license.php.
 
 #include "checkpoints.h"
+#include "checkqueue.h"
 #include "consensus/merkle.h"
 #include "dbwrapper.h"
 #include "main.h"
@@ -26,6 +27,7 @@
 #include "validation.h"
 #include "wallet/wallet.h"
 
+#include <atomic>
 #include <set>
 
 extern GRC::SeenStakes g_seen_stakes;
@@ -38,6 +40,20 @@ bool ReadTxFromDisk(CTransaction& tx, CDiskTxPos pos, FILE** pfileRet)
 {
     tx.SetNull();
 
+    if (!pfileRet) {
+        if (std::shared_ptr<const BlockFileMapping> mapping = MapBlockFile(pos.nFile, pos.nTxPos + 1)) {
+            SpanReader reader(SER_DISK, CLIENT_VERSION, mapping->Data().subspan(pos.nTxPos));
+
+            try {
+                reader >> tx;
+                return true;
+            } catch (const std::exception&) {
+                // Fall back to reading the file below.
+                tx.SetNull();
+            }
+        }
+    }
+
     CAutoFile filein(OpenBlockFile(pos.nFile, 0, pfileRet ? "rb+" : "rb"), SER_DISK, CLIENT_VERSION);
     if (filein.IsNull())
         return error("ReadTxFromDisk() : OpenBlockFile failed");
@@ -352,8 +368,31 @@ bool FetchInputs(CTransaction& tx, CTxDB& txdb, const std::map<uint256, CTxIndex
     return true;
 }
 
+bool CScriptCheck::operator()()
+{
+    const CScript& scriptSig = ptxTo->vin[nIn].scriptSig;
+    return VerifyScript(scriptSig, scriptPubKey, *ptxTo, nIn, nHashType);
+}
+
+static CCheckQueue<CScriptCheck> scriptcheckqueue(128);
+
+//! Whether ConnectBlock() hands the signature checks to the worker threads.
+static std::atomic<bool> g_parallel_script_checks{false};
+
+void StartScriptCheckWorkerThreads(int threads_num)
+{
+    scriptcheckqueue.StartWorkerThreads(threads_num);
+    g_parallel_script_checks = threads_num > 0;
+}
+
+void StopScriptCheckWorkerThreads()
+{
+    g_parallel_script_checks = false;
+    scriptcheckqueue.StopWorkerThreads();
+}
+
 bool ConnectInputs(CTransaction& tx, CTxDB& txdb, MapPrevTx inputs, std::map<uint256, CTxIndex>& mapTestPool, const CDiskTxPos& posThisTx,
-    const CBlockIndex* pindexBlock, bool fBlock, bool fMiner)
+    const CBlockIndex* pindexBlock, bool fBlock, bool fMiner, std::vector<CScriptCheck>* pvChecks)
 {
     // Take over previous transactions' spent pointers
     // fBlock is true when this is called from AcceptBlock when a new best-block is added to the blockchain
@@ -432,7 +471,14 @@ bool ConnectInputs(CTransaction& tx, CTxDB& txdb, MapPrevTx inputs, std::map<uin
             if (!(fBlock && (nBestHeight < Params().Checkpoints().GetHeight())))
             {
                 // Verify signature
-                if (!VerifySignature(txPrev, tx, i, 0))
+                if (pvChecks)
+                {
+                    // Defer the expensive part of VerifySignature(). Its other
+                    // checks hold here: the first loop checked the range of the
+                    // output, and FetchInputs() found txPrev by its hash.
+                    pvChecks->emplace_back(txPrev.vout[prevout.n], tx, i, 0);
+                }
+                else if (!VerifySignature(txPrev, tx, i, 0))
                 {
                     return tx.DoS(100,error("ConnectInputs() : %s VerifySignature failed", tx.GetHash().ToString().substr(0,10).c_str()));
                 }
@@ -1499,6 +1545,14 @@ bool ConnectBlock(CBlock& block, CTxDB& txdb, CBlockIndex* pindex, bool fJustChe
             + GetSizeOfCompactSize(block.vtx.size());
     }
 
+    int64_t nTimeStart = GetTimeMicros();
+    unsigned int nInputs = 0;
+
+    // Worker threads verify the input signatures while this thread moves on
+    // to the next transactions. The control waits for the checks to finish
+    // before this function returns:
+    CCheckQueueControl<CScriptCheck> control(g_parallel_script_checks ? &scriptcheckqueue : nullptr);
+
     std::map<uint256, CTxIndex> mapQueuedChanges;
     int64_t nFees = 0;
     int64_t nValueIn = 0;
@@ -1634,19 +1688,32 @@ bool ConnectBlock(CBlock& block, CTxDB& txdb, CBlockIndex* pindex, bool fJustChe
                 }
             }
 
-            if (!ConnectInputs(tx, txdb, mapInputs, mapQueuedChanges, posThisTx, pindex, true, false))
+            std::vector<CScriptCheck> vChecks;
+            if (!ConnectInputs(tx, txdb, mapInputs, mapQueuedChanges, posThisTx, pindex, true, false,
+                               g_parallel_script_checks ? &vChecks : nullptr))
                 return false;
+            control.Add(vChecks);
+            nInputs += tx.vin.size();
         }
 
         mapQueuedChanges[hashTx] = CTxIndex(posThisTx, tx.vout.size());
     }
 
+    // Finish the deferred signature checks before anything below records the
+    // block's effects in the contract, quorum, or researcher state:
+    if (!control.Wait())
+        return block.DoS(100, error("%s: script verification failed", __func__));
+
     if (IsResearchAgeEnabled(pindex->nHeight)
         && !GridcoinConnectBlock(block, pindex, txdb, stake_value_in, nStakeReward, nFees))
     {
         return false;
     }
 
+    LogPrint(BCLog::LogFlags::BENCH, "%s: connected block %d with %u inputs in %.2fms (%s)",
+             __func__, pindex->nHeight, nInputs, (GetTimeMicros() - nTimeStart) * 0.001,
+             g_parallel_script_checks ? "parallel" : "serial");
+
     pindex->nMoneySupply = ReturnCurrentMoneySupply(pindex) + nValueOut - nValueIn;
 
     if (!txdb.WriteBlockIndex(CDiskBlockIndex(pindex)))
@@ -1703,6 +1770,7 @@ bool AddToBlockIndex(CBlock& block, unsigned int nFile, unsigned int nBlockPos,
     {
         pindexNew->pprev = miPrev->second;
         pindexNew->nHeight = pindexNew->pprev->nHeight + 1;
+        pindexNew->BuildSkip();
     }
 
     // ppcoin: compute stake entropy bit for stake modifier
@@ -1710,7 +1778,7 @@ bool AddToBlockIndex(CBlock& block, unsigned int nFile, unsigned int nBlockPos,
         return error("%s: SetStakeEntropyBit failed", __func__);
 
     // Record proof hash value
-    pindexNew->hashProof = hashProof;
+    pindexNew->SetProofHash(hashProof);
 
     // ppcoin: compute stake modifier
     uint64_t nStakeModifier = 0;
@@ -1890,7 +1958,10 @@ bool CheckBlock(const CBlock& block, int height1, bool fCheckPOW, bool fCheckMer
             return block.DoS(100, error("%s: duplicate transaction", __func__));
     }
 
-    if (fCheckPOW && fCheckMerkleRoot && fCheckSig)
+    // Cache only a pass of the strict checks. Below the grandfather height the
+    // checks above skip the difficulty and block signature, and the same block
+    // may be checked again later for a height above it:
+    if (fCheckPOW && fCheckMerkleRoot && fCheckSig && height1 > nGrandfather)
         block.fChecked = true;
 
     return true;
@@ -11,6 +11,7 @@
 #include "primitives/transaction.h"
 
 #include <map>
+#include <vector>
 
 class CTxDB;
 class CBlockHeader;
@@ -24,6 +25,45 @@ namespace GRC {
 
 typedef std::map<uint256, std::pair<CTxIndex, CTransaction>> MapPrevTx;
 
+/** -par default (number of script-checking threads, 0 = auto) */
+static const int DEFAULT_SCRIPTCHECK_THREADS = 0;
+/** Maximum number of dedicated script-checking threads allowed */
+static const int MAX_SCRIPTCHECK_THREADS = 15;
+
+/**
+ * Closure representing one script verification.
+ * Note that this stores references to the spending transaction.
+ */
+class CScriptCheck
+{
+private:
+    CScript scriptPubKey;
+    const CTransaction* ptxTo;
+    unsigned int nIn;
+    int nHashType;
+
+public:
+    CScriptCheck() : ptxTo(nullptr), nIn(0), nHashType(0) {}
+    CScriptCheck(const CTxOut& txoutIn, const CTransaction& txToIn, unsigned int nInIn, int nHashTypeIn)
+        : scriptPubKey(txoutIn.scriptPubKey), ptxTo(&txToIn), nIn(nInIn), nHashType(nHashTypeIn) {}
+
+    bool operator()();
+
+    void swap(CScriptCheck& check)
+    {
+        scriptPubKey.swap(check.scriptPubKey);
+        std::swap(ptxTo, check.ptxTo);
+        std::swap(nIn, check.nIn);
+        std::swap(nHashType, check.nHashType);
+    }
+};
+
+/** Run instances of script checking worker threads */
+void StartScriptCheckWorkerThreads(int threads_num);
+
+/** Stop all of the script checking worker threads */
+void StopScriptCheckWorkerThreads();
+
 bool ReadTxFromDisk(CTransaction& tx, CDiskTxPos pos, FILE** pfileRet = nullptr);
 bool ReadTxFromDisk(CTransaction& tx, CTxDB& txdb, COutPoint prevout, CTxIndex& txindexRet);
 bool ReadTxFromDisk(CTransaction& tx, CTxDB& txdb, COutPoint prevout);
@@ -91,9 +131,10 @@ bool FetchInputs(CTransaction& tx, CTxDB& txdb, const std::map<uint256, CTxIndex
     @param[in] pindexBlock
     @param[in] fBlock	true if called from ConnectBlock
     @param[in] fMiner	true if called from CreateNewBlock
+    @param[out] pvChecks	If not nullptr, receives the signature checks instead of running them
     @return Returns true if all checks succeed
     */
-bool ConnectInputs(CTransaction& tx, CTxDB& txdb, MapPrevTx inputs, std::map<uint256, CTxIndex>& mapTestPool, const CDiskTxPos& posThisTx, const CBlockIndex* pindexBlock, bool fBlock, bool fMiner);
+bool ConnectInputs(CTransaction& tx, CTxDB& txdb, MapPrevTx inputs, std::map<uint256, CTxIndex>& mapTestPool, const CDiskTxPos& posThisTx, const CBlockIndex* pindexBlock, bool fBlock, bool fMiner, std::vector<CScriptCheck>* pvChecks = nullptr);
 
 bool GetCoinAge(const CTransaction& tx, CTxDB& txdb, uint64_t& nCoinAge); // ppcoin: get transaction coin age
 
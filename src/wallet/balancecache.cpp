@@ -0,0 +1,229 @@
+// Copyright (c) 2022 The Gridcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://opensource.org/licenses/mit-license.php.
+
+#include "main.h"
+#include "wallet/balancecache.h"
+
+WalletBalances& WalletBalances::operator+=(const WalletBalances& other)
+{
+    m_balance += other.m_balance;
+    m_unconfirmed += other.m_unconfirmed;
+    m_immature += other.m_immature;
+    m_stake += other.m_stake;
+
+    return *this;
+}
+
+WalletBalances& WalletBalances::operator-=(const WalletBalances& other)
+{
+    m_balance -= other.m_balance;
+    m_unconfirmed -= other.m_unconfirmed;
+    m_immature -= other.m_immature;
+    m_stake -= other.m_stake;
+
+    return *this;
+}
+
+WalletBalances WalletBalanceCache::Classify(const Entry& entry, int tip_height, int maturity_depth)
+{
+    WalletBalances balances;
+
+    const int depth = tip_height - entry.m_height + 1;
+
+    // Generated outputs only count towards the immature balances until they
+    // mature. See CWalletTx::GetAvailableCredit():
+    if ((entry.m_coinbase || entry.m_coinstake) && depth < maturity_depth) {
+        if (entry.m_coinbase) {
+            balances.m_immature = entry.m_credit;
+        } else {
+            balances.m_stake = entry.m_credit;
+        }
+
+        return balances;
+    }
+
+    if (depth >= CONFIRMED_DEPTH || entry.m_from_me) {
+        balances.m_balance = entry.m_available;
+    } else {
+        balances.m_unconfirmed = entry.m_available;
+    }
+
+    return balances;
+}
+
+void WalletBalanceCache::MarkDirty(const uint256& txid)
+{
+    LOCK(m_mutex);
+
+    if (!m_rebuild) {
+        m_dirty.insert(txid);
+    }
+}
+
+void WalletBalanceCache::MarkAllDirty()
+{
+    LOCK(m_mutex);
+
+    m_rebuild = true;
+    m_dirty.clear();
+}
+
+bool WalletBalanceCache::TakeChanges(const CBlockIndex* pindex_best, std::set<uint256>& txids)
+{
+    LOCK(m_mutex);
+
+    const CBlockIndex* pindex_last = m_tip;
+    m_tip = pindex_best;
+    m_tip_height = pindex_best ? pindex_best->nHeight : -1;
+
+    // The schedule only moves entries forward, so a shorter chain needs every
+    // entry classified again:
+    if (pindex_last && pindex_best && pindex_best->nHeight < pindex_last->nHeight) {
+        m_rebuild = true;
+    }
+
+    if (m_rebuild) {
+        m_rebuild = false;
+        m_dirty.clear();
+        m_entries.clear();
+        m_schedule.clear();
+        m_pending.clear();
+        m_totals = WalletBalances();
+
+        return true;
+    }
+
+    // Transactions in blocks that left the main chain are no longer confirmed:
+    if (pindex_last && pindex_best && pindex_best->GetAncestor(pindex_last->nHeight) != pindex_last) {
+        const CBlockIndex* pindex_fork = LastCommonAncestor(pindex_last, pindex_best);
+        const int fork_height = pindex_fork ? pindex_fork->nHeight : -1;
+
+        for (const auto& item : m_entries) {
+            if (item.second.m_entry.m_height > fork_height) {
+                m_dirty.insert(item.first);
+            }
+        }
+    }
+
+    while (!m_schedule.empty() && m_schedule.begin()->first <= m_tip_height) {
+        const uint256 txid = m_schedule.begin()->second;
+        m_schedule.erase(m_schedule.begin());
+
+        const auto iter = m_entries.find(txid);
+
+        if (iter != m_entries.end()) {
+            ApplyLocked(txid, iter->second);
+        }
+    }
+
+    txids.swap(m_dirty);
+    m_dirty.clear();
+
+    return false;
+}
+
+void WalletBalanceCache::Erase(const uint256& txid)
+{
+    LOCK(m_mutex);
+
+    EraseLocked(txid);
+}
+
+void WalletBalanceCache::Set(const uint256& txid, const Entry& entry)
+{
+    LOCK(m_mutex);
+
+    EraseLocked(txid);
+
+    CachedEntry& cached = m_entries[txid];
+    cached.m_entry = entry;
+    cached.m_next_height = -1;
+
+    ApplyLocked(txid, cached);
+}
+
+void WalletBalanceCache::SetPending(const uint256& txid)
+{
+    LOCK(m_mutex);
+
+    EraseLocked(txid);
+    m_pending.insert(txid);
+}
+
+std::vector<uint256> WalletBalanceCache::GetPending() const
+{
+    LOCK(m_mutex);
+
+    return std::vector<uint256>(m_pending.begin(), m_pending.end());
+}
+
+WalletBalances WalletBalanceCache::GetTotals() const
+{
+    LOCK(m_mutex);
+
+    return m_totals;
+}
+
+size_t WalletBalanceCache::size() const
+{
+    LOCK(m_mutex);
+
+    return m_entries.size();
+}
+
+void WalletBalanceCache::EraseLocked(const uint256& txid)
+{
+    m_pending.erase(txid);
+
+    const auto iter = m_entries.find(txid);
+
+    if (iter == m_entries.end()) {
+        return;
+    }
+
+    const CachedEntry& cached = iter->second;
+
+    if (cached.m_next_height >= 0) {
+        const auto range = m_schedule.equal_range(cached.m_next_height);
+
+        for (auto it = range.first; it != range.second; ++it) {
+            if (it->second == txid) {
+                m_schedule.erase(it);
+                break;
+            }
+        }
+    }
+
+    m_totals -= cached.m_applied;
+    m_entries.erase(iter);
+}
+
+void WalletBalanceCache::ApplyLocked(const uint256& txid, CachedEntry& cached)
+{
+    const Entry& entry = cached.m_entry;
+    const int maturity_depth = nCoinbaseMaturity + 10;
+
+    m_totals -= cached.m_applied;
+    cached.m_applied = Classify(entry, m_tip_height, maturity_depth);
+    m_totals += cached.m_applied;
+
+    // Schedule the entry for the next depth that changes its contribution:
+    cached.m_next_height = -1;
+
+    for (const int depth : { CONFIRMED_DEPTH, maturity_depth }) {
+        if (depth == maturity_depth && !(entry.m_coinbase || entry.m_coinstake)) {
+            continue;
+        }
+
+        const int height = entry.m_height + depth - 1;
+
+        if (height > m_tip_height && (cached.m_next_height < 0 || height < cached.m_next_height)) {
+            cached.m_next_height = height;
+        }
+    }
+
+    if (cached.m_next_height >= 0) {
+        m_schedule.emplace(cached.m_next_height, txid);
+    }
+}
@@ -0,0 +1,142 @@
+// Copyright (c) 2022 The Gridcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_WALLET_BALANCECACHE_H
+#define BITCOIN_WALLET_BALANCECACHE_H
+
+#include "amount.h"
+#include "sync.h"
+#include "uint256.h"
+
+#include <map>
+#include <set>
+#include <vector>
+
+class CBlockIndex;
+
+/**
+ * The amounts that the wallet balance queries report.
+ */
+struct WalletBalances
+{
+    CAmount m_balance = 0;      //!< Trusted, spendable credit. See CWallet::GetBalance().
+    CAmount m_unconfirmed = 0;  //!< See CWallet::GetUnconfirmedBalance().
+    CAmount m_immature = 0;     //!< Credit of immature coinbase transactions.
+    CAmount m_stake = 0;        //!< Credit of immature coinstake transactions.
+
+    WalletBalances& operator+=(const WalletBalances& other);
+    WalletBalances& operator-=(const WalletBalances& other);
+};
+
+/**
+ * Keeps running totals of the wallet balances, so that the balance queries do
+ * not need to walk every wallet transaction.
+ *
+ * The cache holds the transactions buried deep enough in the main chain that
+ * the balance rules no longer depend on other transactions or the mempool.
+ * Their contribution to each balance changes only at a few known depths, so
+ * the cache schedules each entry for the chain height of its next change and
+ * revisits only the entries due when the chain grows. The owner evaluates the
+ * rest of the transactions on each query: unconfirmed ones and those in the
+ * last few blocks. See CWallet::GetBalances().
+ *
+ * Dirty tracking works like StakeCandidateIndex: the wallet marks changed
+ * transactions dirty, and the cache reports the entries above the fork point
+ * of a reorganization as dirty too.
+ *
+ * This is a leaf lock: the wallet marks transactions dirty while it holds
+ * cs_wallet, from places that cannot take more locks.
+ */
+class WalletBalanceCache
+{
+public:
+    /** Depth at which a transaction's outputs become trusted. See CWalletTx::IsTrusted(). */
+    static constexpr int TRUSTED_DEPTH = 3;
+
+    /** Depth at which a transaction counts as confirmed. See CWalletTx::IsConfirmed(). */
+    static constexpr int CONFIRMED_DEPTH = 10;
+
+    /**
+     * The fields of a wallet transaction that its contribution to the balances
+     * depends on.
+     */
+    struct Entry
+    {
+        int m_height = 0;           //!< Height of the block that contains the transaction.
+        CAmount m_available = 0;    //!< Credit of the unspent outputs.
+        CAmount m_credit = 0;       //!< Credit of all the outputs.
+        bool m_coinbase = false;    //!< Whether the transaction is a coinbase.
+        bool m_coinstake = false;   //!< Whether the transaction is a coinstake.
+        bool m_from_me = false;     //!< Whether the wallet created the transaction.
+    };
+
+    /**
+     * Get the contribution of a transaction to the balances.
+     *
+     * \param entry           Transaction at a depth of TRUSTED_DEPTH or more.
+     * \param tip_height      Height of the chain tip.
+     * \param maturity_depth  Depth at which generated outputs mature.
+     */
+    static WalletBalances Classify(const Entry& entry, int tip_height, int maturity_depth);
+
+    /** Replace the entry of a wallet transaction on the next update. */
+    void MarkDirty(const uint256& txid);
+
+    /** Rebuild the cache from the whole wallet on the next update. */
+    void MarkAllDirty();
+
+    /**
+     * Get the transactions to replace the entries of before a read, and move
+     * the entries due for a change at the new chain tip.
+     *
+     * \param pindex_best The current chain tip.
+     * \param txids       Receives the dirty transactions.
+     *
+     * \return \c true when the whole cache needs a rebuild instead. The cache
+     * is empty in that case.
+     */
+    bool TakeChanges(const CBlockIndex* pindex_best, std::set<uint256>& txids);
+
+    /** Remove the entry of a wallet transaction. */
+    void Erase(const uint256& txid);
+
+    /** Add or replace the entry of a wallet transaction. */
+    void Set(const uint256& txid, const Entry& entry);
+
+    /** Track a wallet transaction that the owner evaluates on each query. */
+    void SetPending(const uint256& txid);
+
+    /** Get the transactions that the owner evaluates on each query. */
+    std::vector<uint256> GetPending() const;
+
+    /** Get the balances of the cached entries. */
+    WalletBalances GetTotals() const;
+
+    /** Number of cached entries. */
+    size_t size() const;
+
+private:
+    struct CachedEntry
+    {
+        Entry m_entry;
+        WalletBalances m_applied;   //!< Contribution included in the totals.
+        int m_next_height;          //!< Height of the next change, or -1.
+    };
+
+    mutable Mutex m_mutex;
+
+    std::map<uint256, CachedEntry> m_entries GUARDED_BY(m_mutex);
+    std::multimap<int, uint256> m_schedule GUARDED_BY(m_mutex);
+    std::set<uint256> m_pending GUARDED_BY(m_mutex);
+    std::set<uint256> m_dirty GUARDED_BY(m_mutex);
+    WalletBalances m_totals GUARDED_BY(m_mutex);
+    bool m_rebuild GUARDED_BY(m_mutex) = true;
+    const CBlockIndex* m_tip GUARDED_BY(m_mutex) = nullptr;
+    int m_tip_height GUARDED_BY(m_mutex) = -1;
+
+    void EraseLocked(const uint256& txid) EXCLUSIVE_LOCKS_REQUIRED(m_mutex);
+    void ApplyLocked(const uint256& txid, CachedEntry& cached) EXCLUSIVE_LOCKS_REQUIRED(m_mutex);
+};
+
+#endif // BITCOIN_WALLET_BALANCECACHE_H
@@ -0,0 +1,88 @@
+// Copyright (c) 2022 The Gridcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://opensource.org/licenses/mit-license.php.
+
+#include "main.h"
+#include "wallet/stakeindex.h"
+
+#include <algorithm>
+
+void StakeCandidateIndex::MarkDirty(const uint256& txid)
+{
+    LOCK(m_mutex);
+
+    if (!m_rebuild) {
+        m_dirty.insert(txid);
+    }
+}
+
+void StakeCandidateIndex::MarkAllDirty()
+{
+    LOCK(m_mutex);
+
+    m_rebuild = true;
+    m_dirty.clear();
+}
+
+bool StakeCandidateIndex::TakeChanges(const CBlockIndex* pindex_best, std::set<uint256>& txids)
+{
+    LOCK(m_mutex);
+
+    const CBlockIndex* pindex_last = m_tip;
+    m_tip = pindex_best;
+
+    if (m_rebuild) {
+        m_rebuild = false;
+        m_dirty.clear();
+
+        return true;
+    }
+
+    // Transactions in blocks that left the main chain are no longer confirmed:
+    if (pindex_last && pindex_best && pindex_best->GetAncestor(pindex_last->nHeight) != pindex_last) {
+        const CBlockIndex* pindex_fork = LastCommonAncestor(pindex_last, pindex_best);
+        const int fork_height = pindex_fork ? pindex_fork->nHeight : -1;
+
+        for (const auto& candidate : m_candidates) {
+            if (candidate.m_height > fork_height) {
+                m_dirty.insert(candidate.m_txid);
+            }
+        }
+    }
+
+    txids.swap(m_dirty);
+    m_dirty.clear();
+
+    return false;
+}
+
+void StakeCandidateIndex::Update(const std::set<uint256>& txids, std::vector<StakeCandidate> candidates)
+{
+    LOCK(m_mutex);
+
+    if (!txids.empty()) {
+        m_candidates.erase(
+            std::remove_if(m_candidates.begin(), m_candidates.end(), [&](const StakeCandidate& candidate) {
+                return txids.count(candidate.m_txid) > 0;
+            }),
+            m_candidates.end());
+    }
+
+    m_candidates.insert(
+        m_candidates.end(),
+        std::make_move_iterator(candidates.begin()),
+        std::make_move_iterator(candidates.end()));
+}
+
+void StakeCandidateIndex::Reset(std::vector<StakeCandidate> candidates)
+{
+    LOCK(m_mutex);
+
+    m_candidates = std::move(candidates);
+}
+
+size_t StakeCandidateIndex::size() const
+{
+    LOCK(m_mutex);
+    return m_candidates.size();
+}
@@ -0,0 +1,98 @@
+// Copyright (c) 2022 The Gridcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_WALLET_STAKEINDEX_H
+#define BITCOIN_WALLET_STAKEINDEX_H
+
+#include "amount.h"
+#include "sync.h"
+#include "uint256.h"
+
+#include <set>
+#include <vector>
+
+class CBlockIndex;
+
+/**
+ * An unspent wallet output that counts towards the staking balance, with the
+ * fields that the kernel search needs copied out of the wallet transaction.
+ */
+struct StakeCandidate
+{
+    uint256 m_txid;             //!< Hash of the transaction that produced the output.
+    unsigned int m_n;           //!< Index of the output in the transaction.
+    CAmount m_value;            //!< Amount of the output.
+    int64_t m_weight;           //!< Kernel weight of the output.
+    unsigned int m_tx_time;     //!< Timestamp of the transaction.
+    unsigned int m_block_time;  //!< Timestamp of the block that contains the transaction.
+    int m_height;               //!< Height of that block, or -1 for an unconfirmed transaction.
+    int m_maturity_height;      //!< Lowest chain tip height at which the output can stake.
+
+    bool IsConfirmed() const { return m_height >= 0; }
+};
+
+/**
+ * Keeps the stakeable outputs of a wallet in a flat array, so that the miner
+ * does not need to walk every wallet transaction on each cycle.
+ *
+ * The wallet marks a transaction dirty when its outputs or their spent flags
+ * change, and the owner replaces the entries of the dirty transactions before
+ * it reads the index. A transaction in a block stays valid as long as its
+ * block stays in the main chain: the index remembers the chain tip that it saw
+ * last and reports the transactions above the fork point of a reorganization
+ * as dirty too. Blocks that do not touch the wallet only change the depths of
+ * the entries, which readers compute from the heights.
+ *
+ * This is a leaf lock: the wallet marks transactions dirty while it holds
+ * cs_wallet, from places that cannot take more locks.
+ */
+class StakeCandidateIndex
+{
+public:
+    /** Replace the entries of a wallet transaction on the next update. */
+    void MarkDirty(const uint256& txid);
+
+    /** Rebuild the index from the whole wallet on the next update. */
+    void MarkAllDirty();
+
+    /**
+     * Get the transactions to replace the entries of before a read.
+     *
+     * \param pindex_best The current chain tip.
+     * \param txids       Receives the dirty transactions.
+     *
+     * \return \c true when the whole index needs a rebuild instead.
+     */
+    bool TakeChanges(const CBlockIndex* pindex_best, std::set<uint256>& txids);
+
+    /** Replace the entries of the given transactions with a new set. */
+    void Update(const std::set<uint256>& txids, std::vector<StakeCandidate> candidates);
+
+    /** Replace the whole index after a rebuild. */
+    void Reset(std::vector<StakeCandidate> candidates);
+
+    /** Call a function for each entry while the index is locked. */
+    template <typename Fn>
+    void ForEach(Fn fn) const
+    {
+        LOCK(m_mutex);
+
+        for (const auto& candidate : m_candidates) {
+            fn(candidate);
+        }
+    }
+
+    /** Number of entries in the index. */
+    size_t size() const;
+
+private:
+    mutable Mutex m_mutex;
+
+    std::vector<StakeCandidate> m_candidates GUARDED_BY(m_mutex);
+    std::set<uint256> m_dirty GUARDED_BY(m_mutex);
+    bool m_rebuild GUARDED_BY(m_mutex) = true;
+    const CBlockIndex* m_tip GUARDED_BY(m_mutex) = nullptr;
+};
+
+#endif // BITCOIN_WALLET_STAKEINDEX_H
@@ -19,6 +19,7 @@
 #include "rpc/protocol.h"
 #include <script.h>
 #include "main.h"
+#include "miner.h"
 #include "util.h"
 #include <util/string.h>
 #include "gridcoin/mrc.h"
@@ -148,6 +149,8 @@ bool CWallet::AddKey(const CKey& key) EXCLUSIVE_LOCKS_REQUIRED(cs_wallet)
 
     if (!CCryptoKeyStore::AddKey(key))
         return false;
+    // Outputs already in the wallet may pay to an imported key:
+    MarkAllTxsDirty();
     if (!fFileBacked)
         return true;
     if (!IsCrypted())
@@ -190,6 +193,7 @@ bool CWallet::AddCScript(const CScript& redeemScript)
 {
     if (!CCryptoKeyStore::AddCScript(redeemScript))
         return false;
+    MarkAllTxsDirty();
     if (!fFileBacked)
         return true;
     return CWalletDB(strWalletFile).WriteCScript(Hash160(redeemScript), redeemScript);
@@ -234,6 +238,7 @@ bool CWallet::Unlock(const SecureString& strWalletPassphrase)
                 return false;
             if (CCryptoKeyStore::Unlock(vMasterKey))
             {
+                WakeStakeMiner();
                 return true;
             }
         }
@@ -241,6 +246,22 @@ bool CWallet::Unlock(const SecureString& strWalletPassphrase)
     return false;
 }
 
+void CWallet::MarkTxDirty(const uint256& hash) const
+{
+    m_stake_index.MarkDirty(hash);
+    m_balance_cache.MarkDirty(hash);
+
+    WakeStakeMiner();
+}
+
+void CWallet::MarkAllTxsDirty() const
+{
+    m_stake_index.MarkAllDirty();
+    m_balance_cache.MarkAllDirty();
+
+    WakeStakeMiner();
+}
+
 bool CWallet::ChangeWalletPassphrase(const SecureString& strOldWalletPassphrase, const SecureString& strNewWalletPassphrase)
 {
     bool fWasLocked = IsLocked();
@@ -488,6 +509,7 @@ void CWallet::MarkDirty()
         LOCK(cs_wallet);
         for (auto &item : mapWallet)
             item.second.MarkDirty();
+        MarkAllTxsDirty();
     }
 }
 
@@ -501,6 +523,9 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, CWalletDB* pwalletdb)
         CWalletTx& wtx = ret.first->second;
         wtx.BindWallet(this);
         bool fInsertedNew = ret.second;
+
+        // A new transaction, or a new block for an existing one:
+        MarkTxDirty(hash);
         bool fUpdated = false;
 
         if (fInsertedNew)
@@ -621,6 +646,8 @@ bool CWallet::EraseFromWallet(uint256 hash)
 {
     LOCK(cs_wallet);
 
+    MarkTxDirty(hash);
+
     return fFileBacked && mapWallet.erase(hash) && CWalletDB(strWalletFile).EraseTx(hash);
 }
 
@@ -1091,23 +1118,29 @@ int CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate)
     CBlockIndex* pindex = pindexStart;
     {
         LOCK2(cs_main, cs_wallet);
-        while (pindex)
-        {
-            // no need to read and scan block, if block was created before
-            // our wallet birthday (as adjusted for block time variability)
-            if (nTimeFirstKey && (pindex->nTime < (nTimeFirstKey - 7200))) {
-                pindex = pindex->pnext;
-                continue;
-            }
 
-            CBlock block;
-            ReadBlockFromDisk(block, pindex, Params().GetConsensus());
+        // Skip directly to the first block that could contain transactions
+        // for our keys instead of stepping through every older block:
+        if (nTimeFirstKey && pindex) {
+            pindex = GRC::BlockFinder::FindByMinTimeFromGivenIndex(nTimeFirstKey - 7200, pindex);
+        }
+
+        // no need to read and scan block, if block was created before
+        // our wallet birthday (as adjusted for block time variability)
+        SequentialBlockReader reader(pindex, nullptr, [this](const CBlockIndex* candidate) {
+            return !nTimeFirstKey || candidate->nTime >= nTimeFirstKey - 7200;
+        });
+
+        CBlock block;
+        bool fRead;
+
+        while (reader.Next(block, fRead))
+        {
             for (auto const& tx : block.vtx)
             {
                 if (AddToWalletIfInvolvingMe(tx, &block, fUpdate))
                     ret++;
             }
-            pindex = pindex->pnext;
         }
     }
     return ret;
@@ -1322,52 +1355,129 @@ bool CWalletTx::RevalidateTransaction(CTxDB& txdb)
 //
 
 
-int64_t CWallet::GetBalance() const
+void CWallet::UpdateBalanceCache() const EXCLUSIVE_LOCKS_REQUIRED(cs_main, cs_wallet)
 {
-    int64_t nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
-        {
-            const CWalletTx* pcoin = &it->second;
-            if (pcoin->IsTrusted() && (pcoin->IsConfirmed() || pcoin->fFromMe))
-                nTotal += pcoin->GetAvailableCredit();
+    AssertLockHeld(cs_main);
+    AssertLockHeld(cs_wallet);
+
+    std::set<uint256> dirty;
+
+    if (m_balance_cache.TakeChanges(pindexBest, dirty)) {
+        for (const auto& it : mapWallet) {
+            CacheBalanceEntry(it.first, it.second);
         }
+
+        LogPrint(BCLog::LogFlags::VERBOSE, "%s: rebuilt balances of %u transactions",
+                 __func__, mapWallet.size());
+
+        return;
     }
 
-    return nTotal;
+    for (const auto& hash : dirty) {
+        const auto it = mapWallet.find(hash);
+
+        if (it != mapWallet.end()) {
+            CacheBalanceEntry(it->first, it->second);
+        } else {
+            m_balance_cache.Erase(hash);
+        }
+    }
 }
 
-int64_t CWallet::GetUnconfirmedBalance() const
+void CWallet::CacheBalanceEntry(const uint256& hash, const CWalletTx& wtx) const
+    EXCLUSIVE_LOCKS_REQUIRED(cs_main, cs_wallet)
 {
-    int64_t nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
-        {
-            const CWalletTx* pcoin = &it->second;
-            if (!IsFinalTx(*pcoin) || (!pcoin->IsConfirmed() && !pcoin->fFromMe && pcoin->IsInMainChain())) {
-                nTotal += pcoin->GetAvailableCredit();
-            }
+    CBlockIndex* pindex = nullptr;
+    const int depth = wtx.GetDepthInMainChain(pindex);
+
+    // Below this depth, the balances depend on the mempool and on the other
+    // transactions of the wallet. GetBalances() checks these on each query:
+    if (depth < WalletBalanceCache::TRUSTED_DEPTH) {
+        // Generated transactions outside of the main chain add to no balance
+        // until a block that contains them connects again:
+        if (depth <= 0 && (wtx.IsCoinBase() || wtx.IsCoinStake())) {
+            m_balance_cache.Erase(hash);
+        } else {
+            m_balance_cache.SetPending(hash);
         }
+
+        return;
     }
-    return nTotal;
+
+    WalletBalanceCache::Entry entry;
+    entry.m_height = pindex->nHeight;
+    entry.m_credit = GetCredit(wtx);
+    entry.m_coinbase = wtx.IsCoinBase();
+    entry.m_coinstake = wtx.IsCoinStake();
+    entry.m_from_me = wtx.fFromMe;
+
+    for (unsigned int i = 0; i < wtx.vout.size(); ++i) {
+        if (!wtx.IsSpent(i)) {
+            entry.m_available += GetCredit(wtx.vout[i]);
+        }
+    }
+
+    m_balance_cache.Set(hash, entry);
 }
 
-int64_t CWallet::GetImmatureBalance() const
+WalletBalances CWallet::GetBalances() const
 {
-    int64_t nTotal = 0;
+    LOCK2(cs_main, cs_wallet);
+
+    // Bring the running totals up to date with the wallet transactions that
+    // changed and the blocks that connected since the last query instead of
+    // walking all of mapWallet:
+    UpdateBalanceCache();
+
+    // Move the transactions that reached the depth at which the cache can
+    // track them out of the pending set:
+    for (const auto& hash : m_balance_cache.GetPending())
     {
-        LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
-        {
-            const CWalletTx& pcoin = it->second;
-            if (pcoin.IsCoinBase() && pcoin.GetBlocksToMaturity() > 0 && pcoin.IsInMainChain()) {
-                nTotal += GetCredit(pcoin);
-            }
-        }
+        const auto it = mapWallet.find(hash);
+
+        if (it != mapWallet.end() && it->second.GetDepthInMainChain() >= WalletBalanceCache::TRUSTED_DEPTH)
+            CacheBalanceEntry(hash, it->second);
+    }
+
+    WalletBalances balances = m_balance_cache.GetTotals();
+
+    for (const auto& hash : m_balance_cache.GetPending())
+    {
+        const auto it = mapWallet.find(hash);
+
+        if (it == mapWallet.end()) continue;
+
+        const CWalletTx* pcoin = &it->second;
+
+        if (pcoin->IsTrusted() && (pcoin->IsConfirmed() || pcoin->fFromMe))
+            balances.m_balance += pcoin->GetAvailableCredit();
+
+        if (!IsFinalTx(*pcoin) || (!pcoin->IsConfirmed() && !pcoin->fFromMe && pcoin->IsInMainChain()))
+            balances.m_unconfirmed += pcoin->GetAvailableCredit();
+
+        if (pcoin->IsCoinBase() && pcoin->GetBlocksToMaturity() > 0 && pcoin->IsInMainChain())
+            balances.m_immature += GetCredit(*pcoin);
+
+        if (pcoin->IsCoinStake() && pcoin->GetBlocksToMaturity() > 0 && pcoin->GetDepthInMainChain() > 0)
+            balances.m_stake += GetCredit(*pcoin);
     }
-    return nTotal;
+
+    return balances;
+}
+
+int64_t CWallet::GetBalance() const
+{
+    return GetBalances().m_balance;
+}
+
+int64_t CWallet::GetUnconfirmedBalance() const
+{
+    return GetBalances().m_unconfirmed;
+}
+
+int64_t CWallet::GetImmatureBalance() const
+{
+    return GetBalances().m_immature;
 }
 
 // populate vCoins with vector of spendable COutputs
@@ -1419,9 +1529,79 @@ void CWallet::AvailableCoins(vector<COutput>& vCoins, bool fOnlyConfirmed, const
 }
 
 // A lock must be taken on cs_main before calling this function.
-void CWallet::AvailableCoinsForStaking(vector<COutput>& vCoins, unsigned int nSpendTime, int64_t& balance_out) const EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+void CWallet::UpdateStakeIndex() const EXCLUSIVE_LOCKS_REQUIRED(cs_main, cs_wallet)
 {
+    AssertLockHeld(cs_main);
+    AssertLockHeld(cs_wallet);
+
+    std::set<uint256> dirty;
+    std::vector<StakeCandidate> candidates;
+
+    if (m_stake_index.TakeChanges(pindexBest, dirty)) {
+        for (const auto& it : mapWallet) {
+            AppendStakeCandidates(it.second, candidates);
+        }
+
+        LogPrint(BCLog::LogFlags::MINER, "%s: rebuilt index of %u outputs from %u transactions",
+                 __func__, candidates.size(), mapWallet.size());
+
+        m_stake_index.Reset(std::move(candidates));
+
+        return;
+    }
+
+    for (const auto& hash : dirty) {
+        const auto it = mapWallet.find(hash);
+
+        if (it != mapWallet.end()) {
+            AppendStakeCandidates(it->second, candidates);
+        }
+    }
+
+    m_stake_index.Update(dirty, std::move(candidates));
+}
+
+void CWallet::AppendStakeCandidates(const CWalletTx& wtx, std::vector<StakeCandidate>& candidates) const
+    EXCLUSIVE_LOCKS_REQUIRED(cs_main, cs_wallet)
+{
+    CBlockIndex* pindex = nullptr;
+    const bool confirmed = wtx.GetDepthInMainChain(pindex) > 0;
+
+    // Unconfirmed transactions only count towards the staking balance when
+    // they come from this wallet. See AvailableCoinsForStaking():
+    if (!confirmed && !wtx.fFromMe) return;
+
+    // If coinbase or coinstake, the output must reach a depth of nCoinbaseMaturity + 10 to stake. A regular
+    // transaction must be at a depth of 1 or more.
+    const int maturity_depth = (wtx.IsCoinBase() || wtx.IsCoinStake()) ? nCoinbaseMaturity + 10 : 1;
+
+    for (unsigned int i = 0; i < wtx.vout.size(); ++i)
+    {
+        if (wtx.IsSpent(i)
+            || IsMine(wtx.vout[i]) == ISMINE_NO
+            || wtx.vout[i].nValue <= 0)
+        {
+            continue;
+        }
+
+        StakeCandidate candidate;
+        candidate.m_txid = wtx.GetHash();
+        candidate.m_n = i;
+        candidate.m_value = wtx.vout[i].nValue;
+        candidate.m_weight = GRC::CalculateStakeWeightV8(candidate.m_value);
+        candidate.m_tx_time = wtx.nTime;
+        candidate.m_block_time = confirmed ? pindex->nTime : 0;
+        candidate.m_height = confirmed ? pindex->nHeight : -1;
+        candidate.m_maturity_height = confirmed ? pindex->nHeight + maturity_depth - 1 : -1;
+
+        candidates.push_back(std::move(candidate));
+    }
+}
 
+// A lock must be taken on cs_main before calling this function.
+void CWallet::AvailableCoinsForStaking(vector<StakeCandidate>& vCoins, unsigned int nSpendTime, int64_t& balance_out,
+                                       int64_t* next_maturity_time) const EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+{
     vCoins.clear();
     {
         AssertLockHeld(cs_main);
@@ -1430,87 +1610,65 @@ void CWallet::AvailableCoinsForStaking(vector<COutput>& vCoins, unsigned int nSp
         std::string function = __func__;
         function += ": ";
 
-        unsigned int transactions = 0;
-        unsigned int txns_w_avail_outputs = 0;
+        // Bring the index up to date with the wallet transactions that changed
+        // since the last call instead of walking all of mapWallet:
+        UpdateStakeIndex();
 
-        for (const auto& it : mapWallet)
-        {
-            const CWalletTx* pcoin = &it.second;
+        g_timer.GetTimes(function + "update stake index", "miner");
 
-            // Track number of transactions processed for instrumentation purposes.
-            ++transactions;
+        const int nBestHeight = pindexBest->nHeight;
+        std::vector<StakeCandidate> pending;
 
-            int nDepth = pcoin->GetDepthInMainChain();
-            std::vector<std::pair<const CWalletTx*, int>> possible_vCoins;
-
-            // Do the balance computation here after the GetDepthInMainChain() call.
-            // This avoids the expensive IsTrusted() and IsConfirmed() calls in the GetBalance() function, which each
-            // have a call to GetDepthInMainChain(). We also want to use a slightly different standard for the balance
-            // calculation here, to include recently staked amounts. The number here should be equal or very close to
-            // the "Total" field on the GUI overview screen. This is the proper number to use to be able to do the
-            // efficiency calculations.
-            if (nDepth > 0 || (pcoin->fFromMe && (pcoin->AreDependenciesConfirmed() || pcoin->IsCoinStake())))
+        // The balance here includes recently staked amounts, so it should be equal or very close to the "Total" field
+        // on the GUI overview screen. This is the proper number to use to be able to do the efficiency calculations.
+        m_stake_index.ForEach([&](const StakeCandidate& candidate) {
+            if (!candidate.IsConfirmed())
             {
-                for (unsigned int i = 0; i < pcoin->vout.size(); ++i)
-                {
-                    if (!(pcoin->IsSpent(i))
-                            && (IsMine(pcoin->vout[i]) != ISMINE_NO)
-                            && pcoin->vout[i].nValue > 0)
-                    {
-                        balance_out += pcoin->vout[i].nValue;
-                        possible_vCoins.push_back(std::make_pair(pcoin, i));
-                    }
-                }
+                pending.push_back(candidate);
+                return;
             }
 
-            // If there are no possible (pre-qualified) outputs, continue, so we avoid the expensive GetDepthInMainChain()
-            // call.
-            if (possible_vCoins.empty()) continue;
+            balance_out += candidate.m_value;
 
-            // Filtering by tx timestamp instead of block timestamp may give false positives but never false negatives
-            if (pcoin->nTime + nStakeMinAge > nSpendTime) continue;
+            if (nBestHeight < candidate.m_maturity_height) return;
 
-            // We avoid GetBlocksToMaturity(), because that also calls GetDepthInMainChain(), so the older code,
-            // to get nDepth, still had to call GetDepthInMainChain(), so that meant it was called twice for EVERY
-            // every transaction in the wallet. Wasteful.
-            int blocks_to_maturity = 0;
+            // We need to respect the nMinimumInputValue parameter and include only those outputs that pass.
+            if (candidate.m_value < nMinimumInputValue) return;
 
-            // If coinbase or coinstake, blocks_to_maturity must be 0. (This means a minimum depth of
-            // nCoinbaseMaturity + 10.
-            if (pcoin->IsCoinBase() || pcoin->IsCoinStake())
-            {
-                blocks_to_maturity = std::max(0, (nCoinbaseMaturity + 10) - nDepth);
+            // Filtering by tx timestamp instead of block timestamp may give false positives but never false negatives
+            const int64_t maturity_time = (int64_t) candidate.m_tx_time + nStakeMinAge;
 
-                if (blocks_to_maturity > 0) continue;
-            }
-            // If regular transaction, then must be at depth of 1 or more.
-            else
-            {
-                if (nDepth < 1) continue;
+            if (maturity_time > nSpendTime) {
+                // Report when the output can stake so that the miner does not
+                // sleep past that time without a change to the chain tip:
+                if (next_maturity_time && (*next_maturity_time == 0 || maturity_time < *next_maturity_time)) {
+                    *next_maturity_time = maturity_time;
+                }
+
+                return;
             }
 
-            bool available_output = false;
+            vCoins.push_back(candidate);
+        });
+
+        // Unconfirmed outputs from this wallet count towards the balance once
+        // their inputs confirm. This depends on other transactions, so check it
+        // here for the few outputs that it applies to:
+        for (const auto& candidate : pending)
+        {
+            const auto it = mapWallet.find(candidate.m_txid);
 
-            for (const auto& iter : possible_vCoins)
+            if (it != mapWallet.end() && (it->second.AreDependenciesConfirmed() || it->second.IsCoinStake()))
             {
-                // We need to respect the nMinimumInputValue parameter and include only those outputs that pass.
-                if (iter.first->vout[iter.second].nValue >= nMinimumInputValue)
-                {
-                    vCoins.push_back(COutput(iter.first, iter.second, nDepth));
-                    available_output = true;
-                }
+                balance_out += candidate.m_value;
             }
-
-            // If the transaction has one or more available outputs that have passed the requirements,
-            // increment the counter.
-            if (available_output) ++txns_w_avail_outputs;
         }
 
         g_timer.GetElapsedTime(function
-                               + "transactions = "
-                               + ToString(transactions)
-                               + ", txns_w_avail_outputs = "
-                               + ToString(txns_w_avail_outputs)
+                               + "outputs = "
+                               + ToString(m_stake_index.size())
+                               + ", available = "
+                               + ToString(vCoins.size())
                                + ", balance = "
                                + ToString(balance_out)
                                , "miner");
@@ -1566,30 +1724,12 @@ static void ApproximateBestSubset(vector<pair<int64_t, pair<const CWalletTx*,uns
 // ppcoin: total coins staked (non-spendable until maturity)
 int64_t CWallet::GetStake() const
 {
-    int64_t nTotal = 0;
-    LOCK2(cs_main, cs_wallet);
-    for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
-    {
-        const CWalletTx* pcoin = &it->second;
-        if (pcoin->IsCoinStake() && pcoin->GetBlocksToMaturity() > 0 && pcoin->GetDepthInMainChain() > 0) {
-            nTotal += CWallet::GetCredit(*pcoin);
-        }
-    }
-    return nTotal;
+    return GetBalances().m_stake;
 }
 
 int64_t CWallet::GetNewMint() const
 {
-    int64_t nTotal = 0;
-    LOCK2(cs_main, cs_wallet);
-    for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
-    {
-        const CWalletTx* pcoin = &it->second;
-        if (pcoin->IsCoinStake() && pcoin->GetBlocksToMaturity() > 0 && pcoin->GetDepthInMainChain() > 0) {
-            nTotal += CWallet::GetCredit(*pcoin);
-        }
-    }
-    return nTotal;
+    return GetBalances().m_stake;
 }
 
 // This comparator is needed since std::sort alone cannot sort COutput
@@ -1780,15 +1920,16 @@ bool CWallet::SelectCoins(int64_t nTargetValue, unsigned int nSpendTime, set<pai
 //
 // Formula Stakable = ((SPENDABLE - RESERVED) > UTXO)
 */
-bool CWallet::SelectCoinsForStaking(unsigned int nSpendTime, std::vector<pair<const CWalletTx*,unsigned int> >& vCoinsRet,
+bool CWallet::SelectCoinsForStaking(unsigned int nSpendTime, std::vector<StakeCandidate>& vCoinsRet,
                                     GRC::MinerStatus::ErrorFlags& not_staking_error,
                                     int64_t& balance_out,
-                                    bool fMiner) const EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+                                    bool fMiner,
+                                    int64_t* next_maturity_time) const EXCLUSIVE_LOCKS_REQUIRED(cs_main)
 {
     std::string function = __func__;
     function += ": ";
 
-    vector<COutput> vCoins;
+    vector<StakeCandidate> vCoins;
 
     // The balance is now calculated INSIDE of AvailableCoinsForStaking while iterating through wallet map
     // and reported back out to maintain compatibility with overall MinerStatus fields, which all are retained
@@ -1801,8 +1942,9 @@ bool CWallet::SelectCoinsForStaking(unsigned int nSpendTime, std::vector<pair<co
     // through the map AGAIN. Silly. Just go through the map once, do all of the required work there, and then get
     // the balance_out as a by-product.
     // For that 210000 transaction wallet, all of these changes have reduced the time in the miner loop from >750 msec
-    // down to < 450 msec.
-    AvailableCoinsForStaking(vCoins, nSpendTime, balance_out);
+    // down to < 450 msec. AvailableCoinsForStaking now reads the outputs from the wallet's stake index, which only
+    // revisits the transactions that changed since the last miner cycle.
+    AvailableCoinsForStaking(vCoins, nSpendTime, balance_out, next_maturity_time);
 
     int64_t BalanceToConsider = balance_out;
 
@@ -1839,23 +1981,20 @@ bool CWallet::SelectCoinsForStaking(unsigned int nSpendTime, std::vector<pair<co
     // to get rid of this iteration too, but unfortunately, we need the computed balance for the test.
     vCoinsRet.clear();
 
-    for (const COutput& output : vCoins)
+    for (const StakeCandidate& output : vCoins)
     {
-        const CWalletTx *pcoin = output.tx;
-        int i = output.i;
-
         // If the Spendable balance is more then utxo value it is classified as able to stake
-        if (BalanceToConsider >= pcoin->vout[i].nValue)
+        if (BalanceToConsider >= output.m_value)
         {
             if (LogInstance().WillLogCategory(BCLog::LogFlags::MINER) && fMiner)
             {
                 LogPrintf("SelectCoinsForStaking: UTXO=%s (BalanceToConsider=%.8f >= Value=%.8f)",
-                          pcoin->GetHash().ToString(),
+                          output.m_txid.ToString(),
                           BalanceToConsider / (double) COIN,
-                          pcoin->vout[i].nValue / (double) COIN);
+                          output.m_value / (double) COIN);
             }
 
-            vCoinsRet.push_back(make_pair(pcoin, i));
+            vCoinsRet.push_back(output);
         }
      }
 
@@ -2355,6 +2494,8 @@ DBErrors CWallet::ZapWalletTx(std::vector<CWalletTx>& vWtx)
     if (nZapWalletTxRet != DB_LOAD_OK)
         return nZapWalletTxRet;
 
+    MarkAllTxsDirty();
+
     return DB_LOAD_OK;
 }
 
@@ -3060,9 +3201,9 @@ MinedType GetGeneratedType(const CWallet *wallet, const uint256& tx, unsigned in
         bool fIsCoinStakeMine = (wallet->IsMine(wallettx.vout[1]) != ISMINE_NO) ? true : false;
         bool fIsOutputMine = (wallet->IsMine(wallettx.vout[vout]) != ISMINE_NO) ? true : false;
 
-        // This will be at an index value one unit beyond the end of the vector is m_mrc_researchers.size()
+        // This will be at an index value one unit beyond the end of the vector is MRCResearchers().size()
         // in the claim is zero.
-        unsigned int mrc_index_start = wallettx.vout.size() - blkindex->m_mrc_researchers.size();
+        unsigned int mrc_index_start = wallettx.vout.size() - blkindex->MRCResearchers().size();
 
         // If output 1 is mine and the pubkey (address) for the output is the same as
         // output 1, it is a split stake return from my stake.
@@ -25,6 +25,8 @@
 #include "wallet/walletdb.h"
 #include <wallet/walletutil.h>
 #include "wallet/ismine.h"
+#include "wallet/balancecache.h"
+#include "wallet/stakeindex.h"
 
 extern bool fWalletUnlockStakingOnly;
 extern bool fConfChange;
@@ -90,6 +92,13 @@ private:
     /* the HD chain data model (external chain counters) */
     CHDChain hdChain;
 
+    void UpdateStakeIndex() const EXCLUSIVE_LOCKS_REQUIRED(cs_main, cs_wallet);
+    void AppendStakeCandidates(const CWalletTx& wtx, std::vector<StakeCandidate>& candidates) const
+        EXCLUSIVE_LOCKS_REQUIRED(cs_main, cs_wallet);
+
+    void UpdateBalanceCache() const EXCLUSIVE_LOCKS_REQUIRED(cs_main, cs_wallet);
+    void CacheBalanceEntry(const uint256& hash, const CWalletTx& wtx) const EXCLUSIVE_LOCKS_REQUIRED(cs_main, cs_wallet);
+
 public:
     /// Main wallet lock.
     /// This lock protects all the fields added by CWallet
@@ -171,6 +180,23 @@ public:
     }
 
     std::map<uint256, CWalletTx> mapWallet GUARDED_BY(cs_wallet);
+
+    //! Unspent outputs of mapWallet for the staking balance and kernel search.
+    //! Whatever changes the outputs or spent flags of a wallet transaction
+    //! marks the transaction dirty here.
+    mutable StakeCandidateIndex m_stake_index;
+
+    //! Running totals of the balances of mapWallet. Whatever changes a wallet
+    //! transaction marks it dirty here too. See MarkTxDirty().
+    mutable WalletBalanceCache m_balance_cache;
+
+    //! Mark a wallet transaction for an update of the stake index and balance
+    //! cache, and wake the stake miner to search the changed outputs.
+    void MarkTxDirty(const uint256& hash) const;
+
+    //! Rebuild the stake index and balance cache on their next read, and wake
+    //! the stake miner to search the changed outputs.
+    void MarkAllTxsDirty() const;
     int64_t nOrderPosNext GUARDED_BY(cs_wallet);
     std::map<uint256, int> mapRequestCount GUARDED_BY(cs_wallet);
 
@@ -186,9 +212,11 @@ public:
         return wallet::IsFeatureSupported(nWalletVersion, wf);
     }
 
-    void AvailableCoinsForStaking(std::vector<COutput>& vCoins, unsigned int nSpendTime, int64_t& nBalanceOut) const;
-    bool SelectCoinsForStaking(unsigned int nSpendTime, std::vector<std::pair<const CWalletTx*,unsigned int> >& vCoinsRet,
-                               GRC::MinerStatus::ErrorFlags& not_staking_error, int64_t& balance_out, bool fMiner = false) const;
+    void AvailableCoinsForStaking(std::vector<StakeCandidate>& vCoins, unsigned int nSpendTime, int64_t& nBalanceOut,
+                                  int64_t* next_maturity_time = nullptr) const;
+    bool SelectCoinsForStaking(unsigned int nSpendTime, std::vector<StakeCandidate>& vCoinsRet,
+                               GRC::MinerStatus::ErrorFlags& not_staking_error, int64_t& balance_out, bool fMiner = false,
+                               int64_t* next_maturity_time = nullptr) const;
     void AvailableCoins(std::vector<COutput>& vCoins, bool fOnlyConfirmed = true, const CCoinControl* coinControl = nullptr,
                         bool fIncludeStakingCoins = false) const;
     bool SelectCoinsMinConf(int64_t nTargetValue, unsigned int nSpendTime, int nConfMine, int nConfTheirs, std::vector<COutput> vCoins,
@@ -249,6 +277,7 @@ public:
     int ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate = false);
     void ReacceptWalletTransactions();
     void ResendWalletTransactions(bool fForce = false);
+    WalletBalances GetBalances() const;
     int64_t GetBalance() const;
     int64_t GetUnconfirmedBalance() const;
     int64_t GetImmatureBalance() const;
@@ -653,6 +682,8 @@ public:
                 fAvailableCreditCached = false;
             }
         }
+        if (fReturn)
+            MarkWalletCachesDirty();
         return fReturn;
     }
 
@@ -665,6 +696,7 @@ public:
 		fWatchCreditCached = false;
         fDebitCached = false;
         fChangeCached = false;
+        MarkWalletCachesDirty();
     }
 
     void BindWallet(CWallet *pwalletIn)
@@ -673,6 +705,13 @@ public:
         MarkDirty();
     }
 
+    // make sure the wallet's staking index and balance totals pick up changed spent flags
+    void MarkWalletCachesDirty()
+    {
+        if (pwallet)
+            pwallet->MarkTxDirty(GetHash());
+    }
+
     void MarkSpent(unsigned int nOut)
     {
         if (nOut >= vout.size())
@@ -682,6 +721,7 @@ public:
         {
             vfSpent[nOut] = true;
             fAvailableCreditCached = false;
+            MarkWalletCachesDirty();
         }
     }
 
@@ -694,6 +734,7 @@ public:
         {
             vfSpent[nOut] = false;
             fAvailableCreditCached = false;
+            MarkWalletCachesDirty();
         }
     }
 